@@ -4,6 +4,7 @@
 // State
 let lapNo = -1;
 let lapTimes = [];
+let deviceStats = null;
 let maxLaps = 0;
 let raceStartTime = 0;
 let raceRunning = false;
@@ -152,6 +153,12 @@ function connectToEvents() {
     addLap(parseFloat(lapTimeSec));
   });
 
+  // Live stats computed by the timer (Gate 1 excluded, same as the main UI)
+  source.addEventListener('lapStats', (e) => {
+    deviceStats = JSON.parse(e.data);
+    updateStats();
+  });
+
   // Listen for race state events
   source.addEventListener('raceState', (e) => {
     console.log('Race state changed:', e.data);
@@ -223,6 +230,7 @@ function handleRaceStart() {
   // Reset everything
   lapNo = -1;
   lapTimes = [];
+  deviceStats = null;
   startTimer();
   updateLapCounter();
   clearStats();
@@ -296,6 +304,16 @@ function updateStats() {
     return;
   }
   
+  // Use the timer's stats once they cover every lap we have
+  if (deviceStats && deviceStats.lapCount === lapTimes.length - 1 && deviceStats.lapCount > 0) {
+    fastestLap.textContent = `${(deviceStats.fastestLap / 1000).toFixed(2)}s`;
+    fastest3Consec.textContent = deviceStats.lapCount >= 3
+      ? `${(deviceStats.best3Consecutive / 1000).toFixed(2)}s`
+      : '--';
+    medianLap.textContent = `${(deviceStats.medianLap / 1000).toFixed(2)}s`;
+    return;
+  }
+  
   // Fastest Lap
   const fastest = Math.min(...lapTimes);
   fastestLap.textContent = `${fastest.toFixed(2)}s`;
@@ -67,6 +67,7 @@ var announcerRate = 1.0;
 
 var lapNo = -1;
 var lapTimes = [];
+var deviceLapStats = null;  // Live stats streamed by the timer after each lap
 var maxLaps = 0;
 
 // Track data for current race
@@ -268,6 +269,14 @@ function setupWiFiEvents() {
       addLap(lap);
       console.log("lap raw:", e.data, " formatted:", lap);
     }, false);
+
+    eventSource.addEventListener("lapStats", function (e) {
+      handleLapStats(JSON.parse(e.data));
+    }, false);
+
+    eventSource.addEventListener("selftest", function (e) {
+      handleSelfTestEvent(JSON.parse(e.data));
+    }, false);
   }
 }
 
@@ -287,6 +296,14 @@ function setupUSBEvents() {
     addLap(lap);
     console.log("USB lap raw:", data, " formatted:", lap);
   });
+
+  transportManager.on('lapStats', (data) => {
+    handleLapStats(data);
+  });
+
+  transportManager.on('selftest', (data) => {
+    handleSelfTestEvent(data);
+  });
   
   transportManager.on('disconnect', () => {
     console.log('USB disconnected');
@@ -639,6 +656,23 @@ onload = async function (e) {
       webhookLapToggle.checked = configData.webhookLap === 1;
     }
 
+    const gateUdpEnabledToggle = document.getElementById('gateUdpEnabled');
+    if (gateUdpEnabledToggle && configData.gateUdpEnabled !== undefined) {
+      gateUdpEnabledToggle.checked = configData.gateUdpEnabled === 1;
+    }
+    const gateUdpAddrInput = document.getElementById('gateUdpAddr');
+    if (gateUdpAddrInput && configData.gateUdpAddr !== undefined) {
+      gateUdpAddrInput.value = configData.gateUdpAddr;
+    }
+    const gateUdpPortInput = document.getElementById('gateUdpPort');
+    if (gateUdpPortInput && configData.gateUdpPort !== undefined) {
+      gateUdpPortInput.value = configData.gateUdpPort;
+    }
+    const gateUdpRepeatsInput = document.getElementById('gateUdpRepeats');
+    if (gateUdpRepeatsInput && configData.gateUdpRepeats !== undefined) {
+      gateUdpRepeatsInput.value = configData.gateUdpRepeats;
+    }
+
     // Battery monitoring capability (hardware dependent)
     const batterySection = document.getElementById('batteryMonitoringSection');
     const batteryToggle = document.getElementById('batteryMonitorToggle');
@@ -1038,6 +1072,10 @@ function buildConfigSnapshotFromUI() {
   const webhookRaceStartToggle = document.getElementById('webhookRaceStart');
   const webhookRaceStopToggle = document.getElementById('webhookRaceStop');
   const webhookLapToggle = document.getElementById('webhookLap');
+  const gateUdpEnabledToggle = document.getElementById('gateUdpEnabled');
+  const gateUdpAddrInput = document.getElementById('gateUdpAddr');
+  const gateUdpPortInput = document.getElementById('gateUdpPort');
+  const gateUdpRepeatsInput = document.getElementById('gateUdpRepeats');
 
   // Battery / antenna (only if present)
   const batteryToggle = document.getElementById('batteryMonitorToggle');
@@ -1096,6 +1134,10 @@ function buildConfigSnapshotFromUI() {
     webhookRaceStart: (webhookRaceStartToggle && webhookRaceStartToggle.checked) ? 1 : 0,
     webhookRaceStop: (webhookRaceStopToggle && webhookRaceStopToggle.checked) ? 1 : 0,
     webhookLap: (webhookLapToggle && webhookLapToggle.checked) ? 1 : 0,
+    gateUdpEnabled: (gateUdpEnabledToggle && gateUdpEnabledToggle.checked) ? 1 : 0,
+    gateUdpAddr: gateUdpAddrInput ? gateUdpAddrInput.value.trim() : '',
+    gateUdpPort: parseInt(gateUdpPortInput?.value || 5760, 10),
+    gateUdpRepeats: parseInt(gateUdpRepeatsInput?.value || 0, 10),
 
     // Pilot
     name: (document.getElementById('pname')?.value || ''),
@@ -1199,6 +1241,10 @@ function attachConfigStagingListeners() {
   wire('webhookRaceStart', 'change');
   wire('webhookRaceStop', 'change');
   wire('webhookLap', 'change');
+  wire('gateUdpEnabled', 'change');
+  wire('gateUdpAddr', 'input');
+  wire('gateUdpPort', 'input');
+  wire('gateUdpRepeats', 'input');
 
   // Battery + External antenna (if present in this build)
   wire('batteryMonitorToggle', 'change');
@@ -1488,6 +1534,13 @@ function playBeepTone(duration, frequency, type) {
   }, duration);
 }
 
+function handleLapStats(stats) {
+  deviceLapStats = stats;
+  if (lapTimes.length > 0) {
+    updateStatsBoxes();
+  }
+}
+
 function addLap(lapStr) {
   // Use phonetic name for TTS if available, otherwise use regular pilot name
   const phoneticInput = document.getElementById('pphonetic');
@@ -1625,23 +1678,47 @@ function startTimer() {
     timer.innerHTML = `${m}:${s}:${ms}s`;
   }, 10);
 
+  // The timer has no clock of its own; an interrupted race is dated from this
+  const epoch = Math.floor(Date.now() / 1000);
   if (usbConnected && transportManager) {
-    transportManager.sendCommand('timer/start', 'POST')
+    transportManager.sendCommand('timer/start', 'POST', { epoch: epoch })
       .then((response) => console.log("/timer/start:", response))
       .catch(err => console.error('Failed to start timer:', err));
   } else {
+    const formData = new URLSearchParams();
+    formData.append('epoch', epoch);
     fetch("/timer/start", {
       method: "POST",
       headers: {
         Accept: "application/json",
-        "Content-Type": "application/json",
+        "Content-Type": "application/x-www-form-urlencoded",
       },
+      body: formData,
     })
       .then((response) => response.json())
       .then((response) => console.log("/timer/start:" + JSON.stringify(response)));
   }
 }
 
+// Tell the timer when the start tone will sound, so the LED countdown lands on it
+function announceRaceStart(delayMs) {
+  const ms = Math.round(delayMs);
+  if (usbConnected && transportManager) {
+    transportManager.sendCommand('timer/countdown', 'POST', { ms: ms })
+      .catch(err => console.error('Failed to announce race start:', err));
+  } else {
+    const formData = new URLSearchParams();
+    formData.append('ms', ms);
+    fetch('/timer/countdown', {
+      method: 'POST',
+      headers: {
+        'Content-Type': 'application/x-www-form-urlencoded'
+      },
+      body: formData
+    }).catch(err => console.error('Failed to announce race start:', err));
+  }
+}
+
 function queueSpeak(obj) {
   if (!audioEnabled) {
     return;
@@ -2036,6 +2113,7 @@ async function startRace() {
   
   // Add random delay between 1-5 seconds after announcements complete
   let delayTime = Math.random() * (5000 - 1000) + 1000;
+  announceRaceStart(delayTime);
   await new Promise((r) => setTimeout(r, delayTime));
   
   // Play start beep and begin race
@@ -2101,6 +2179,7 @@ function stopRace() {
 
   lapNo = -1;
   lapTimes = [];
+  deviceLapStats = null;
   currentTotalDistance = 0;
   currentDistanceRemaining = 0;
   currentLapDistance = 0.0;
@@ -2123,6 +2202,7 @@ function clearLaps() {
   }
   lapNo = -1;
   lapTimes = [];
+  deviceLapStats = null;
   updateLapCounter();
   
   // Clear lap analysis
@@ -2306,6 +2386,13 @@ function updateStatsBoxes() {
   
   // Fastest Lap (excluding Gate 1 which is just passing through to start)
   const validLaps = lapTimes.slice(1); // Skip Gate 1
+
+  // Prefer the timer's own stats; only recompute locally for laps it
+  // hasn't seen (manually added laps)
+  if (deviceLapStats && deviceLapStats.lapCount === validLaps.length && validLaps.length > 0) {
+    renderDeviceStatsBoxes(deviceLapStats);
+    return;
+  }
   if (validLaps.length === 0) {
     document.getElementById('statFastest').textContent = '--';
     document.getElementById('statFastestLapNo').textContent = 'Need 1 lap';
@@ -2365,6 +2452,27 @@ function updateStatsBoxes() {
   }
 }
 
+function renderDeviceStatsBoxes(stats) {
+  const secs = (ms) => `${(ms / 1000).toFixed(2)}s`;
+  
+  document.getElementById('statFastest').textContent = secs(stats.fastestLap);
+  document.getElementById('statFastestLapNo').textContent = `Lap ${stats.fastestLapNo}`;
+  document.getElementById('statMedian').textContent = secs(stats.medianLap);
+  
+  if (stats.lapCount >= 3) {
+    const start = stats.best3ConsecutiveStart;
+    document.getElementById('statFastest3Consec').textContent = secs(stats.best3Consecutive);
+    document.getElementById('statFastest3ConsecLaps').textContent = `L${start}-L${start + 1}-L${start + 2}`;
+    document.getElementById('statBest3').textContent = secs(stats.best3LapsTotal);
+    document.getElementById('statBest3Laps').textContent = stats.best3LapNos.map(n => `L${n}`).sort().join(', ');
+  } else {
+    document.getElementById('statFastest3Consec').textContent = '--';
+    document.getElementById('statFastest3ConsecLaps').textContent = 'Need 3 laps';
+    document.getElementById('statBest3').textContent = '--';
+    document.getElementById('statBest3Laps').textContent = 'Need 3 laps';
+  }
+}
+
 function renderLapHistory() {
   // Show last 10 laps (or all if less than 10)
   const recentLaps = lapTimes.slice(-10);
@@ -2444,18 +2552,7 @@ let currentDetailRace = null;
 function saveCurrentRace() {
   if (lapTimes.length === 0) return;
   
-  // Calculate stats (excluding Gate 1)
-  const validLaps = lapTimes.slice(1);
-  const fastest = validLaps.length > 0 ? Math.min(...validLaps) : 0;
-  const sorted = [...validLaps].sort((a, b) => a - b);
-  const mid = Math.floor(sorted.length / 2);
-  const median = sorted.length > 0 ? (sorted.length % 2 === 0 ? (sorted[mid - 1] + sorted[mid]) / 2 : sorted[mid]) : 0;
-  
-  let best3Total = 0;
-  if (validLaps.length >= 3) {
-    const best3 = sorted.slice(0, 3);
-    best3Total = best3.reduce((sum, t) => sum + t, 0);
-  }
+  // fastestLap/medianLap/best3LapsTotal are computed by the timer on save
   
   // Get current pilot and frequency info
   const pilotCallsign = document.getElementById('pcallsign')?.value || '';
@@ -2476,9 +2573,6 @@ function saveCurrentRace() {
   const raceData = {
     timestamp: Math.floor(Date.now() / 1000),
     lapTimes: lapTimes.map(t => Math.round(t * 1000)), // Convert to milliseconds
-    fastestLap: Math.round(fastest * 1000),
-    medianLap: Math.round(median * 1000),
-    best3LapsTotal: Math.round(best3Total * 1000),
     pilotName: pilotNameInput.value || '',
     pilotCallsign: pilotCallsign,
     frequency: frequency,
@@ -2570,15 +2664,25 @@ function applyRaceHistoryModeUI() {
 
 
 
+const RACE_PAGE_SIZE = 25;
+
 async function loadRaceHistory() {
   try {
     // IMPORTANT: use transportFetch so USB mode works too
-    const data = await transportFetch('/races', {
-      method: 'GET',
-      headers: { 'Accept': 'application/json' }
-    });
+    // Summaries come in pages; lap data is fetched per race when opened
+    let races = [];
+    let offset = 0;
+    let data;
+    do {
+      data = await transportFetch(`/races?offset=${offset}&limit=${RACE_PAGE_SIZE}`, {
+        method: 'GET',
+        headers: { 'Accept': 'application/json' }
+      });
+      races = races.concat(data.races || []);
+      offset += RACE_PAGE_SIZE;
+    } while (data.total !== undefined && offset < data.total);
 
-    raceHistoryData = data.races || [];
+    raceHistoryData = races;
     raceHistoryPersistent = (data.persistent !== false);
 
     
@@ -2603,9 +2707,9 @@ function renderRaceHistory() {
     const dateStr = date.toLocaleDateString() + ' ' + date.toLocaleTimeString();
     const fastestLap = (race.fastestLap / 1000).toFixed(2);
     // Lap count should exclude Gate 1 (first entry)
-    const actualLapCount = race.lapTimes.length > 0 ? race.lapTimes.length - 1 : 0;
-    // Calculate total race time (sum of all times)
-    const totalTime = race.lapTimes.reduce((sum, t) => sum + t, 0) / 1000;
+    const actualLapCount = race.lapCount > 0 ? race.lapCount - 1 : 0;
+    // Total race time (sum of all times)
+    const totalTime = race.totalTime / 1000;
     const name = race.name || '';
     const tag = race.tag || '';
     const pilotCallsign = race.pilotCallsign || race.pilotName || '';
@@ -2643,7 +2747,19 @@ function renderRaceHistory() {
   listContainer.innerHTML = html;
 }
 
-function viewRaceDetails(index) {
+// Fetch full lap data for a race summary (cached on the summary once loaded)
+async function ensureRaceLaps(race) {
+  if (race.lapTimes) return race;
+  const data = await transportFetch('/races/downloadOne?timestamp=' + race.timestamp, {
+    method: 'GET',
+    headers: { 'Accept': 'application/json' }
+  });
+  race.lapTimes = (data.races && data.races[0] && data.races[0].lapTimes) || [];
+  return race;
+}
+
+async function viewRaceDetails(index) {
+  await ensureRaceLaps(raceHistoryData[index]);
   currentDetailRace = raceHistoryData[index];
   const race = currentDetailRace;
   const date = new Date(race.timestamp * 1000);
@@ -3040,9 +3156,9 @@ function downloadSingleRace(timestamp) {
 
 let editingRaceIndex = null;
 
-function openEditModal(index) {
+async function openEditModal(index) {
   editingRaceIndex = index;
-  const race = raceHistoryData[index];
+  const race = await ensureRaceLaps(raceHistoryData[index]);
   
   document.getElementById('raceName').value = race.name || '';
   document.getElementById('raceTag').value = race.tag || '';
@@ -3384,9 +3500,14 @@ function importConfig(input) {
           enterRssi: config.enterRssi,
           exitRssi: config.exitRssi,
           maxLaps: config.maxLaps,
-          name: config.name || '',
-          ssid: config.ssid || '',
-          pwd: config.pwd || '',
+          filterQ: config.filterQ,
+          filterR: config.filterR,
+          filterWindow: config.filterWindow,
+          // Keys a partial file (e.g. from tools/lapsim/lapopt) leaves out are
+          // dropped by JSON.stringify, so the timer keeps its current values
+          name: config.name,
+          ssid: config.ssid,
+          pwd: config.pwd,
           // LED settings
           ledMode: config.ledMode,
           ledBrightness: config.ledBrightness,
@@ -3407,6 +3528,10 @@ function importConfig(input) {
           webhookRaceStart: config.webhookRaceStart,
           webhookRaceStop: config.webhookRaceStop,
           webhookLap: config.webhookLap,
+          gateUdpEnabled: config.gateUdpEnabled,
+          gateUdpAddr: config.gateUdpAddr,
+          gateUdpPort: config.gateUdpPort,
+          gateUdpRepeats: config.gateUdpRepeats,
           // Operation mode
           opMode: config.opMode
         })
@@ -3970,87 +4095,261 @@ function switchSettingsSection(sectionName) {
 }
 
 // Self-Test Functions
-function runSelfTest() {
-  const button = document.getElementById('runTestsButton');
+// The device runs the suite as a background job: start it, then follow the
+// "selftest" events for progress and poll the job for results. The
+// benchmark category runs the same way and adds metrics to each result.
+let selfTestJob = 0;
+let selfTestPollTimer = null;
+let selfTestCategory = 'diagnostics';
+let selfTestLastResult = null;
+
+const SELF_TEST_BUTTONS = {
+  diagnostics: { id: 'runTestsButton', idle: 'Run All Tests Again', running: 'Running Tests...' },
+  benchmark: { id: 'runBenchButton', idle: 'Run Benchmarks Again', running: 'Benchmarking...' },
+};
+
+function setSelfTestButtons(running) {
+  Object.keys(SELF_TEST_BUTTONS).forEach(category => {
+    const info = SELF_TEST_BUTTONS[category];
+    const button = document.getElementById(info.id);
+    if (!button) return;
+    button.disabled = running;
+    if (running && category === selfTestCategory) {
+      button.textContent = info.running;
+    } else if (!running && category === selfTestCategory) {
+      button.textContent = info.idle;
+    }
+  });
+}
+
+function runSelfTest(category = 'diagnostics') {
   const loadingDiv = document.getElementById('testLoading');
   const resultsDiv = document.getElementById('testResults');
-  const resultsListDiv = document.getElementById('testResultsList');
+  selfTestCategory = category;
   
   // Show loading, hide results
-  button.disabled = true;
-  button.textContent = 'Running Tests...';
+  setSelfTestButtons(true);
+  document.getElementById('testProgress').textContent = 'Running tests...';
   loadingDiv.style.display = 'block';
   resultsDiv.style.display = 'none';
   
+  const body = new URLSearchParams();
+  body.append('category', category);
+  fetch('/api/selftest', { method: 'POST', body: body })
+    .then(response => response.json())
+    .then(data => {
+      if (!data.job) {
+        throw new Error(data.message || 'Self-test could not start');
+      }
+      selfTestJob = data.job;
+      pollSelfTest();
+    })
+    .catch(showSelfTestError);
+}
+
+function handleSelfTestEvent(ev) {
+  if (!ev || ev.job !== selfTestJob) return;
+  if (ev.event === 'ping') return;  // Latency probes of the event benchmark
+  if (ev.event === 'test' || ev.event === 'progress') {
+    const progress = ev.progress ? ` ${ev.progress}%` : '';
+    document.getElementById('testProgress').textContent =
+      `Running ${ev.name} (${ev.index + 1}/${ev.total})${progress}`;
+  } else {
+    // A result or the end: show it now rather than at the next poll
+    pollSelfTest();
+  }
+}
+
+function pollSelfTest() {
+  clearTimeout(selfTestPollTimer);
   fetch('/api/selftest')
     .then(response => response.json())
     .then(data => {
-      // Hide loading
-      loadingDiv.style.display = 'none';
-      
-      // Build results HTML
-      let html = '';
-      let allPassed = true;
-      
-      data.tests.forEach(test => {
-        if (!test.passed) allPassed = false;
-        
-        const statusIcon = test.passed ? '✓' : '✗';
-        const statusColor = test.passed ? '#4ade80' : '#ff5555';
-        const bgColor = test.passed ? 'rgba(74, 222, 128, 0.1)' : 'rgba(255, 85, 85, 0.1)';
-        
-        html += `
-          <div style="margin-bottom: 12px; padding: 12px; background-color: ${bgColor}; border-left: 4px solid ${statusColor}; border-radius: 4px;">
-            <div style="display: flex; justify-content: space-between; align-items: center; margin-bottom: 6px;">
-              <div style="display: flex; align-items: center; gap: 8px;">
-                <span style="font-size: 20px; color: ${statusColor};">${statusIcon}</span>
-                <span style="font-weight: bold; font-size: 16px;">${test.name}</span>
-              </div>
-              <span style="font-size: 12px; color: var(--secondary-color);">${test.duration}ms</span>
-            </div>
-            <div style="font-size: 14px; color: var(--secondary-color); margin-left: 28px;">
-              ${test.details}
-            </div>
-          </div>
-        `;
-      });
-      
-      // Add summary
-      const passedCount = data.tests.filter(t => t.passed).length;
-      const totalCount = data.tests.length;
-      const summaryColor = allPassed ? '#4ade80' : '#ff9f43';
-      
-      html = `
-        <div style="margin-bottom: 20px; padding: 16px; background-color: var(--bg-secondary); border-radius: 8px; text-align: center;">
-          <div style="font-size: 18px; font-weight: bold; margin-bottom: 8px; color: ${summaryColor};">
-            ${allPassed ? 'All Tests Passed!' : 'Some Tests Failed'}
-          </div>
-          <div style="font-size: 14px; color: var(--secondary-color);">
-            ${passedCount} / ${totalCount} tests passed
+      if (data.job !== selfTestJob) return;
+      renderSelfTestResults(data);
+      if (data.state === 'running') {
+        selfTestPollTimer = setTimeout(pollSelfTest, 1000);
+        return;
+      }
+      document.getElementById('testLoading').style.display = 'none';
+      setSelfTestButtons(false);
+    })
+    .catch(showSelfTestError);
+}
+
+function renderSelfTestResults(data) {
+  const resultsDiv = document.getElementById('testResults');
+  const resultsListDiv = document.getElementById('testResultsList');
+  const running = data.state === 'running';
+  
+  // Build results HTML
+  let html = '';
+  let allPassed = true;
+  
+  data.tests.forEach(test => {
+    if (!test.passed) allPassed = false;
+    
+    const statusIcon = test.passed ? '✓' : '✗';
+    const statusColor = test.passed ? '#4ade80' : '#ff5555';
+    const bgColor = test.passed ? 'rgba(74, 222, 128, 0.1)' : 'rgba(255, 85, 85, 0.1)';
+    
+    html += `
+      <div style="margin-bottom: 12px; padding: 12px; background-color: ${bgColor}; border-left: 4px solid ${statusColor}; border-radius: 4px;">
+        <div style="display: flex; justify-content: space-between; align-items: center; margin-bottom: 6px;">
+          <div style="display: flex; align-items: center; gap: 8px;">
+            <span style="font-size: 20px; color: ${statusColor};">${statusIcon}</span>
+            <span style="font-weight: bold; font-size: 16px;">${test.name}</span>
           </div>
+          <span style="font-size: 12px; color: var(--secondary-color);">${test.duration}ms</span>
         </div>
-      ` + html;
-      
-      resultsListDiv.innerHTML = html;
-      resultsDiv.style.display = 'block';
-      
-      // Re-enable button
-      button.disabled = false;
-      button.textContent = 'Run All Tests Again';
-    })
-    .catch(error => {
-      console.error('Error running self-test:', error);
-      loadingDiv.style.display = 'none';
-      resultsListDiv.innerHTML = `
-        <div style="padding: 16px; background-color: rgba(255, 85, 85, 0.1); border-left: 4px solid #ff5555; border-radius: 4px;">
-          <div style="font-weight: bold; color: #ff5555; margin-bottom: 6px;">Error Running Tests</div>
-          <div style="font-size: 14px; color: var(--secondary-color);">${error.message}</div>
+        <div style="font-size: 14px; color: var(--secondary-color); margin-left: 28px;">
+          ${test.details}
         </div>
-      `;
-      resultsDiv.style.display = 'block';
-      button.disabled = false;
-      button.textContent = 'Run All Tests';
+        ${renderBenchMetrics(test.metrics)}
+      </div>
+    `;
+  });
+  
+  // Add summary
+  const passedCount = data.tests.filter(t => t.passed).length;
+  const totalCount = data.tests.length;
+  const summaryColor = running ? 'var(--primary-color)' : (allPassed ? '#4ade80' : '#ff9f43');
+  const benchmark = data.category === 'benchmark';
+  let summary = allPassed ? 'All Tests Passed!' : 'Some Tests Failed';
+  if (benchmark) {
+    summary = allPassed ? 'Benchmarks Complete' : 'Some Benchmarks Failed';
+  }
+  if (running) {
+    summary = `Testing... ${totalCount} / ${data.total} done`;
+  } else if (data.cancelled) {
+    summary = 'Self-Test Cancelled';
+  }
+  
+  html = `
+    <div style="margin-bottom: 20px; padding: 16px; background-color: var(--bg-secondary); border-radius: 8px; text-align: center;">
+      <div style="font-size: 18px; font-weight: bold; margin-bottom: 8px; color: ${summaryColor};">
+        ${summary}
+      </div>
+      <div style="font-size: 14px; color: var(--secondary-color);">
+        ${passedCount} / ${totalCount} tests passed
+      </div>
+      ${benchmark && data.device ? renderBenchDevice(data.device, running) : ''}
+    </div>
+  ` + html;
+  
+  selfTestLastResult = data;
+  resultsListDiv.innerHTML = html;
+  resultsDiv.style.display = 'block';
+}
+
+function renderBenchMetrics(metrics) {
+  if (!metrics || metrics.length === 0) return '';
+  const cells = metrics.map(m => {
+    const value = Number.isInteger(m.value) ? m.value : m.value.toFixed(2);
+    return `<span style="margin-right: 16px;"><code>${m.name}</code> ${value} ${m.unit}</span>`;
+  }).join('');
+  return `<div style="font-size: 12px; margin: 6px 0 0 28px; display: flex; flex-wrap: wrap; row-gap: 4px;">${cells}</div>`;
+}
+
+function renderBenchDevice(device, running) {
+  const board = device.board ? `${device.board}, ` : '';
+  return `
+    <div style="font-size: 12px; color: var(--secondary-color); margin-top: 8px;">
+      FPVGate ${device.firmware} (${device.build}) on ${board}${device.chip} @ ${device.cpuMhz} MHz, ${device.storage}
+    </div>
+    ${running ? '' : '<button onclick="downloadBenchResults()" style="margin-top: 10px; padding: 6px 12px;">Download Results (JSON)</button>'}
+  `;
+}
+
+// Saved results are what gets compared between firmware versions and boards
+function downloadBenchResults() {
+  if (!selfTestLastResult) return;
+  const device = selfTestLastResult.device || {};
+  const name = `fpvgate-bench-${device.firmware || 'unknown'}-${(device.chip || 'esp32').toLowerCase()}-${Date.now()}.json`;
+  const blob = new Blob([JSON.stringify(selfTestLastResult, null, 2)], { type: 'application/json' });
+  const link = document.createElement('a');
+  link.href = URL.createObjectURL(blob);
+  link.download = name;
+  link.click();
+  URL.revokeObjectURL(link.href);
+}
+
+function showSelfTestError(error) {
+  console.error('Error running self-test:', error);
+  document.getElementById('testLoading').style.display = 'none';
+  document.getElementById('testResultsList').innerHTML = `
+    <div style="padding: 16px; background-color: rgba(255, 85, 85, 0.1); border-left: 4px solid #ff5555; border-radius: 4px;">
+      <div style="font-weight: bold; color: #ff5555; margin-bottom: 6px;">Error Running Tests</div>
+      <div style="font-size: 14px; color: var(--secondary-color);">${error.message}</div>
+    </div>
+  `;
+  document.getElementById('testResults').style.display = 'block';
+  setSelfTestButtons(false);
+}
+
+// Storage benchmark runs on the device in the background; poll until done
+function runStorageBenchmark() {
+  const button = document.getElementById('storageBenchButton');
+  const resultsDiv = document.getElementById('storageBenchResults');
+
+  button.disabled = true;
+  button.textContent = 'Running Benchmark...';
+  resultsDiv.style.display = 'none';
+
+  const finish = (html) => {
+    resultsDiv.innerHTML = html;
+    resultsDiv.style.display = 'block';
+    button.disabled = false;
+    button.textContent = 'Run Storage Benchmark';
+  };
+
+  const poll = () => {
+    fetch('/api/storagebench')
+      .then(response => response.json())
+      .then(data => {
+        if (data.state === 'running') {
+          setTimeout(poll, 1000);
+          return;
+        }
+        finish(renderStorageBenchmark(data));
+      })
+      .catch(error => finish(`<div style="color: #ff5555;">Benchmark failed: ${error.message}</div>`));
+  };
+
+  fetch('/api/storagebench', { method: 'POST' })
+    .then(response => {
+      if (!response.ok && response.status !== 409) throw new Error(`HTTP ${response.status}`);
+      setTimeout(poll, 1000);
+    })
+    .catch(error => finish(`<div style="color: #ff5555;">Benchmark failed: ${error.message}</div>`));
+}
+
+function renderStorageBenchmark(data) {
+  const r = data.result || {};
+  const ok = data.state === 'done' && r.ok;
+  const color = ok ? '#4ade80' : '#ff5555';
+  const clock = data.sdClockHz ? ` @ ${(data.sdClockHz / 1000000).toFixed(1)}MHz SPI` : '';
+  const rows = [
+    ['Sequential write', `${r.seqWriteMBs} MB/s`],
+    ['Sequential read', `${r.seqReadMBs} MB/s`],
+    ['Random write (4KB)', `${r.randWriteMBs} MB/s`],
+    ['Random read (4KB)', `${r.randReadMBs} MB/s`],
+    ['File open', `${r.openLatencyUs} &micro;s`],
+    [`Create ${r.dirFiles} files`, `${r.dirCreateMs} ms`],
+    [`List ${r.dirFiles} files`, `${r.dirListMs} ms`]
+  ];
+
+  let html = `
+    <div style="padding: 12px; background-color: var(--bg-secondary); border-left: 4px solid ${color}; border-radius: 4px;">
+      <div style="font-weight: bold; margin-bottom: 8px; color: ${color};">
+        ${ok ? 'Benchmark complete' : 'Benchmark failed' + (r.error ? ': ' + r.error : '')} (${data.storage}${clock})
+      </div>`;
+  if (ok) {
+    rows.forEach(([label, value]) => {
+      html += `<div style="display: flex; justify-content: space-between; font-size: 14px; padding: 2px 0;"><span>${label}</span><span>${value}</span></div>`;
     });
+  }
+  return html + '</div>';
 }
 
 // ============================================
@@ -4060,8 +4359,8 @@ function runSelfTest() {
 let serialMonitorActive = false;
 let serialMonitorPollInterval = null;
 let serialMonitorBuffer = [];
-let lastSeenTimestampBanner = 0;   // advances always
-let lastSeenTimestampUI = 0;       // advances only when serial monitor is open
+let debugLogCursor = 0;            // Next log sequence to fetch; 0 = the recent backlog
+const DEBUG_LEVEL_COLORS = { error: '#ff5555', warn: '#ffaa00', debug: '#88aaff', verbose: '#888888' };
 const MAX_SERIAL_LINES = 500;
 
 function toggleSerialMonitor() {
@@ -4094,7 +4393,7 @@ function startSerialMonitor() {
   button.textContent = 'Stop Monitor';
   button.style.backgroundColor = '#ff5555';
   serialMonitorActive = true;
-  lastSeenTimestampUI = 0;
+  debugLogCursor = 0;  // Show the recent backlog again
   
   // Clear monitor and show starting message
   monitor.innerHTML = '<div style="color: #4ade80;">[SYSTEM] Serial monitor started</div>';
@@ -4111,26 +4410,23 @@ function handleLogForCalibrationBanner(line) {
   }
 }
 
-function pollDebugLogs() {  
-  fetch('/api/debuglog')
+function pollDebugLogs() {
+  // Cursor protocol: the reply's "next" is where the following poll starts
+  fetch('/debug/log?since=' + debugLogCursor)
     .then(response => response.json())
     .then(data => {
-      if (data.logs && data.logs.length > 0) {
-        // Add new logs that we haven't seen yet
-        data.logs.forEach(log => {
-          // 1) Always process for banner (real-time UX)
-          if (log.timestamp > lastSeenTimestampBanner) {
-            handleLogForCalibrationBanner(log.message);
-            lastSeenTimestampBanner = log.timestamp;
-          }
-
-          // 2) Only advance the UI pointer when the serial monitor is open
-          if (serialMonitorActive && log.timestamp > lastSeenTimestampUI) {
-            appendSerialLine(log.message, '#00ff00', log.timestamp);
-            lastSeenTimestampUI = log.timestamp;
-          }
-        });
+      if (serialMonitorActive && data.dropped > 0) {
+        appendSerialLine('[SYSTEM] ' + data.dropped + ' lines dropped', '#ffaa00');
       }
+      (data.lines || []).forEach(log => {
+        // Always process for banner (real-time UX)
+        handleLogForCalibrationBanner(log.msg);
+        if (serialMonitorActive) {
+          const tagged = log.module === 'core' && log.level === 'info' ? log.msg : log.level.charAt(0).toUpperCase() + ' ' + log.module + ': ' + log.msg;
+          appendSerialLine(tagged, DEBUG_LEVEL_COLORS[log.level] || '#00ff00', log.t);
+        }
+      });
+      debugLogCursor = data.next;
     })
     .catch(error => {
       if (serialMonitorActive) {
@@ -4358,6 +4654,7 @@ function displayTracks() {
     html += `
       <div style="padding: 12px; background-color: var(--bg-secondary); border-radius: 8px; border-left: 4px solid var(--accent-color);">
         <div style="display: flex; justify-content: between; align-items: center; margin-bottom: 8px;">
+          ${track.imagePath ? `<img src="/tracks/image?trackId=${track.trackId}" loading="lazy" alt="" style="width: 64px; height: 64px; object-fit: cover; border-radius: 4px; margin-right: 12px;">` : ''}
           <div style="flex: 1;">
             <div style="font-weight: bold; font-size: 16px; margin-bottom: 4px;">${track.name}</div>
             <div style="font-size: 14px; color: var(--secondary-color);">
@@ -4408,6 +4705,7 @@ function openCreateTrackModal() {
   document.getElementById('trackDistance').value = '';
   document.getElementById('trackTags').value = '';
   document.getElementById('trackNotes').value = '';
+  document.getElementById('trackImage').value = '';
   document.getElementById('saveTrackBtn').textContent = 'Save Track';
   document.getElementById('trackModal').style.display = 'flex';
 }
@@ -4422,6 +4720,7 @@ function editTrack(trackId) {
   document.getElementById('trackDistance').value = track.distance;
   document.getElementById('trackTags').value = track.tags || '';
   document.getElementById('trackNotes').value = track.notes || '';
+  document.getElementById('trackImage').value = '';
   document.getElementById('saveTrackBtn').textContent = 'Update Track';
   document.getElementById('trackModal').style.display = 'flex';
 }
@@ -4467,12 +4766,18 @@ function saveTrack() {
   })
   .then(response => response.json())
   .then(data => {
-    if (data.status === 'OK') {
-      closeTrackModal();
-      loadTracks();
-    } else {
+    if (data.status !== 'OK') {
       alert('Error saving track');
+      return;
     }
+    const imageFile = document.getElementById('trackImage').files[0];
+    const upload = imageFile ? uploadTrackImage(trackData.trackId, imageFile) : Promise.resolve();
+    return upload
+      .catch(error => alert('Track saved, but the image upload failed: ' + error.message))
+      .then(() => {
+        closeTrackModal();
+        loadTracks();
+      });
   })
   .catch(error => {
     console.error('Error saving track:', error);
@@ -4480,6 +4785,41 @@ function saveTrack() {
   });
 }
 
+const TRACK_IMAGE_MAX_BYTES = 500 * 1024;
+const TRACK_IMAGE_MAX_DIM = 1280;
+
+// Re-encode as a JPEG no larger than TRACK_IMAGE_MAX_DIM, so phone photos fit
+// the server's 500KB limit and PNGs are accepted too
+function prepareTrackImage(file) {
+  if (file.type === 'image/jpeg' && file.size <= TRACK_IMAGE_MAX_BYTES) {
+    return Promise.resolve(file);
+  }
+  return createImageBitmap(file).then(bitmap => {
+    const scale = Math.min(1, TRACK_IMAGE_MAX_DIM / Math.max(bitmap.width, bitmap.height));
+    const canvas = document.createElement('canvas');
+    canvas.width = Math.round(bitmap.width * scale);
+    canvas.height = Math.round(bitmap.height * scale);
+    canvas.getContext('2d').drawImage(bitmap, 0, 0, canvas.width, canvas.height);
+    return new Promise(resolve => canvas.toBlob(resolve, 'image/jpeg', 0.85));
+  });
+}
+
+// The body is the raw JPEG; the server streams it to storage as it arrives
+function uploadTrackImage(trackId, file) {
+  return prepareTrackImage(file)
+    .then(blob => fetch('/tracks/image?trackId=' + trackId, {
+      method: 'POST',
+      headers: { 'Content-Type': 'image/jpeg' },
+      body: blob
+    }))
+    .then(response => response.json())
+    .then(data => {
+      if (data.status !== 'OK') {
+        throw new Error(data.message || 'upload rejected');
+      }
+    });
+}
+
 function deleteTrack(trackId) {
   if (!confirm('Are you sure you want to delete this track?')) {
     return;
@@ -35,6 +35,7 @@ class USBTransport {
         this.eventHandlers = {
             rssi: [],
             lap: [],
+            lapStats: [],
             raceState: [],
             disconnect: []
         };
@@ -419,9 +420,11 @@ class TransportManager {
      */
     async startTimer() {
         if (this.mode === 'usb') {
-            await this.usb.sendCommand('timer/start');
+            await this.usb.sendCommand('timer/start', 'POST', { epoch: Math.floor(Date.now() / 1000) });
         } else {
-            await fetch('/timer/start', { method: 'POST' });
+            const formData = new URLSearchParams();
+            formData.append('epoch', Math.floor(Date.now() / 1000));
+            await fetch('/timer/start', { method: 'POST', body: formData });
         }
     }
 
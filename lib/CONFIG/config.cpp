@@ -2,355 +2,637 @@
 
 #include <EEPROM.h>
 #include <LittleFS.h>
+#include <Preferences.h>
+#include <stddef.h>
 
 #include "debug.h"
+#include "gateudpproto.h"
+#include "lapdetector.h"
 #include "storage.h"
 
-#ifdef ESP32S3
-#include <SD.h>
-#endif
-
 #define CONFIG_BACKUP_PATH "/config_backup.bin"
+// EEPROM images and SD backups written before gateUdpEnabled was added end here
+#define CONFIG_BASE_SIZE (offsetof(laptimer_config_t, password) + sizeof(((laptimer_config_t*)nullptr)->password))
+// ...and those written before filterQ was added end here
+#define CONFIG_UDP_SIZE \
+    (offsetof(laptimer_config_t, gateUdpRepeats) + sizeof(((laptimer_config_t*)nullptr)->gateUdpRepeats))
+
+// One schema drives JSON output, JSON input (with validation), NVS group
+// packing and change detection, so a field is declared exactly once.
+enum ConfigFieldType : uint8_t {
+    CONFIG_TYPE_UINT,      // 1, 2 or 4 bytes, clamped to [min, max]
+    CONFIG_TYPE_BOOL,      // Stored as uint8_t 0/1
+    CONFIG_TYPE_STR,       // NUL-terminated char array
+    CONFIG_TYPE_STR_LIST,  // char[max][size / max] with a uint8_t count at countOffset
+};
+
+#define CONFIG_FIELD_SUMMARY 0x01   // Included in the /status summary
+#define CONFIG_FIELD_READONLY 0x02  // Reported, never set from JSON (derived)
+
+struct ConfigFieldDef {
+    const char* key;       // JSON key
+    uint16_t offset;
+    uint16_t size;
+    uint8_t type;
+    uint8_t group;         // ConfigGroup it is persisted with
+    uint8_t flags;
+    uint16_t countOffset;  // STR_LIST only
+    uint32_t min;
+    uint32_t max;          // Capacity for STR_LIST
+    uint32_t below;        // Stored when the input is under min
+};
+
+#define CONFIG_OFFSET(field) offsetof(laptimer_config_t, field)
+#define CONFIG_SIZE(field) sizeof(((laptimer_config_t*)nullptr)->field)
+
+#define CONFIG_UINT(key, field, group, lo, hi, flags) \
+    {key, CONFIG_OFFSET(field), CONFIG_SIZE(field), CONFIG_TYPE_UINT, group, flags, 0, lo, hi, lo}
+#define CONFIG_UINT_OR(key, field, group, lo, hi, below, flags) \
+    {key, CONFIG_OFFSET(field), CONFIG_SIZE(field), CONFIG_TYPE_UINT, group, flags, 0, lo, hi, below}
+#define CONFIG_BOOL(key, field, group, flags) \
+    {key, CONFIG_OFFSET(field), CONFIG_SIZE(field), CONFIG_TYPE_BOOL, group, flags, 0, 0, 1, 0}
+#define CONFIG_STR(key, field, group, flags) \
+    {key, CONFIG_OFFSET(field), CONFIG_SIZE(field), CONFIG_TYPE_STR, group, flags, 0, 0, 0, 0}
+#define CONFIG_STR_LIST(key, field, countField, group, flags)                                      \
+    {key, CONFIG_OFFSET(field), CONFIG_SIZE(field), CONFIG_TYPE_STR_LIST, group, flags,          \
+     CONFIG_OFFSET(countField), 0, sizeof(((laptimer_config_t*)nullptr)->field) /                 \
+                                       sizeof(((laptimer_config_t*)nullptr)->field[0]), 0}
+
+// JSON output follows this order; within a group it is also the NVS blob layout,
+// so new fields go after the group's existing ones (older blobs are a prefix)
+static const ConfigFieldDef CONFIG_SCHEMA[] = {
+    CONFIG_UINT("band", bandIndex, CONFIG_GROUP_RF, 0, 255, CONFIG_FIELD_SUMMARY),
+    CONFIG_UINT("chan", channelIndex, CONFIG_GROUP_RF, 0, 7, CONFIG_FIELD_SUMMARY),
+    CONFIG_UINT("freq", frequency, CONFIG_GROUP_RF, 0, 7000, CONFIG_FIELD_SUMMARY),
+    CONFIG_UINT("minLap", minLap, CONFIG_GROUP_TIMING, 0, 255, CONFIG_FIELD_SUMMARY),  // x10 (0.1s steps)
+    CONFIG_UINT("alarm", alarm, CONFIG_GROUP_TIMING, 0, 255, CONFIG_FIELD_SUMMARY),
+    CONFIG_UINT("anType", announcerType, CONFIG_GROUP_ANNOUNCER, 0, 20, CONFIG_FIELD_SUMMARY),
+    CONFIG_UINT_OR("anRate", announcerRate, CONFIG_GROUP_ANNOUNCER, 1, 20, 10, CONFIG_FIELD_SUMMARY),  // x10, 1.0 if invalid
+    CONFIG_UINT("enterRssi", enterRssi, CONFIG_GROUP_TIMING, 0, 255, CONFIG_FIELD_SUMMARY),
+    CONFIG_UINT("exitRssi", exitRssi, CONFIG_GROUP_TIMING, 0, 255, CONFIG_FIELD_SUMMARY),
+    CONFIG_UINT("rssiSens", rssiSens, CONFIG_GROUP_RF, 0, 1, CONFIG_FIELD_SUMMARY),
+    CONFIG_UINT("maxLaps", maxLaps, CONFIG_GROUP_TIMING, 0, 255, CONFIG_FIELD_SUMMARY),
+    CONFIG_UINT("filterQ", filterQ, CONFIG_GROUP_TIMING, 0, 10000, 0),
+    CONFIG_UINT("filterR", filterR, CONFIG_GROUP_TIMING, 1, 10000, 0),
+    CONFIG_UINT("filterWindow", filterWindow, CONFIG_GROUP_TIMING, 1, LAPDETECT_WINDOW_MAX, 0),
+    CONFIG_UINT("ledMode", ledMode, CONFIG_GROUP_LED, 0, 10, CONFIG_FIELD_SUMMARY),
+    CONFIG_UINT("ledBrightness", ledBrightness, CONFIG_GROUP_LED, 0, 255, CONFIG_FIELD_SUMMARY),
+    CONFIG_UINT("ledColor", ledColor, CONFIG_GROUP_LED, 0, UINT32_MAX, CONFIG_FIELD_SUMMARY),
+    CONFIG_UINT("ledPreset", ledPreset, CONFIG_GROUP_LED, 0, 50, CONFIG_FIELD_SUMMARY),
+    CONFIG_UINT("ledSpeed", ledSpeed, CONFIG_GROUP_LED, 1, 20, CONFIG_FIELD_SUMMARY),
+    CONFIG_UINT("ledFadeColor", ledFadeColor, CONFIG_GROUP_LED, 0, UINT32_MAX, CONFIG_FIELD_SUMMARY),
+    CONFIG_UINT("ledStrobeColor", ledStrobeColor, CONFIG_GROUP_LED, 0, UINT32_MAX, CONFIG_FIELD_SUMMARY),
+    CONFIG_BOOL("ledManualOverride", ledManualOverride, CONFIG_GROUP_LED, CONFIG_FIELD_SUMMARY),
+    CONFIG_UINT("opMode", operationMode, CONFIG_GROUP_SYSTEM, 0, 1, CONFIG_FIELD_SUMMARY),
+    CONFIG_BOOL("tracksEnabled", tracksEnabled, CONFIG_GROUP_SYSTEM, CONFIG_FIELD_SUMMARY),
+    CONFIG_UINT("selectedTrackId", selectedTrackId, CONFIG_GROUP_SYSTEM, 0, UINT32_MAX, CONFIG_FIELD_SUMMARY),
+    CONFIG_BOOL("webhooksEnabled", webhooksEnabled, CONFIG_GROUP_WEBHOOKS, 0),
+    CONFIG_STR_LIST("webhookIPs", webhookIPs, webhookCount, CONFIG_GROUP_WEBHOOKS, 0),
+    CONFIG_UINT("webhookCount", webhookCount, CONFIG_GROUP_WEBHOOKS, 0, 10, CONFIG_FIELD_READONLY),  // Follows webhookIPs
+    CONFIG_BOOL("gateLEDsEnabled", gateLEDsEnabled, CONFIG_GROUP_LED, 0),
+    CONFIG_BOOL("webhookRaceStart", webhookRaceStart, CONFIG_GROUP_WEBHOOKS, 0),
+    CONFIG_BOOL("webhookRaceStop", webhookRaceStop, CONFIG_GROUP_WEBHOOKS, 0),
+    CONFIG_BOOL("webhookLap", webhookLap, CONFIG_GROUP_WEBHOOKS, 0),
+    CONFIG_BOOL("gateUdpEnabled", gateUdpEnabled, CONFIG_GROUP_WEBHOOKS, 0),
+    CONFIG_STR("gateUdpAddr", gateUdpAddress, CONFIG_GROUP_WEBHOOKS, 0),
+    CONFIG_UINT_OR("gateUdpPort", gateUdpPort, CONFIG_GROUP_WEBHOOKS, 1, 65535, GATE_UDP_DEFAULT_PORT, 0),
+    CONFIG_UINT("gateUdpRepeats", gateUdpRepeats, CONFIG_GROUP_WEBHOOKS, 0, 3, 0),
+    CONFIG_STR("name", pilotName, CONFIG_GROUP_PILOT, CONFIG_FIELD_SUMMARY),
+    CONFIG_STR("pilotCallsign", pilotCallsign, CONFIG_GROUP_PILOT, 0),
+    CONFIG_STR("pilotPhonetic", pilotPhonetic, CONFIG_GROUP_PILOT, 0),
+    CONFIG_UINT("pilotColor", pilotColor, CONFIG_GROUP_PILOT, 0, UINT32_MAX, 0),
+    CONFIG_STR("theme", theme, CONFIG_GROUP_SYSTEM, 0),
+    CONFIG_STR("selectedVoice", selectedVoice, CONFIG_GROUP_ANNOUNCER, 0),
+    CONFIG_STR("lapFormat", lapFormat, CONFIG_GROUP_ANNOUNCER, 0),
+    CONFIG_STR("ssid", ssid, CONFIG_GROUP_WIFI, CONFIG_FIELD_SUMMARY),
+    CONFIG_STR("pwd", password, CONFIG_GROUP_WIFI, CONFIG_FIELD_SUMMARY),
+};
+
+#define CONFIG_FIELD_COUNT (sizeof(CONFIG_SCHEMA) / sizeof(CONFIG_SCHEMA[0]))
+static_assert(CONFIG_FIELD_COUNT <= 64, "Config change masks are 64 bits wide");
+
+// NVS key per group, indexed by ConfigGroup
+static const char* const CONFIG_GROUP_KEYS[CONFIG_GROUP_COUNT] = {
+    "rf", "timing", "announcer", "led", "system", "webhooks", "pilot", "wifi"};
+
+static uint32_t readUint(const ConfigFieldDef& def, const laptimer_config_t& conf) {
+    const uint8_t* p = (const uint8_t*)&conf + def.offset;
+    switch (def.size) {
+        case 1: return *p;
+        case 2: return *(const uint16_t*)p;
+        default: return *(const uint32_t*)p;
+    }
+}
+
+static void writeUint(const ConfigFieldDef& def, laptimer_config_t& conf, uint32_t value) {
+    uint8_t* p = (uint8_t*)&conf + def.offset;
+    switch (def.size) {
+        case 1: *p = (uint8_t)value; break;
+        case 2: *(uint16_t*)p = (uint16_t)value; break;
+        default: *(uint32_t*)p = value; break;
+    }
+}
+
+static bool fieldBytesEqual(const ConfigFieldDef& def, const laptimer_config_t& a, const laptimer_config_t& b) {
+    return memcmp((const uint8_t*)&a + def.offset, (const uint8_t*)&b + def.offset, def.size) == 0;
+}
+
+// Packs a group's fields back to back; returns the blob size
+static size_t packGroup(uint8_t group, const laptimer_config_t& conf, uint8_t* out) {
+    size_t len = 0;
+    for (const ConfigFieldDef& def : CONFIG_SCHEMA) {
+        if (def.group != group) continue;
+        if (out) memcpy(out + len, (const uint8_t*)&conf + def.offset, def.size);
+        len += def.size;
+    }
+    return len;
+}
+
+static void unpackGroup(uint8_t group, const uint8_t* in, laptimer_config_t& conf) {
+    size_t len = 0;
+    for (const ConfigFieldDef& def : CONFIG_SCHEMA) {
+        if (def.group != group) continue;
+        memcpy((uint8_t*)&conf + def.offset, in + len, def.size);
+        len += def.size;
+    }
+}
+
+static size_t groupSize(uint8_t group) {
+    return packGroup(group, laptimer_config_t(), nullptr);
+}
+
+// Writes a JSON string literal, escaping quotes, backslashes and control characters
+static void printJsonString(Print& out, const char* str, size_t maxLen) {
+    out.print('"');
+    size_t len = strnlen(str, maxLen);
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = (uint8_t)str[i];
+        if (c != '"' && c != '\\' && c >= 0x20) continue;
+        out.write((const uint8_t*)str + start, i - start);
+        if (c == '"' || c == '\\') {
+            out.print('\\');
+            out.print((char)c);
+        } else {
+            out.printf("\\u%04x", c);
+        }
+        start = i + 1;
+    }
+    out.write((const uint8_t*)str + start, len - start);
+    out.print('"');
+}
+
+// Print sink over a fixed buffer; output past the end is dropped
+class ConfigBufferPrint : public Print {
+   public:
+    ConfigBufferPrint(char* buf, size_t len) : buf(buf), len(len), pos(0) {
+        if (len) buf[0] = '\0';
+    }
+    size_t write(uint8_t c) override {
+        if (pos + 1 >= len) return 0;
+        buf[pos++] = c;
+        buf[pos] = '\0';
+        return 1;
+    }
+    size_t write(const uint8_t* data, size_t size) override {
+        size_t n = 0;
+        while (n < size && write(data[n])) n++;
+        return n;
+    }
+    size_t length() const { return pos; }
+
+   private:
+    char* buf;
+    size_t len;
+    size_t pos;
+};
 
 void Config::init(void) {
     if (sizeof(laptimer_config_t) > EEPROM_RESERVED_SIZE) {
         DEBUG("Config size too big, adjust reserved EEPROM size\n");
         return;
     }
+    for (uint8_t g = 0; g < CONFIG_GROUP_COUNT; g++) {
+        if (groupSize(g) > CONFIG_GROUP_MAX_BYTES) {
+            DEBUG("Config group %s too big, adjust CONFIG_GROUP_MAX_BYTES\n", CONFIG_GROUP_KEYS[g]);
+            return;
+        }
+    }
 
-    EEPROM.begin(EEPROM_RESERVED_SIZE);  // Size of EEPROM
-    load();                              // Override default settings from EEPROM
+    publishLock = xSemaphoreCreateMutex();
+    EEPROM.begin(EEPROM_RESERVED_SIZE);  // Only read to migrate older firmware's config
+    load();
+    memcpy(&published, &conf, sizeof(conf));
 
     checkTimeMs = millis();
 
-    DEBUG("EEPROM Init Successful\n");
+    DEBUG("Config Init Successful\n");
 }
 
 void Config::load(void) {
     modified = false;
-    EEPROM.get(0, conf);
-
-    uint32_t version = 0xFFFFFFFF;
-    if ((conf.version & CONFIG_MAGIC_MASK) == CONFIG_MAGIC) {
-        version = conf.version & ~CONFIG_MAGIC_MASK;
-    }
+    forcedGroups = 0;
 
-    // If version is not current, try to restore from SD backup
-    if (version != CONFIG_VERSION) {
-        DEBUG("EEPROM config invalid (version=%u, expected=%u)\n", version, CONFIG_VERSION);
+    if (!loadFromNvs() && !loadFromEeprom()) {
         if (loadFromSD()) {
             DEBUG("Successfully restored config from SD card backup\n");
-            modified = true;  // Mark as modified to write back to EEPROM
-            write();  // Write restored config to EEPROM
         } else {
             DEBUG("No SD backup found, using defaults\n");
-            setDefaults();
+            applyDefaults();
         }
+        // Nothing in NVS yet: write every group
+        forcedGroups = CONFIG_ALL_GROUPS;
+        markModified();
+        write();
     }
 
     // Sanity: announcerRate stored as x10 (1–20). If invalid, reset to default (10).
     if (conf.announcerRate < 1 || conf.announcerRate > 20) {
         DEBUG("Invalid announcerRate=%u; resetting to default 10\n", conf.announcerRate);
         conf.announcerRate = 10;
-        modified = true;
+        markModified();
     }
 }
 
-void Config::write(void) {
-    if (!modified) return;
-
-    DEBUG("Writing to EEPROM\n");
-
-    EEPROM.put(0, conf);
-    EEPROM.commit();
+bool Config::loadFromNvs() {
+    Preferences prefs;
+    if (!prefs.begin(CONFIG_NVS_NAMESPACE, true)) {
+        return false;  // Namespace doesn't exist yet
+    }
+    uint32_t version = prefs.getUInt("ver", 0);
+    if (version != (CONFIG_VERSION | CONFIG_MAGIC)) {
+        DEBUG("NVS config missing or old (version=0x%08x)\n", version);
+        prefs.end();
+        return false;
+    }
 
-    DEBUG("Writing to EEPROM done\n");
-    
-    // Also backup to SD card if available
-    if (saveToSD()) {
-        DEBUG("Config backed up to SD card\n");
+    // Groups that are missing or invalid keep their defaults
+    applyDefaults();
+    uint8_t buffer[CONFIG_GROUP_MAX_BYTES];
+    for (uint8_t g = 0; g < CONFIG_GROUP_COUNT; g++) {
+        const char* key = CONFIG_GROUP_KEYS[g];
+        size_t size = groupSize(g);
+        size_t stored = prefs.getBytesLength(key);
+        // A shorter blob predates fields appended to the group: take its
+        // prefix over the defaults and rewrite the group at full size
+        packGroup(g, conf, buffer);
+        if (stored && stored <= size && prefs.getBytes(key, buffer, stored) == stored) {
+            unpackGroup(g, buffer, conf);
+            if (stored < size) {
+                forcedGroups |= 1U << g;
+            }
+        } else {
+            DEBUG("NVS config group %s invalid, using defaults\n", key);
+            forcedGroups |= 1U << g;
+        }
     }
+    persistStats.lifetimeWrites = prefs.getUInt("writes", 0);
+    prefs.end();
 
-    modified = false;
+    memcpy(&persisted, &conf, sizeof(conf));
+    if (forcedGroups) {
+        markModified();
+    }
+    DEBUG("Config loaded from NVS\n");
+    return true;
 }
 
-void Config::toJson(AsyncResponseStream& destination) {
-    // Use https://arduinojson.org/v6/assistant to estimate memory
-    DynamicJsonDocument config(550);
-    config["band"] = conf.bandIndex;
-    config["chan"] = conf.channelIndex;
-    config["freq"] = conf.frequency;
-    config["minLap"] = conf.minLap;
-    config["alarm"] = conf.alarm;
-    config["anType"] = conf.announcerType;
-    config["anRate"] = conf.announcerRate;
-    config["enterRssi"] = conf.enterRssi;
-    config["exitRssi"] = conf.exitRssi;
-    config["rssiSens"] = conf.rssiSens;
-    config["maxLaps"] = conf.maxLaps;
-    config["ledMode"] = conf.ledMode;
-    config["ledBrightness"] = conf.ledBrightness;
-    config["ledColor"] = conf.ledColor;
-    config["ledPreset"] = conf.ledPreset;
-    config["ledSpeed"] = conf.ledSpeed;
-    config["ledFadeColor"] = conf.ledFadeColor;
-    config["ledStrobeColor"] = conf.ledStrobeColor;
-    config["ledManualOverride"] = conf.ledManualOverride;
-    config["opMode"] = conf.operationMode;
-    config["tracksEnabled"] = conf.tracksEnabled;
-    config["selectedTrackId"] = conf.selectedTrackId;
-    config["webhooksEnabled"] = conf.webhooksEnabled;
-    config["webhookCount"] = conf.webhookCount;
-    JsonArray webhooks = config.createNestedArray("webhookIPs");
-    for (uint8_t i = 0; i < conf.webhookCount; i++) {
-        webhooks.add(conf.webhookIPs[i]);
-    }
-    config["gateLEDsEnabled"] = conf.gateLEDsEnabled;
-    config["webhookRaceStart"] = conf.webhookRaceStart;
-    config["webhookRaceStop"] = conf.webhookRaceStop;
-    config["webhookLap"] = conf.webhookLap;
-    config["name"] = conf.pilotName;
-    config["pilotCallsign"] = conf.pilotCallsign;
-    config["pilotPhonetic"] = conf.pilotPhonetic;
-    config["pilotColor"] = conf.pilotColor;
-    config["theme"] = conf.theme;
-    config["selectedVoice"] = conf.selectedVoice;
-    config["lapFormat"] = conf.lapFormat;
-    config["ssid"] = conf.ssid;
-    config["pwd"] = conf.password;
-    
-    #ifdef PIN_VBAT
-        config["hasVbat"] = true;
-    #else
-        config["hasVbat"] = false;
-    #endif
+// Config written by firmware that stored the whole struct in EEPROM
+bool Config::loadFromEeprom() {
+    applyDefaults();
+    EEPROM.readBytes(0, &conf, CONFIG_BASE_SIZE);
+    uint32_t version = 0xFFFFFFFF;
+    if ((conf.version & CONFIG_MAGIC_MASK) == CONFIG_MAGIC) {
+        version = conf.version & ~CONFIG_MAGIC_MASK;
+    }
+    if (version != CONFIG_VERSION) {
+        DEBUG("EEPROM config invalid (version=%u, expected=%u)\n", version, CONFIG_VERSION);
+        return false;
+    }
 
-    #ifdef PIN_LED
-        config["hasLed"] = true;
-    #else
-        config["hasLed"] = false;
-    #endif
+    DEBUG("Migrating config from EEPROM to NVS\n");
+    forcedGroups = CONFIG_ALL_GROUPS;
+    markModified();
+    write();
+    return true;
+}
 
-    serializeJson(config, destination);
-}
-
-void Config::toJsonString(char* buf) {
-    DynamicJsonDocument config(512);
-    config["band"] = conf.bandIndex;
-    config["chan"] = conf.channelIndex;
-    config["freq"] = conf.frequency;
-    config["minLap"] = conf.minLap;
-    config["alarm"] = conf.alarm;
-    config["anType"] = conf.announcerType;
-    config["anRate"] = conf.announcerRate;
-    config["enterRssi"] = conf.enterRssi;
-    config["exitRssi"] = conf.exitRssi;
-    config["rssiSens"] = conf.rssiSens;
-    config["maxLaps"] = conf.maxLaps;
-    config["ledMode"] = conf.ledMode;
-    config["ledBrightness"] = conf.ledBrightness;
-    config["ledColor"] = conf.ledColor;
-    config["ledPreset"] = conf.ledPreset;
-    config["ledSpeed"] = conf.ledSpeed;
-    config["ledFadeColor"] = conf.ledFadeColor;
-    config["ledStrobeColor"] = conf.ledStrobeColor;
-    config["ledManualOverride"] = conf.ledManualOverride;
-    config["opMode"] = conf.operationMode;
-    config["tracksEnabled"] = conf.tracksEnabled;
-    config["selectedTrackId"] = conf.selectedTrackId;
-    config["name"] = conf.pilotName;
-    config["ssid"] = conf.ssid;
-    config["pwd"] = conf.password;
+void Config::markModified() {
+    uint32_t now = millis();
+    if (!modified) {
+        firstChangeMs = now;
+    }
+    changedMs = now;
+    modified = true;
+    publish();
+}
 
-    #ifdef PIN_VBAT
-        config["hasVbat"] = true;
-    #else
-        config["hasVbat"] = false;
-    #endif
+bool Config::subscribe(ConfigListener* listener, uint8_t groups) {
+    if (listenerCount >= CONFIG_MAX_LISTENERS) {
+        DEBUG("Too many config listeners, adjust CONFIG_MAX_LISTENERS\n");
+        return false;
+    }
+    listeners[listenerCount].listener = listener;
+    listeners[listenerCount].groups = groups;
+    listenerCount++;
+    listener->onConfigChanged(*this, groups);
+    return true;
+}
 
-    #ifdef PIN_LED
-        config["hasLed"] = true;
-    #else
-        config["hasLed"] = false;
-    #endif
+void Config::publish() {
+    if (listenerCount == 0) {
+        return;  // Still loading; subscribe() hands out the initial values
+    }
+    if (publishLock) xSemaphoreTake(publishLock, portMAX_DELAY);
+    uint64_t fields = diffFields(published, conf);
+    uint8_t groups = 0;
+    for (uint8_t i = 0; i < CONFIG_FIELD_COUNT; i++) {
+        if (fields & (1ULL << i)) {
+            groups |= 1U << CONFIG_SCHEMA[i].group;
+        }
+    }
+    memcpy(&published, &conf, sizeof(conf));
+    if (publishLock) xSemaphoreGive(publishLock);
 
-    serializeJsonPretty(config, buf, 312);
+    if (!groups) return;
+    for (uint8_t i = 0; i < listenerCount; i++) {
+        if (listeners[i].groups & groups) {
+            listeners[i].listener->onConfigChanged(*this, listeners[i].groups & groups);
+        }
+    }
 }
 
-void Config::fromJson(JsonObject source) {
-    // Helpers to avoid "missing key reads as 0/empty" and to prevent false modified=true.
-    auto setU8 = [&](const char* key, uint8_t& dst, uint8_t minV, uint8_t maxV) {
-        if (!source.containsKey(key)) return;
-        int v = source[key].as<int>();
-        if (v < (int)minV) v = minV;
-        if (v > (int)maxV) v = maxV;
-        uint8_t nv = (uint8_t)v;
-        if (dst != nv) { dst = nv; modified = true; }
-    };
-
-    auto setU16 = [&](const char* key, uint16_t& dst, uint16_t minV, uint16_t maxV) {
-        if (!source.containsKey(key)) return;
-        int v = source[key].as<int>();
-        if (v < (int)minV) v = minV;
-        if (v > (int)maxV) v = maxV;
-        uint16_t nv = (uint16_t)v;
-        if (dst != nv) { dst = nv; modified = true; }
-    };
-
-    auto setU32 = [&](const char* key, uint32_t& dst) {
-        if (!source.containsKey(key)) return;
-        uint32_t nv = source[key].as<uint32_t>();
-        if (dst != nv) { dst = nv; modified = true; }
-    };
-
-    auto setBool01 = [&](const char* key, uint8_t& dst) {
-        if (!source.containsKey(key)) return;
-        int v = source[key].as<int>();
-        uint8_t nv = (v != 0) ? 1 : 0;
-        if (dst != nv) { dst = nv; modified = true; }
-    };
-
-    auto setStr = [&](const char* key, char* dst, size_t dstSize) {
-        if (!source.containsKey(key)) return;
-        const char* v = source[key] | "";
-        if (strcmp(v, dst) != 0) {
-            strlcpy(dst, v, dstSize);
-            modified = true;
+uint8_t Config::dirtyGroups() const {
+    uint8_t dirty = forcedGroups;
+    for (const ConfigFieldDef& def : CONFIG_SCHEMA) {
+        if (!fieldBytesEqual(def, conf, persisted)) {
+            dirty |= 1U << def.group;
         }
-    };
-
-    if (source.containsKey("band")) {
-        int b = source["band"].as<int>();
-        if (b < 0) b = 0;
-        if (b > 255) b = 255;
-        setBandIndex((uint8_t)b);
     }
+    return dirty;
+}
 
-    if (source.containsKey("chan")) {
-        int c = source["chan"].as<int>();
-        if (c < 0) c = 0;
-        if (c > 7) c = 7;
-        setChannelIndex((uint8_t)c);
+void Config::write(void) {
+    if (!modified) return;
+    modified = false;
+
+    uint8_t dirty = dirtyGroups();
+    if (!dirty) {
+        return;  // Changed and changed back
     }
 
-    // ===== Core timing / RF =====
-    // Frequency (MHz). Allow 0 only if you really use it; otherwise clamp to plausible band.
-    if (source.containsKey("freq")) {
-        int f = source["freq"].as<int>();
-        if (f < 0) f = 0;
-        if (f > 7000) f = 7000;
-        uint16_t nf = (uint16_t)f;
-        if (conf.frequency != nf) { conf.frequency = nf; modified = true; }
+    uint32_t start = micros();
+    Preferences prefs;
+    if (!prefs.begin(CONFIG_NVS_NAMESPACE, false)) {
+        DEBUG("Failed to open NVS namespace %s\n", CONFIG_NVS_NAMESPACE);
+        persistStats.failedWrites++;
+        markModified();  // Retry on the next pass
+        return;
     }
 
-    // Units: stored x10 (0.1s steps) per your UI, but kept as uint8
-    setU8("minLap",   conf.minLap,        0, 255);
-    setU8("alarm",    conf.alarm,         0, 255);
+    conf.version = CONFIG_VERSION | CONFIG_MAGIC;
+    if (prefs.getUInt("ver", 0) != conf.version) {
+        prefs.putUInt("ver", conf.version);
+    }
+
+    uint8_t buffer[CONFIG_GROUP_MAX_BYTES];
+    uint8_t written = 0;
+    uint32_t bytes = 0;
+    for (uint8_t g = 0; g < CONFIG_GROUP_COUNT; g++) {
+        if (!(dirty & (1U << g))) continue;
+        const char* key = CONFIG_GROUP_KEYS[g];
+        size_t len = packGroup(g, conf, buffer);
+        if (prefs.putBytes(key, buffer, len) == len) {
+            unpackGroup(g, buffer, persisted);
+            forcedGroups &= ~(1U << g);
+            written |= 1U << g;
+            bytes += len;
+            persistStats.groupWrites++;
+        } else {
+            DEBUG("Failed to write config group %s\n", key);
+            persistStats.failedWrites++;
+        }
+    }
+    if (written) {
+        persistStats.lifetimeWrites += __builtin_popcount(written);
+        prefs.putUInt("writes", persistStats.lifetimeWrites);
+    }
+    prefs.end();
 
-    // Announcer
-    setU8("anType",   conf.announcerType, 0, 20);
+    uint32_t elapsed = micros() - start;
+    persistStats.commits++;
+    persistStats.bytesWritten += bytes;
+    persistStats.lastDirtyMask = written;
+    persistStats.lastWriteUs = elapsed;
+    if (elapsed > persistStats.maxWriteUs) persistStats.maxWriteUs = elapsed;
+    DEBUG("Config groups 0x%02x written to NVS (%u bytes, %uus)\n", written, bytes, elapsed);
 
-    // IMPORTANT: rate is x10 (0.1–2.0 => 1–20); default 10
-    if (source.containsKey("anRate")) {
-        int r = source["anRate"].as<int>();
-        if (r < 1) r = 10;     // fall back to default 1.0 if invalid
-        if (r > 20) r = 20;
-        uint8_t nr = (uint8_t)r;
-        if (conf.announcerRate != nr) { conf.announcerRate = nr; modified = true; }
-    }
-
-    // RSSI + race settings
-    setU8("enterRssi", conf.enterRssi,    0, 255);
-    setU8("exitRssi",  conf.exitRssi,     0, 255);
-    setU8("rssiSens", conf.rssiSens,      0, 1);
-    setU8("maxLaps",   conf.maxLaps,      0, 255);
-
-    // ===== LED settings =====
-    if (source.containsKey("ledMode"))           setU8("ledMode",           conf.ledMode,           0, 10);
-    if (source.containsKey("ledBrightness"))     setU8("ledBrightness",     conf.ledBrightness,     0, 255);
-    if (source.containsKey("ledColor"))          setU32("ledColor",         conf.ledColor);
-    if (source.containsKey("ledPreset"))         setU8("ledPreset",         conf.ledPreset,         0, 50);
-    if (source.containsKey("ledSpeed"))          setU8("ledSpeed",          conf.ledSpeed,          1, 20);
-    if (source.containsKey("ledFadeColor"))      setU32("ledFadeColor",     conf.ledFadeColor);
-    if (source.containsKey("ledStrobeColor"))    setU32("ledStrobeColor",   conf.ledStrobeColor);
-    if (source.containsKey("ledManualOverride")) setBool01("ledManualOverride", conf.ledManualOverride);
-
-    // ===== System =====
-    if (source.containsKey("opMode")) setU8("opMode", conf.operationMode, 0, 1);
-
-    // ===== Tracks =====
-    if (source.containsKey("tracksEnabled")) setBool01("tracksEnabled", conf.tracksEnabled);
-    if (source.containsKey("selectedTrackId")) setU32("selectedTrackId", conf.selectedTrackId);
-
-    // ===== Gate LED options + webhook event toggles =====
-    if (source.containsKey("gateLEDsEnabled"))  setBool01("gateLEDsEnabled", conf.gateLEDsEnabled);
-    if (source.containsKey("webhookRaceStart")) setBool01("webhookRaceStart", conf.webhookRaceStart);
-    if (source.containsKey("webhookRaceStop"))  setBool01("webhookRaceStop", conf.webhookRaceStop);
-    if (source.containsKey("webhookLap"))       setBool01("webhookLap", conf.webhookLap);
-
-    // ===== Webhooks master enable =====
-    if (source.containsKey("webhooksEnabled")) setBool01("webhooksEnabled", conf.webhooksEnabled);
-
-    // ===== Webhook IP list (only mark modified if list actually changed) =====
-    if (source.containsKey("webhookIPs")) {
-        JsonArray arr = source["webhookIPs"].as<JsonArray>();
+    if (written != dirty) {
+        markModified();  // Retry the failed groups
+    }
 
-        // Compare current list vs incoming
-        bool changed = false;
+    // Also backup to SD card if available
+    if (saveToSD()) {
+        DEBUG("Config backed up to SD card\n");
+    }
+}
 
-        uint8_t incomingCount = 0;
-        for (JsonVariant ipV : arr) {
-            if (incomingCount >= 10) break;
-            incomingCount++;
+void Config::printField(Print& out, uint8_t index) const {
+    const ConfigFieldDef& def = CONFIG_SCHEMA[index];
+    const char* base = (const char*)&conf + def.offset;
+    switch (def.type) {
+        case CONFIG_TYPE_UINT:
+            out.print(readUint(def, conf));
+            break;
+        case CONFIG_TYPE_BOOL:
+            out.print(*(const uint8_t*)base);
+            break;
+        case CONFIG_TYPE_STR:
+            printJsonString(out, base, def.size);
+            break;
+        case CONFIG_TYPE_STR_LIST: {
+            size_t element = def.size / def.max;
+            uint8_t count = *((const uint8_t*)&conf + def.countOffset);
+            if (count > def.max) count = def.max;
+            out.print('[');
+            for (uint8_t i = 0; i < count; i++) {
+                if (i) out.print(',');
+                printJsonString(out, base + i * element, element);
+            }
+            out.print(']');
+            break;
         }
+    }
+}
 
-        if (incomingCount != conf.webhookCount) {
-            changed = true;
-        } else {
-            uint8_t i = 0;
-            for (JsonVariant ipV : arr) {
-                if (i >= 10) break;
-                const char* ipStr = ipV.as<const char*>() ? ipV.as<const char*>() : "";
-                if (strcmp(conf.webhookIPs[i], ipStr) != 0) {
-                    changed = true;
-                    break;
+void Config::writeJson(Print& out, uint8_t requiredFlags, bool pretty) const {
+    const char* open = pretty ? "{\n  \"" : "{\"";
+    const char* next = pretty ? ",\n  \"" : ",\"";
+    const char* colon = pretty ? "\": " : "\":";
+
+    for (uint8_t i = 0; i < CONFIG_FIELD_COUNT; i++) {
+        const ConfigFieldDef& def = CONFIG_SCHEMA[i];
+        if ((def.flags & requiredFlags) != requiredFlags) continue;
+        out.print(open);
+        open = next;
+        out.print(def.key);
+        out.print(colon);
+        printField(out, i);
+    }
+
+    // Board capabilities, not stored
+    #ifdef PIN_VBAT
+        bool hasVbat = true;
+    #else
+        bool hasVbat = false;
+    #endif
+    #ifdef PIN_LED
+        bool hasLed = true;
+    #else
+        bool hasLed = false;
+    #endif
+    out.print(open);
+    out.print("hasVbat");
+    out.print(colon);
+    out.print(hasVbat ? "true" : "false");
+    out.print(next);
+    out.print("hasLed");
+    out.print(colon);
+    out.print(hasLed ? "true" : "false");
+    out.print(pretty ? "\n}" : "}");
+}
+
+void Config::toJson(Print& destination) {
+    writeJson(destination, 0, false);
+}
+
+size_t Config::toJsonString(char* buf, size_t len) {
+    ConfigBufferPrint out(buf, len);
+    writeJson(out, CONFIG_FIELD_SUMMARY, true);
+    return out.length();
+}
+
+// Validates one JSON value against its schema entry and stores it in dst.
+// Returns false if the value has the wrong type; out-of-range numbers are clamped.
+static bool parseField(const ConfigFieldDef& def, JsonVariant value, laptimer_config_t& dst) {
+    char* base = (char*)&dst + def.offset;
+    switch (def.type) {
+        case CONFIG_TYPE_UINT: {
+            double v;
+            if (value.is<bool>()) {
+                v = value.as<bool>() ? 1 : 0;
+            } else if (value.is<double>()) {
+                v = value.as<double>();
+            } else if (value.is<const char*>()) {
+                // Numeric strings from older UI builds
+                const char* str = value.as<const char*>();
+                char* end;
+                v = strtod(str, &end);
+                if (end == str || *end != '\0') return false;
+            } else {
+                return false;
+            }
+            uint32_t nv;
+            if (!(v >= def.min)) nv = def.below;  // Also catches NaN
+            else if (v > def.max) nv = def.max;
+            else nv = (uint32_t)v;
+            writeUint(def, dst, nv);
+            return true;
+        }
+        case CONFIG_TYPE_BOOL:
+            if (value.is<bool>()) {
+                *(uint8_t*)base = value.as<bool>() ? 1 : 0;
+            } else if (value.is<double>()) {
+                *(uint8_t*)base = value.as<double>() != 0 ? 1 : 0;
+            } else {
+                return false;
+            }
+            return true;
+        case CONFIG_TYPE_STR:
+            if (!value.is<const char*>()) return false;
+            strlcpy(base, value.as<const char*>(), def.size);
+            return true;
+        case CONFIG_TYPE_STR_LIST: {
+            if (!value.is<JsonArray>()) return false;
+            size_t element = def.size / def.max;
+            uint8_t count = 0;
+            memset(base, 0, def.size);
+            for (JsonVariant item : value.as<JsonArray>()) {
+                if (count >= def.max) break;
+                const char* str = item.as<const char*>();
+                if (str && strlen(str) >= element) {
+                    DEBUG("Config %s: skipping over-long entry %s\n", def.key, str);
+                    continue;  // Truncated it would name another target
                 }
-                i++;
+                strlcpy(base + count * element, str ? str : "", element);
+                count++;
             }
+            *((uint8_t*)&dst + def.countOffset) = count;
+            return true;
         }
+    }
+    return false;
+}
 
-        if (changed) {
-            memset(conf.webhookIPs, 0, sizeof(conf.webhookIPs));
-            conf.webhookCount = 0;
-
-            for (JsonVariant ipV : arr) {
-                if (conf.webhookCount >= 10) break;
-                const char* ipStr = ipV.as<const char*>() ? ipV.as<const char*>() : "";
-                strlcpy(conf.webhookIPs[conf.webhookCount], ipStr, 16);
-                conf.webhookCount++;
+// Compares the stored values (not the raw bytes past a string terminator)
+static bool fieldValueEqual(const ConfigFieldDef& def, const laptimer_config_t& a, const laptimer_config_t& b) {
+    const char* pa = (const char*)&a + def.offset;
+    const char* pb = (const char*)&b + def.offset;
+    switch (def.type) {
+        case CONFIG_TYPE_STR:
+            return strncmp(pa, pb, def.size) == 0;
+        case CONFIG_TYPE_STR_LIST: {
+            uint8_t count = *((const uint8_t*)&a + def.countOffset);
+            if (count != *((const uint8_t*)&b + def.countOffset)) return false;
+            size_t element = def.size / def.max;
+            for (uint8_t i = 0; i < count && i < def.max; i++) {
+                if (strncmp(pa + i * element, pb + i * element, element) != 0) return false;
             }
-
-            modified = true;
+            return true;
         }
+        default:
+            return readUint(def, a) == readUint(def, b);
     }
+}
 
-    // ===== Pilot/UI strings =====
-    setStr("name",          conf.pilotName,     sizeof(conf.pilotName));
-    if (source.containsKey("pilotCallsign")) setStr("pilotCallsign", conf.pilotCallsign, sizeof(conf.pilotCallsign));
-    if (source.containsKey("pilotPhonetic")) setStr("pilotPhonetic", conf.pilotPhonetic, sizeof(conf.pilotPhonetic));
-
-    if (source.containsKey("pilotColor")) {
-        uint32_t c = source["pilotColor"].as<uint32_t>();
-        if (conf.pilotColor != c) { conf.pilotColor = c; modified = true; }
+uint64_t Config::diffFields(const laptimer_config_t& a, const laptimer_config_t& b) {
+    uint64_t changed = 0;
+    for (uint8_t i = 0; i < CONFIG_FIELD_COUNT; i++) {
+        if (!fieldValueEqual(CONFIG_SCHEMA[i], a, b)) {
+            changed |= 1ULL << i;
+        }
     }
+    return changed;
+}
 
-    if (source.containsKey("theme"))        setStr("theme",        conf.theme,        sizeof(conf.theme));
-    if (source.containsKey("selectedVoice"))setStr("selectedVoice",conf.selectedVoice,sizeof(conf.selectedVoice));
-    if (source.containsKey("lapFormat"))    setStr("lapFormat",    conf.lapFormat,    sizeof(conf.lapFormat));
+uint64_t Config::fromJson(JsonObject source) {
+    // Parse into a scratch copy so only fields whose value really changes
+    // are copied over (and mark the config modified)
+    laptimer_config_t incoming = conf;
+    for (const ConfigFieldDef& def : CONFIG_SCHEMA) {
+        if (def.flags & CONFIG_FIELD_READONLY) continue;
+        JsonVariant value = source[def.key];
+        if (value.isNull()) continue;  // Missing keys leave the field alone
+        if (!parseField(def, value, incoming)) {
+            DEBUG("Config: ignoring %s, wrong type\n", def.key);
+        }
+    }
 
-    // ===== WiFi credentials (CRITICAL: must be guarded) =====
-    if (source.containsKey("ssid")) setStr("ssid", conf.ssid, sizeof(conf.ssid));
-    if (source.containsKey("pwd"))  setStr("pwd",  conf.password, sizeof(conf.password));
+    uint64_t changed = diffFields(conf, incoming);
+    if (!changed) {
+        return 0;
+    }
+    for (uint8_t i = 0; i < CONFIG_FIELD_COUNT; i++) {
+        if (changed & (1ULL << i)) {
+            const ConfigFieldDef& def = CONFIG_SCHEMA[i];
+            memcpy((uint8_t*)&conf + def.offset, (const uint8_t*)&incoming + def.offset, def.size);
+            if (def.type == CONFIG_TYPE_STR_LIST) {
+                *((uint8_t*)&conf + def.countOffset) = *((const uint8_t*)&incoming + def.countOffset);
+            }
+        }
+    }
+    markModified();
+    return changed;
 }
 
 
@@ -665,6 +947,34 @@ uint8_t Config::getWebhookLap() {
     return conf.webhookLap;
 }
 
+uint8_t Config::getGateUdpEnabled() {
+    return conf.gateUdpEnabled;
+}
+
+const char* Config::getGateUdpAddress() {
+    return conf.gateUdpAddress;
+}
+
+uint16_t Config::getGateUdpPort() {
+    return conf.gateUdpPort;
+}
+
+uint8_t Config::getGateUdpRepeats() {
+    return conf.gateUdpRepeats;
+}
+
+uint16_t Config::getFilterQ() {
+    return conf.filterQ;
+}
+
+uint16_t Config::getFilterR() {
+    return conf.filterR;
+}
+
+uint8_t Config::getFilterWindow() {
+    return conf.filterWindow;
+}
+
 char* Config::getPilotCallsign() {
     return conf.pilotCallsign;
 }
@@ -692,14 +1002,14 @@ char* Config::getLapFormat() {
 void Config::setBandIndex(uint8_t band) {
   if (conf.bandIndex != band) {
     conf.bandIndex = band;
-    modified = true;
+    markModified();
   }
 }
 
 void Config::setChannelIndex(uint8_t ch) {
   if (conf.channelIndex != ch) {
     conf.channelIndex = ch;
-    modified = true;
+    markModified();
   }
 }
 
@@ -707,98 +1017,98 @@ void Config::setChannelIndex(uint8_t ch) {
 void Config::setFrequency(uint16_t freq) {
     if (conf.frequency != freq) {
         conf.frequency = freq;
-        modified = true;
+        markModified();
     }
 }
 
 void Config::setEnterRssi(uint8_t rssi) {
     if (conf.enterRssi != rssi) {
         conf.enterRssi = rssi;
-        modified = true;
+        markModified();
     }
 }
 
 void Config::setExitRssi(uint8_t rssi) {
     if (conf.exitRssi != rssi) {
         conf.exitRssi = rssi;
-        modified = true;
+        markModified();
     }
 }
 
 void Config::setOperationMode(uint8_t mode) {
     if (conf.operationMode != mode) {
         conf.operationMode = mode;
-        modified = true;
+        markModified();
     }
 }
 
 void Config::setLedPreset(uint8_t preset) {
     if (conf.ledPreset != preset) {
         conf.ledPreset = preset;
-        modified = true;
+        markModified();
     }
 }
 
 void Config::setLedBrightness(uint8_t brightness) {
     if (conf.ledBrightness != brightness) {
         conf.ledBrightness = brightness;
-        modified = true;
+        markModified();
     }
 }
 
 void Config::setLedSpeed(uint8_t speed) {
     if (conf.ledSpeed != speed) {
         conf.ledSpeed = speed;
-        modified = true;
+        markModified();
     }
 }
 
 void Config::setLedColor(uint32_t color) {
     if (conf.ledColor != color) {
         conf.ledColor = color;
-        modified = true;
+        markModified();
     }
 }
 
 void Config::setLedFadeColor(uint32_t color) {
     if (conf.ledFadeColor != color) {
         conf.ledFadeColor = color;
-        modified = true;
+        markModified();
     }
 }
 
 void Config::setLedStrobeColor(uint32_t color) {
     if (conf.ledStrobeColor != color) {
         conf.ledStrobeColor = color;
-        modified = true;
+        markModified();
     }
 }
 
 void Config::setLedManualOverride(uint8_t override) {
     if (conf.ledManualOverride != override) {
         conf.ledManualOverride = override;
-        modified = true;
+        markModified();
     }
 }
 
 void Config::setTracksEnabled(uint8_t enabled) {
     if (conf.tracksEnabled != enabled) {
         conf.tracksEnabled = enabled;
-        modified = true;
+        markModified();
     }
 }
 
 void Config::setSelectedTrackId(uint32_t trackId) {
     if (conf.selectedTrackId != trackId) {
         conf.selectedTrackId = trackId;
-        modified = true;
+        markModified();
     }
 }
 
 void Config::setWebhooksEnabled(uint8_t enabled) {
     if (conf.webhooksEnabled != enabled) {
         conf.webhooksEnabled = enabled;
-        modified = true;
+        markModified();
     }
 }
 
@@ -808,6 +1118,11 @@ bool Config::addWebhookIP(const char* ip) {
         return false;
     }
     
+    if (strlen(ip) >= CONFIG_WEBHOOK_ADDR_LEN) {
+        DEBUG("Webhook address too long: %s\n", ip);
+        return false;
+    }
+
     // Check if IP already exists
     for (uint8_t i = 0; i < conf.webhookCount; i++) {
         if (strcmp(conf.webhookIPs[i], ip) == 0) {
@@ -816,9 +1131,9 @@ bool Config::addWebhookIP(const char* ip) {
         }
     }
     
-    strlcpy(conf.webhookIPs[conf.webhookCount], ip, 16);
+    strlcpy(conf.webhookIPs[conf.webhookCount], ip, CONFIG_WEBHOOK_ADDR_LEN);
     conf.webhookCount++;
-    modified = true;
+    markModified();
     return true;
 }
 
@@ -831,7 +1146,7 @@ bool Config::removeWebhookIP(const char* ip) {
             }
             conf.webhookCount--;
             memset(conf.webhookIPs[conf.webhookCount], 0, 16);  // Clear last entry
-            modified = true;
+            markModified();
             return true;
         }
     }
@@ -841,39 +1156,45 @@ bool Config::removeWebhookIP(const char* ip) {
 void Config::clearWebhookIPs() {
     memset(conf.webhookIPs, 0, sizeof(conf.webhookIPs));
     conf.webhookCount = 0;
-    modified = true;
+    markModified();
 }
 
 void Config::setGateLEDsEnabled(uint8_t enabled) {
     if (conf.gateLEDsEnabled != enabled) {
         conf.gateLEDsEnabled = enabled;
-        modified = true;
+        markModified();
     }
 }
 
 void Config::setWebhookRaceStart(uint8_t enabled) {
     if (conf.webhookRaceStart != enabled) {
         conf.webhookRaceStart = enabled;
-        modified = true;
+        markModified();
     }
 }
 
 void Config::setWebhookRaceStop(uint8_t enabled) {
     if (conf.webhookRaceStop != enabled) {
         conf.webhookRaceStop = enabled;
-        modified = true;
+        markModified();
     }
 }
 
 void Config::setWebhookLap(uint8_t enabled) {
     if (conf.webhookLap != enabled) {
         conf.webhookLap = enabled;
-        modified = true;
+        markModified();
     }
 }
 
 void Config::setDefaults(void) {
-    DEBUG("Setting EEPROM defaults\n");
+    applyDefaults();
+    markModified();
+    write();
+}
+
+void Config::applyDefaults(void) {
+    DEBUG("Setting config defaults\n");
     // Reset everything to 0/false and then just set anything that zero is not appropriate
     memset(&conf, 0, sizeof(conf));
     conf.version = CONFIG_VERSION | CONFIG_MAGIC;
@@ -906,6 +1227,13 @@ void Config::setDefaults(void) {
     conf.webhookRaceStart = 1;  // Race start enabled by default
     conf.webhookRaceStop = 1;  // Race stop enabled by default
     conf.webhookLap = 1;  // Lap enabled by default
+    conf.gateUdpEnabled = 0;  // UDP gate events off by default
+    strlcpy(conf.gateUdpAddress, GATE_UDP_DEFAULT_ADDRESS, sizeof(conf.gateUdpAddress));  // Multicast group
+    conf.gateUdpPort = GATE_UDP_DEFAULT_PORT;
+    conf.gateUdpRepeats = 1;  // One redundant copy
+    conf.filterQ = LAPDETECT_FILTER_Q;
+    conf.filterR = LAPDETECT_FILTER_R;
+    conf.filterWindow = LAPDETECT_FILTER_WINDOW;
     strlcpy(conf.pilotName, "Louis", sizeof(conf.pilotName));  // Default pilot name
     strlcpy(conf.pilotCallsign, "Louis", sizeof(conf.pilotCallsign));  // Default callsign
     strlcpy(conf.pilotPhonetic, "Louie", sizeof(conf.pilotPhonetic));  // Default phonetic
@@ -915,13 +1243,19 @@ void Config::setDefaults(void) {
     strlcpy(conf.lapFormat, "timeonly", sizeof(conf.lapFormat));  // Default lap format
     strlcpy(conf.ssid, "", sizeof(conf.ssid));  // Empty WiFi credentials
     strlcpy(conf.password, "", sizeof(conf.password));  // Empty WiFi credentials
-    modified = true;
-    write();
 }
 
 void Config::handleEeprom(uint32_t currentTimeMs) {
-    if (modified && ((currentTimeMs - checkTimeMs) > EEPROM_CHECK_TIME_MS)) {
-        checkTimeMs = currentTimeMs;
+    if (!modified || (currentTimeMs - checkTimeMs) <= EEPROM_CHECK_TIME_MS) {
+        return;
+    }
+    checkTimeMs = currentTimeMs;
+
+    // Let a value that is still moving (slider drag) settle first, but
+    // don't hold a change back indefinitely
+    bool settled = (currentTimeMs - changedMs) >= CONFIG_SETTLE_MS;
+    bool overdue = (currentTimeMs - firstChangeMs) >= CONFIG_MAX_DEFER_MS;
+    if (settled || overdue) {
         write();
     }
 }
@@ -933,26 +1267,15 @@ bool Config::saveToSD() {
     
     DEBUG("Saving config to SD: %s\n", CONFIG_BACKUP_PATH);
     
-#ifdef ESP32S3
-    File file = SD.open(CONFIG_BACKUP_PATH, FILE_WRITE);
-    if (!file) {
-        DEBUG("Failed to open config backup file for writing\n");
+    // Write-behind; the flush task commits it via temp file + rename, so a
+    // reset mid-save never leaves a truncated backup
+    if (!storage->queueWrite(CONFIG_BACKUP_PATH, (const uint8_t*)&conf, sizeof(laptimer_config_t))) {
+        DEBUG("Failed to queue config backup\n");
         return false;
     }
     
-    size_t written = file.write((uint8_t*)&conf, sizeof(laptimer_config_t));
-    file.close();
-    
-    if (written != sizeof(laptimer_config_t)) {
-        DEBUG("Failed to write complete config (wrote %d of %d bytes)\n", written, sizeof(laptimer_config_t));
-        return false;
-    }
-    
-    DEBUG("Config saved to SD (%d bytes)\n", written);
+    DEBUG("Config queued for SD (%d bytes)\n", sizeof(laptimer_config_t));
     return true;
-#else
-    return false;
-#endif
 }
 
 bool Config::loadFromSD() {
@@ -962,31 +1285,34 @@ bool Config::loadFromSD() {
     
     DEBUG("Attempting to load config from SD: %s\n", CONFIG_BACKUP_PATH);
     
-#ifdef ESP32S3
-    if (!SD.exists(CONFIG_BACKUP_PATH)) {
-        DEBUG("No config backup file found on SD\n");
-        return false;
-    }
-    
-    File file = SD.open(CONFIG_BACKUP_PATH, FILE_READ);
+    File file = storage->openRead(CONFIG_BACKUP_PATH);
     if (!file) {
-        DEBUG("Failed to open config backup file for reading\n");
+        DEBUG("No config backup file found on SD\n");
         return false;
     }
     
+    // Backups from before the appended fields are shorter
     size_t fileSize = file.size();
-    if (fileSize != sizeof(laptimer_config_t)) {
+    if (fileSize < CONFIG_BASE_SIZE || fileSize > sizeof(laptimer_config_t)) {
         DEBUG("Config backup file size mismatch (found %d, expected %d)\n", fileSize, sizeof(laptimer_config_t));
         file.close();
         return false;
     }
     
-    laptimer_config_t temp_conf;
-    size_t bytesRead = file.read((uint8_t*)&temp_conf, sizeof(laptimer_config_t));
+    // Fields an older backup predates keep their current values; its tail
+    // past the last field it had is struct padding, not data
+    laptimer_config_t temp_conf = conf;
+    size_t readSize = CONFIG_BASE_SIZE;
+    if (fileSize == sizeof(laptimer_config_t)) {
+        readSize = fileSize;
+    } else if (fileSize >= CONFIG_UDP_SIZE) {
+        readSize = CONFIG_UDP_SIZE;
+    }
+    size_t bytesRead = file.read((uint8_t*)&temp_conf, readSize);
     file.close();
     
-    if (bytesRead != sizeof(laptimer_config_t)) {
-        DEBUG("Failed to read complete config (read %d of %d bytes)\n", bytesRead, sizeof(laptimer_config_t));
+    if (bytesRead != readSize) {
+        DEBUG("Failed to read complete config (read %d of %d bytes)\n", bytesRead, readSize);
         return false;
     }
     
@@ -1001,11 +1327,9 @@ bool Config::loadFromSD() {
         return false;
     }
     
-    // Config is valid, use it
+    // Config is valid, use it; persisted and published like any other change
     memcpy(&conf, &temp_conf, sizeof(laptimer_config_t));
+    markModified();
     DEBUG("Config loaded from SD successfully\n");
     return true;
-#else
-    return false;
-#endif
 }
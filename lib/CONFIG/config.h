@@ -1,8 +1,11 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <Arduino.h>
 #include <ArduinoJson.h>
 #include <AsyncJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <stdint.h>
 
 /*
@@ -106,6 +109,41 @@
 
 #define EEPROM_CHECK_TIME_MS 1000
 
+// Config is persisted in NVS as one blob per field group; only groups whose
+// bytes changed since the last write are rewritten
+#define CONFIG_NVS_NAMESPACE "config"
+#define CONFIG_SETTLE_MS 1500       // Quiet time after the last change (slider drags) before writing
+#define CONFIG_MAX_DEFER_MS 5000    // ...but never hold a change longer than this
+#define CONFIG_GROUP_MAX_BYTES 192
+// Webhook target incl. NUL: "a.b.c.d" or "a.b.c.d:port" if it fits; part of
+// the NVS webhooks blob, so it can't grow without migrating that group
+#define CONFIG_WEBHOOK_ADDR_LEN 16
+
+enum ConfigGroup {
+    CONFIG_GROUP_RF,          // band, channel, frequency, sensitivity
+    CONFIG_GROUP_TIMING,      // thresholds, min lap, alarm, max laps, RSSI filter
+    CONFIG_GROUP_ANNOUNCER,
+    CONFIG_GROUP_LED,
+    CONFIG_GROUP_SYSTEM,      // op mode, tracks, theme
+    CONFIG_GROUP_WEBHOOKS,
+    CONFIG_GROUP_PILOT,
+    CONFIG_GROUP_WIFI,
+    CONFIG_GROUP_COUNT
+};
+#define CONFIG_GROUP_BIT(group) (1U << (group))
+#define CONFIG_ALL_GROUPS ((1U << CONFIG_GROUP_COUNT) - 1)
+
+struct ConfigPersistStats {
+    uint32_t commits;          // Persist passes that wrote at least one group
+    uint32_t groupWrites;
+    uint32_t bytesWritten;
+    uint32_t lifetimeWrites;   // Group writes since NVS was first used (survives reboots)
+    uint32_t failedWrites;
+    uint32_t lastWriteUs;
+    uint32_t maxWriteUs;
+    uint8_t lastDirtyMask;     // Bit per ConfigGroup written by the last pass
+};
+
 typedef struct {
     uint8_t bandIndex;    
     uint8_t channelIndex; 
@@ -131,7 +169,7 @@ typedef struct {
     uint8_t tracksEnabled;     // Track feature enabled (0=disabled, 1=enabled)
     uint32_t selectedTrackId;  // Currently selected track (0=none)
     uint8_t webhooksEnabled;   // Webhooks enabled (0=disabled, 1=enabled)
-    char webhookIPs[10][16];   // Up to 10 webhook IPs (xxx.xxx.xxx.xxx format)
+    char webhookIPs[10][CONFIG_WEBHOOK_ADDR_LEN];  // Up to 10 webhook IPs (xxx.xxx.xxx.xxx[:port])
     uint8_t webhookCount;      // Number of configured webhooks
     uint8_t gateLEDsEnabled;   // Gate LEDs feature enabled (0=disabled, 1=enabled)
     uint8_t webhookRaceStart;  // Send /RaceStart webhook (0=disabled, 1=enabled)
@@ -146,19 +184,46 @@ typedef struct {
     char lapFormat[11];        // Lap announcement format (full, laptime, timeonly)
     char ssid[33];
     char password[33];
+    // Added after the layout above shipped; older images load these as defaults
+    uint8_t gateUdpEnabled;    // Send gate events as UDP datagrams (0=disabled, 1=enabled)
+    char gateUdpAddress[16];   // Multicast group or broadcast address
+    uint16_t gateUdpPort;
+    uint8_t gateUdpRepeats;    // Redundant copies sent after each event (0-3)
+    uint16_t filterQ;          // RSSI Kalman measurement noise x100 (0 = unfiltered)
+    uint16_t filterR;          // RSSI Kalman process noise x10000
+    uint8_t filterWindow;      // RSSI moving average, samples (1-5)
 } laptimer_config_t;
 
+#define CONFIG_MAX_LISTENERS 8
+
 class Storage;  // Forward declaration
+class Config;
+
+// Implemented by modules that keep a local snapshot of their settings
+// instead of reading Config on every use. Called on the task that made the
+// change, right after it; implementations only copy values and must not
+// block or modify Config.
+class ConfigListener {
+   public:
+    virtual ~ConfigListener() {}
+    // groups: ConfigGroup bits whose values changed (all subscribed bits on subscribe)
+    virtual void onConfigChanged(Config& config, uint8_t groups) = 0;
+};
 
 class Config {
    public:
     void init();
     void load();
     void write();
-    void toJson(AsyncResponseStream& destination);
-    void toJsonString(char* buf);
-    void fromJson(JsonObject source);
+    void toJson(Print& destination);
+    size_t toJsonString(char* buf, size_t len);  // Pretty summary for /status, truncated to len
+    // Returns a bit per schema field whose value changed (0 if none)
+    uint64_t fromJson(JsonObject source);
     void handleEeprom(uint32_t currentTimeMs);
+    const ConfigPersistStats& getPersistStats() const { return persistStats; }
+
+    // Change notifications; the listener is called once right away with the current values
+    bool subscribe(ConfigListener* listener, uint8_t groups);
     
     // SD card backup/restore
     void setStorage(Storage* stor) { storage = stor; }
@@ -191,6 +256,13 @@ class Config {
     uint8_t getWebhookRaceStart();
     uint8_t getWebhookRaceStop();
     uint8_t getWebhookLap();
+    uint8_t getGateUdpEnabled();
+    const char* getGateUdpAddress();
+    uint16_t getGateUdpPort();
+    uint8_t getGateUdpRepeats();
+    uint16_t getFilterQ();
+    uint16_t getFilterR();
+    uint8_t getFilterWindow();
     char* getSsid();
     char* getPassword();
     uint8_t getOperationMode();
@@ -231,10 +303,33 @@ class Config {
 
    private:
     laptimer_config_t conf;
+    laptimer_config_t persisted;    // What NVS holds; diffed per group to find dirty groups
     bool modified;
+    uint8_t forcedGroups = 0;       // Written regardless of the diff (missing/invalid in NVS)
     volatile uint32_t checkTimeMs = 0;
+    volatile uint32_t changedMs = 0;
+    volatile uint32_t firstChangeMs = 0;
+    ConfigPersistStats persistStats = {};
     Storage* storage = nullptr;
     void setDefaults();
+    void applyDefaults();
+    void markModified();
+    bool loadFromNvs();
+    bool loadFromEeprom();
+    uint8_t dirtyGroups() const;
+    void writeJson(Print& out, uint8_t requiredFlags, bool pretty) const;
+    void printField(Print& out, uint8_t index) const;
+    static uint64_t diffFields(const laptimer_config_t& a, const laptimer_config_t& b);
+
+    struct Subscription {
+        ConfigListener* listener;
+        uint8_t groups;
+    };
+    Subscription listeners[CONFIG_MAX_LISTENERS];
+    uint8_t listenerCount = 0;
+    laptimer_config_t published;    // Values listeners were last told about
+    SemaphoreHandle_t publishLock = nullptr;
+    void publish();
 };
 
 #endif // CONFIG_H
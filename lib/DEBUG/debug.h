@@ -4,9 +4,14 @@
 #define DEBUG_OUT Serial
 
 #ifdef DEBUG_OUT
-#define DEBUG_INIT DEBUG_OUT.begin(SERIAL_BAUD);
+#define DEBUG_INIT DEBUG_OUT.begin(SERIAL_BAUD); DebugLogger::getInstance().begin();
 #include "debuglogger.h"
 #else
 #define DEBUG_INIT
 #define DEBUG(...)
+#define LOG_E(module, ...)
+#define LOG_W(module, ...)
+#define LOG_I(module, ...)
+#define LOG_D(module, ...)
+#define LOG_V(module, ...)
 #endif
@@ -0,0 +1,319 @@
+#include "debug.h"
+
+#ifdef DEBUG_OUT
+
+DebugLogger DebugLogger::instance;
+
+uint8_t DebugLogger::levels[LOG_MODULE_COUNT] = {
+    LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL,
+    LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL, LOG_DEFAULT_LEVEL,
+};
+
+// Indexed by log_module_e and by level
+static const char* const MODULE_NAMES[LOG_MODULE_COUNT] = {
+    "core", "timer", "rx", "storage", "race", "config", "web", "webhook", "led",
+};
+static const char* const LEVEL_NAMES[] = {"none", "error", "warn", "info", "debug", "verbose"};
+static const char LEVEL_TAGS[] = "-EWIDV";
+
+void DebugLogger::setLevel(uint8_t module, uint8_t level) {
+    if (level > LOG_LEVEL_VERBOSE) level = LOG_LEVEL_VERBOSE;
+    if (module == LOG_MODULE_COUNT) {
+        memset(levels, level, sizeof(levels));
+    } else if (module < LOG_MODULE_COUNT) {
+        levels[module] = level;
+    }
+}
+
+const char* DebugLogger::moduleName(uint8_t module) {
+    return module < LOG_MODULE_COUNT ? MODULE_NAMES[module] : "?";
+}
+
+const char* DebugLogger::levelName(uint8_t level) {
+    return level <= LOG_LEVEL_VERBOSE ? LEVEL_NAMES[level] : "?";
+}
+
+bool DebugLogger::parseModule(const char* name, int& module) {
+    if (!name) return false;
+    if (strcmp(name, "all") == 0) {
+        module = LOG_MODULE_COUNT;
+        return true;
+    }
+    for (int m = 0; m < LOG_MODULE_COUNT; m++) {
+        if (strcmp(name, MODULE_NAMES[m]) == 0) {
+            module = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DebugLogger::parseLevel(const char* name, uint8_t& level) {
+    if (!name) return false;
+    for (uint8_t l = 0; l <= LOG_LEVEL_VERBOSE; l++) {
+        if (strcmp(name, LEVEL_NAMES[l]) == 0) {
+            level = l;
+            return true;
+        }
+    }
+    return false;
+}
+
+void DebugLogger::begin() {
+    if (task) return;
+    xTaskCreatePinnedToCore(taskMain, "debuglog", DEBUG_LOG_TASK_STACK, this, DEBUG_LOG_TASK_PRIORITY, &task, 0);
+}
+
+void DebugLogger::taskMain(void* arg) {
+    static_cast<DebugLogger*>(arg)->drain();
+}
+
+void DebugLogger::drain() {
+    uint32_t nextSeq = 1;
+    char line[DEBUG_LOG_LINE_SIZE];
+    for (;;) {
+        uint32_t end = getNextSeq();
+        uint32_t oldest = getOldestSeq();
+        if ((int32_t)(oldest - nextSeq) > 0) {
+            DEBUG_OUT.printf("[debuglog] %u lines dropped\n", oldest - nextSeq);
+            nextSeq = oldest;
+        }
+        while (nextSeq != end) {
+            uint32_t timeMs;
+            uint8_t level, module;
+            if (!format(nextSeq, line, sizeof(line), &timeMs, &level, &module)) {
+                if (getOldestSeq() > nextSeq) {
+                    nextSeq++;  // Overwritten while we were behind
+                    continue;
+                }
+                break;  // Still being written; pick it up next pass
+            }
+            if (module == LOG_CORE && level == LOG_LEVEL_INFO) {
+                DEBUG_OUT.printf("[%lu] %s", (unsigned long)timeMs, line);
+            } else {
+                DEBUG_OUT.printf("[%lu] %c %s: %s", (unsigned long)timeMs, LEVEL_TAGS[level <= LOG_LEVEL_VERBOSE ? level : 0],
+                                 moduleName(module), line);
+            }
+            nextSeq++;
+        }
+        vTaskDelay(pdMS_TO_TICKS(DEBUG_LOG_DRAIN_MS));
+    }
+}
+
+uint32_t DebugLogger::getOldestSeq() const {
+    uint32_t next = getNextSeq();
+    uint32_t oldest = next > DEBUG_LOG_RECORDS ? next - DEBUG_LOG_RECORDS : 1;
+    return oldest > clearedSeq ? oldest : clearedSeq + 1;
+}
+
+void DebugLogger::clear() {
+    clearedSeq = getNextSeq() - 1;
+}
+
+bool DebugLogger::format(uint32_t seq, char* out, size_t len, uint32_t* timeMs, uint8_t* level,
+                         uint8_t* module) const {
+    if (seq == 0 || seq <= clearedSeq) return false;
+    const Record& r = records[seq & (DEBUG_LOG_RECORDS - 1)];
+    if (r.seq.load(std::memory_order_acquire) != seq) return false;
+
+    Record copy;
+    copy.ticks = r.ticks;
+    copy.format = r.format;
+    copy.level = r.level;
+    copy.module = r.module;
+    copy.kinds = r.kinds;
+    copy.argCount = r.argCount;
+    copy.payloadLen = r.payloadLen;
+    memcpy(copy.payload, r.payload, sizeof(copy.payload));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (r.seq.load(std::memory_order_relaxed) != seq) return false;  // Overwritten during the copy
+
+    if (timeMs) *timeMs = copy.ticks * portTICK_PERIOD_MS;
+    if (level) *level = copy.level;
+    if (module) *module = copy.module;
+    formatRecord(copy, out, len);
+    return true;
+}
+
+void DebugLogger::printJsonString(Print& out, const char* str) {
+    out.print('"');
+    for (const char* c = str; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            out.print('\\');
+            out.print(*c);
+        } else if ((uint8_t)*c < 0x20) {
+            out.printf("\\u%04x", (uint8_t)*c);
+        } else {
+            out.print(*c);
+        }
+    }
+    out.print('"');
+}
+
+void DebugLogger::toJson(Print& out, uint32_t since, uint16_t maxLines) const {
+    uint32_t end = getNextSeq();
+    uint32_t oldest = getOldestSeq();
+    if (maxLines == 0) maxLines = DEBUG_LOG_JSON_MAX;
+    uint32_t seq;
+    uint32_t dropped = 0;
+    if (since == 0) {
+        seq = end - oldest > maxLines ? end - maxLines : oldest;
+    } else if ((int32_t)(oldest - since) > 0) {
+        dropped = oldest - since;
+        seq = oldest;
+    } else if ((int32_t)(since - end) > 0) {
+        seq = end;  // Cursor from before a reboot; resume from here
+    } else {
+        seq = since;
+    }
+
+    out.print("{\"lines\":[");
+    char line[DEBUG_LOG_LINE_SIZE];
+    bool first = true;
+    uint16_t count = 0;
+    for (; seq != end && count < maxLines; seq++) {
+        uint32_t timeMs;
+        uint8_t level, module;
+        if (!format(seq, line, sizeof(line), &timeMs, &level, &module)) {
+            if ((int32_t)(getOldestSeq() - seq) > 0) {
+                dropped++;  // Overwritten while we were formatting
+                continue;
+            }
+            break;  // Still being written; the next request starts here
+        }
+        out.printf("%s{\"seq\":%u,\"t\":%u,\"level\":\"%s\",\"module\":\"%s\",\"msg\":", first ? "" : ",", seq,
+                   timeMs, levelName(level), moduleName(module));
+        printJsonString(out, line);
+        out.print('}');
+        first = false;
+        count++;
+    }
+    out.printf("],\"next\":%u,\"dropped\":%u}", seq, dropped);
+}
+
+void DebugLogger::levelsToJson(Print& out) {
+    out.printf("{\"compileLevel\":\"%s\",\"modules\":{", levelName(LOG_COMPILE_LEVEL));
+    for (int m = 0; m < LOG_MODULE_COUNT; m++) {
+        out.printf("%s\"%s\":\"%s\"", m ? "," : "", MODULE_NAMES[m], levelName(levels[m]));
+    }
+    out.print("}}");
+}
+
+// printf over the stored arguments: each conversion is handed to snprintf
+// on its own, with the length modifier rewritten to match how the argument
+// was stored (so %lu, %zu and friends work whatever the caller's types were)
+size_t DebugLogger::formatRecord(const Record& r, char* out, size_t len) {
+    if (!len) return 0;
+    size_t pos = 0;
+    uint8_t arg = 0;
+    uint8_t offset = 0;
+    const char* f = r.format;
+
+    auto append = [&](const char* s, size_t n) {
+        while (n-- && pos + 1 < len) out[pos++] = *s++;
+    };
+
+    while (*f && pos + 1 < len) {
+        if (*f != '%') {
+            const char* start = f;
+            while (*f && *f != '%') f++;
+            append(start, f - start);
+            continue;
+        }
+        if (f[1] == '%') {
+            append("%", 1);
+            f += 2;
+            continue;
+        }
+
+        // %[flags][width][.precision][length]conversion
+        char spec[16];
+        size_t specLen = 0;
+        spec[specLen++] = *f++;
+        while (*f && strchr("-+ #0", *f) && specLen < 8) spec[specLen++] = *f++;
+        while (*f && ((*f >= '0' && *f <= '9') || *f == '.') && specLen < 12) spec[specLen++] = *f++;
+        while (*f && strchr("hlLqjzt", *f)) f++;  // Replaced below
+        char conv = *f;
+        if (!conv) break;
+        f++;
+
+        if (arg >= r.argCount) {
+            append("?", 1);
+            continue;
+        }
+        ArgKind kind = (ArgKind)((r.kinds >> (arg * 2)) & 0x3);
+        arg++;
+
+        uint64_t value = 0;
+        const char* str = nullptr;
+        uint8_t strLen = 0;
+        if (kind == ARG_STR) {
+            strLen = r.payload[offset];
+            str = (const char*)r.payload + offset + 1;
+            offset += 1 + strLen;
+        } else if (kind == ARG_32) {
+            uint32_t v;
+            memcpy(&v, r.payload + offset, 4);
+            value = v;
+            offset += 4;
+        } else {
+            memcpy(&value, r.payload + offset, 8);
+            offset += 8;
+        }
+
+        char piece[DEBUG_LOG_LINE_SIZE];
+        int n = 0;
+        if (conv == 's') {
+            if (kind != ARG_STR) {
+                append("?", 1);
+                continue;
+            }
+            spec[specLen++] = '.';
+            spec[specLen++] = '*';
+            spec[specLen++] = 's';
+            spec[specLen] = '\0';
+            // Not NUL-terminated in the record; the precision bounds it
+            n = snprintf(piece, sizeof(piece), spec, (int)strLen, str);
+        } else if (kind == ARG_STR) {
+            append("?", 1);
+            continue;
+        } else if (strchr("fFeEgGaA", conv)) {
+            double d;
+            if (kind == ARG_DOUBLE) {
+                memcpy(&d, &value, 8);
+            } else {
+                d = (double)(int64_t)value;
+            }
+            spec[specLen++] = conv;
+            spec[specLen] = '\0';
+            n = snprintf(piece, sizeof(piece), spec, d);
+        } else if (conv == 'p') {
+            spec[specLen++] = 'p';
+            spec[specLen] = '\0';
+            n = snprintf(piece, sizeof(piece), spec, (void*)(uintptr_t)value);
+        } else if (strchr("diuxXoc", conv)) {
+            bool isSigned = conv == 'd' || conv == 'i';
+            if (kind == ARG_32) {
+                spec[specLen++] = conv;
+                spec[specLen] = '\0';
+                n = isSigned ? snprintf(piece, sizeof(piece), spec, (int)(int32_t)value)
+                             : snprintf(piece, sizeof(piece), spec, (unsigned int)value);
+            } else {
+                spec[specLen++] = 'l';
+                spec[specLen++] = 'l';
+                spec[specLen++] = conv;
+                spec[specLen] = '\0';
+                n = isSigned ? snprintf(piece, sizeof(piece), spec, (long long)value)
+                             : snprintf(piece, sizeof(piece), spec, (unsigned long long)value);
+            }
+        } else {
+            append("?", 1);
+            continue;
+        }
+        if (n > 0) append(piece, (size_t)n < sizeof(piece) ? n : sizeof(piece) - 1);
+    }
+    out[pos] = '\0';
+    return pos;
+}
+
+#endif
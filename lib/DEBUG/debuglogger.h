@@ -1,55 +1,247 @@
 #pragma once
 
 #include <Arduino.h>
-#include <vector>
+#include <atomic>
+#include <type_traits>
 
-#define DEBUG_BUFFER_SIZE 100
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// DEBUG() only stores the format pointer, a tick timestamp and the raw
+// arguments in a fixed-size record; the text is produced later by the
+// drain task (Serial) or by whoever reads the ring (/api/debuglog). A call
+// with integer arguments is a few dozen stores, so it's fine in the timing
+// path. Format strings must be literals: only the pointer is kept.
+#define DEBUG_LOG_RECORDS 256          // Power of two
+#define DEBUG_LOG_PAYLOAD 78           // Argument bytes; 96-byte records on the ESP32
+#define DEBUG_LOG_MAX_ARGS 8
+#define DEBUG_LOG_LINE_SIZE 256        // Longest formatted line
+#define DEBUG_LOG_DRAIN_MS 20
+#define DEBUG_LOG_TASK_STACK 3072
+#define DEBUG_LOG_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#define DEBUG_LOG_JSON_MAX 100         // Default line count for toJson()
+
+// Log levels. Calls above LOG_COMPILE_LEVEL are not compiled at all (their
+// arguments aren't even evaluated); the rest cost one compare against the
+// module's runtime level before anything is stored.
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_VERBOSE 5
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG  // -DLOG_COMPILE_LEVEL=... to change
+#endif
+#ifndef LOG_DEFAULT_LEVEL
+#define LOG_DEFAULT_LEVEL LOG_LEVEL_INFO   // Runtime level every module starts at
+#endif
+
+typedef enum : uint8_t {
+    LOG_CORE,
+    LOG_TIMER,
+    LOG_RX,
+    LOG_STORAGE,
+    LOG_RACE,
+    LOG_CONFIG,
+    LOG_WEB,
+    LOG_WEBHOOK,
+    LOG_LED,
+    LOG_MODULE_COUNT
+} log_module_e;
 
 class DebugLogger {
 public:
-    struct LogEntry {
-        unsigned long timestamp;
-        char message[256];
-    };
-    
     static DebugLogger& getInstance() {
-        static DebugLogger instance;
         return instance;
     }
-    
-    void log(const char* format, ...) {
-        va_list args;
-        va_start(args, format);
-        
-        LogEntry entry;
-        entry.timestamp = millis();
-        vsnprintf(entry.message, sizeof(entry.message), format, args);
-        
-        va_end(args);
-        
-        // Add to ring buffer
-        if (buffer.size() >= DEBUG_BUFFER_SIZE) {
-            buffer.erase(buffer.begin());
+
+    // Starts the task that prints new records to Serial; records made
+    // before this are kept and printed once it runs
+    void begin();
+
+    // Runtime filter, read by the LOG_x macros before calling log()
+    static uint8_t levels[LOG_MODULE_COUNT];
+
+    static void setLevel(uint8_t module, uint8_t level);  // LOG_MODULE_COUNT sets all
+    static const char* moduleName(uint8_t module);
+    static const char* levelName(uint8_t level);
+    // Name lookups for the endpoints; false if unknown ("all" is a module)
+    static bool parseModule(const char* name, int& module);
+    static bool parseLevel(const char* name, uint8_t& level);
+
+    template <typename... Args>
+    void log(uint8_t level, uint8_t module, const char* format, const Args&... args) {
+        uint32_t seq = head.fetch_add(1, std::memory_order_relaxed) + 1;
+        Record& r = records[seq & (DEBUG_LOG_RECORDS - 1)];
+        // Seqlock: readers skip a record whose seq isn't final
+        r.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        r.ticks = xTaskGetTickCount();
+        r.format = format;
+        r.level = level;
+        r.module = module;
+        r.kinds = 0;
+        r.argCount = 0;
+        r.payloadLen = 0;
+        packArgs(r, args...);
+        r.seq.store(seq, std::memory_order_release);
+    }
+
+    // Reader side. Sequence numbers start at 1; records older than
+    // getOldestSeq() have been overwritten.
+    uint32_t getNextSeq() const { return head.load(std::memory_order_acquire) + 1; }
+    uint32_t getOldestSeq() const;
+    // Formats one record; false if it was overwritten or is still being written
+    bool format(uint32_t seq, char* out, size_t len, uint32_t* timeMs,
+                uint8_t* level = nullptr, uint8_t* module = nullptr) const;
+    void clear();  // Hides everything logged so far from readers
+
+    // {"next":N,"dropped":D,"lines":[{"seq","t","level","module","msg"}]} for
+    // up to maxLines records from since on. A client passes "next" back as since
+    // to get only what's new; "dropped" counts records it missed. since = 0
+    // starts from the most recent maxLines records.
+    void toJson(Print& out, uint32_t since, uint16_t maxLines) const;
+    // {"compileLevel":"debug","modules":{"core":"info",...}}
+    static void levelsToJson(Print& out);
+    // JSON string literal with quotes, backslashes and control characters escaped
+    static void printJsonString(Print& out, const char* str);
+
+private:
+    enum ArgKind : uint8_t { ARG_32, ARG_64, ARG_DOUBLE, ARG_STR };
+
+    struct Record {
+        std::atomic<uint32_t> seq;  // 0 while being written
+        uint32_t ticks;
+        const char* format;
+        uint8_t level;
+        uint8_t module;
+        uint16_t kinds;             // 2 bits per argument
+        uint8_t argCount;
+        uint8_t payloadLen;
+        uint8_t payload[DEBUG_LOG_PAYLOAD];
+    };
+
+    static DebugLogger instance;
+
+    Record records[DEBUG_LOG_RECORDS];
+    std::atomic<uint32_t> head;     // Last claimed sequence number
+    uint32_t clearedSeq = 0;
+    TaskHandle_t task = nullptr;
+
+    DebugLogger() : head(0) {}
+
+    static void taskMain(void* arg);
+    void drain();
+    static size_t formatRecord(const Record& r, char* out, size_t len);
+
+    static bool reserve(Record& r, ArgKind kind, uint8_t size) {
+        if (r.argCount >= DEBUG_LOG_MAX_ARGS || r.payloadLen + size > DEBUG_LOG_PAYLOAD) {
+            return false;  // Formatter prints "?" for arguments that didn't fit
+        }
+        r.kinds |= kind << (r.argCount * 2);
+        r.argCount++;
+        return true;
+    }
+    static void put32(Record& r, uint32_t v) {
+        if (!reserve(r, ARG_32, 4)) return;
+        memcpy(r.payload + r.payloadLen, &v, 4);
+        r.payloadLen += 4;
+    }
+    static void put64(Record& r, uint64_t v, ArgKind kind) {
+        if (!reserve(r, kind, 8)) return;
+        memcpy(r.payload + r.payloadLen, &v, 8);
+        r.payloadLen += 8;
+    }
+    // Strings are copied (length byte + text, truncated to what fits)
+    // since the caller's buffer is usually gone by the time it's formatted
+    static void putStr(Record& r, const char* s) {
+        if (!s) s = "(null)";
+        if (!reserve(r, ARG_STR, 1)) return;
+        uint8_t* lenByte = r.payload + r.payloadLen++;
+        uint8_t n = 0;
+        while (s[n] && r.payloadLen < DEBUG_LOG_PAYLOAD) {
+            r.payload[r.payloadLen++] = s[n++];
         }
-        buffer.push_back(entry);
-        
-        // Also print to serial
-        Serial.printf("[%lu] %s", entry.timestamp, entry.message);
+        *lenByte = n;
     }
-    
-    const std::vector<LogEntry>& getBuffer() const {
-        return buffer;
+
+    static void packArg(Record& r, bool v) { put32(r, v); }
+    static void packArg(Record& r, char v) { put32(r, (uint32_t)(int32_t)v); }
+    static void packArg(Record& r, signed char v) { put32(r, (uint32_t)(int32_t)v); }
+    static void packArg(Record& r, unsigned char v) { put32(r, v); }
+    static void packArg(Record& r, short v) { put32(r, (uint32_t)(int32_t)v); }
+    static void packArg(Record& r, unsigned short v) { put32(r, v); }
+    static void packArg(Record& r, int v) { put32(r, (uint32_t)v); }
+    static void packArg(Record& r, unsigned int v) { put32(r, v); }
+    static void packArg(Record& r, long v) {
+        if (sizeof(long) == 8) put64(r, (uint64_t)v, ARG_64); else put32(r, (uint32_t)v);
     }
-    
-    void clear() {
-        buffer.clear();
+    static void packArg(Record& r, unsigned long v) {
+        if (sizeof(long) == 8) put64(r, v, ARG_64); else put32(r, (uint32_t)v);
+    }
+    static void packArg(Record& r, long long v) { put64(r, (uint64_t)v, ARG_64); }
+    static void packArg(Record& r, unsigned long long v) { put64(r, v, ARG_64); }
+    static void packArg(Record& r, double v) {
+        uint64_t bits;
+        memcpy(&bits, &v, 8);
+        put64(r, bits, ARG_DOUBLE);
+    }
+    static void packArg(Record& r, float v) { packArg(r, (double)v); }
+    static void packArg(Record& r, const char* s) { putStr(r, s); }
+    static void packArg(Record& r, char* s) { putStr(r, s); }
+    static void packArg(Record& r, const String& s) { putStr(r, s.c_str()); }
+    template <typename T>
+    static void packArg(Record& r, T* p) {
+        if (sizeof(p) == 8) put64(r, (uint64_t)(uintptr_t)p, ARG_64); else put32(r, (uint32_t)(uintptr_t)p);
+    }
+    template <typename T>
+    static typename std::enable_if<std::is_enum<T>::value>::type packArg(Record& r, T v) {
+        packArg(r, (int)v);
+    }
+
+    static void packArgs(Record&) {}
+    template <typename T, typename... Rest>
+    static void packArgs(Record& r, const T& first, const Rest&... rest) {
+        packArg(r, first);
+        packArgs(r, rest...);
     }
-    
-private:
-    DebugLogger() {}
-    std::vector<LogEntry> buffer;
 };
 
-// Redefine DEBUG macro to use logger
+#define LOG_AT(level, module, ...)                                     \
+    do {                                                               \
+        if ((level) <= DebugLogger::levels[module]) {                  \
+            DebugLogger::getInstance().log(level, module, __VA_ARGS__); \
+        }                                                              \
+    } while (0)
+
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_E(module, ...) LOG_AT(LOG_LEVEL_ERROR, module, __VA_ARGS__)
+#else
+#define LOG_E(module, ...) do {} while (0)
+#endif
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_WARN
+#define LOG_W(module, ...) LOG_AT(LOG_LEVEL_WARN, module, __VA_ARGS__)
+#else
+#define LOG_W(module, ...) do {} while (0)
+#endif
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_INFO
+#define LOG_I(module, ...) LOG_AT(LOG_LEVEL_INFO, module, __VA_ARGS__)
+#else
+#define LOG_I(module, ...) do {} while (0)
+#endif
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_D(module, ...) LOG_AT(LOG_LEVEL_DEBUG, module, __VA_ARGS__)
+#else
+#define LOG_D(module, ...) do {} while (0)
+#endif
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_VERBOSE
+#define LOG_V(module, ...) LOG_AT(LOG_LEVEL_VERBOSE, module, __VA_ARGS__)
+#else
+#define LOG_V(module, ...) do {} while (0)
+#endif
+
+// Untagged calls are core info lines
 #undef DEBUG
-#define DEBUG(...) DebugLogger::getInstance().log(__VA_ARGS__)
+#define DEBUG(...) LOG_I(LOG_CORE, __VA_ARGS__)
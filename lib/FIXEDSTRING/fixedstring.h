@@ -0,0 +1,58 @@
+#ifndef FIXEDSTRING_H
+#define FIXEDSTRING_H
+
+#include <Arduino.h>
+
+/*
+ * Fixed-capacity inline string
+ *
+ * Drop-in for the String members of records that are kept in vectors
+ * (RaceSession, Track): the characters live inside the record, so a record is
+ * one flat block with no per-field heap allocation. N includes the terminator;
+ * longer input is truncated on a UTF-8 character boundary.
+ */
+template <size_t N>
+class FixedString {
+   public:
+    FixedString() { buf[0] = '\0'; }
+    FixedString(const char* s) { assign(s); }
+    FixedString(const String& s) { assign(s.c_str()); }
+
+    FixedString& operator=(const char* s) {
+        assign(s);
+        return *this;
+    }
+    FixedString& operator=(const String& s) {
+        assign(s.c_str());
+        return *this;
+    }
+
+    const char* c_str() const { return buf; }
+    size_t length() const { return strlen(buf); }
+    bool isEmpty() const { return buf[0] == '\0'; }
+    static constexpr size_t capacity() { return N - 1; }
+
+    bool operator==(const char* s) const { return strcmp(buf, s ? s : "") == 0; }
+    bool operator!=(const char* s) const { return !(*this == s); }
+
+   private:
+    char buf[N];
+
+    void assign(const char* s) {
+        if (!s) s = "";
+        size_t len = strlcpy(buf, s, N);
+        if (len >= N) {
+            // Don't leave half of a multi-byte character at the end
+            size_t end = N - 1;
+            if (((uint8_t)s[end] & 0xC0) == 0x80) {
+                while (end > 0 && ((uint8_t)buf[end - 1] & 0xC0) == 0x80) {
+                    end--;
+                }
+                if (end > 0) end--;  // Lead byte of the cut character
+            }
+            buf[end] = '\0';
+        }
+    }
+};
+
+#endif
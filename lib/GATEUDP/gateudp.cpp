@@ -0,0 +1,182 @@
+#include "gateudp.h"
+#include "debug.h"
+#include <lwip/sockets.h>
+#include <unistd.h>
+
+GateUdpSender::GateUdpSender()
+    : enabled(false), color(0), port(GATE_UDP_DEFAULT_PORT), repeats(0), settingsVersion(0),
+      settingsLock(nullptr), queue(nullptr), task(nullptr), fd(-1), destAddr(0), destPort(0),
+      destRepeats(0), syncedVersion(0), sequence(0) {
+    strlcpy(address, GATE_UDP_DEFAULT_ADDRESS, sizeof(address));
+    memset(&stats, 0, sizeof(stats));
+    memset(slots, 0, sizeof(slots));
+}
+
+void GateUdpSender::begin() {
+    if (task) return;
+    settingsLock = xSemaphoreCreateMutex();
+    queue = xQueueCreate(GATE_UDP_QUEUE_SIZE, sizeof(QueuedEvent));
+    xTaskCreatePinnedToCore(taskMain, "gateudp", GATE_UDP_TASK_STACK, this, GATE_UDP_TASK_PRIORITY, &task, 0);
+}
+
+void GateUdpSender::onConfigChanged(Config& config, uint8_t groups) {
+    enabled = config.getGateUdpEnabled();
+    color = config.getPilotColor();
+
+    if (settingsLock) xSemaphoreTake(settingsLock, portMAX_DELAY);
+    strlcpy(address, config.getGateUdpAddress(), sizeof(address));
+    port = config.getGateUdpPort();
+    repeats = config.getGateUdpRepeats();
+    if (repeats > GATE_UDP_MAX_REPEATS) repeats = GATE_UDP_MAX_REPEATS;
+    settingsVersion++;
+    if (settingsLock) xSemaphoreGive(settingsLock);
+}
+
+void GateUdpSender::getDestination(char* buf, size_t len) {
+    if (settingsLock) xSemaphoreTake(settingsLock, portMAX_DELAY);
+    snprintf(buf, len, "%s:%u", address, port);
+    if (settingsLock) xSemaphoreGive(settingsLock);
+}
+
+void GateUdpSender::getStats(GateUdpStats& out) const {
+    out = stats;  // Counters only; a torn read is harmless
+}
+
+void GateUdpSender::sendRaceStart() {
+    queueEvent(GATE_UDP_RACE_START, 0);
+}
+
+void GateUdpSender::sendRaceStop() {
+    queueEvent(GATE_UDP_RACE_STOP, 0);
+}
+
+void GateUdpSender::sendLap(uint16_t lapNumber) {
+    queueEvent(GATE_UDP_LAP, lapNumber);
+}
+
+void GateUdpSender::queueEvent(uint8_t type, uint16_t lap) {
+    if (!enabled || !queue) return;
+    QueuedEvent event = {type, lap, millis(), micros(), color};
+    // Never wait: this runs on the timing loop
+    if (xQueueSend(queue, &event, 0) != pdTRUE) {
+        stats.queueDrops++;
+    }
+}
+
+void GateUdpSender::taskMain(void* arg) {
+    static_cast<GateUdpSender*>(arg)->sendLoop();
+}
+
+void GateUdpSender::sendLoop() {
+    for (;;) {
+        QueuedEvent event;
+        if (xQueueReceive(queue, &event, nextRepeatWait(millis())) == pdTRUE) {
+            syncSettings();
+            sendEvent(event);
+        }
+        sendDueRepeats(millis());
+    }
+}
+
+void GateUdpSender::syncSettings() {
+    if (syncedVersion == settingsVersion) return;
+
+    xSemaphoreTake(settingsLock, portMAX_DELAY);
+    struct in_addr parsed;
+    destAddr = inet_aton(address, &parsed) ? parsed.s_addr : 0;
+    destPort = port;
+    destRepeats = repeats;
+    syncedVersion = settingsVersion;
+    // Logged under the lock; address may be rewritten once it is released
+    if (!destAddr || !destPort) {
+        DEBUG("Gate UDP destination invalid: %s:%u\n", address, port);
+    }
+    xSemaphoreGive(settingsLock);
+}
+
+bool GateUdpSender::openSocket() {
+    if (fd >= 0) return true;
+    fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0) {
+        return false;  // Network stack not up yet; try again on the next event
+    }
+    // Either kind of destination may be configured
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+    uint8_t ttl = GATE_UDP_MULTICAST_TTL;
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    return true;
+}
+
+bool GateUdpSender::sendPacket(const uint8_t* packet) {
+    if (!destAddr || !destPort || !openSocket()) {
+        stats.sendErrors++;
+        return false;
+    }
+    struct sockaddr_in dest;
+    memset(&dest, 0, sizeof(dest));
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(destPort);
+    dest.sin_addr.s_addr = destAddr;
+    if (sendto(fd, packet, GATE_UDP_PACKET_SIZE, 0, (struct sockaddr*)&dest, sizeof(dest)) !=
+        GATE_UDP_PACKET_SIZE) {
+        stats.sendErrors++;
+        // Interface may have gone down; start from a fresh socket next time
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    stats.datagrams++;
+    return true;
+}
+
+void GateUdpSender::sendEvent(const QueuedEvent& queued) {
+    GateUdpEvent event;
+    event.type = queued.type;
+    event.copy = 0;
+    event.lap = queued.lap;
+    event.sequence = ++sequence;
+    event.timeMs = queued.timeMs;
+    event.color = queued.color;
+
+    uint8_t packet[GATE_UDP_PACKET_SIZE];
+    gateUdpEncode(event, packet, sizeof(packet));
+    if (sendPacket(packet)) {
+        stats.events++;
+        stats.lastLatencyUs = micros() - queued.queuedUs;
+        if (stats.lastLatencyUs > stats.maxLatencyUs) {
+            stats.maxLatencyUs = stats.lastLatencyUs;
+        }
+    }
+
+    if (destRepeats == 0) return;
+    // Reuse a free slot, or the one closest to done
+    RepeatSlot* slot = &slots[0];
+    for (RepeatSlot& s : slots) {
+        if (s.copiesLeft < slot->copiesLeft) slot = &s;
+    }
+    memcpy(slot->packet, packet, sizeof(packet));
+    slot->copiesLeft = destRepeats;
+    slot->dueMs = millis() + GATE_UDP_REPEAT_GAP_MS;
+}
+
+void GateUdpSender::sendDueRepeats(uint32_t now) {
+    for (RepeatSlot& s : slots) {
+        if (!s.copiesLeft || (int32_t)(now - s.dueMs) < 0) continue;
+        s.packet[GATE_UDP_COPY_OFFSET]++;
+        sendPacket(s.packet);
+        s.copiesLeft--;
+        s.dueMs = now + GATE_UDP_REPEAT_GAP_MS;
+    }
+}
+
+TickType_t GateUdpSender::nextRepeatWait(uint32_t now) const {
+    TickType_t wait = portMAX_DELAY;
+    for (const RepeatSlot& s : slots) {
+        if (!s.copiesLeft) continue;
+        int32_t left = (int32_t)(s.dueMs - now);
+        TickType_t ticks = left > 0 ? pdMS_TO_TICKS(left) : 0;
+        if (ticks < wait) wait = ticks;
+    }
+    return wait;
+}
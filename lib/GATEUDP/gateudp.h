@@ -0,0 +1,100 @@
+#ifndef GATEUDP_H
+#define GATEUDP_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include "config.h"
+#include "gateudpproto.h"
+
+#define GATE_UDP_QUEUE_SIZE 16
+#define GATE_UDP_MAX_REPEATS 3       // Redundant copies per event (config clamps to this)
+#define GATE_UDP_REPEAT_GAP_MS 3     // Spacing between copies, to get past short WiFi loss bursts
+#define GATE_UDP_REPEAT_SLOTS 4      // Events whose repeats can be outstanding at once
+#define GATE_UDP_MULTICAST_TTL 1     // Stay on the local network
+#define GATE_UDP_TASK_STACK 3072
+#define GATE_UDP_TASK_PRIORITY 2     // Above the webhook dispatcher, still on core 0
+
+struct GateUdpStats {
+    uint32_t events;          // Events sent (first copy)
+    uint32_t datagrams;       // Including repeats
+    uint32_t sendErrors;
+    uint32_t queueDrops;
+    uint32_t lastLatencyUs;   // Event time to first copy handed to the stack
+    uint32_t maxLatencyUs;
+};
+
+// Sends gate events as one small UDP datagram to a multicast group or
+// broadcast address, so any number of LED controllers get them with a
+// single send and no per-target connections. Like the webhook triggers,
+// send*() only queues; a core 0 task does the socket work.
+class GateUdpSender : public ConfigListener {
+   public:
+    GateUdpSender();
+    void begin();  // Starts the sender task
+
+    void sendRaceStart();
+    void sendRaceStop();
+    void sendLap(uint16_t lapNumber);
+
+    bool isEnabled() const { return enabled; }
+    void getStats(GateUdpStats& out) const;
+    void getDestination(char* buf, size_t len);  // "a.b.c.d:port"
+
+    // Follows the gate UDP settings and the pilot color
+    void onConfigChanged(Config& config, uint8_t groups) override;
+
+   private:
+    struct QueuedEvent {
+        uint8_t type;
+        uint16_t lap;
+        uint32_t timeMs;
+        uint32_t queuedUs;
+        uint32_t color;
+    };
+
+    struct RepeatSlot {
+        uint8_t packet[GATE_UDP_PACKET_SIZE];
+        uint8_t copiesLeft;
+        uint32_t dueMs;
+    };
+
+    volatile bool enabled;
+    volatile uint32_t color;
+
+    // Destination as configured; guarded by settingsLock
+    char address[16];
+    uint16_t port;
+    uint8_t repeats;
+    uint32_t settingsVersion;
+    SemaphoreHandle_t settingsLock;
+
+    QueueHandle_t queue;
+    TaskHandle_t task;
+    GateUdpStats stats;
+
+    // Sender task state
+    int fd;
+    uint32_t destAddr;        // Network byte order, 0 = unusable address
+    uint16_t destPort;
+    uint8_t destRepeats;
+    uint32_t syncedVersion;
+    uint32_t sequence;
+    RepeatSlot slots[GATE_UDP_REPEAT_SLOTS];
+
+    void queueEvent(uint8_t type, uint16_t lap);
+
+    static void taskMain(void* arg);
+    void sendLoop();
+    void syncSettings();
+    bool openSocket();
+    bool sendPacket(const uint8_t* packet);
+    void sendEvent(const QueuedEvent& event);
+    void sendDueRepeats(uint32_t now);
+    TickType_t nextRepeatWait(uint32_t now) const;
+};
+
+#endif  // GATEUDP_H
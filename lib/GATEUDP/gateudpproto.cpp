@@ -0,0 +1,70 @@
+#include "gateudpproto.h"
+
+static void putLe16(uint8_t* p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void putLe32(uint8_t* p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+}
+
+static uint16_t getLe16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t getLe32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+size_t gateUdpEncode(const GateUdpEvent& event, uint8_t* out, size_t len) {
+    if (len < GATE_UDP_PACKET_SIZE) return 0;
+    out[0] = GATE_UDP_MAGIC0;
+    out[1] = GATE_UDP_MAGIC1;
+    out[2] = GATE_UDP_VERSION;
+    out[3] = event.type;
+    putLe32(out + 4, event.sequence);
+    putLe32(out + 8, event.timeMs);
+    putLe16(out + 12, event.lap);
+    out[14] = (event.color >> 16) & 0xFF;
+    out[15] = (event.color >> 8) & 0xFF;
+    out[16] = event.color & 0xFF;
+    out[GATE_UDP_COPY_OFFSET] = event.copy;
+    return GATE_UDP_PACKET_SIZE;
+}
+
+bool gateUdpDecode(const uint8_t* in, size_t len, GateUdpEvent& event) {
+    if (len < GATE_UDP_PACKET_SIZE || in[0] != GATE_UDP_MAGIC0 || in[1] != GATE_UDP_MAGIC1 ||
+        in[2] != GATE_UDP_VERSION) {
+        return false;
+    }
+    event.type = in[3];
+    event.sequence = getLe32(in + 4);
+    event.timeMs = getLe32(in + 8);
+    event.lap = getLe16(in + 12);
+    event.color = ((uint32_t)in[14] << 16) | ((uint32_t)in[15] << 8) | in[16];
+    event.copy = in[GATE_UDP_COPY_OFFSET];
+    return true;
+}
+
+bool gateUdpIsNew(uint32_t sequence, uint32_t& newest, bool& seenAny) {
+    int32_t ahead = (int32_t)(sequence - newest);
+    if (seenAny && ahead <= 0 && ahead > -GATE_UDP_DUPLICATE_WINDOW) {
+        return false;
+    }
+    newest = sequence;
+    seenAny = true;
+    return true;
+}
+
+const char* gateUdpEventName(uint8_t type) {
+    switch (type) {
+        case GATE_UDP_RACE_START: return "RaceStart";
+        case GATE_UDP_RACE_STOP: return "RaceStop";
+        case GATE_UDP_LAP: return "Lap";
+        default: return "Unknown";
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef GATEUDPPROTO_H
+#define GATEUDPPROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Wire format of the UDP gate event protocol. Kept free of Arduino headers
+// so receivers and the host tool in tools/gateudp build from the same code.
+//
+// One datagram per event, all integers little-endian:
+//
+//   off size
+//    0   2   magic "FG"
+//    2   1   protocol version (GATE_UDP_VERSION)
+//    3   1   event type (gate_udp_event_e)
+//    4   4   sequence, +1 per event (repeats of an event share it)
+//    8   4   device timestamp, millis() when the event happened
+//   12   2   lap number (0 = Gate 1 holeshot, then 1, 2, ...; 0 for race start/stop)
+//   14   3   pilot color R, G, B
+//   17   1   copy index (0 = first send, n = nth redundant repeat)
+//
+// Repeats of one event can interleave with the next event's first copy.
+// Receivers act on a sequence newer than any seen so far and ignore one up
+// to GATE_UDP_DUPLICATE_WINDOW behind it; anything further back means the
+// timer restarted (sequences begin at 1 after boot) and counts as new.
+
+#define GATE_UDP_MAGIC0 'F'
+#define GATE_UDP_MAGIC1 'G'
+#define GATE_UDP_VERSION 1
+#define GATE_UDP_PACKET_SIZE 18
+#define GATE_UDP_COPY_OFFSET 17  // Senders bump it in place for each repeat
+#define GATE_UDP_DUPLICATE_WINDOW 16
+#define GATE_UDP_DEFAULT_PORT 5760
+#define GATE_UDP_DEFAULT_ADDRESS "239.255.57.60"
+
+typedef enum : uint8_t {
+    GATE_UDP_RACE_START = 1,
+    GATE_UDP_RACE_STOP = 2,
+    GATE_UDP_LAP = 3,
+} gate_udp_event_e;
+
+struct GateUdpEvent {
+    uint8_t type;
+    uint8_t copy;
+    uint16_t lap;
+    uint32_t sequence;
+    uint32_t timeMs;
+    uint32_t color;  // 0xRRGGBB
+};
+
+// Returns GATE_UDP_PACKET_SIZE, or 0 if len is too small
+size_t gateUdpEncode(const GateUdpEvent& event, uint8_t* out, size_t len);
+// False for anything that isn't a packet of this protocol version
+bool gateUdpDecode(const uint8_t* in, size_t len, GateUdpEvent& event);
+// Applies the duplicate rule above; newest is updated when the event is new
+bool gateUdpIsNew(uint32_t sequence, uint32_t& newest, bool& seenAny);
+const char* gateUdpEventName(uint8_t type);
+
+#endif  // GATEUDPPROTO_H
@@ -8,6 +8,8 @@ KalmanFilter::KalmanFilter() {
     A = 1;
     B = 0;
     C = 1;
+    cov = NAN;
+    x = NAN;  // First measurement initializes the estimate
 }
 
 float KalmanFilter::filter(uint16_t z, uint16_t u = 0) {
@@ -0,0 +1,83 @@
+#include "lapdetector.h"
+#include <math.h>
+#include <string.h>
+
+LapDetector::LapDetector() {
+    setFilter(defaultFilter());
+}
+
+LapFilterSettings LapDetector::defaultFilter() {
+    LapFilterSettings filter;
+    filter.q = LAPDETECT_FILTER_Q;
+    filter.r = LAPDETECT_FILTER_R;
+    filter.window = LAPDETECT_FILTER_WINDOW;
+    return filter;
+}
+
+void LapDetector::setFilter(const LapFilterSettings& filter) {
+    filterSettings = filter;
+    if (filterSettings.window < 1) filterSettings.window = 1;
+    if (filterSettings.window > LAPDETECT_WINDOW_MAX) filterSettings.window = LAPDETECT_WINDOW_MAX;
+
+    kalman = KalmanFilter();
+    kalman.setMeasurementNoise(filterSettings.q * 0.01f);
+    kalman.setProcessNoise(filterSettings.r * 0.0001f);
+    memset(window, 0, sizeof(window));
+    windowIndex = 0;
+}
+
+uint8_t LapDetector::filter(uint8_t raw) {
+    // Two-stage filtering:
+    // 1. Kalman filter for adaptive smoothing
+    // 2. Moving average for additional noise reduction
+    window[windowIndex] = (uint8_t)roundf(kalman.filter(raw, 0));
+    windowIndex = (windowIndex + 1) % filterSettings.window;
+
+    uint16_t sum = 0;
+    for (uint8_t i = 0; i < filterSettings.window; i++) {
+        sum += window[i];
+    }
+    return sum / filterSettings.window;
+}
+
+void LapDetector::startRace(uint32_t timeMs) {
+    startTimeMs = timeMs;
+    peak = 0;
+    peakTimeMs = 0;
+    laps = 0;
+}
+
+bool LapDetector::update(uint8_t rssi, uint32_t timeMs) {
+    // Gate 1 (first lap) bypasses minimum lap time check
+    // All subsequent laps must respect minimum lap time
+    if (laps > 0 && timeMs - startTimeMs <= settings.minLapMs) {
+        return false;
+    }
+    if (!capture(rssi, timeMs)) {
+        return false;
+    }
+    laps++;
+    return true;
+}
+
+bool LapDetector::capture(uint8_t rssi, uint32_t timeMs) {
+    // Capture any RSSI above enter threshold as a potential peak
+    if (rssi >= settings.enterRssi && rssi > peak) {
+        peak = rssi;
+        peakTimeMs = timeMs;
+    }
+
+    // Lap detection with strict validation:
+    // 1. Must have captured a peak
+    // 2. Peak must have crossed enter threshold (not just noise)
+    // 3. Peak must be significantly above exit threshold
+    // 4. Current RSSI must have dropped back below exit threshold
+    bool validPeak = peak > 0 && peak >= settings.enterRssi && peak > settings.exitRssi + LAPDETECT_PEAK_MARGIN;
+    return validPeak && rssi < settings.exitRssi;
+}
+
+void LapDetector::beginLap() {
+    startTimeMs = peakTimeMs;
+    peak = 0;
+    peakTimeMs = 0;
+}
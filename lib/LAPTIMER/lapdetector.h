@@ -0,0 +1,86 @@
+#ifndef LAPDETECTOR_H
+#define LAPDETECTOR_H
+
+#include <stdint.h>
+#include "kalman.h"
+
+/*
+ * Lap detection core of LapTimer
+ *
+ * Plain C++ with no Arduino dependency: LapTimer feeds it every sample on
+ * the device, and the host tools (tools/lapsim) replay recorded or
+ * synthetic traces through the same code.
+ *
+ *   filter   - Kalman filter, then a moving average of `window` samples
+ *   peak     - highest sample at or above enterRssi since the last lap
+ *   lap      - a valid peak (> exitRssi + LAPDETECT_PEAK_MARGIN) followed by
+ *              a sample below exitRssi; laps after the first wait minLapMs
+ *              from the previous peak. Laps are timed peak to peak.
+ */
+
+#define LAPDETECT_WINDOW_MAX 5
+#define LAPDETECT_PEAK_MARGIN 5     // Peak must clear exitRssi by this much
+
+// Light Kalman filtering since hardware cap does most of the work
+// Lower Q = less filtering (hardware cap already smooths noise)
+// Lower R = faster response to real signal changes
+#define LAPDETECT_FILTER_Q 500      // Measurement noise x100
+#define LAPDETECT_FILTER_R 50       // Process noise x10000
+#define LAPDETECT_FILTER_WINDOW 3
+
+struct LapFilterSettings {
+    uint16_t q;
+    uint16_t r;
+    uint8_t window;  // 1..LAPDETECT_WINDOW_MAX
+};
+
+struct LapDetectorSettings {
+    uint8_t enterRssi;
+    uint8_t exitRssi;
+    uint32_t minLapMs;
+};
+
+class LapDetector {
+   public:
+    LapDetector();
+
+    static LapFilterSettings defaultFilter();
+    void setFilter(const LapFilterSettings& filter);  // Restarts the filter
+    void setLevels(const LapDetectorSettings& levels) { settings = levels; }
+
+    // Filtered RSSI for one raw sample
+    uint8_t filter(uint8_t raw);
+
+    // A race starting at timeMs: no peak, next lap is Gate 1
+    void startRace(uint32_t timeMs);
+
+    // One filtered sample of a running race; true when it finishes a lap,
+    // whose time is then getLapTimeMs(). Call beginLap() before the next one.
+    bool update(uint8_t rssi, uint32_t timeMs);
+
+    // Peak capture and lap test without the minimum lap check (hole shot)
+    bool capture(uint8_t rssi, uint32_t timeMs);
+
+    // Next lap timed from the peak just captured; the peak is cleared
+    void beginLap();
+
+    uint32_t getLapTimeMs() const { return peakTimeMs - startTimeMs; }
+    uint32_t getPeakTimeMs() const { return peakTimeMs; }
+    uint32_t getLapStartMs() const { return startTimeMs; }  // minLapMs counts from here
+    uint8_t getPeak() const { return peak; }
+    uint32_t getLapCount() const { return laps; }
+
+   private:
+    LapDetectorSettings settings = {};
+    LapFilterSettings filterSettings;
+    KalmanFilter kalman;
+    uint8_t window[LAPDETECT_WINDOW_MAX];
+    uint8_t windowIndex;
+
+    uint32_t startTimeMs = 0;  // Race start, then the last lap's peak
+    uint8_t peak = 0;
+    uint32_t peakTimeMs = 0;
+    uint32_t laps = 0;
+};
+
+#endif
@@ -1,20 +1,11 @@
 #include "laptimer.h"
 #include "trackmanager.h"
 #include "webhook.h"
+#include "gateudp.h"
+#include "racejournal.h"
 
 #include "debug.h"
 
-#ifdef ESP32S3
-#include "rgbled.h"
-extern RgbLed* g_rgbLed;
-#endif
-
-// Light Kalman filtering since hardware cap does most of the work
-// Lower Q = less filtering (hardware cap already smooths noise)
-// Lower R = faster response to real signal changes
-const uint16_t rssi_filter_q = 500;   // Light filtering with hardware cap
-const uint16_t rssi_filter_r = 50;    // Fast response
-
 void LapTimer::init(Config *config, RX5808 *rx5808, Buzzer *buzzer, Led *l, WebhookManager *webhook) {
     conf = config;
     rx = rx5808;
@@ -22,102 +13,108 @@ void LapTimer::init(Config *config, RX5808 *rx5808, Buzzer *buzzer, Led *l, Webh
     led = l;
     webhooks = webhook;
 
-    filter.setMeasurementNoise(rssi_filter_q * 0.01f);
-    filter.setProcessNoise(rssi_filter_r * 0.0001f);
+    detector.setFilter(LapDetector::defaultFilter());
 
     selectedTrack = nullptr;
     totalDistanceTravelled = 0.0f;
     distanceRemaining = 0.0f;
 
+    conf->subscribe(this, CONFIG_GROUP_BIT(CONFIG_GROUP_TIMING) | CONFIG_GROUP_BIT(CONFIG_GROUP_LED) |
+                              CONFIG_GROUP_BIT(CONFIG_GROUP_WEBHOOKS));
     stop();
     memset(rssi, 0, sizeof(rssi));
-    memset(rssi_window, 0, sizeof(rssi_window));
-    rssi_window_index = 0;
 }
 
-void LapTimer::start() {
-    DEBUG("\n=== RACE STARTED ===\n");
-    DEBUG("Current Thresholds:\n");
-    DEBUG("  Enter RSSI: %u\n", conf->getEnterRssi());
-    DEBUG("  Exit RSSI: %u\n", conf->getExitRssi());
-    DEBUG("  Min Lap Time: %u ms\n", conf->getMinLapMs());
-    DEBUG("\nCurrent RSSI: %u\n", rssi[rssiCount]);
-    DEBUG("\nIf laps aren't detected, your thresholds may be too high!\n");
-    DEBUG("Suggested values based on typical signal:\n");
-    DEBUG("  Enter RSSI: ~55-60 (baseline + 15)\n");
-    DEBUG("  Exit RSSI: ~48-50 (baseline + 5)\n");
-    DEBUG("Use Calibration Wizard to set optimal values.\n");
-    DEBUG("====================\n\n");
+void LapTimer::onConfigChanged(Config& config, uint8_t groups) {
+    settings.enterRssi = config.getEnterRssi();
+    settings.exitRssi = config.getExitRssi();
+    settings.minLapMs = config.getMinLapMs();
+    settings.maxLaps = config.getMaxLaps();
+    LapDetectorSettings levels = {settings.enterRssi, settings.exitRssi, settings.minLapMs};
+    detector.setLevels(levels);
+    LapFilterSettings filter = {config.getFilterQ(), config.getFilterR(), config.getFilterWindow()};
+    if (filter.q != settings.filter.q || filter.r != settings.filter.r || filter.window != settings.filter.window) {
+        // Restarting the filter is left to the sampling path, which owns its state
+        settings.filter = filter;
+        filterChanged = true;
+    }
+    bool gateLEDs = config.getGateLEDsEnabled();
+    settings.raceStartHook = gateLEDs && config.getWebhookRaceStart();
+    settings.raceStopHook = gateLEDs && config.getWebhookRaceStop();
+    settings.lapHook = gateLEDs && config.getWebhookLap();
+}
+
+void LapTimer::start(uint32_t startEpoch) {
+    LOG_I(LOG_TIMER, "\n=== RACE STARTED ===\n");
+    LOG_I(LOG_TIMER, "Current Thresholds:\n");
+    LOG_I(LOG_TIMER, "  Enter RSSI: %u\n", settings.enterRssi);
+    LOG_I(LOG_TIMER, "  Exit RSSI: %u\n", settings.exitRssi);
+    LOG_I(LOG_TIMER, "  Min Lap Time: %u ms\n", settings.minLapMs);
+    LOG_I(LOG_TIMER, "\nCurrent RSSI: %u\n", getRssi());
+    LOG_I(LOG_TIMER, "\nIf laps aren't detected, your thresholds may be too high!\n");
+    LOG_I(LOG_TIMER, "Suggested values based on typical signal:\n");
+    LOG_I(LOG_TIMER, "  Enter RSSI: ~55-60 (baseline + 15)\n");
+    LOG_I(LOG_TIMER, "  Exit RSSI: ~48-50 (baseline + 5)\n");
+    LOG_I(LOG_TIMER, "Use Calibration Wizard to set optimal values.\n");
+    LOG_I(LOG_TIMER, "====================\n\n");
     
-    raceStartTimeMs = millis();
-    startTimeMs = raceStartTimeMs;  // Initialize start time for min lap check
+    detector.startRace(millis());  // Clears any spurious peak; Gate 1 times from here
     state = RUNNING;
-    rssiPeak = 0;  // Clear any spurious peak values
-    rssiPeakTimeMs = 0;
-    gateExited = true;  // Start assuming we're outside the gate
     totalDistanceTravelled = 0.0f;
     distanceRemaining = 0.0f;
+    stats.reset();
+    if (journal) journal->beginRace(startEpoch);
     buz->beep(500);
     led->on(500);
-#ifdef ESP32S3
-    // Flash green for race start
-    if (g_rgbLed) g_rgbLed->flashGreen();
-#endif
-    // Trigger race start webhook if Gate LEDs enabled and Race Start enabled
-    if (webhooks && conf->getGateLEDsEnabled() && conf->getWebhookRaceStart()) {
+    emit(RACE_EVENT_START);
+    // Trigger race start webhook/UDP event if Gate LEDs enabled and Race Start enabled
+    if (webhooks && settings.raceStartHook) {
         webhooks->triggerRaceStart();
     }
+    if (gateUdp && settings.raceStartHook) {
+        gateUdp->sendRaceStart();
+    }
 }
 
 void LapTimer::stop() {
-    DEBUG("LapTimer stopped\n");
+    LOG_I(LOG_TIMER, "LapTimer stopped\n");
+    if (journal && state == RUNNING) journal->endRace();
     state = STOPPED;
     lapCountWraparound = false;
     lapCount = 0;
     rssiCount = 0;
-    rssiPeak = 0;  // Clear peak tracking
-    rssiPeakTimeMs = 0;
-    startTimeMs = 0;
-    gateExited = true;
+    detector.startRace(0);  // Clear peak tracking
     totalDistanceTravelled = 0.0f;
     distanceRemaining = 0.0f;
     memset(lapTimes, 0, sizeof(lapTimes));
     buz->beep(500);
     led->on(500);
-#ifdef ESP32S3
-    // Flash red 3 times for race reset, then turn off
-    if (g_rgbLed) g_rgbLed->flashReset();
-#endif
-    // Trigger race stop webhook if Gate LEDs enabled and Race Stop enabled
-    if (webhooks && conf->getGateLEDsEnabled() && conf->getWebhookRaceStop()) {
+    emit(RACE_EVENT_STOP);
+    // Trigger race stop webhook/UDP event if Gate LEDs enabled and Race Stop enabled
+    if (webhooks && settings.raceStopHook) {
         webhooks->triggerRaceStop();
     }
+    if (gateUdp && settings.raceStopHook) {
+        gateUdp->sendRaceStop();
+    }
 }
 
 void LapTimer::handleLapTimerUpdate(uint32_t currentTimeMs) {
-    // Read RSSI and apply two-stage filtering:
-    // 1. Kalman filter for adaptive smoothing
-    // 2. Moving average for additional noise reduction
+    // Read RSSI; the detector applies the Kalman filter and moving average
     uint8_t rawRssi = rx->readRssi();
-    uint8_t kalman_filtered = round(filter.filter(rawRssi, 0));
-    
-    // Small moving average (3 samples) - hardware cap provides main filtering
-    rssi_window[rssi_window_index] = kalman_filtered;
-    rssi_window_index = (rssi_window_index + 1) % 3;
-    
-    // Calculate moving average over 3 samples
-    uint16_t sum = 0;
-    for (int i = 0; i < 3; i++) {
-        sum += rssi_window[i];
+    uint32_t processStartUs = micros();
+    if (filterChanged) {
+        filterChanged = false;
+        detector.setFilter(settings.filter);
     }
-    rssi[rssiCount] = sum / 3;
+    rssi[rssiCount] = detector.filter(rawRssi);
     
-    // RSSI debug output disabled for cleaner serial monitor
-    // Uncomment below to re-enable RSSI filtering debug:
+    // Per-sample trace; needs -DLOG_COMPILE_LEVEL=LOG_LEVEL_VERBOSE as well
+    // as uncommenting:
     // static uint32_t debugCounter = 0;
     // if (state == RUNNING && debugCounter++ % 50 == 0) {
-    //     DEBUG("Raw: %u -> Kalman: %u -> Avg: %u | Peak: %u, Time: %u ms\n", 
-    //           rawRssi, kalman_filtered, rssi[rssiCount], rssiPeak, currentTimeMs - startTimeMs);
+    //     LOG_V(LOG_TIMER, "Raw: %u -> Avg: %u | Peak: %u, Time: %u ms\n", 
+    //           rawRssi, rssi[rssiCount], detector.getPeak(), currentTimeMs);
     // }
 
     switch (state) {
@@ -125,32 +122,20 @@ void LapTimer::handleLapTimerUpdate(uint32_t currentTimeMs) {
             break;
         case WAITING:
             // detect hole shot
-            lapPeakCapture();
-            if (lapPeakCaptured()) {
+            if (detector.capture(rssi[rssiCount], currentTimeMs)) {
                 state = RUNNING;
                 startLap();
             }
             break;
-        case RUNNING: {
+        case RUNNING:
             // Gate 1 (first lap) bypasses minimum lap time check
-            // All subsequent laps must respect minimum lap time
-            bool isGate1 = (lapCount == 0 && !lapCountWraparound);
-            bool minLapElapsed = (currentTimeMs - startTimeMs) > conf->getMinLapMs();
-            
-            if (isGate1 || minLapElapsed) {
-                // Capture peaks and detect laps
-                lapPeakCapture();
-                
-                // Check for lap completion
-                if (lapPeakCaptured()) {
-                    DEBUG("Lap triggered! Time: %u ms (Gate 1: %s)\n", 
-                          currentTimeMs - startTimeMs, isGate1 ? "YES" : "NO");
-                    finishLap();
-                    startLap();
-                }
+            if (detector.update(rssi[rssiCount], currentTimeMs)) {
+                LOG_I(LOG_TIMER, "Lap triggered! Peak %u, lap time: %u ms (Gate 1: %s)\n", detector.getPeak(),
+                      detector.getLapTimeMs(), detector.getLapCount() == 1 ? "YES" : "NO");
+                finishLap(detector.getLapTimeMs());
+                startLap();
             }
             break;
-        }
         case CALIBRATION_WIZARD:
             // Record RSSI data without triggering lap detection
             // Sample every 20ms (50Hz) for longer recording duration with good resolution
@@ -167,75 +152,35 @@ void LapTimer::handleLapTimerUpdate(uint32_t currentTimeMs) {
     }
 
     rssiCount = (rssiCount + 1) % LAPTIMER_RSSI_HISTORY;
-}
 
-void LapTimer::lapPeakCapture() {
-    // Capture any RSSI above enter threshold as a potential peak
-    if (rssi[rssiCount] >= conf->getEnterRssi()) {
-        if (rssi[rssiCount] > rssiPeak) {
-            rssiPeak = rssi[rssiCount];
-            rssiPeakTimeMs = millis();
-            DEBUG("*** PEAK CAPTURED: %u at time %u ms (since lap start: %u ms) ***\n", 
-                  rssiPeak, rssiPeakTimeMs, rssiPeakTimeMs - startTimeMs);
-        }
-    }
-}
-
-bool LapTimer::lapPeakCaptured() {
-    // Lap detection with strict validation:
-    // 1. Must have captured a peak
-    // 2. Peak must have crossed enter threshold (not just noise)
-    // 3. Peak must be significantly above exit threshold (at least 5 RSSI units)
-    // 4. Current RSSI must have dropped back below exit threshold
-    
-    bool validPeak = (rssiPeak > 0) && 
-                     (rssiPeak >= conf->getEnterRssi()) && 
-                     (rssiPeak > (conf->getExitRssi() + 5));  // Peak must be well above exit
-    
-    bool droppedBelowExit = (rssi[rssiCount] < conf->getExitRssi());
-    
-    bool captured = validPeak && droppedBelowExit;
-    
-    if (captured) {
-        DEBUG("\n*** LAP DETECTED! ***\n");
-        DEBUG("  Current RSSI: %u\n", rssi[rssiCount]);
-        DEBUG("  Peak was: %u\n", rssiPeak);
-        DEBUG("  Enter threshold: %u\n", conf->getEnterRssi());
-        DEBUG("  Exit threshold: %u\n", conf->getExitRssi());
-        DEBUG("  Peak margin above exit: %d\n", rssiPeak - conf->getExitRssi());
-        DEBUG("******************\n\n");
+    uint32_t processUs = micros() - processStartUs;
+    loopStats.samples++;
+    loopStats.processUs += processUs;
+    if (processUs > loopStats.maxProcessUs) {
+        loopStats.maxProcessUs = processUs;
     }
-    
-    return captured;
 }
 
 void LapTimer::startLap() {
-    DEBUG("Lap started - Peak was %u, new lap begins\n", rssiPeak);
-    startTimeMs = rssiPeakTimeMs;
-    rssiPeak = 0;  // Reset peak for next lap
-    rssiPeakTimeMs = 0;
+    LOG_D(LOG_TIMER, "Lap started - Peak was %u, new lap begins\n", detector.getPeak());
+    detector.beginLap();  // Next lap times from this peak
     buz->beep(200);
     led->on(200);
 }
 
-void LapTimer::finishLap() {
-    lapTimes[lapCount] = rssiPeakTimeMs - startTimeMs;
-    if (lapCount == 0 && lapCountWraparound == false)
-    {
-        lapTimes[0] = rssiPeakTimeMs - raceStartTimeMs;
-    }
-    else
-    {
-        lapTimes[lapCount] = rssiPeakTimeMs - startTimeMs;
-    }
-    DEBUG("Lap finished, lap time = %u\n", lapTimes[lapCount]);
+void LapTimer::finishLap(uint32_t lapTimeMs) {
+    // Gate 1 is timed from the race start, later laps peak to peak
+    lapTimes[lapCount] = lapTimeMs;
+    LOG_I(LOG_TIMER, "Lap finished, lap time = %u\n", lapTimes[lapCount]);
+    stats.addLap(lapTimeMs);
+    if (journal) journal->recordLap(lapTimeMs);
     
     // Update distance if track is selected
     if (selectedTrack && selectedTrack->distance > 0) {
         totalDistanceTravelled += selectedTrack->distance;
         
         // Calculate remaining distance if maxLaps is set
-        uint8_t maxLaps = conf->getMaxLaps();
+        uint8_t maxLaps = settings.maxLaps;
         if (maxLaps > 0) {
             int lapsCompleted = lapCount + 1;
             if (lapCountWraparound) {
@@ -247,7 +192,7 @@ void LapTimer::finishLap() {
             distanceRemaining = 0.0f;  // No max laps set, can't calculate remaining
         }
         
-        DEBUG("Distance: Travelled = %.2f m, Remaining = %.2f m\n", 
+        LOG_I(LOG_TIMER, "Distance: Travelled = %.2f m, Remaining = %.2f m\n", 
               totalDistanceTravelled, distanceRemaining);
     }
     
@@ -256,17 +201,55 @@ void LapTimer::finishLap() {
     }
     lapCount = (lapCount + 1) % LAPTIMER_LAP_HISTORY;
     lapAvailable = true;
-#ifdef ESP32S3
-    if (g_rgbLed) g_rgbLed->flashLap();
-#endif
-    // Trigger lap webhook if Gate LEDs enabled and Lap enabled
-    if (webhooks && conf->getGateLEDsEnabled() && conf->getWebhookLap()) {
+    // Lap events say where the race stands, so listeners needn't know maxLaps
+    uint16_t laps = stats.getLapCount();
+    race_event_e lapEvent = RACE_EVENT_LAP;
+    if (settings.maxLaps > 0 && laps == settings.maxLaps) {
+        lapEvent = RACE_EVENT_FINISH;
+    } else if (settings.maxLaps > 0 && laps + 1 == settings.maxLaps) {
+        lapEvent = RACE_EVENT_FINAL_LAP;
+    }
+    emit(lapEvent, laps, lapTimeMs);
+    // Trigger lap webhook/UDP event if Gate LEDs enabled and Lap enabled
+    if (webhooks && settings.lapHook) {
         webhooks->triggerLap();
     }
+    if (gateUdp && settings.lapHook) {
+        gateUdp->sendLap(stats.getLapCount());
+    }
+}
+
+bool LapTimer::subscribe(RaceEventListener* listener) {
+    if (listenerCount >= RACE_EVENT_MAX_LISTENERS) {
+        LOG_E(LOG_TIMER, "Too many race event listeners, adjust RACE_EVENT_MAX_LISTENERS\n");
+        return false;
+    }
+    listeners[listenerCount++] = listener;
+    return true;
+}
+
+void LapTimer::publish(const RaceEvent& event) {
+    for (uint8_t i = 0; i < listenerCount; i++) {
+        listeners[i]->onRaceEvent(event);
+    }
+}
+
+void LapTimer::emit(race_event_e type, uint16_t lap, uint32_t lapTimeMs) {
+    RaceEvent event = {type, lap, lapTimeMs, millis()};
+    publish(event);
+}
+
+void LapTimer::announceStart(uint32_t inMs) {
+    if (inMs > RACE_COUNTDOWN_MAX_MS) {
+        inMs = RACE_COUNTDOWN_MAX_MS;
+    }
+    RaceEvent event = {RACE_EVENT_COUNTDOWN, 0, 0, millis() + inMs};
+    publish(event);
 }
 
 uint8_t LapTimer::getRssi() {
-    return rssi[rssiCount];
+    // rssiCount has already moved past the sample just taken
+    return rssi[(rssiCount + LAPTIMER_RSSI_HISTORY - 1) % LAPTIMER_RSSI_HISTORY];
 }
 
 uint32_t LapTimer::getLapTime() {
@@ -285,7 +268,7 @@ bool LapTimer::isLapAvailable() {
 }
 
 void LapTimer::startCalibrationWizard() {
-    DEBUG("Calibration wizard started\n");
+    LOG_I(LOG_TIMER, "Calibration wizard started\n");
     state = CALIBRATION_WIZARD;
     calibrationRssiCount = 0;
     lastCalibrationSampleMs = 0;  // Reset sample timing
@@ -293,19 +276,15 @@ void LapTimer::startCalibrationWizard() {
     memset(calibrationTimestamps, 0, sizeof(calibrationTimestamps));
     buz->beep(300);
     led->on(300);
-#ifdef ESP32S3
-    if (g_rgbLed) g_rgbLed->flashGreen();
-#endif
+    emit(RACE_EVENT_CALIBRATION_START);
 }
 
 void LapTimer::stopCalibrationWizard() {
-    DEBUG("Calibration wizard stopped, recorded %u samples\n", calibrationRssiCount);
+    LOG_I(LOG_TIMER, "Calibration wizard stopped, recorded %u samples\n", calibrationRssiCount);
     state = STOPPED;
     buz->beep(300);
     led->on(300);
-#ifdef ESP32S3
-    if (g_rgbLed) g_rgbLed->flashReset();
-#endif
+    emit(RACE_EVENT_CALIBRATION_STOP);
 }
 
 uint16_t LapTimer::getCalibrationRssiCount() {
@@ -331,9 +310,9 @@ void LapTimer::setTrack(Track* track) {
     totalDistanceTravelled = 0.0f;
     distanceRemaining = 0.0f;
     if (track) {
-        DEBUG("Track selected: %s (%.2f m)\n", track->name.c_str(), track->distance);
+        LOG_I(LOG_TIMER, "Track selected: %s (%.2f m)\n", track->name.c_str(), track->distance);
     } else {
-        DEBUG("Track deselected\n");
+        LOG_I(LOG_TIMER, "Track deselected\n");
     }
 }
 
@@ -4,12 +4,16 @@
 #include "RX5808.h"
 #include "buzzer.h"
 #include "config.h"
-#include "kalman.h"
+#include "lapdetector.h"
 #include "led.h"
+#include "racestats.h"
+#include "raceevents.h"
 
 // Forward declarations to avoid circular dependency
 struct Track;
 class WebhookManager;
+class GateUdpSender;
+class RaceJournal;
 
 typedef enum {
     STOPPED,
@@ -22,15 +26,26 @@ typedef enum {
 #define LAPTIMER_RSSI_HISTORY 100
 #define LAPTIMER_CALIBRATION_HISTORY 5000  // Increased buffer for longer recordings
 
-class LapTimer {
+// Cost of the sampling path after the ADC read (filters and detection).
+// Counters only grow; callers take differences over their own window.
+struct LapTimerLoopStats {
+    uint32_t samples;
+    uint32_t processUs;     // Total
+    uint32_t maxProcessUs;
+};
+
+class LapTimer : public ConfigListener {
    public:
     void init(Config *config, RX5808 *rx5808, Buzzer *buzzer, Led *l, WebhookManager *webhook = nullptr);
-    void start();
+    // startEpoch: wall clock start time from the client (epoch seconds), 0 if unknown
+    void start(uint32_t startEpoch = 0);
     void stop();
     void handleLapTimerUpdate(uint32_t currentTimeMs);
     uint8_t getRssi();
     uint32_t getLapTime();
     bool isLapAvailable();
+    laptimer_state_e getState() const { return state; }
+    void getLoopStats(LapTimerLoopStats& out) const { out = loopStats; }
     
     // Calibration wizard methods
     void startCalibrationWizard();
@@ -45,6 +60,26 @@ class LapTimer {
     float getDistanceRemaining();
     Track* getSelectedTrack();
 
+    // Crash-safe lap journal; only queues events, never touches storage
+    void setJournal(RaceJournal* raceJournal) { journal = raceJournal; }
+
+    // UDP gate events, sent alongside the webhooks; only queues
+    void setGateUdp(GateUdpSender* sender) { gateUdp = sender; }
+    
+    // Live race statistics, updated as each lap is finished
+    const RaceStats& getStats() const { return stats; }
+
+    // Race events (start, laps, finish...) for LED cues and the like. The
+    // buzzer, status LED, webhooks and UDP gate events are still driven
+    // directly; listeners are for outputs added on top of those
+    bool subscribe(RaceEventListener* listener);
+    void publish(const RaceEvent& event);
+    // Race start announced ahead of time, e.g. after the UI's random delay;
+    // inMs is capped at RACE_COUNTDOWN_MAX_MS
+    void announceStart(uint32_t inMs);
+
+    void onConfigChanged(Config& config, uint8_t groups) override;
+
    private:
     laptimer_state_e state = STOPPED;
     RX5808 *rx;
@@ -52,22 +87,34 @@ class LapTimer {
     Buzzer *buz;
     Led *led;
     WebhookManager *webhooks;
-    KalmanFilter filter;
+    RaceJournal *journal = nullptr;
+    GateUdpSender *gateUdp = nullptr;
+    RaceEventListener *listeners[RACE_EVENT_MAX_LISTENERS] = {};
+    uint8_t listenerCount = 0;
+    LapDetector detector;  // Filters and peak/lap logic, shared with the host tools
+    LapTimerLoopStats loopStats = {};
+
+    // Settings used on the sampling path, kept current by onConfigChanged()
+    // so the timing loop never calls into Config
+    struct {
+        uint8_t enterRssi;
+        uint8_t exitRssi;
+        uint32_t minLapMs;
+        uint8_t maxLaps;
+        LapFilterSettings filter;
+        bool raceStartHook;  // Gate LEDs enabled and the matching webhook/UDP event on
+        bool raceStopHook;
+        bool lapHook;
+    } settings = {};
+    volatile bool filterChanged = false;  // settings.filter not yet applied to the detector
     boolean lapCountWraparound;
-    uint32_t raceStartTimeMs;
-    uint32_t startTimeMs;
     uint8_t lapCount;
     uint8_t rssiCount;
     uint32_t lapTimes[LAPTIMER_LAP_HISTORY];
     uint8_t rssi[LAPTIMER_RSSI_HISTORY];
-    uint8_t rssi_window[5];  // Small window for moving average
-    uint8_t rssi_window_index;
-
-    uint8_t rssiPeak;
-    uint32_t rssiPeakTimeMs;
-    bool gateExited;  // Track if drone has fully exited gate after lap
 
     bool lapAvailable = false;
+    RaceStats stats;
     
     // Calibration wizard data
     uint16_t calibrationRssiCount;
@@ -80,12 +127,9 @@ class LapTimer {
     float totalDistanceTravelled;
     float distanceRemaining;
 
-    void lapPeakCapture();
-    bool lapPeakCaptured();
-    void lapPeakReset();
-
     void startLap();
-    void finishLap();
+    void finishLap(uint32_t lapTimeMs);
+    void emit(race_event_e type, uint16_t lap = 0, uint32_t lapTimeMs = 0);
 };
 
 #endif
@@ -0,0 +1,39 @@
+#ifndef RACEEVENTS_H
+#define RACEEVENTS_H
+
+#include <stdint.h>
+
+// Race events published by LapTimer. Listeners are called from whichever
+// task published the event, including the timing loop, so onRaceEvent()
+// must only copy what it needs and hand it off (queue, flag); never block.
+
+typedef enum : uint8_t {
+    RACE_EVENT_COUNTDOWN,          // timeMs = when the race will start
+    RACE_EVENT_START,
+    RACE_EVENT_LAP,                // A lap finished with more to go (or no lap limit)
+    RACE_EVENT_FINAL_LAP,          // A lap finished and the next one is the last
+    RACE_EVENT_FINISH,             // The last lap finished
+    RACE_EVENT_STOP,
+    RACE_EVENT_CALIBRATION_START,
+    RACE_EVENT_CALIBRATION_STOP,
+} race_event_e;
+
+struct RaceEvent {
+    race_event_e type;
+    uint16_t lap;        // Laps completed, Gate 1 excluded (lap events only)
+    uint32_t lapTimeMs;  // Lap events only
+    uint32_t timeMs;     // millis() the event happened, or is due for a countdown
+};
+
+class RaceEventListener {
+   public:
+    virtual void onRaceEvent(const RaceEvent& event) = 0;
+};
+
+#define RACE_EVENT_MAX_LISTENERS 4
+
+// Longest race start that may be announced ahead; the UI's random start
+// delay is at most 5 s
+#define RACE_COUNTDOWN_MAX_MS 30000
+
+#endif  // RACEEVENTS_H
@@ -1,10 +1,29 @@
 #include "nodemode.h"
 
-// Firmware version strings (for RotorHazard identification)
+// Firmware strings (for RotorHazard identification), sent without the
+// "NAME: " prefix in a NODE_TEXT_SIZE block
 const char *firmwareVersionString = "FIRMWARE_VERSION: FPVGate_RH_1.0.0";
 const char *firmwareBuildDateString = "FIRMWARE_BUILDDATE: " __DATE__;
 const char *firmwareBuildTimeString = "FIRMWARE_BUILDTIME: " __TIME__;
+#if defined(ESP32S3)
 const char *firmwareProcTypeString = "FIRMWARE_PROCTYPE: ESP32-S3";
+#elif defined(ESP32C3)
+const char *firmwareProcTypeString = "FIRMWARE_PROCTYPE: ESP32-C3";
+#elif defined(APP_BOARD_XIAO_C6)
+const char *firmwareProcTypeString = "FIRMWARE_PROCTYPE: ESP32-C6";
+#else
+const char *firmwareProcTypeString = "FIRMWARE_PROCTYPE: ESP32";
+#endif
+
+static inline uint8_t put16(uint8_t* out, uint16_t value) {
+    out[0] = (value >> 8) & 0xFF;
+    out[1] = value & 0xFF;
+    return 2;
+}
+
+static inline uint16_t clamp16(uint32_t value) {
+    return value > 0xFFFF ? 0xFFFF : value;
+}
 
 NodeMode::NodeMode() {
     // Constructor
@@ -19,57 +38,77 @@ void NodeMode::begin(LapTimer* timer, Config* config) {
     _settings.enterAtLevel = config->getEnterRssi();
     _settings.exitAtLevel = config->getExitRssi();
     
-    // Initialize lap counter
-    _lastPass.lap = 0;
-    _lastPass.timestamp = 0;
-    _lastPass.rssiPeak = 0;
-    
-    // Start race automatically in node mode (RotorHazard expects node to be always active)
-    _timer->start();
+    _tracker.reset();
+    _tracker.setLevels(_settings.enterAtLevel, _settings.exitAtLevel);
+    _stats = {};
 }
 
-void NodeMode::process() {
-    // Handle serial communication
-    handleSerialInput();
-    
-    // Check for new laps and update state
-    if (_timer->isLapAvailable()) {
-        uint32_t lapTime = _timer->getLapTime();
-        uint8_t rssiPeak = _timer->getRssi();
-        
-        // Update internal state for RotorHazard
-        _lastPass.timestamp = millis();
-        _lastPass.rssiPeak = rssiPeak;
-        _lastPass.lap++;
+void NodeMode::onConfigChanged(Config& config, uint8_t groups) {
+    if (groups & CONFIG_GROUP_BIT(CONFIG_GROUP_RF)) {
+        uint16_t freq = config.getFrequency();
+        if (freq != _settings.vtxFreq) {
+            _settings.vtxFreq = freq;
+            // Peak and nadir belong to the old channel
+            _tracker.resetNode();
+        }
+    }
+    if (groups & CONFIG_GROUP_BIT(CONFIG_GROUP_TIMING)) {
+        _settings.enterAtLevel = config.getEnterRssi();
+        _settings.exitAtLevel = config.getExitRssi();
+        _tracker.setLevels(_settings.enterAtLevel, _settings.exitAtLevel);
     }
 }
 
-void NodeMode::handleSerialInput() {
-    int iterCount = 0;
-    
-    // Process all available bytes (USB CDC can have multiple bytes queued)
-    while (Serial.available() > 0) {
+void NodeMode::process(uint32_t currentTimeMs) {
+    uint32_t nowUs = micros();
+    if (_lastProcessUs != 0) {
+        _loopTimeUs = nowUs - _lastProcessUs;
+    }
+    _lastProcessUs = nowUs;
+
+    // One filtered sample per loop, taken by the timer update just before
+    _tracker.update(_timer->getRssi(), currentTimeMs);
+
+    handleSerialInput(currentTimeMs);
+}
+
+void NodeMode::getStats(NodeModeStats& out) const {
+    out = _stats;
+    _tracker.getStats(out.passes);
+}
+
+void NodeMode::handleSerialInput(uint32_t currentTimeMs) {
+    // A write command whose payload stopped arriving would swallow the next
+    // commands as payload; give up on it and resync on the next byte
+    if (_currentCommand != 0 && currentTimeMs - _commandStartMs > NODE_COMMAND_TIMEOUT_MS) {
+        _stats.timeouts++;
+        _currentCommand = 0;
+        _payloadIndex = 0;
+    }
+
+    // Fixed budget per call so a burst of input can't stall the timing loop;
+    // whatever is left is handled on the next pass
+    for (int budget = NODE_SERIAL_BUDGET; budget > 0 && Serial.available() > 0; budget--) {
         uint8_t inByte = Serial.read();
         
         if (_currentCommand == 0) {
-            // New command byte
-            _currentCommand = inByte;
-            
             // Validate command before processing
-            if (!isValidCommand(_currentCommand)) {
+            if (!isValidCommand(inByte)) {
                 // Invalid command (likely baud rate mismatch or garbage) - ignore silently
-                _currentCommand = 0;
+                _stats.invalidBytes++;
                 continue;
             }
+            _stats.commands++;
             
-            if (_currentCommand >= 0x51) {
+            if (inByte >= 0x51) {
                 // Write command - expect payload + checksum
-                _expectedPayloadSize = getPayloadSize(_currentCommand);
+                _currentCommand = inByte;
+                _expectedPayloadSize = getPayloadSize(inByte);
                 _payloadIndex = 0;
+                _commandStartMs = currentTimeMs;
             } else {
                 // Read command - handle immediately
-                handleReadCommand(_currentCommand);
-                _currentCommand = 0;
+                handleReadCommand(inByte, currentTimeMs);
             }
         } else {
             // Collecting payload bytes for write command
@@ -82,9 +121,11 @@ void NodeMode::handleSerialInput() {
                     checksum += _payloadBuffer[i];  // SUM, not XOR (RotorHazard uses sum)
                 }
                 
-                if (_payloadBuffer[_expectedPayloadSize] == (checksum & 0xFF)) {
+                if (_payloadBuffer[_expectedPayloadSize] == checksum) {
                     // Valid message - handle it
                     handleWriteCommand(_currentCommand, _payloadBuffer, _expectedPayloadSize);
+                } else {
+                    _stats.checksumErrors++;
                 }
                 
                 // Reset state
@@ -92,14 +133,64 @@ void NodeMode::handleSerialInput() {
                 _payloadIndex = 0;
             }
         }
-        
-        // Prevent blocking (process up to 100 bytes per call)
-        if (++iterCount > 100) return;
     }
 }
 
-void NodeMode::handleReadCommand(uint8_t cmd) {
-    uint8_t response[32];
+// lap, ms since the pass, rssi, node peak, pass peak, loop time
+uint8_t NodeMode::writePassStats(uint8_t* out, uint32_t currentTimeMs) {
+    const NodePass& pass = _tracker.reportPass();
+    uint8_t len = 0;
+    out[len++] = pass.lap;
+    len += put16(out + len, pass.lap ? clamp16(currentTimeMs - pass.timeMs) : 0);
+    out[len++] = _timer->getRssi();
+    out[len++] = _tracker.getNodePeak();
+    out[len++] = pass.rssiPeak;
+    len += put16(out + len, clamp16(_loopTimeUs));
+    return len;
+}
+
+// flags, pass nadir, node nadir, then the oldest unsent extremum (rssi, ms
+// since it started, duration) or zeros
+uint8_t NodeMode::writeExtremums(uint8_t* out, uint32_t currentTimeMs) {
+    uint8_t flags = _tracker.isCrossing() ? LAPSTATS_FLAG_CROSSING : 0;
+    if (_tracker.peekExtremumIsPeak()) {
+        flags |= LAPSTATS_FLAG_PEAK;
+    }
+    uint8_t len = 0;
+    out[len++] = flags;
+    out[len++] = _tracker.getPassNadir();
+    out[len++] = _tracker.getNodeNadir();
+
+    NodeExtremum extremum;
+    if (_tracker.popExtremum(extremum)) {
+        out[len++] = extremum.rssi;
+        len += put16(out + len, clamp16(currentTimeMs - extremum.firstMs));
+        len += put16(out + len, extremum.durationMs);
+    } else {
+        out[len++] = 0;
+        len += put16(out + len, 0);
+        len += put16(out + len, 0);
+    }
+    return len;
+}
+
+uint8_t NodeMode::writeText(uint8_t* out, const char* text) {
+    const char* value = strchr(text, ':');
+    value = value ? value + 1 : text;
+    while (*value == ' ') value++;
+
+    uint8_t len = 0;
+    while (*value && len < NODE_TEXT_SIZE) {
+        out[len++] = *value++;
+    }
+    while (len < NODE_TEXT_SIZE) {
+        out[len++] = 0;
+    }
+    return len;
+}
+
+void NodeMode::handleReadCommand(uint8_t cmd, uint32_t currentTimeMs) {
+    uint8_t response[NODE_MAX_RESPONSE];
     uint8_t len = 0;
     
     switch (cmd) {
@@ -108,70 +199,37 @@ void NodeMode::handleReadCommand(uint8_t cmd) {
             break;
             
         case READ_FREQUENCY:
-            response[len++] = (_settings.vtxFreq >> 8) & 0xFF;
-            response[len++] = _settings.vtxFreq & 0xFF;
+            len += put16(response, _settings.vtxFreq);
             break;
             
         case READ_LAP_STATS:
-            // Return simple lap stats (not used much, but RotorHazard may query it)
-            response[len++] = 0;  // placeholder
+            // What RotorHazard polls: pass stats followed by extremums
+            len += writePassStats(response, currentTimeMs);
+            len += writeExtremums(response + len, currentTimeMs);
             break;
             
-        case READ_LAP_PASS_STATS: {
-            // Current time (4 bytes, big-endian)
-            uint32_t now = millis();
-            response[len++] = (now >> 24) & 0xFF;
-            response[len++] = (now >> 16) & 0xFF;
-            response[len++] = (now >> 8) & 0xFF;
-            response[len++] = now & 0xFF;
-            
-            // Current RSSI (1 byte)
-            response[len++] = _timer->getRssi();
-            
-            // Last pass timestamp (4 bytes, big-endian)
-            uint32_t ts = _lastPass.timestamp;
-            response[len++] = (ts >> 24) & 0xFF;
-            response[len++] = (ts >> 16) & 0xFF;
-            response[len++] = (ts >> 8) & 0xFF;
-            response[len++] = ts & 0xFF;
-            
-            // Last pass peak RSSI (1 byte)
-            response[len++] = _lastPass.rssiPeak;
-            
-            // Flags (1 byte) - 0 for now
-            response[len++] = 0;
-            
-            // Lap counter (2 bytes, big-endian)
-            response[len++] = (_lastPass.lap >> 8) & 0xFF;
-            response[len++] = _lastPass.lap & 0xFF;
-            
-            // Nadir RSSI (1 byte) - not used in FPVGate
-            response[len++] = 0;
+        case READ_LAP_PASS_STATS:
+            len += writePassStats(response, currentTimeMs);
             break;
-        }
         
         case READ_LAP_EXTREMUMS:
-            // Not implemented yet - return zeros
-            for (int i = 0; i < 8; i++) {
-                response[len++] = 0;
-            }
+            len += writeExtremums(response, currentTimeMs);
             break;
             
         case READ_RHFEAT_FLAGS:
-            response[len++] = (RHFEAT_FLAGS_VALUE >> 8) & 0xFF;
-            response[len++] = RHFEAT_FLAGS_VALUE & 0xFF;
+            len += put16(response, RHFEAT_FLAGS_VALUE);
             break;
             
         case READ_REVISION_CODE:
-            response[len++] = NODE_API_LEVEL;
+            len += put16(response, NODE_REVISION_CODE);
             break;
             
         case READ_NODE_RSSI_PEAK:
-            response[len++] = _lastPass.rssiPeak;
+            response[len++] = _tracker.getNodePeak();
             break;
             
         case READ_NODE_RSSI_NADIR:
-            response[len++] = 0;  // Not tracked
+            response[len++] = _tracker.getNodeNadir();
             break;
             
         case READ_ENTER_AT_LEVEL:
@@ -203,41 +261,21 @@ void NodeMode::handleReadCommand(uint8_t cmd) {
             response[len++] = _slotIndex;
             break;
             
-        case READ_FW_VERSION: {
-            // Send firmware version string
-            const char* verStr = firmwareVersionString;
-            while (*verStr && len < 31) {
-                response[len++] = *verStr++;
-            }
+        case READ_FW_VERSION:
+            len += writeText(response, firmwareVersionString);
             break;
-        }
         
-        case READ_FW_BUILDDATE: {
-            // Send build date string
-            const char* dateStr = firmwareBuildDateString;
-            while (*dateStr && len < 31) {
-                response[len++] = *dateStr++;
-            }
+        case READ_FW_BUILDDATE:
+            len += writeText(response, firmwareBuildDateString);
             break;
-        }
         
-        case READ_FW_BUILDTIME: {
-            // Send build time string
-            const char* timeStr = firmwareBuildTimeString;
-            while (*timeStr && len < 31) {
-                response[len++] = *timeStr++;
-            }
+        case READ_FW_BUILDTIME:
+            len += writeText(response, firmwareBuildTimeString);
             break;
-        }
         
-        case READ_FW_PROCTYPE: {
-            // Send processor type string
-            const char* procStr = firmwareProcTypeString;
-            while (*procStr && len < 31) {
-                response[len++] = *procStr++;
-            }
+        case READ_FW_PROCTYPE:
+            len += writeText(response, firmwareProcTypeString);
             break;
-        }
         
         default:
             // Unknown command - no response
@@ -251,13 +289,13 @@ void NodeMode::handleReadCommand(uint8_t cmd) {
 
 void NodeMode::handleWriteCommand(uint8_t cmd, uint8_t* payload, uint8_t len) {
     switch (cmd) {
+        // Settings go through Config; onConfigChanged() picks them up
         case WRITE_FREQUENCY: {
             if (len >= 2) {
                 uint16_t freq = (payload[0] << 8) | payload[1];
                 
                 // Validate frequency range (5645-5945 MHz)
                 if (freq >= 5645 && freq <= 5945) {
-                    _settings.vtxFreq = freq;
                     _config->setFrequency(freq);
                     // Frequency change will be handled by RX5808 update in main loop
                 }
@@ -267,7 +305,6 @@ void NodeMode::handleWriteCommand(uint8_t cmd, uint8_t* payload, uint8_t len) {
         
         case WRITE_ENTER_AT_LEVEL: {
             if (len >= 1) {
-                _settings.enterAtLevel = payload[0];
                 _config->setEnterRssi(payload[0]);
             }
             break;
@@ -275,7 +312,6 @@ void NodeMode::handleWriteCommand(uint8_t cmd, uint8_t* payload, uint8_t len) {
         
         case WRITE_EXIT_AT_LEVEL: {
             if (len >= 1) {
-                _settings.exitAtLevel = payload[0];
                 _config->setExitRssi(payload[0]);
             }
             break;
@@ -286,7 +322,7 @@ void NodeMode::handleWriteCommand(uint8_t cmd, uint8_t* payload, uint8_t len) {
             break;
             
         case FORCE_END_CROSSING:
-            // Force end crossing - not implemented yet
+            _tracker.forceEndCrossing();
             break;
             
         case WRITE_CURNODE_INDEX:
@@ -306,9 +342,19 @@ void NodeMode::handleWriteCommand(uint8_t cmd, uint8_t* payload, uint8_t len) {
 }
 
 void NodeMode::sendResponse(uint8_t* data, uint8_t len) {
-    // Send response data
+    // RotorHazard checks every response against a trailing sum byte
+    uint8_t checksum = 0;
+    for (uint8_t i = 0; i < len; i++) {
+        checksum += data[i];
+    }
+    data[len++] = checksum;
+
+    // Never wait on the port: RotorHazard retries a read that goes unanswered
+    if (Serial.availableForWrite() < len) {
+        _stats.txDrops++;
+        return;
+    }
     Serial.write(data, len);
-    Serial.flush();  // Ensure data is sent immediately
 }
 
 uint8_t NodeMode::getPayloadSize(uint8_t cmd) {
@@ -319,6 +365,7 @@ uint8_t NodeMode::getPayloadSize(uint8_t cmd) {
         case SEND_STATUS_MESSAGE: return 2;
         case FORCE_END_CROSSING: return 1;
         case WRITE_CURNODE_INDEX: return 1;
+        case JUMP_TO_BOOTLOADER: return 1;
         default: return 0;
     }
 }
@@ -4,6 +4,7 @@
 #include <Arduino.h>
 #include "laptimer.h"
 #include "config.h"
+#include "nodepass.h"
 
 // RotorHazard protocol command constants (must match RHInterface.py exactly)
 // READ commands (< 0x50)
@@ -39,6 +40,17 @@
 // Protocol constants
 #define NODE_API_LEVEL 35  // RotorHazard API version
 #define RHFEAT_FLAGS_VALUE 0x0000  // No special features
+#define NODE_REVISION_CODE ((0x25 << 8) | NODE_API_LEVEL)
+#define NODE_TEXT_SIZE 16  // Firmware strings, zero padded
+
+// READ_LAP_EXTREMUMS flags
+#define LAPSTATS_FLAG_CROSSING 0x01
+#define LAPSTATS_FLAG_PEAK 0x02
+
+#define NODE_SERIAL_BAUD 115200
+#define NODE_SERIAL_BUDGET 16          // Bytes parsed per process() call
+#define NODE_COMMAND_TIMEOUT_MS 100    // Drop a write command whose payload stalls
+#define NODE_MAX_RESPONSE 24           // Largest response, checksum included
 
 // Node settings structure
 struct NodeSettings {
@@ -47,40 +59,61 @@ struct NodeSettings {
     uint8_t exitAtLevel = 100;
 };
 
-// Last pass/lap data structure
-struct NodeLastPass {
-    uint32_t timestamp = 0;
-    uint8_t rssiPeak = 0;
-    uint16_t lap = 0;
+struct NodeModeStats {
+    uint32_t commands;
+    uint32_t invalidBytes;     // Not a command we know (noise, wrong baud)
+    uint32_t checksumErrors;
+    uint32_t timeouts;         // Write commands dropped part way
+    uint32_t txDrops;          // Responses skipped because the TX buffer was full
+    NodePassStats passes;
 };
 
-class NodeMode {
+// Answers RotorHazard's node protocol over Serial, the way an RH Arduino node
+// does, so RotorHazard can poll the gate directly. The timer isn't started:
+// RotorHazard applies its own minimum lap, so every crossing is reported.
+// process() never blocks: it parses at most NODE_SERIAL_BUDGET bytes and
+// drops a response rather than wait for room in the TX buffer.
+class NodeMode : public ConfigListener {
 public:
     NodeMode();
     void begin(LapTimer* timer, Config* config);
-    void process();  // Called in main loop
+    void process(uint32_t currentTimeMs);  // Called in main loop after the timer update
+
+    void getStats(NodeModeStats& out) const;
+
+    // Keeps the reported frequency and levels in step with Config (RF and
+    // timing groups), whoever changed them
+    void onConfigChanged(Config& config, uint8_t groups) override;
     
 private:
-    LapTimer* _timer;
-    Config* _config;
+    LapTimer* _timer = nullptr;
+    Config* _config = nullptr;
     NodeSettings _settings;
-    NodeLastPass _lastPass;
+    NodePassTracker _tracker;
+    NodeModeStats _stats = {};
     uint8_t _nodeIndex = 0;
     uint8_t _slotIndex = 0;
+    uint32_t _lastProcessUs = 0;
+    uint32_t _loopTimeUs = 0;
     
     // Serial communication
-    void handleSerialInput();
-    void handleReadCommand(uint8_t command);
+    void handleSerialInput(uint32_t currentTimeMs);
+    void handleReadCommand(uint8_t command, uint32_t currentTimeMs);
     void handleWriteCommand(uint8_t command, uint8_t* payload, uint8_t len);
     void sendResponse(uint8_t* data, uint8_t len);
     uint8_t getPayloadSize(uint8_t command);
     bool isValidCommand(uint8_t command);
+
+    uint8_t writePassStats(uint8_t* out, uint32_t currentTimeMs);
+    uint8_t writeExtremums(uint8_t* out, uint32_t currentTimeMs);
+    uint8_t writeText(uint8_t* out, const char* text);
     
     // Message parsing state
     uint8_t _currentCommand = 0;
     uint8_t _payloadBuffer[32];
     uint8_t _payloadIndex = 0;
     uint8_t _expectedPayloadSize = 0;
+    uint32_t _commandStartMs = 0;
 };
 
 #endif // NODEMODE_H
@@ -0,0 +1,146 @@
+#include "nodepass.h"
+#include <string.h>
+
+static inline uint16_t clampDuration(uint32_t ms) {
+    return ms > 0xFFFF ? 0xFFFF : (uint16_t)ms;
+}
+
+void NodePassTracker::reset() {
+    crossing = false;
+    memset(&passPeak, 0, sizeof(passPeak));
+    memset(passes, 0, sizeof(passes));
+    memset(&shown, 0, sizeof(shown));
+    passCount = 0;
+    passShown = 0;
+    haveCandidate = false;
+    extremumHead = 0;
+    extremumCount = 0;
+    memset(&stats, 0, sizeof(stats));
+    passNadir = 0xFF;
+    resetNode();
+}
+
+void NodePassTracker::resetNode() {
+    nodePeak = 0;
+    nodeNadir = 0xFF;
+}
+
+void NodePassTracker::setLevels(uint8_t enter, uint8_t exit) {
+    enterAt = enter;
+    exitAt = exit;
+}
+
+void NodePassTracker::update(uint8_t rssi, uint32_t timeMs) {
+    if (rssi > nodePeak) nodePeak = rssi;
+    if (rssi < nodeNadir) nodeNadir = rssi;
+
+    if (!crossing && enterAt > 0 && rssi >= enterAt) {
+        crossing = true;
+        passPeak.rssi = rssi;
+        passPeak.peak = true;
+        passPeak.firstMs = timeMs;
+        passPeak.durationMs = 0;
+    }
+
+    if (crossing) {
+        if (rssi > passPeak.rssi) {
+            passPeak.rssi = rssi;
+            passPeak.firstMs = timeMs;
+            passPeak.durationMs = 0;
+        } else if (rssi == passPeak.rssi) {
+            passPeak.durationMs = clampDuration(timeMs - passPeak.firstMs);
+        }
+        if (rssi < exitAt) {
+            endCrossing();
+        }
+    } else if (rssi < passNadir) {
+        passNadir = rssi;
+    }
+
+    trackExtremum(rssi, timeMs);
+}
+
+void NodePassTracker::forceEndCrossing() {
+    if (crossing) {
+        endCrossing();
+    }
+}
+
+void NodePassTracker::endCrossing() {
+    crossing = false;
+    passCount++;
+    NodePass& pass = passes[(passCount - 1) % NODE_PASS_HISTORY];
+    pass.lap = (uint8_t)passCount;
+    pass.rssiPeak = passPeak.rssi;
+    pass.timeMs = passPeak.firstMs + passPeak.durationMs / 2;
+    stats.passes++;
+    passNadir = 0xFF;
+}
+
+const NodePass& NodePassTracker::reportPass() {
+    if (passCount - passShown > NODE_PASS_HISTORY) {
+        stats.passDrops += passCount - passShown - NODE_PASS_HISTORY;
+        passShown = passCount - NODE_PASS_HISTORY;
+    }
+    if (passShown < passCount) {
+        shown = passes[passShown % NODE_PASS_HISTORY];
+        passShown++;
+    }
+    return shown;
+}
+
+void NodePassTracker::trackExtremum(uint8_t rssi, uint32_t timeMs) {
+    if (!haveCandidate) {
+        // Follow the first sample upwards
+        candidate.rssi = rssi;
+        candidate.peak = true;
+        candidate.firstMs = timeMs;
+        candidate.durationMs = 0;
+        haveCandidate = true;
+        return;
+    }
+
+    bool further = candidate.peak ? rssi > candidate.rssi : rssi < candidate.rssi;
+    if (further) {
+        candidate.rssi = rssi;
+        candidate.firstMs = timeMs;
+        candidate.durationMs = 0;
+        return;
+    }
+    if (rssi == candidate.rssi) {
+        candidate.durationMs = clampDuration(timeMs - candidate.firstMs);
+        return;
+    }
+
+    uint8_t back = candidate.peak ? candidate.rssi - rssi : rssi - candidate.rssi;
+    if (back >= NODE_EXTREMUM_HYSTERESIS) {
+        pushExtremum(candidate);
+        candidate.rssi = rssi;
+        candidate.peak = !candidate.peak;
+        candidate.firstMs = timeMs;
+        candidate.durationMs = 0;
+    }
+}
+
+void NodePassTracker::pushExtremum(const NodeExtremum& e) {
+    if (extremumCount == NODE_EXTREMUM_HISTORY) {
+        extremumHead = (extremumHead + 1) % NODE_EXTREMUM_HISTORY;
+        extremumCount--;
+        stats.extremumDrops++;
+    }
+    NodeExtremum& slot = extremums[(extremumHead + extremumCount) % NODE_EXTREMUM_HISTORY];
+    slot = e;
+    if (slot.rssi == 0) slot.rssi = 1;
+    extremumCount++;
+    stats.extremums++;
+}
+
+bool NodePassTracker::popExtremum(NodeExtremum& out) {
+    if (extremumCount == 0) {
+        return false;
+    }
+    out = extremums[extremumHead];
+    extremumHead = (extremumHead + 1) % NODE_EXTREMUM_HISTORY;
+    extremumCount--;
+    return true;
+}
@@ -0,0 +1,100 @@
+#ifndef NODEPASS_H
+#define NODEPASS_H
+
+#include <stdint.h>
+
+/*
+ * RotorHazard pass and extremum tracking
+ *
+ * Plain C++ with no Arduino dependency: NodeMode feeds it one filtered RSSI
+ * sample per loop and reads back what a RotorHazard node reports.
+ *
+ *   crossing    - starts when RSSI reaches enterAt, ends when it drops below
+ *                 exitAt; the pass is timed at the middle of its peak
+ *   pass history - passes wait in a ring until a READ_LAP_STATS poll shows
+ *                 them, one per poll, so a slow poll doesn't lose a lap
+ *   extremums   - alternating peaks and nadirs (with hysteresis) queued for
+ *                 RotorHazard's RSSI history, oldest dropped when full
+ *   peak/nadir  - highest and lowest RSSI since the node was tuned, and the
+ *                 lowest since the last pass ended
+ */
+
+#define NODE_PASS_HISTORY 8
+#define NODE_EXTREMUM_HISTORY 16
+#define NODE_EXTREMUM_HYSTERESIS 2  // RSSI a value must move back before its extremum counts
+
+struct NodeExtremum {
+    uint8_t rssi;         // Never 0, which RotorHazard reads as "none"
+    bool peak;
+    uint32_t firstMs;     // First sample at this value
+    uint16_t durationMs;  // Until the last sample at this value
+};
+
+struct NodePass {
+    uint8_t lap;          // Wraps; RotorHazard only looks for a change
+    uint8_t rssiPeak;
+    uint32_t timeMs;
+};
+
+struct NodePassStats {
+    uint32_t passes;
+    uint32_t passDrops;      // Passes overwritten before a poll showed them
+    uint32_t extremums;
+    uint32_t extremumDrops;  // Extremums overwritten before a poll sent them
+};
+
+class NodePassTracker {
+   public:
+    NodePassTracker() { reset(); }
+
+    void reset();      // Everything, including pass history
+    void resetNode();  // Node peak/nadir only, after retuning
+    void setLevels(uint8_t enterAt, uint8_t exitAt);
+    void update(uint8_t rssi, uint32_t timeMs);
+    void forceEndCrossing();
+
+    bool isCrossing() const { return crossing; }
+    uint8_t getNodePeak() const { return nodePeak; }
+    uint8_t getNodeNadir() const { return nodeNadir == 0xFF ? 0 : nodeNadir; }
+    uint8_t getPassNadir() const { return passNadir == 0xFF ? 0 : passNadir; }
+
+    // The pass to report for this poll: the next unshown one if there is
+    // one, otherwise the last shown (lap 0 before the first pass)
+    const NodePass& reportPass();
+
+    // Oldest extremum not yet sent; false when there's none
+    bool hasExtremum() const { return extremumCount > 0; }
+    bool peekExtremumIsPeak() const { return extremumCount > 0 && extremums[extremumHead].peak; }
+    bool popExtremum(NodeExtremum& out);
+
+    void getStats(NodePassStats& out) const { out = stats; }
+
+   private:
+    uint8_t enterAt = 0;
+    uint8_t exitAt = 0;
+
+    bool crossing = false;
+    NodeExtremum passPeak;
+    uint8_t nodePeak;
+    uint8_t nodeNadir;
+    uint8_t passNadir;
+
+    NodePass passes[NODE_PASS_HISTORY];  // Pass n at passes[n % NODE_PASS_HISTORY]
+    uint32_t passCount;
+    uint32_t passShown;
+    NodePass shown;
+
+    NodeExtremum candidate;  // Extremum being followed, not yet confirmed
+    bool haveCandidate;
+    NodeExtremum extremums[NODE_EXTREMUM_HISTORY];
+    uint8_t extremumHead;
+    uint8_t extremumCount;
+
+    NodePassStats stats;
+
+    void endCrossing();
+    void trackExtremum(uint8_t rssi, uint32_t timeMs);
+    void pushExtremum(const NodeExtremum& e);
+};
+
+#endif
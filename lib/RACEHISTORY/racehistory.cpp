@@ -3,7 +3,83 @@
 #include <time.h>
 #include "debug.h"
 
-RaceHistory::RaceHistory() : storage(nullptr) {
+RaceHistory::RaceHistory() : storage(nullptr), lapCacheTick(0) {
+    for (auto& slot : lapCache) {
+        slot.timestamp = 0;
+        slot.lastUsed = 0;
+    }
+}
+
+void RaceHistory::toEntry(const RaceSession& race, RaceIndexEntry& entry) {
+    memset(&entry, 0, sizeof(entry));
+    entry.timestamp = race.timestamp;
+    entry.fastestLap = race.fastestLap;
+    entry.medianLap = race.medianLap;
+    entry.best3LapsTotal = race.best3LapsTotal;
+    entry.frequency = race.frequency;
+    entry.channel = race.channel;
+    entry.trackId = race.trackId;
+    entry.totalDistance = race.totalDistance;
+    strlcpy(entry.name, race.name.c_str(), sizeof(entry.name));
+    strlcpy(entry.tag, race.tag.c_str(), sizeof(entry.tag));
+    strlcpy(entry.pilotName, race.pilotName.c_str(), sizeof(entry.pilotName));
+    strlcpy(entry.pilotCallsign, race.pilotCallsign.c_str(), sizeof(entry.pilotCallsign));
+    strlcpy(entry.band, race.band.c_str(), sizeof(entry.band));
+    strlcpy(entry.trackName, race.trackName.c_str(), sizeof(entry.trackName));
+}
+
+void RaceHistory::fromEntry(const RaceIndexEntry& entry, RaceSession& race) {
+    race.timestamp = entry.timestamp;
+    race.lapTimes.clear();
+    race.fastestLap = entry.fastestLap;
+    race.medianLap = entry.medianLap;
+    race.best3LapsTotal = entry.best3LapsTotal;
+    race.name = entry.name;
+    race.tag = entry.tag;
+    race.pilotName = entry.pilotName;
+    race.pilotCallsign = entry.pilotCallsign;
+    race.frequency = entry.frequency;
+    race.band = entry.band;
+    race.channel = entry.channel;
+    race.trackId = entry.trackId;
+    race.trackName = entry.trackName;
+    race.totalDistance = entry.totalDistance;
+}
+
+void RaceHistory::calculateStats(RaceIndexEntry& entry, const std::vector<uint32_t>& lapTimes) {
+    // Same engine as the live lap stats, so saved and streamed numbers always agree
+    RaceStats stats = RaceStats::fromLaps(lapTimes);
+    entry.fastestLap = stats.getFastestLap();
+    entry.medianLap = stats.getMedianLap();
+    entry.best3LapsTotal = stats.getBest3LapsTotal();
+}
+
+bool RaceHistory::parseRace(JsonObject raceObj, RaceSession& race) {
+    if (raceObj.isNull()) {
+        return false;
+    }
+    race.timestamp = raceObj["timestamp"] | 0;
+    race.fastestLap = raceObj["fastestLap"] | 0;
+    race.medianLap = raceObj["medianLap"] | 0;
+    race.best3LapsTotal = raceObj["best3LapsTotal"] | 0;
+    race.name = (const char*)(raceObj["name"] | "");
+    race.tag = (const char*)(raceObj["tag"] | "");
+    race.pilotName = (const char*)(raceObj["pilotName"] | "");
+    race.pilotCallsign = (const char*)(raceObj["pilotCallsign"] | "");
+    race.frequency = raceObj["frequency"] | 0;
+    race.band = (const char*)(raceObj["band"] | "");
+    race.channel = raceObj["channel"] | 0;
+    race.trackId = raceObj["trackId"] | 0;
+    race.trackName = (const char*)(raceObj["trackName"] | "");
+    race.totalDistance = raceObj["totalDistance"] | 0.0f;
+
+    race.lapTimes.clear();
+    if (raceObj.containsKey("lapTimes")) {
+        for (JsonVariant lap : raceObj["lapTimes"].as<JsonArray>()) {
+            race.lapTimes.push_back(lap.as<uint32_t>());
+        }
+    }
+    return true;
 }
 
 bool RaceHistory::isPersistenceEnabled() const {
@@ -14,12 +90,29 @@ bool RaceHistory::isPersistenceEnabled() const {
     #endif
 }
 
+const std::vector<RaceSummary>& RaceHistory::getRaces() const {
+    #ifndef PIN_SD_CS
+        return ramRaces;
+    #endif
+    return store.getEntries();
+}
+
+const RaceSummary* RaceHistory::findRace(uint32_t timestamp) const {
+    for (const auto& summary : getRaces()) {
+        if (summary.timestamp == timestamp) {
+            return &summary;
+        }
+    }
+    return nullptr;
+}
+
 bool RaceHistory::init(Storage* storageBackend) {
     storage = storageBackend;
 
     #ifndef PIN_SD_CS
         // No SD support on this build: keep only the current race in RAM and do not persist to flash.
-        races.clear();
+        ramRaces.clear();
+        ramLaps.clear();
         return true;
     #endif
 
@@ -27,358 +120,297 @@ bool RaceHistory::init(Storage* storageBackend) {
         DEBUG("RaceHistory: Storage backend is null!\n");
         return false;
     }
-    
-    // Create races directory if it doesn't exist
-    storage->mkdir("/races");
-    
+
+    store.init(storage);
+
     return loadRaces();
 }
 
 bool RaceHistory::saveRace(const RaceSession& race) {
+    RaceIndexEntry entry;
+    toEntry(race, entry);
+    if (!race.lapTimes.empty()) {
+        calculateStats(entry, race.lapTimes);
+    }
+
     #ifndef PIN_SD_CS
         // RAM-only mode: keep just the most recent race in memory.
-        races.clear();
-        races.push_back(race);
+        entry.lapCount = race.lapTimes.size();
+        entry.totalTime = 0;
+        for (uint32_t lap : race.lapTimes) {
+            entry.totalTime += lap;
+        }
+        ramRaces.assign(1, entry);
+        ramLaps = race.lapTimes;
         return true;
     #endif
-    
-    
-    // Generate filename from timestamp: DDMMYY-HrMinSec.json
-    time_t timestamp = race.timestamp;
-    struct tm timeinfo;
-    localtime_r(&timestamp, &timeinfo);
-    
-    char filename[32];
-    strftime(filename, sizeof(filename), "%d%m%y-%H%M%S.json", &timeinfo);
-    String filepath = String(RACES_DIR) + "/" + String(filename);
-    
-    // Create JSON for single race
-    DynamicJsonDocument doc(16384);
-    JsonObject raceObj = doc.to<JsonObject>();
-    raceObj["timestamp"] = race.timestamp;
-    raceObj["fastestLap"] = race.fastestLap;
-    raceObj["medianLap"] = race.medianLap;
-    raceObj["best3LapsTotal"] = race.best3LapsTotal;
-    raceObj["name"] = race.name;
-    raceObj["tag"] = race.tag;
-    raceObj["pilotName"] = race.pilotName;
-    raceObj["pilotCallsign"] = race.pilotCallsign;
-    raceObj["frequency"] = race.frequency;
-    raceObj["band"] = race.band;
-    raceObj["channel"] = race.channel;
-    raceObj["trackId"] = race.trackId;
-    raceObj["trackName"] = race.trackName;
-    raceObj["totalDistance"] = race.totalDistance;
-    
-    JsonArray lapsArray = raceObj.createNestedArray("lapTimes");
-    for (uint32_t lap : race.lapTimes) {
-        lapsArray.add(lap);
-    }
-    
-    String json;
-    serializeJson(doc, json);
-    
-    DEBUG("Saving race JSON: totalDistance=%.2f\n", race.totalDistance);
-    DEBUG("JSON content: %s\n", json.c_str());
-    
-    bool success = storage->writeFile(filepath, json);
+
+    // The timestamp is the race's key; a second race with it could never be
+    // opened, edited or deleted on its own
+    if (store.find(race.timestamp)) {
+        DEBUG("Race %u already exists, not saving\n", race.timestamp);
+        return false;
+    }
+
+    // Drop the oldest race once the index is full
+    while (store.getEntries().size() >= MAX_RACES) {
+        uint32_t oldest = store.getEntries().back().timestamp;
+        DEBUG("Race index full, dropping oldest race %u\n", oldest);
+        invalidateLaps(oldest);
+        store.remove(oldest);
+    }
+
+    bool success = store.append(entry, race.lapTimes);
     if (success) {
-        DEBUG("Saved race to %s (%d bytes)\n", filepath.c_str(), json.length());
-        
-        // Add to in-memory list
-        races.insert(races.begin(), race);
-        if (races.size() > MAX_RACES) {
-            races.resize(MAX_RACES);
-        }
+        DEBUG("Saved race %u (%d laps, %d bytes)\n", race.timestamp, race.lapTimes.size(), entry.lapBytes);
+        // Just-finished races are the most likely to be opened next
+        cacheLaps(race.timestamp, race.lapTimes);
     } else {
-        DEBUG("Failed to save race to %s\n", filepath.c_str());
+        DEBUG("Failed to save race %u\n", race.timestamp);
     }
-    
+
     return success;
 }
 
 bool RaceHistory::loadRaces() {
     #ifndef PIN_SD_CS
         // RAM-only mode: nothing to load from storage.
-        races.clear();
+        ramRaces.clear();
+        ramLaps.clear();
         return true;
     #endif
-    
+
     if (!storage) {
         DEBUG("RaceHistory: Storage backend is null!\n");
         return false;
     }
-    
-    races.clear();
-    
-    // List all JSON files in races directory
+
+    for (auto& slot : lapCache) {
+        slot.timestamp = 0;
+        std::vector<uint32_t>().swap(slot.lapTimes);
+    }
+
+    // Create races directory if it doesn't exist (SD may have just been mounted)
+    storage->mkdir(RACES_DIR);
+
+    // Only the index is read here; lap data stays in the log until requested.
+    // A missing or damaged index is rebuilt from the log.
+    if (!store.load()) {
+        if (store.rebuild(calculateStats)) {
+            DEBUG("RaceHistory: Race index rebuilt from the log\n");
+        } else {
+            DEBUG("RaceHistory: Race index could not be rebuilt\n");
+        }
+    }
+    migrateJsonRaces();
+
+    // Free heap vs. largest allocatable block: the gap is the fragmentation
+    DEBUG("Loaded %d races from index (heap free %u, largest block %u)\n",
+          store.getEntries().size(), ESP.getFreeHeap(), ESP.getMaxAllocHeap());
+    return true;
+}
+
+bool RaceHistory::migrateJsonRaces() {
+    // One-time import of the old one-JSON-file-per-race layout
     std::vector<String> files;
     if (!storage->listDir(RACES_DIR, files)) {
-        DEBUG("Races directory does not exist or is empty\n");
-        return true;
+        return false;
     }
-    
-    // Load each race file
+
+    int migrated = 0;
     for (const String& filename : files) {
         if (!filename.endsWith(".json")) {
             continue;
         }
-        
+
         String filepath = String(RACES_DIR) + "/" + filename;
-        String json;
-        if (!storage->readFile(filepath, json)) {
+        File file = storage->openRead(filepath);
+        if (!file) {
             DEBUG("Failed to read %s\n", filepath.c_str());
             continue;
         }
-        
+
+        // Parse straight from the file, no String copy of the JSON
         DynamicJsonDocument doc(16384);
-        DeserializationError error = deserializeJson(doc, json);
+        DeserializationError error = deserializeJson(doc, file);
+        file.close();
         if (error) {
             DEBUG("Failed to parse %s: %s\n", filepath.c_str(), error.c_str());
             continue;
         }
-        
+
         RaceSession race;
-        race.timestamp = doc["timestamp"];
-        race.fastestLap = doc["fastestLap"];
-        race.medianLap = doc["medianLap"];
-        race.best3LapsTotal = doc["best3LapsTotal"];
-        race.name = doc["name"] | "";
-        race.tag = doc["tag"] | "";
-        race.pilotName = doc["pilotName"] | "";
-        race.pilotCallsign = doc["pilotCallsign"] | "";
-        race.frequency = doc["frequency"] | 0;
-        race.band = doc["band"] | "";
-        race.channel = doc["channel"] | 0;
-        race.trackId = doc["trackId"] | 0;
-        race.trackName = doc["trackName"] | "";
-        race.totalDistance = doc["totalDistance"] | 0.0f;
-        
-        JsonArray lapsArray = doc["lapTimes"];
-        for (uint32_t lap : lapsArray) {
-            race.lapTimes.push_back(lap);
+        parseRace(doc.as<JsonObject>(), race);
+
+        if (store.find(race.timestamp)) {
+            storage->deleteFile(filepath);
+            continue;
+        }
+
+        RaceIndexEntry entry;
+        toEntry(race, entry);
+        if (store.append(entry, race.lapTimes)) {
+            storage->deleteFile(filepath);
+            migrated++;
+        }
+    }
+
+    if (migrated > 0) {
+        DEBUG("Migrated %d JSON races to binary store\n", migrated);
+    }
+    return true;
+}
+
+void RaceHistory::cacheLaps(uint32_t timestamp, const std::vector<uint32_t>& lapTimes) {
+    // Reuse the race's own slot, otherwise evict the least recently used one
+    LapCacheSlot* victim = &lapCache[0];
+    for (auto& slot : lapCache) {
+        if (slot.timestamp == timestamp) {
+            victim = &slot;
+            break;
+        }
+        if (slot.lastUsed < victim->lastUsed) {
+            victim = &slot;
+        }
+    }
+    victim->timestamp = timestamp;
+    victim->lastUsed = ++lapCacheTick;
+    victim->lapTimes = lapTimes;
+}
+
+void RaceHistory::invalidateLaps(uint32_t timestamp) {
+    for (auto& slot : lapCache) {
+        if (slot.timestamp == timestamp) {
+            slot.timestamp = 0;
+            slot.lastUsed = 0;
+            std::vector<uint32_t>().swap(slot.lapTimes);
+        }
+    }
+}
+
+const std::vector<uint32_t>* RaceHistory::getLapTimes(uint32_t timestamp) {
+    #ifndef PIN_SD_CS
+        return findRace(timestamp) ? &ramLaps : nullptr;
+    #endif
+
+    for (auto& slot : lapCache) {
+        if (slot.timestamp == timestamp) {
+            slot.lastUsed = ++lapCacheTick;
+            return &slot.lapTimes;
         }
-        
-        races.push_back(race);
-    }
-    
-    // Sort by timestamp (newest first)
-    std::sort(races.begin(), races.end(), 
-        [](const RaceSession& a, const RaceSession& b) { return a.timestamp > b.timestamp; });
-    
-    // Keep only MAX_RACES
-    if (races.size() > MAX_RACES) {
-        races.resize(MAX_RACES);
-    }
-    
-    DEBUG("Loaded %d races from individual files\n", races.size());
+    }
+
+    // Cache miss: one read from the race log
+    RaceIndexEntry* entry = store.find(timestamp);
+    if (!entry) {
+        return nullptr;
+    }
+    std::vector<uint32_t> lapTimes;
+    if (!store.readLaps(*entry, lapTimes)) {
+        return nullptr;
+    }
+    cacheLaps(timestamp, lapTimes);
+    return getLapTimes(timestamp);
+}
+
+bool RaceHistory::getRace(uint32_t timestamp, RaceSession& race) {
+    const RaceSummary* summary = findRace(timestamp);
+    if (!summary) {
+        return false;
+    }
+    fromEntry(*summary, race);
+
+    const std::vector<uint32_t>* lapTimes = getLapTimes(timestamp);
+    if (!lapTimes) {
+        DEBUG("Failed to load laps for race %u\n", timestamp);
+        return false;
+    }
+    race.lapTimes = *lapTimes;
     return true;
 }
 
 bool RaceHistory::deleteRace(uint32_t timestamp) {
     #ifndef PIN_SD_CS
-        auto ramIt = std::find_if(races.begin(), races.end(),
-            [timestamp](const RaceSession& r) { return r.timestamp == timestamp; });
-        if (ramIt != races.end()) {
-            races.erase(ramIt);
+        if (findRace(timestamp)) {
+            ramRaces.clear();
+            ramLaps.clear();
             return true;
         }
         return false;
-    #endif    
-    
-    // Find and delete the file
-    time_t ts = timestamp;
-    struct tm timeinfo;
-    localtime_r(&ts, &timeinfo);
-    
-    char filename[32];
-    strftime(filename, sizeof(filename), "%d%m%y-%H%M%S.json", &timeinfo);
-    String filepath = String(RACES_DIR) + "/" + String(filename);
-    
-    bool fileDeleted = storage->deleteFile(filepath);
-    
-    // Remove from in-memory list
-    auto it = std::remove_if(races.begin(), races.end(),
-        [timestamp](const RaceSession& r) { return r.timestamp == timestamp; });
-    
-    if (it != races.end()) {
-        races.erase(it, races.end());
-        return fileDeleted;
-    }
-    
-    return false;
+    #endif
+
+    invalidateLaps(timestamp);
+    return store.remove(timestamp);
 }
 
 bool RaceHistory::updateRace(uint32_t timestamp, const String& name, const String& tag, float totalDistance) {
+    RaceIndexEntry* target = nullptr;
     #ifndef PIN_SD_CS
-        // RAM-only mode: update in-memory entry only.
-        for (auto& race : races) {
-            if (race.timestamp == timestamp) {
-                race.name = name;
-                race.tag = tag;
-                if (totalDistance >= 0.0f) {
-                    race.totalDistance = totalDistance;
-                }
-                return true;
+        for (auto& summary : ramRaces) {
+            if (summary.timestamp == timestamp) {
+                target = &summary;
             }
         }
-        return false;
+    #else
+        target = store.find(timestamp);
     #endif
-    
-    // Update in-memory race
-    RaceSession* targetRace = nullptr;
-    for (auto& race : races) {
-        if (race.timestamp == timestamp) {
-            race.name = name;
-            race.tag = tag;
-            if (totalDistance >= 0.0f) {
-                race.totalDistance = totalDistance;
-            }
-            targetRace = &race;
-            break;
-        }
-    }
-    
-    if (!targetRace) {
+
+    if (!target) {
         return false;
     }
-    
-    // Regenerate file with updated data
-    time_t ts = timestamp;
-    struct tm timeinfo;
-    localtime_r(&ts, &timeinfo);
-    
-    char filename[32];
-    strftime(filename, sizeof(filename), "%d%m%y-%H%M%S.json", &timeinfo);
-    String filepath = String(RACES_DIR) + "/" + String(filename);
-    
-    // Create JSON
-    DynamicJsonDocument doc(16384);
-    JsonObject raceObj = doc.to<JsonObject>();
-    raceObj["timestamp"] = targetRace->timestamp;
-    raceObj["fastestLap"] = targetRace->fastestLap;
-    raceObj["medianLap"] = targetRace->medianLap;
-    raceObj["best3LapsTotal"] = targetRace->best3LapsTotal;
-    raceObj["name"] = targetRace->name;
-    raceObj["tag"] = targetRace->tag;
-    raceObj["pilotName"] = targetRace->pilotName;
-    raceObj["pilotCallsign"] = targetRace->pilotCallsign;
-    raceObj["frequency"] = targetRace->frequency;
-    raceObj["band"] = targetRace->band;
-    raceObj["channel"] = targetRace->channel;
-    raceObj["trackId"] = targetRace->trackId;
-    raceObj["trackName"] = targetRace->trackName;
-    raceObj["totalDistance"] = targetRace->totalDistance;
-    
-    JsonArray lapsArray = raceObj.createNestedArray("lapTimes");
-    for (uint32_t lap : targetRace->lapTimes) {
-        lapsArray.add(lap);
-    }
-    
-    String json;
-    serializeJson(doc, json);
-    
-    return storage->writeFile(filepath, json);
-}
 
-bool RaceHistory::updateLaps(uint32_t timestamp, const std::vector<uint32_t>& newLapTimes) {
+    // Metadata only: laps stay where they are
+    RaceIndexEntry entry = *target;
+    strlcpy(entry.name, name.c_str(), sizeof(entry.name));
+    strlcpy(entry.tag, tag.c_str(), sizeof(entry.tag));
+    if (totalDistance >= 0.0f) {
+        entry.totalDistance = totalDistance;
+    }
+
     #ifndef PIN_SD_CS
         // RAM-only mode: update in-memory entry only.
-        for (auto& race : races) {
-            if (race.timestamp == timestamp) {
-                race.lapTimes = newLapTimes;
-                // (Optional) recompute fastest/median/best3 here if you want.
-                return true;
-            }
-        }
-        return false;
+        *target = entry;
+        return true;
     #endif
-    
+
+    return store.update(entry);
+}
+
+bool RaceHistory::updateLaps(uint32_t timestamp, const std::vector<uint32_t>& newLapTimes) {
     // Validate lap times
     if (newLapTimes.empty()) {
         DEBUG("Cannot update race with empty lap times\n");
         return false;
     }
-    
-    // Find the race in memory
-    RaceSession* targetRace = nullptr;
-    for (auto& race : races) {
-        if (race.timestamp == timestamp) {
-            targetRace = &race;
-            break;
-        }
-    }
-    
-    if (!targetRace) {
+
+    const RaceSummary* summary = findRace(timestamp);
+    if (!summary) {
         DEBUG("Race with timestamp %u not found\n", timestamp);
         return false;
     }
-    
-    // Update lap times
-    targetRace->lapTimes = newLapTimes;
-    
-    // Recalculate statistics
-    // Fastest lap
-    targetRace->fastestLap = *std::min_element(newLapTimes.begin(), newLapTimes.end());
-    
-    // Median lap
-    std::vector<uint32_t> sorted = newLapTimes;
-    std::sort(sorted.begin(), sorted.end());
-    size_t mid = sorted.size() / 2;
-    if (sorted.size() % 2 == 0) {
-        targetRace->medianLap = (sorted[mid - 1] + sorted[mid]) / 2;
-    } else {
-        targetRace->medianLap = sorted[mid];
-    }
-    
-    // Best 3 laps total
-    if (newLapTimes.size() >= 3) {
-        targetRace->best3LapsTotal = sorted[0] + sorted[1] + sorted[2];
-    } else {
-        targetRace->best3LapsTotal = 0;
-        for (uint32_t lap : sorted) {
-            targetRace->best3LapsTotal += lap;
+
+    RaceIndexEntry entry = *summary;
+    calculateStats(entry, newLapTimes);
+
+    #ifndef PIN_SD_CS
+        // RAM-only mode: update in-memory entry only.
+        entry.lapCount = newLapTimes.size();
+        entry.totalTime = 0;
+        for (uint32_t lap : newLapTimes) {
+            entry.totalTime += lap;
         }
-    }
-    
-    // Write updated race to file
-    time_t ts = timestamp;
-    struct tm timeinfo;
-    localtime_r(&ts, &timeinfo);
-    
-    char filename[32];
-    strftime(filename, sizeof(filename), "%d%m%y-%H%M%S.json", &timeinfo);
-    String filepath = String(RACES_DIR) + "/" + String(filename);
-    
-    // Create JSON
-    DynamicJsonDocument doc(16384);
-    JsonObject raceObj = doc.to<JsonObject>();
-    raceObj["timestamp"] = targetRace->timestamp;
-    raceObj["fastestLap"] = targetRace->fastestLap;
-    raceObj["medianLap"] = targetRace->medianLap;
-    raceObj["best3LapsTotal"] = targetRace->best3LapsTotal;
-    raceObj["name"] = targetRace->name;
-    raceObj["tag"] = targetRace->tag;
-    raceObj["pilotName"] = targetRace->pilotName;
-    raceObj["pilotCallsign"] = targetRace->pilotCallsign;
-    raceObj["frequency"] = targetRace->frequency;
-    raceObj["band"] = targetRace->band;
-    raceObj["channel"] = targetRace->channel;
-    raceObj["trackId"] = targetRace->trackId;
-    raceObj["trackName"] = targetRace->trackName;
-    raceObj["totalDistance"] = targetRace->totalDistance;
-    
-    JsonArray lapsArray = raceObj.createNestedArray("lapTimes");
-    for (uint32_t lap : targetRace->lapTimes) {
-        lapsArray.add(lap);
-    }
-    
-    String json;
-    serializeJson(doc, json);
-    
-    bool success = storage->writeFile(filepath, json);
+        ramRaces[0] = entry;
+        ramLaps = newLapTimes;
+        return true;
+    #endif
+
+    // Append a new lap record and repoint the index at it
+    bool success = store.replaceLaps(entry, newLapTimes);
     if (success) {
+        cacheLaps(timestamp, newLapTimes);
         DEBUG("Updated laps for race %u\n", timestamp);
+    } else {
+        invalidateLaps(timestamp);
     }
     return success;
 }
@@ -386,69 +418,80 @@ bool RaceHistory::updateLaps(uint32_t timestamp, const std::vector<uint32_t>& ne
 bool RaceHistory::clearAll() {
     #ifndef PIN_SD_CS
         // RAM-only mode: just clear memory.
-        races.clear();
+        ramRaces.clear();
+        ramLaps.clear();
         return true;
     #endif
-    
-    // Delete all race files
-    std::vector<String> files;
-    if (storage->listDir(RACES_DIR, files)) {
-        for (const String& filename : files) {
-            if (filename.endsWith(".json")) {
-                String filepath = String(RACES_DIR) + "/" + filename;
-                storage->deleteFile(filepath);
-            }
+
+    for (auto& slot : lapCache) {
+        slot.timestamp = 0;
+        std::vector<uint32_t>().swap(slot.lapTimes);
+    }
+    return store.clear();
+}
+
+void RaceHistory::toJson(Print& out, size_t offset, size_t limit, bool includeLaps) {
+    const std::vector<RaceSummary>& summaries = getRaces();
+    size_t total = summaries.size();
+    size_t end = (limit > total - std::min(offset, total)) ? total : offset + limit;
+
+    out.printf("{\"persistent\":%s,\"storage\":\"%s\",\"total\":%u,\"offset\":%u,\"races\":[",
+               isPersistenceEnabled() ? "true" : "false",
+               isPersistenceEnabled() ? "sd" : "ram",
+               total, offset);
+
+    // One small document per race keeps heap use flat regardless of race count
+    for (size_t i = offset; i < end; i++) {
+        const RaceSummary& race = summaries[i];
+        if (i > offset) {
+            out.print(',');
         }
+        raceToJson(out, race, includeLaps ? getLapTimes(race.timestamp) : nullptr, includeLaps);
     }
-    
-    races.clear();
-    return true;
+
+    out.print("]}");
 }
 
-String RaceHistory::toJsonString() {
-    DynamicJsonDocument doc(32768);
-    JsonArray racesArray = doc.createNestedArray("races");
-    
-    doc["persistent"] = isPersistenceEnabled();
-    doc["storage"] = isPersistenceEnabled() ? "sd" : "ram";
-
-    for (const auto& race : races) {
-        JsonObject raceObj = racesArray.createNestedObject();
-        raceObj["timestamp"] = race.timestamp;
-        raceObj["fastestLap"] = race.fastestLap;
-        raceObj["medianLap"] = race.medianLap;
-        raceObj["best3LapsTotal"] = race.best3LapsTotal;
-        raceObj["name"] = race.name;
-        raceObj["tag"] = race.tag;
-        raceObj["pilotName"] = race.pilotName;
-        raceObj["pilotCallsign"] = race.pilotCallsign;
-        raceObj["frequency"] = race.frequency;
-        raceObj["band"] = race.band;
-        raceObj["channel"] = race.channel;
-        raceObj["trackId"] = race.trackId;
-        raceObj["trackName"] = race.trackName;
-        raceObj["totalDistance"] = race.totalDistance;
-        
+void RaceHistory::raceToJson(Print& out, const RaceSummary& race, const std::vector<uint32_t>* lapTimes, bool includeLaps) {
+    DynamicJsonDocument doc(1024 + (lapTimes ? lapTimes->size() * 16 : 0));
+    JsonObject raceObj = doc.to<JsonObject>();
+    raceObj["timestamp"] = race.timestamp;
+    raceObj["fastestLap"] = race.fastestLap;
+    raceObj["medianLap"] = race.medianLap;
+    raceObj["best3LapsTotal"] = race.best3LapsTotal;
+    raceObj["lapCount"] = race.lapCount;
+    raceObj["totalTime"] = race.totalTime;
+    raceObj["name"] = race.name;
+    raceObj["tag"] = race.tag;
+    raceObj["pilotName"] = race.pilotName;
+    raceObj["pilotCallsign"] = race.pilotCallsign;
+    raceObj["frequency"] = race.frequency;
+    raceObj["band"] = race.band;
+    raceObj["channel"] = race.channel;
+    raceObj["trackId"] = race.trackId;
+    raceObj["trackName"] = race.trackName;
+    raceObj["totalDistance"] = race.totalDistance;
+
+    if (includeLaps) {
         JsonArray lapsArray = raceObj.createNestedArray("lapTimes");
-        for (uint32_t lap : race.lapTimes) {
-            lapsArray.add(lap);
+        if (lapTimes) {
+            for (uint32_t lap : *lapTimes) {
+                lapsArray.add(lap);
+            }
         }
     }
-    
-    String output;
-    serializeJson(doc, output);
-    return output;
+    serializeJson(doc, out);
 }
 
 bool RaceHistory::fromJsonString(const String& json) {
     DynamicJsonDocument doc(32768);
     DeserializationError error = deserializeJson(doc, json);
-    
+
     if (error) {
         DEBUG("Failed to parse races JSON: %s\n", error.c_str());
         return false;
     }
-    
+
     // Import races from JSON array
     JsonArray racesArray = doc["races"];
     int importedCount = 0;
@@ -456,81 +499,28 @@ bool RaceHistory::fromJsonString(const String& json) {
     #ifndef PIN_SD_CS
         // RAM-only mode: load just the first race into memory ("current race").
         if (racesArray.isNull() || racesArray.size() == 0) {
-            races.clear();
+            ramRaces.clear();
+            ramLaps.clear();
             return true;
         }
         {
-            JsonObject raceObj = racesArray[0];
             RaceSession race;
-            race.timestamp = raceObj["timestamp"] | 0;
-            race.fastestLap = raceObj["fastestLap"] | 0;
-            race.medianLap = raceObj["medianLap"] | 0;
-            race.best3LapsTotal = raceObj["best3LapsTotal"] | 0;
-            race.name = (const char*)(raceObj["name"] | "");
-            race.tag = (const char*)(raceObj["tag"] | "");
-            race.pilotName = (const char*)(raceObj["pilotName"] | "");
-            race.pilotCallsign = (const char*)(raceObj["pilotCallsign"] | "");
-            race.frequency = raceObj["frequency"] | 0;
-            race.band = (const char*)(raceObj["band"] | "");
-            race.channel = raceObj["channel"] | 0;
-            race.trackId = raceObj["trackId"] | 0;
-            race.trackName = (const char*)(raceObj["trackName"] | "");
-            race.totalDistance = raceObj["totalDistance"] | 0.0f;
-
-            race.lapTimes.clear();
-            if (raceObj.containsKey("lapTimes")) {
-                for (JsonVariant lap : raceObj["lapTimes"].as<JsonArray>()) {
-                    race.lapTimes.push_back(lap.as<uint32_t>());
-                }
-            }
-
-            races.clear();
-            races.push_back(race);
+            parseRace(racesArray[0], race);
+            saveRace(race);
         }
         return true;
     #endif
-    
+
     for (JsonObject raceObj : racesArray) {
         RaceSession race;
-        race.timestamp = raceObj["timestamp"];
-        race.fastestLap = raceObj["fastestLap"];
-        race.medianLap = raceObj["medianLap"];
-        race.best3LapsTotal = raceObj["best3LapsTotal"];
-        race.name = raceObj["name"] | "";
-        race.tag = raceObj["tag"] | "";
-        race.pilotName = raceObj["pilotName"] | "";
-        race.pilotCallsign = raceObj["pilotCallsign"] | "";
-        race.frequency = raceObj["frequency"] | 0;
-        race.band = raceObj["band"] | "";
-        race.channel = raceObj["channel"] | 0;
-        race.trackId = raceObj["trackId"] | 0;
-        race.trackName = raceObj["trackName"] | "";
-        race.totalDistance = raceObj["totalDistance"] | 0.0f;
-        
-        JsonArray lapsArray = raceObj["lapTimes"];
-        for (uint32_t lap : lapsArray) {
-            race.lapTimes.push_back(lap);
-        }
-        
-        // Check if race with this timestamp already exists
-        bool exists = false;
-        for (const auto& existingRace : races) {
-            if (existingRace.timestamp == race.timestamp) {
-                exists = true;
-                break;
-            }
-        }
-        
-        // Save to individual file if it doesn't exist
-        if (!exists && saveRace(race)) {
+        parseRace(raceObj, race);
+
+        // Skip races that are already stored
+        if (!findRace(race.timestamp) && saveRace(race)) {
             importedCount++;
         }
     }
-    
-    // Reload all races to update in-memory list
-    loadRaces();
-    
+
     DEBUG("Imported %d races\n", importedCount);
     return true;
 }
-
@@ -5,28 +5,39 @@
 #include <ArduinoJson.h>
 #include <vector>
 #include "storage.h"
+#include "racestore.h"
+#include "racestats.h"
+#include "fixedstring.h"
 
-#define MAX_RACES 50
+#define MAX_RACES 200           // Index entries kept (~190 bytes each); oldest race is dropped beyond this
 #define RACES_DIR "/races"
+#define RACE_LAP_CACHE_SIZE 4   // Races whose full lap data is kept in RAM
+#define RACES_PAGE_DEFAULT 25
 
+// Full race, used when saving/importing and when lap data is requested.
+// Strings are inline with the same capacities as the index entry, so the
+// only heap allocation per race is the lap vector.
 struct RaceSession {
     uint32_t timestamp;
     std::vector<uint32_t> lapTimes;
     uint32_t fastestLap;
     uint32_t medianLap;
     uint32_t best3LapsTotal;
-    String name;
-    String tag;
-    String pilotName;
-    String pilotCallsign;
+    FixedString<RACE_NAME_LEN> name;
+    FixedString<RACE_TAG_LEN> tag;
+    FixedString<RACE_PILOT_LEN> pilotName;
+    FixedString<RACE_PILOT_LEN> pilotCallsign;
     uint16_t frequency;
-    String band;
+    FixedString<RACE_BAND_LEN> band;
     uint8_t channel;
     uint32_t trackId;
-    String trackName;
+    FixedString<RACE_TRACK_NAME_LEN> trackName;
     float totalDistance;
 };
 
+// Lightweight, fixed-size per-race metadata kept in RAM for every race
+typedef RaceIndexEntry RaceSummary;
+
 class RaceHistory {
    public:
     RaceHistory();
@@ -37,15 +48,46 @@ class RaceHistory {
     bool updateRace(uint32_t timestamp, const String& name, const String& tag, float totalDistance = -1.0f);
     bool updateLaps(uint32_t timestamp, const std::vector<uint32_t>& newLapTimes);
     bool clearAll();
-    String toJsonString();
+
+    // Full race with lap times, served through the LRU lap cache
+    bool getRace(uint32_t timestamp, RaceSession& race);
+    const std::vector<uint32_t>* getLapTimes(uint32_t timestamp);
+
+    // Writes {"races":[...]} straight to the output, one race at a time.
+    // Summaries carry lapCount/totalTime; lapTimes only when includeLaps is set.
+    void toJson(Print& out, size_t offset = 0, size_t limit = SIZE_MAX, bool includeLaps = true);
+    // One race object as toJson() writes it (lapTimes may be null)
+    static void raceToJson(Print& out, const RaceSummary& race, const std::vector<uint32_t>* lapTimes, bool includeLaps);
     bool fromJsonString(const String& json);
-    const std::vector<RaceSession>& getRaces() const { return races; }
-    size_t getRaceCount() const { return races.size(); }
+
+    const std::vector<RaceSummary>& getRaces() const;
+    const RaceSummary* findRace(uint32_t timestamp) const;
+    size_t getRaceCount() const { return getRaces().size(); }
     bool isPersistenceEnabled() const;
 
    private:
-    std::vector<RaceSession> races;
+    struct LapCacheSlot {
+        uint32_t timestamp;  // 0 = empty
+        uint32_t lastUsed;
+        std::vector<uint32_t> lapTimes;
+    };
+
     Storage* storage;
+    RaceStore store;
+    LapCacheSlot lapCache[RACE_LAP_CACHE_SIZE];
+    uint32_t lapCacheTick;
+
+    // RAM-only mode (no SD): just the current race
+    std::vector<RaceSummary> ramRaces;
+    std::vector<uint32_t> ramLaps;
+
+    bool migrateJsonRaces();
+    void cacheLaps(uint32_t timestamp, const std::vector<uint32_t>& lapTimes);
+    void invalidateLaps(uint32_t timestamp);
+    static bool parseRace(JsonObject raceObj, RaceSession& race);
+    static void toEntry(const RaceSession& race, RaceIndexEntry& entry);
+    static void fromEntry(const RaceIndexEntry& entry, RaceSession& race);
+    static void calculateStats(RaceIndexEntry& entry, const std::vector<uint32_t>& lapTimes);
 };
 
 #endif
@@ -0,0 +1,170 @@
+#include "racejournal.h"
+#include "racehistory.h"
+#include "debug.h"
+
+RaceJournal::RaceJournal()
+    : storage(nullptr), queue(nullptr), pendingCount(0), oldestPendingMs(0), active(false), recoveryPending(false), dropped(0) {
+}
+
+void RaceJournal::init(Storage* storageBackend) {
+    storage = storageBackend;
+    if (storage) {
+        // Small and written throughout a race: keep it in flash, card or not
+        storage->setTier(RACE_JOURNAL_FILE, STORAGE_TIER_HOT);
+        storage->mkdir(RACES_DIR);
+    }
+    if (!queue) {
+        queue = xQueueCreate(RACE_JOURNAL_QUEUE_LEN, sizeof(RaceJournalRecord));
+        recoveryPending = true;
+    }
+}
+
+uint8_t RaceJournal::checksum(const RaceJournalRecord& record) {
+    uint8_t sum = record.type;
+    const uint8_t* value = (const uint8_t*)&record.value;
+    for (uint8_t i = 0; i < sizeof(record.value); i++) {
+        sum += value[i];
+    }
+    return ~sum;
+}
+
+void RaceJournal::post(uint8_t type, uint32_t value) {
+    if (!queue) return;
+    RaceJournalRecord record;
+    record.magic = RACE_JOURNAL_MAGIC;
+    record.type = type;
+    record.value = value;
+    record.checksum = checksum(record);
+    // Never wait: losing a journal record is better than delaying a lap
+    if (xQueueSend(queue, &record, 0) != pdTRUE) {
+        dropped++;
+    }
+}
+
+void RaceJournal::beginRace(uint32_t startEpoch) {
+    // Nothing sets the system clock, so only the client can say when a race began
+    post(JOURNAL_RACE_START, startEpoch >= RACE_JOURNAL_MIN_EPOCH ? startEpoch : 0);
+}
+
+void RaceJournal::recordLap(uint32_t lapTimeMs) {
+    post(JOURNAL_LAP, lapTimeMs);
+}
+
+void RaceJournal::endRace() {
+    post(JOURNAL_RACE_END, 0);
+}
+
+void RaceJournal::flush() {
+    if (pendingCount == 0) return;
+    if (!storage->appendBytes(RACE_JOURNAL_FILE, (const uint8_t*)pending, pendingCount * sizeof(RaceJournalRecord))) {
+        DEBUG("RaceJournal: Failed to append %u records\n", pendingCount);
+    }
+    pendingCount = 0;
+}
+
+void RaceJournal::process(uint32_t currentTimeMs) {
+    // Before recovery a RACE_START would delete the interrupted race's
+    // journal; its events wait in the queue (or are counted as dropped)
+    if (!queue || !storage || recoveryPending) return;
+
+    RaceJournalRecord record;
+    while (xQueueReceive(queue, &record, 0) == pdTRUE) {
+        switch (record.type) {
+            case JOURNAL_RACE_START:
+                // A new race replaces whatever was journaled before
+                pendingCount = 0;
+                storage->deleteFile(RACE_JOURNAL_FILE);
+                active = true;
+                break;
+            case JOURNAL_RACE_END:
+                // Clean stop: the journal has done its job
+                pendingCount = 0;
+                if (active) {
+                    storage->deleteFile(RACE_JOURNAL_FILE);
+                }
+                active = false;
+                continue;
+            default:
+                if (!active) continue;
+                break;
+        }
+
+        if (pendingCount == 0) {
+            oldestPendingMs = currentTimeMs;
+        }
+        pending[pendingCount++] = record;
+        if (pendingCount >= RACE_JOURNAL_BATCH_RECORDS) {
+            flush();
+        }
+    }
+
+    if (pendingCount > 0 && currentTimeMs - oldestPendingMs >= RACE_JOURNAL_FLUSH_MS) {
+        flush();
+    }
+}
+
+bool RaceJournal::recover(RaceHistory* history) {
+    bool recovered = recoverFile(history);
+    recoveryPending = false;
+    return recovered;
+}
+
+bool RaceJournal::recoverFile(RaceHistory* history) {
+    if (!storage || active || !storage->exists(RACE_JOURNAL_FILE)) {
+        return false;
+    }
+
+    size_t size = storage->fileSize(RACE_JOURNAL_FILE);
+    size_t count = size / sizeof(RaceJournalRecord);
+    std::vector<RaceJournalRecord> records(count);
+    if (count == 0 || storage->readBytes(RACE_JOURNAL_FILE, 0, (uint8_t*)records.data(), count * sizeof(RaceJournalRecord)) != count * sizeof(RaceJournalRecord)) {
+        storage->deleteFile(RACE_JOURNAL_FILE);
+        return false;
+    }
+
+    RaceSession race;
+    bool started = false;
+    race.timestamp = 0;
+    race.fastestLap = 0;
+    race.medianLap = 0;
+    race.best3LapsTotal = 0;
+    race.frequency = 0;
+    race.channel = 0;
+    race.trackId = 0;
+    race.totalDistance = 0.0f;
+
+    for (const auto& record : records) {
+        // Stop at the first torn or corrupt record
+        if (record.magic != RACE_JOURNAL_MAGIC || record.checksum != checksum(record)) {
+            break;
+        }
+        if (record.type == JOURNAL_RACE_START) {
+            started = true;
+            race.timestamp = record.value;
+            race.lapTimes.clear();
+        } else if (record.type == JOURNAL_LAP) {
+            race.lapTimes.push_back(record.value);
+        }
+    }
+
+    bool recovered = false;
+    if (started && !race.lapTimes.empty()) {
+        race.name = "Recovered race";
+        race.tag = "recovered";
+        if (race.timestamp == 0) {
+            // Start time unknown: list it right after the newest saved race
+            const std::vector<RaceSummary>& races = history->getRaces();
+            race.timestamp = races.empty() ? RACE_JOURNAL_MIN_EPOCH : races.front().timestamp + 1;
+            race.name = "Recovered race (start time unknown)";
+        }
+        // Timestamps identify races, so move off one that is already taken
+        while (history->findRace(race.timestamp)) {
+            race.timestamp++;
+        }
+        recovered = history->saveRace(race);
+        DEBUG("RaceJournal: Recovered interrupted race %u with %d laps\n", race.timestamp, race.lapTimes.size());
+    }
+
+    storage->deleteFile(RACE_JOURNAL_FILE);
+    return recovered;
+}
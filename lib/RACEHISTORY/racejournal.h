@@ -0,0 +1,77 @@
+#ifndef RACEJOURNAL_H
+#define RACEJOURNAL_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include "storage.h"
+
+class RaceHistory;
+
+/*
+ * Crash-safe journal of the race in progress
+ *
+ * The timing loop only posts events to a FreeRTOS queue (zero timeout, never
+ * blocks). process() runs on the core 0 task, batches the events and appends
+ * them to RACE_JOURNAL_FILE. A clean stop deletes the journal; a journal still
+ * present at boot is an interrupted race and is recovered into race history.
+ * Until recover() has run, process() leaves events queued, so a race started
+ * early cannot delete the previous race's journal first.
+ */
+
+#define RACE_JOURNAL_FILE "/races/current.jnl"
+#define RACE_JOURNAL_MAGIC 0x4A52         // "RJ"
+#define RACE_JOURNAL_QUEUE_LEN 32
+#define RACE_JOURNAL_BATCH_RECORDS 8      // Flush once this many records are pending...
+#define RACE_JOURNAL_FLUSH_MS 3000        // ...or the oldest pending record is this old
+#define RACE_JOURNAL_MIN_EPOCH 946684800  // 2000-01-01: anything earlier is time since boot, not a date
+
+typedef enum {
+    JOURNAL_RACE_START = 1,  // value = wall clock start time (epoch seconds), 0 if unknown
+    JOURNAL_LAP = 2,         // value = lap time in ms
+    JOURNAL_RACE_END = 3
+} race_journal_type_e;
+
+struct __attribute__((packed)) RaceJournalRecord {
+    uint16_t magic;
+    uint8_t type;
+    uint8_t checksum;  // Detects a torn final write after power loss
+    uint32_t value;
+};
+
+class RaceJournal {
+   public:
+    RaceJournal();
+    void init(Storage* storage);
+
+    // Called from the timing path - queue only, no I/O
+    void beginRace(uint32_t startEpoch);
+    void recordLap(uint32_t lapTimeMs);
+    void endRace();
+
+    // Called from the background task - does the batched flash writes
+    void process(uint32_t currentTimeMs);
+
+    // Saves an interrupted race into history and lets process() start.
+    // Returns true if one was recovered.
+    bool recover(RaceHistory* history);
+
+    uint32_t getDroppedCount() const { return dropped; }
+
+   private:
+    Storage* storage;
+    QueueHandle_t queue;
+    RaceJournalRecord pending[RACE_JOURNAL_BATCH_RECORDS];
+    uint8_t pendingCount;
+    uint32_t oldestPendingMs;
+    bool active;
+    volatile bool recoveryPending;  // Set by init(), cleared once recover() has run
+    volatile uint32_t dropped;
+
+    void post(uint8_t type, uint32_t value);
+    void flush();
+    bool recoverFile(RaceHistory* history);
+    static uint8_t checksum(const RaceJournalRecord& record);
+};
+
+#endif
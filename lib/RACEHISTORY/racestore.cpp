@@ -0,0 +1,535 @@
+#include "racestore.h"
+#include <algorithm>
+#include "debug.h"
+
+static size_t putVarint(uint32_t value, uint8_t* out, size_t outSize) {
+    size_t n = 0;
+    do {
+        if (n >= outSize) return 0;
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        if (value) byte |= 0x80;
+        out[n++] = byte;
+    } while (value);
+    return n;
+}
+
+static size_t getVarint(const uint8_t* in, size_t len, uint32_t& value) {
+    value = 0;
+    for (size_t n = 0; n < len && n < 5; n++) {
+        value |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+        if (!(in[n] & 0x80)) return n + 1;
+    }
+    return 0;  // Truncated or over-long varint
+}
+
+static inline uint32_t zigzagEncode(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t zigzagDecode(uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+// Offset of the next RACE_LOG_MAGIC at or after pos, or end if there is none
+static uint32_t nextMagic(File& log, uint32_t pos, uint32_t end) {
+    const uint32_t magic = RACE_LOG_MAGIC;
+    uint8_t buf[STORAGE_IO_BUFFER_SIZE];
+    while (pos + sizeof(magic) <= end && log.seek(pos)) {
+        size_t got = log.read(buf, std::min((uint32_t)sizeof(buf), end - pos));
+        if (got < sizeof(magic)) break;
+        for (size_t i = 0; i + sizeof(magic) <= got; i++) {
+            if (memcmp(buf + i, &magic, sizeof(magic)) == 0) {
+                return pos + i;
+            }
+        }
+        pos += got - (sizeof(magic) - 1);
+    }
+    return end;
+}
+
+RaceStore::RaceStore() : storage(nullptr), liveBytes(0), logBytes(0), indexReady(false) {
+}
+
+void RaceStore::init(Storage* storageBackend) {
+    storage = storageBackend;
+    if (storage) {
+        // Offsets in the index are only good for the log next to it
+        storage->setTier(RACE_STORE_PREFIX, STORAGE_TIER_BULK, TIER_FLAG_GROUP);
+    }
+}
+
+size_t RaceStore::encodeLaps(const std::vector<uint32_t>& lapTimes, uint8_t* out, size_t outSize) {
+    size_t pos = 0;
+    uint32_t prev = 0;
+    for (size_t i = 0; i < lapTimes.size(); i++) {
+        uint32_t value = (i == 0) ? lapTimes[0] : zigzagEncode((int32_t)(lapTimes[i] - prev));
+        size_t n = putVarint(value, out + pos, outSize - pos);
+        if (n == 0) return 0;
+        pos += n;
+        prev = lapTimes[i];
+    }
+    return pos;
+}
+
+bool RaceStore::decodeLaps(const uint8_t* in, size_t len, uint16_t lapCount, std::vector<uint32_t>& lapTimes) {
+    lapTimes.clear();
+    lapTimes.reserve(lapCount);
+    size_t pos = 0;
+    uint32_t prev = 0;
+    for (uint16_t i = 0; i < lapCount; i++) {
+        uint32_t value;
+        size_t n = getVarint(in + pos, len - pos, value);
+        if (n == 0) return false;
+        pos += n;
+        prev = (i == 0) ? value : (uint32_t)((int32_t)prev + zigzagDecode(value));
+        lapTimes.push_back(prev);
+    }
+    return pos == len;
+}
+
+// Live entries of races.idx, unsorted. False if the header is bad (out is
+// then empty) or the entries are cut short (out holds the complete ones).
+bool RaceStore::readIndex(std::vector<RaceIndexEntry>& out, bool& headerValid) {
+    out.clear();
+    headerValid = false;
+    File file = storage->openRead(RACE_INDEX_FILE);
+    if (!file) return false;
+
+    RaceIndexHeader header;
+    if (file.read((uint8_t*)&header, sizeof(header)) != sizeof(header)) {
+        file.close();
+        return false;
+    }
+    if (header.magic != RACE_INDEX_MAGIC || header.version != RACE_INDEX_VERSION ||
+        header.entrySize != sizeof(RaceIndexEntry)) {
+        DEBUG("RaceStore: Index header invalid (magic=%08X, version=%u, entrySize=%u)\n",
+              header.magic, header.version, header.entrySize);
+        file.close();
+        return false;
+    }
+    headerValid = true;
+
+    size_t count = (file.size() - sizeof(header)) / sizeof(RaceIndexEntry);
+    bool complete = (file.size() - sizeof(header)) % sizeof(RaceIndexEntry) == 0;
+
+    // One read for the whole index - entries are fixed size
+    out.resize(count);
+    size_t wanted = count * sizeof(RaceIndexEntry);
+    size_t got = count > 0 ? file.read((uint8_t*)out.data(), wanted) : 0;
+    file.close();
+    if (got != wanted) {
+        DEBUG("RaceStore: Short read on index\n");
+        out.resize(got / sizeof(RaceIndexEntry));
+        complete = false;
+    }
+
+    out.erase(std::remove_if(out.begin(), out.end(),
+        [](const RaceIndexEntry& e) { return e.flags & RACE_INDEX_FLAG_DELETED; }), out.end());
+    return complete;
+}
+
+// Every entry must point at its own record: a compaction cut short by a
+// reset leaves an index whose offsets belong to the log that never landed
+bool RaceStore::checkRecords() {
+    if (entries.empty()) return true;
+    File log = storage->openRead(RACE_LOG_FILE);
+    if (!log) {
+        DEBUG("RaceStore: Index lists %d races but there is no log\n", entries.size());
+        return false;
+    }
+    bool ok = true;
+    for (const auto& e : entries) {
+        RaceLogHeader header;
+        if ((uint64_t)e.offset + sizeof(header) + e.lapBytes > logBytes || !log.seek(e.offset) ||
+            log.read((uint8_t*)&header, sizeof(header)) != sizeof(header) || header.magic != RACE_LOG_MAGIC ||
+            header.timestamp != e.timestamp || header.lapCount != e.lapCount || header.lapBytes != e.lapBytes) {
+            DEBUG("RaceStore: Index entry for race %u does not match the log at %u\n", e.timestamp, e.offset);
+            ok = false;
+            break;
+        }
+    }
+    log.close();
+    return ok;
+}
+
+bool RaceStore::load() {
+    entries.clear();
+    liveBytes = 0;
+    logBytes = 0;
+    indexReady = false;
+
+    if (!storage) return false;
+
+    // Appends go to the end of whatever log is there, even without a usable index
+    logBytes = storage->fileSize(RACE_LOG_FILE);
+
+    bool headerValid;
+    if (!readIndex(entries, headerValid) || !checkRecords()) {
+        entries.clear();
+        return false;
+    }
+
+    std::sort(entries.begin(), entries.end(),
+        [](const RaceIndexEntry& a, const RaceIndexEntry& b) { return a.timestamp > b.timestamp; });
+
+    for (const auto& e : entries) {
+        liveBytes += sizeof(RaceLogHeader) + e.lapBytes;
+    }
+    indexReady = true;
+
+    DEBUG("RaceStore: Loaded index with %d races (log %u bytes, live %u bytes)\n",
+          entries.size(), logBytes, liveBytes);
+    return true;
+}
+
+bool RaceStore::rebuild(void (*fillStats)(RaceIndexEntry& entry, const std::vector<uint32_t>& lapTimes)) {
+    entries.clear();
+    liveBytes = 0;
+    logBytes = 0;
+    indexReady = false;
+
+    if (!storage) return false;
+    uint32_t start = millis();
+
+    // Whatever the old index still says. With an intact header it also says
+    // which races exist; if its tail was torn, records past the last one it
+    // knows were appended since and are kept as well.
+    std::vector<RaceIndexEntry> known;
+    bool headerValid;
+    bool complete = readIndex(known, headerValid);
+    uint32_t knownEnd = 0;
+    for (const auto& e : known) {
+        knownEnd = std::max(knownEnd, (uint32_t)(e.offset + sizeof(RaceLogHeader) + e.lapBytes));
+    }
+
+    // Edits append a new record, so the last record of a race is its live one.
+    // Unreadable bytes (a torn append that later records were written after)
+    // are skipped until the next record header.
+    std::vector<RaceIndexEntry> found;
+    uint32_t unreadable = 0;
+    size_t fileBytes = storage->fileSize(RACE_LOG_FILE);
+    File log = fileBytes > 0 ? storage->openRead(RACE_LOG_FILE) : File();
+    if (log) {
+        std::vector<uint8_t> payload;
+        std::vector<uint32_t> lapTimes;
+        uint32_t pos = 0;
+        while (pos + sizeof(RaceLogHeader) <= fileBytes) {
+            RaceLogHeader header;
+            bool valid = log.seek(pos) && log.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                         header.magic == RACE_LOG_MAGIC && header.lapCount <= RACE_MAX_LAPS &&
+                         pos + sizeof(header) + header.lapBytes <= fileBytes;
+            if (valid) {
+                payload.resize(header.lapBytes);
+                valid = log.read(payload.data(), header.lapBytes) == header.lapBytes &&
+                        decodeLaps(payload.data(), header.lapBytes, header.lapCount, lapTimes);
+            }
+            if (!valid) {
+                // Resume at the next byte that could start a record
+                uint32_t next = nextMagic(log, pos + 1, fileBytes);
+                unreadable += next - pos;
+                pos = next;
+                continue;
+            }
+
+            RaceIndexEntry entry;
+            memset(&entry, 0, sizeof(entry));
+            entry.timestamp = header.timestamp;
+            entry.offset = pos;
+            entry.lapCount = header.lapCount;
+            entry.lapBytes = header.lapBytes;
+            for (uint32_t lap : lapTimes) {
+                entry.totalTime += lap;
+            }
+            auto it = std::find_if(found.begin(), found.end(),
+                [&header](const RaceIndexEntry& e) { return e.timestamp == header.timestamp; });
+            if (it != found.end()) {
+                *it = entry;
+            } else {
+                found.push_back(entry);
+            }
+            pos += sizeof(header) + header.lapBytes;
+        }
+        if (pos < fileBytes) unreadable += fileBytes - pos;
+        log.close();
+    }
+
+    std::vector<uint32_t> lapTimes;
+    for (auto& entry : found) {
+        auto it = std::find_if(known.begin(), known.end(),
+            [&entry](const RaceIndexEntry& e) { return e.timestamp == entry.timestamp; });
+        if (it == known.end() && headerValid && (complete || entry.offset < knownEnd)) {
+            continue;  // Removed from the index, only its record was left behind
+        }
+        RaceIndexEntry located = entry;
+        if (it != known.end()) {
+            entry = *it;  // Name, pilot, track...
+            entry.offset = located.offset;
+            entry.lapCount = located.lapCount;
+            entry.lapBytes = located.lapBytes;
+            entry.totalTime = located.totalTime;
+            entry.flags = 0;
+        }
+        // Stats are only kept if they were worked out from these laps
+        bool statsValid = it != known.end() && it->lapCount == located.lapCount && it->lapBytes == located.lapBytes;
+        if (!statsValid && fillStats && readLaps(entry, lapTimes)) {
+            fillStats(entry, lapTimes);
+        }
+        entries.push_back(entry);
+        liveBytes += sizeof(RaceLogHeader) + entry.lapBytes;
+    }
+
+    std::sort(entries.begin(), entries.end(),
+        [](const RaceIndexEntry& a, const RaceIndexEntry& b) { return a.timestamp > b.timestamp; });
+
+    logBytes = fileBytes;
+    bool success;
+    if (unreadable > 0) {
+        // Rewrite the log without the damage, or the next rebuild trips on it again
+        DEBUG("RaceStore: Dropping %u unreadable bytes from the log\n", unreadable);
+        success = compact();
+    } else {
+        success = writeIndex();
+    }
+
+    DEBUG("RaceStore: Rebuilt index with %d races from %u log bytes in %ums\n",
+          entries.size(), fileBytes, millis() - start);
+    return success;
+}
+
+void RaceStore::insertSorted(const RaceIndexEntry& entry) {
+    auto pos = std::upper_bound(entries.begin(), entries.end(), entry,
+        [](const RaceIndexEntry& a, const RaceIndexEntry& b) { return a.timestamp > b.timestamp; });
+    entries.insert(pos, entry);
+}
+
+RaceIndexEntry* RaceStore::find(uint32_t timestamp) {
+    for (auto& e : entries) {
+        if (e.timestamp == timestamp) {
+            return &e;
+        }
+    }
+    return nullptr;
+}
+
+bool RaceStore::appendRecord(uint32_t timestamp, const std::vector<uint32_t>& lapTimes, uint32_t& offset, uint16_t& lapBytes) {
+    if (lapTimes.size() > RACE_MAX_LAPS) {
+        DEBUG("RaceStore: Too many laps (%d, max %d)\n", lapTimes.size(), RACE_MAX_LAPS);
+        return false;
+    }
+
+    // Worst case 5 bytes per varint
+    std::vector<uint8_t> record(sizeof(RaceLogHeader) + lapTimes.size() * 5);
+    size_t payload = encodeLaps(lapTimes, record.data() + sizeof(RaceLogHeader), record.size() - sizeof(RaceLogHeader));
+    if (payload == 0 && !lapTimes.empty()) {
+        return false;
+    }
+
+    RaceLogHeader header;
+    header.magic = RACE_LOG_MAGIC;
+    header.timestamp = timestamp;
+    header.lapCount = lapTimes.size();
+    header.lapBytes = payload;
+    memcpy(record.data(), &header, sizeof(header));
+
+    // Queued, not written: logBytes tracks the end of the log including
+    // records that are still in the write-behind queue
+    size_t recordSize = sizeof(RaceLogHeader) + payload;
+    offset = logBytes;
+    if (!storage->queueAppend(RACE_LOG_FILE, record.data(), recordSize)) {
+        DEBUG("RaceStore: Failed to append race record\n");
+        return false;
+    }
+
+    lapBytes = payload;
+    logBytes = offset + recordSize;
+    return true;
+}
+
+bool RaceStore::append(RaceIndexEntry& entry, const std::vector<uint32_t>& lapTimes) {
+    if (!storage) return false;
+    if (find(entry.timestamp)) {
+        DEBUG("RaceStore: Race %u already stored\n", entry.timestamp);
+        return false;
+    }
+
+    // Log first: an orphaned record is harmless, an index entry without data is not
+    if (!appendRecord(entry.timestamp, lapTimes, entry.offset, entry.lapBytes)) {
+        return false;
+    }
+    entry.lapCount = lapTimes.size();
+    entry.totalTime = 0;
+    for (uint32_t lap : lapTimes) {
+        entry.totalTime += lap;
+    }
+    entry.flags = 0;
+
+    // Without a usable index on disk (none yet, or unreadable) an appended
+    // entry would land behind a bad header: write the whole index instead
+    if (!indexReady) {
+        insertSorted(entry);
+        liveBytes += sizeof(RaceLogHeader) + entry.lapBytes;
+        return writeIndex();
+    }
+
+    // Queued after the log record; the write-behind queue keeps that order
+    if (!storage->queueAppend(RACE_INDEX_FILE, (const uint8_t*)&entry, sizeof(entry))) {
+        DEBUG("RaceStore: Failed to append index entry\n");
+        return false;
+    }
+
+    insertSorted(entry);
+    liveBytes += sizeof(RaceLogHeader) + entry.lapBytes;
+    return true;
+}
+
+bool RaceStore::writeIndex() {
+    // Streamed and committed atomically: a reset mid-write keeps the old index
+    StorageWriter writer;
+    if (!storage->openWrite(RACE_INDEX_FILE, writer)) {
+        return false;
+    }
+    RaceIndexHeader header = {RACE_INDEX_MAGIC, RACE_INDEX_VERSION, sizeof(RaceIndexEntry)};
+    writer.write((const uint8_t*)&header, sizeof(header));
+    if (!entries.empty()) {
+        writer.write((const uint8_t*)entries.data(), entries.size() * sizeof(RaceIndexEntry));
+    }
+    indexReady = writer.commit();
+    return indexReady;
+}
+
+bool RaceStore::update(const RaceIndexEntry& entry) {
+    RaceIndexEntry* target = find(entry.timestamp);
+    if (!target) return false;
+    *target = entry;
+    return writeIndex();
+}
+
+bool RaceStore::replaceLaps(RaceIndexEntry& entry, const std::vector<uint32_t>& lapTimes) {
+    RaceIndexEntry* target = find(entry.timestamp);
+    if (!target) return false;
+
+    uint32_t offset;
+    uint16_t lapBytes;
+    if (!appendRecord(entry.timestamp, lapTimes, offset, lapBytes)) {
+        return false;
+    }
+
+    liveBytes -= sizeof(RaceLogHeader) + target->lapBytes;
+    entry.offset = offset;
+    entry.lapBytes = lapBytes;
+    entry.lapCount = lapTimes.size();
+    entry.totalTime = 0;
+    for (uint32_t lap : lapTimes) {
+        entry.totalTime += lap;
+    }
+    *target = entry;
+    liveBytes += sizeof(RaceLogHeader) + lapBytes;
+
+    bool success = writeIndex();
+    maybeCompact();
+    return success;
+}
+
+bool RaceStore::remove(uint32_t timestamp) {
+    auto it = std::find_if(entries.begin(), entries.end(),
+        [timestamp](const RaceIndexEntry& e) { return e.timestamp == timestamp; });
+    if (it == entries.end()) return false;
+
+    liveBytes -= sizeof(RaceLogHeader) + it->lapBytes;
+    entries.erase(it);
+
+    bool success = writeIndex();
+    maybeCompact();
+    return success;
+}
+
+bool RaceStore::clear() {
+    entries.clear();
+    liveBytes = 0;
+    logBytes = 0;
+    indexReady = false;
+    if (!storage) return false;
+    storage->deleteFile(RACE_LOG_FILE);
+    storage->deleteFile(RACE_INDEX_FILE);
+    return true;
+}
+
+bool RaceStore::readLaps(const RaceIndexEntry& entry, std::vector<uint32_t>& lapTimes) {
+    lapTimes.clear();
+    if (!storage) return false;
+
+    std::vector<uint8_t> record(sizeof(RaceLogHeader) + entry.lapBytes);
+    if (storage->readBytes(RACE_LOG_FILE, entry.offset, record.data(), record.size()) != record.size()) {
+        DEBUG("RaceStore: Short read for race %u at %u\n", entry.timestamp, entry.offset);
+        return false;
+    }
+
+    RaceLogHeader header;
+    memcpy(&header, record.data(), sizeof(header));
+    if (header.magic != RACE_LOG_MAGIC || header.timestamp != entry.timestamp ||
+        header.lapCount != entry.lapCount || header.lapBytes != entry.lapBytes) {
+        DEBUG("RaceStore: Record mismatch for race %u at %u\n", entry.timestamp, entry.offset);
+        return false;
+    }
+
+    return decodeLaps(record.data() + sizeof(header), header.lapBytes, header.lapCount, lapTimes);
+}
+
+void RaceStore::maybeCompact() {
+    uint32_t garbage = logBytes > liveBytes ? logBytes - liveBytes : 0;
+    if (garbage >= RACE_COMPACT_MIN_GARBAGE && garbage > liveBytes) {
+        compact();
+    }
+}
+
+bool RaceStore::compact() {
+    DEBUG("RaceStore: Compacting log (%u bytes, %u live)\n", logBytes, liveBytes);
+    uint32_t start = millis();
+
+    File src = storage->openRead(RACE_LOG_FILE);
+    StorageWriter dst;
+    if (!src || !storage->openWrite(RACE_LOG_FILE, dst)) {
+        DEBUG("RaceStore: Failed to open log for compaction\n");
+        return false;
+    }
+
+    // Copy live records into a fresh log, recording their new offsets
+    std::vector<RaceIndexEntry> compacted = entries;
+    uint32_t newOffset = 0;
+    std::vector<uint8_t> record;
+    for (auto& e : compacted) {
+        size_t recordSize = sizeof(RaceLogHeader) + e.lapBytes;
+        record.resize(recordSize);
+        if (!src.seek(e.offset) || src.read(record.data(), recordSize) != recordSize ||
+            dst.write(record.data(), recordSize) != recordSize) {
+            DEBUG("RaceStore: Compaction failed for race %u\n", e.timestamp);
+            src.close();
+            return false;  // dst discards its temp file
+        }
+        e.offset = newOffset;
+        newOffset += recordSize;
+    }
+    src.close();
+
+    // Index first: if power fails before the new log is committed, the index
+    // points at records the old log doesn't have there, load() notices and
+    // rebuild() recovers the races from the old log
+    entries.swap(compacted);
+    if (!writeIndex()) {
+        DEBUG("RaceStore: Failed to write compacted index\n");
+        entries.swap(compacted);
+        return false;  // dst discards its temp file; the old index is untouched
+    }
+    if (!dst.commit()) {
+        DEBUG("RaceStore: Failed to commit compacted log\n");
+        entries.swap(compacted);
+        writeIndex();  // Back to the offsets in the log that is still there
+        return false;
+    }
+    logBytes = newOffset;
+    liveBytes = newOffset;
+
+    DEBUG("RaceStore: Compaction done in %ums (%u bytes)\n", millis() - start, newOffset);
+    return true;
+}
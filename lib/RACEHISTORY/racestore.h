@@ -0,0 +1,138 @@
+#ifndef RACESTORE_H
+#define RACESTORE_H
+
+#include <Arduino.h>
+#include <vector>
+#include "storage.h"
+
+/*
+ * Append-only binary race store
+ *
+ * Two files live in RACES_DIR:
+ *   races.log - append-only log of race records. Each record is a fixed
+ *               RaceLogHeader followed by the lap times encoded as varints
+ *               (first lap absolute, then zigzag deltas to the previous lap).
+ *   races.idx - small index: RaceIndexHeader followed by one fixed-size
+ *               RaceIndexEntry per race (metadata + offset into races.log).
+ *
+ * Boot only reads the index and checks each entry against its record header,
+ * so load time and heap do not depend on how many laps are stored. Lap data
+ * is read from the log on demand. Edits append a new record and repoint the
+ * index entry; the log is compacted once the garbage outweighs the live data.
+ * An index that is unreadable or points at the wrong records is rebuilt by
+ * scanning the log.
+ */
+
+#define RACE_LOG_FILE "/races/races.log"
+#define RACE_INDEX_FILE "/races/races.idx"
+#define RACE_STORE_PREFIX "/races/races."  // Both files, kept on one filesystem
+
+#define RACE_LOG_MAGIC 0x52435246    // "FRCR"
+#define RACE_INDEX_MAGIC 0x58495246  // "FRIX"
+#define RACE_INDEX_VERSION 1
+
+// Fixed string capacities (including terminator)
+#define RACE_NAME_LEN 33
+#define RACE_TAG_LEN 25
+#define RACE_PILOT_LEN 21
+#define RACE_BAND_LEN 8
+#define RACE_TRACK_NAME_LEN 33
+
+#define RACE_MAX_LAPS 1024
+#define RACE_COMPACT_MIN_GARBAGE 8192  // Don't compact for less than 8KB of garbage
+
+#define RACE_INDEX_FLAG_DELETED 0x01
+
+struct __attribute__((packed)) RaceLogHeader {
+    uint32_t magic;
+    uint32_t timestamp;
+    uint16_t lapCount;
+    uint16_t lapBytes;  // Size of the varint lap payload that follows
+};
+
+struct __attribute__((packed)) RaceIndexHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entrySize;  // sizeof(RaceIndexEntry), guards against layout changes
+};
+
+// Naturally aligned (no packing needed), so fields can be handed out by reference
+struct RaceIndexEntry {
+    uint32_t timestamp;
+    uint32_t offset;  // Offset of the RaceLogHeader in races.log
+    uint16_t lapCount;
+    uint16_t lapBytes;
+    uint32_t fastestLap;
+    uint32_t medianLap;
+    uint32_t best3LapsTotal;
+    uint32_t totalTime;  // Sum of all lap times
+    uint16_t frequency;
+    uint8_t channel;
+    uint8_t flags;
+    uint32_t trackId;
+    float totalDistance;
+    char name[RACE_NAME_LEN];
+    char tag[RACE_TAG_LEN];
+    char pilotName[RACE_PILOT_LEN];
+    char pilotCallsign[RACE_PILOT_LEN];
+    char band[RACE_BAND_LEN];
+    char trackName[RACE_TRACK_NAME_LEN];
+    uint8_t reserved[3];
+};
+static_assert(sizeof(RaceIndexEntry) == 184, "RaceIndexEntry is written to disk as-is");
+
+class RaceStore {
+   public:
+    RaceStore();
+    void init(Storage* storage);
+
+    // Reads races.idx and checks it against the log's record headers.
+    // Returns false if the index is missing, unreadable or out of step.
+    bool load();
+
+    // Recreates races.idx from races.log after load() failed. Metadata is
+    // kept from whatever index entries are still readable, and with an
+    // intact index header only its races are kept (deleted races stay
+    // deleted); races without metadata get their stats from fillStats.
+    // A torn log tail is cut off. With no log, writes an empty index.
+    bool rebuild(void (*fillStats)(RaceIndexEntry& entry, const std::vector<uint32_t>& lapTimes));
+
+    // Appends the laps to races.log and the entry to races.idx.
+    // entry.offset/lapCount/lapBytes/totalTime are filled in. Fails if a
+    // race with the same timestamp is already stored.
+    bool append(RaceIndexEntry& entry, const std::vector<uint32_t>& lapTimes);
+
+    // Metadata-only change: rewrites the (small) index.
+    bool update(const RaceIndexEntry& entry);
+
+    // Appends a new lap record and repoints the entry at it.
+    bool replaceLaps(RaceIndexEntry& entry, const std::vector<uint32_t>& lapTimes);
+
+    bool remove(uint32_t timestamp);
+    bool clear();
+
+    bool readLaps(const RaceIndexEntry& entry, std::vector<uint32_t>& lapTimes);
+
+    const std::vector<RaceIndexEntry>& getEntries() const { return entries; }
+    RaceIndexEntry* find(uint32_t timestamp);
+
+    static size_t encodeLaps(const std::vector<uint32_t>& lapTimes, uint8_t* out, size_t outSize);
+    static bool decodeLaps(const uint8_t* in, size_t len, uint16_t lapCount, std::vector<uint32_t>& lapTimes);
+
+   private:
+    Storage* storage;
+    std::vector<RaceIndexEntry> entries;  // Live entries only, newest first
+    uint32_t liveBytes;
+    uint32_t logBytes;
+    bool indexReady;  // races.idx matches entries, so appends can extend it
+
+    bool readIndex(std::vector<RaceIndexEntry>& out, bool& headerValid);
+    bool checkRecords();
+    bool writeIndex();
+    void insertSorted(const RaceIndexEntry& entry);
+    bool appendRecord(uint32_t timestamp, const std::vector<uint32_t>& lapTimes, uint32_t& offset, uint16_t& lapBytes);
+    void maybeCompact();
+    bool compact();
+};
+
+#endif
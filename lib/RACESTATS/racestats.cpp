@@ -0,0 +1,112 @@
+#include "racestats.h"
+#include <math.h>
+#include <algorithm>
+
+RaceStats::RaceStats() {
+    reset();
+}
+
+void RaceStats::reset() {
+    gateSeen = false;
+    lapCount = 0;
+    lastLap = 0;
+    fastestLap = 0;
+    fastestLapNo = 0;
+    sorted.clear();
+    memset(window, 0, sizeof(window));
+    windowSum = 0;
+    best3Consecutive = 0;
+    best3ConsecutiveStart = 0;
+    mean = 0.0;
+    m2 = 0.0;
+}
+
+RaceStats RaceStats::fromLaps(const std::vector<uint32_t>& lapTimes) {
+    RaceStats stats;
+    stats.sorted.reserve(lapTimes.size());
+    for (uint32_t lap : lapTimes) {
+        stats.addLap(lap);
+    }
+    return stats;
+}
+
+void RaceStats::addLap(uint32_t lapTimeMs) {
+    if (!gateSeen) {
+        // Gate 1 holeshot - not a full lap
+        gateSeen = true;
+        return;
+    }
+
+    lapCount++;
+    lastLap = lapTimeMs;
+
+    // Running fastest
+    if (lapCount == 1 || lapTimeMs < fastestLap) {
+        fastestLap = lapTimeMs;
+        fastestLapNo = lapCount;
+    }
+
+    // Order statistics: binary search for the slot, equal times keep lap order
+    SortedLap entry = {lapTimeMs, lapCount};
+    auto pos = std::upper_bound(sorted.begin(), sorted.end(), entry,
+        [](const SortedLap& a, const SortedLap& b) { return a.timeMs < b.timeMs; });
+    sorted.insert(pos, entry);
+
+    // Sliding window of the last three laps
+    uint8_t slot = (lapCount - 1) % 3;
+    windowSum = windowSum - window[slot] + lapTimeMs;
+    window[slot] = lapTimeMs;
+    if (lapCount >= 3 && (best3Consecutive == 0 || windowSum < best3Consecutive)) {
+        best3Consecutive = windowSum;
+        best3ConsecutiveStart = lapCount - 2;
+    }
+
+    // Welford's online mean/variance
+    double delta = lapTimeMs - mean;
+    mean += delta / lapCount;
+    m2 += delta * (lapTimeMs - mean);
+}
+
+uint32_t RaceStats::getMedianLap() const {
+    size_t n = sorted.size();
+    if (n == 0) return 0;
+    size_t mid = n / 2;
+    if (n % 2 == 0) {
+        return (sorted[mid - 1].timeMs + sorted[mid].timeMs) / 2;
+    }
+    return sorted[mid].timeMs;
+}
+
+uint32_t RaceStats::getBest3LapsTotal() const {
+    if (sorted.size() < 3) return 0;
+    return sorted[0].timeMs + sorted[1].timeMs + sorted[2].timeMs;
+}
+
+void RaceStats::getBest3LapNos(uint16_t lapNos[3]) const {
+    for (uint8_t i = 0; i < 3; i++) {
+        lapNos[i] = i < sorted.size() ? sorted[i].lapNo : 0;
+    }
+}
+
+uint32_t RaceStats::getStdDev() const {
+    if (lapCount < 2) return 0;
+    return (uint32_t)(sqrt(m2 / (lapCount - 1)) + 0.5);
+}
+
+size_t RaceStats::toJson(char* buf, size_t len) const {
+    uint16_t best3LapNos[3];
+    getBest3LapNos(best3LapNos);
+    int written = snprintf(buf, len,
+        "{\"lapCount\":%u,\"lastLap\":%u,\"fastestLap\":%u,\"fastestLapNo\":%u,"
+        "\"medianLap\":%u,\"best3LapsTotal\":%u,\"best3LapNos\":[%u,%u,%u],"
+        "\"best3Consecutive\":%u,\"best3ConsecutiveStart\":%u,"
+        "\"averageLap\":%u,\"stdDev\":%u}",
+        lapCount, lastLap, fastestLap, fastestLapNo,
+        getMedianLap(), getBest3LapsTotal(), best3LapNos[0], best3LapNos[1], best3LapNos[2],
+        best3Consecutive, best3ConsecutiveStart,
+        getAverageLap(), getStdDev());
+    if (written < 0 || (size_t)written >= len) {
+        return 0;
+    }
+    return written;
+}
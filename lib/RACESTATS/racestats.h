@@ -0,0 +1,69 @@
+#ifndef RACESTATS_H
+#define RACESTATS_H
+
+#include <Arduino.h>
+#include <vector>
+
+/*
+ * Incremental race statistics
+ *
+ * Updated once per lap in O(log n) search + O(n) shift (n = laps so far),
+ * instead of re-sorting every lap on every render:
+ *   - sorted lap list (order statistics) -> median, three fastest laps
+ *   - 3-lap sliding window               -> best consecutive 3 laps
+ *   - Welford running mean/variance     -> average, standard deviation
+ *
+ * The first pass after the start is the Gate 1 holeshot and is excluded,
+ * matching how the web UI has always shown stats.
+ */
+
+#define RACESTATS_JSON_SIZE 320
+
+class RaceStats {
+   public:
+    RaceStats();
+    void reset();
+    void addLap(uint32_t lapTimeMs);
+
+    // Builds stats from a complete lap list (index 0 = Gate 1)
+    static RaceStats fromLaps(const std::vector<uint32_t>& lapTimes);
+
+    uint16_t getLapCount() const { return lapCount; }  // Excludes Gate 1
+    uint32_t getLastLap() const { return lastLap; }
+    uint32_t getFastestLap() const { return fastestLap; }
+    uint16_t getFastestLapNo() const { return fastestLapNo; }
+    uint32_t getMedianLap() const;
+    uint32_t getBest3LapsTotal() const;  // Sum of the three fastest laps
+    void getBest3LapNos(uint16_t lapNos[3]) const;
+    uint32_t getBest3Consecutive() const { return best3Consecutive; }
+    uint16_t getBest3ConsecutiveStart() const { return best3ConsecutiveStart; }
+    uint32_t getAverageLap() const { return lapCount ? (uint32_t)(mean + 0.5) : 0; }
+    uint32_t getStdDev() const;
+
+    // {"lapCount":..,"fastestLap":..,...}; returns bytes written (0 if buf too small)
+    size_t toJson(char* buf, size_t len) const;
+
+   private:
+    struct SortedLap {
+        uint32_t timeMs;
+        uint16_t lapNo;
+    };
+
+    bool gateSeen;
+    uint16_t lapCount;
+    uint32_t lastLap;
+    uint32_t fastestLap;
+    uint16_t fastestLapNo;
+
+    std::vector<SortedLap> sorted;  // Ascending by time
+
+    uint32_t window[3];  // Last three laps, ring buffer
+    uint32_t windowSum;
+    uint32_t best3Consecutive;
+    uint16_t best3ConsecutiveStart;
+
+    double mean;
+    double m2;
+};
+
+#endif
@@ -0,0 +1,174 @@
+#ifdef ESP32S3
+
+#include "ledeffects.h"
+
+static uint8_t sineLut[256];        // 128 + 127 * sin(2 * pi * i / 256)
+static CRGB rainbowLut[256];        // Full-saturation hue wheel
+static CRGB oceanLut[256];          // Blue-cyan, indexed by wave height
+static uint8_t sparkleLut[LED_SPARKLE_FRAMES];  // Brightness by sparkle age
+
+void ledEffectsInit() {
+    for (int i = 0; i < 256; i++) {
+        sineLut[i] = 128 + (int)lroundf(127.0f * sinf(i * (2.0f * PI / 256.0f)));
+        hsv2rgb_rainbow(CHSV(i, 255, 255), rainbowLut[i]);
+        uint16_t value = 200 + i / 4;
+        hsv2rgb_rainbow(CHSV(160 + i / 8, 255, value > 255 ? 255 : value), oceanLut[i]);
+    }
+    // Each frame keeps ~61% of the last, what the old 10 ms fade of 200/256 did per 20 ms
+    float level = 255.0f;
+    for (int age = 0; age < LED_SPARKLE_FRAMES; age++) {
+        sparkleLut[age] = (uint8_t)level;
+        level *= 0.61f;
+    }
+}
+
+// Position-and-time hash standing in for random(): same input, same pixel
+static inline uint32_t pixelHash(uint32_t x, uint32_t y) {
+    uint32_t h = x * 0x9E3779B1u ^ y * 0x85EBCA77u;
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return h;
+}
+
+// Phase in the units the effects were tuned in: speed steps per 10 ms
+static inline uint32_t phaseOf(const LedEffectParams& p) {
+    return p.frame * p.speed * LED_FRAME_MS / 10;
+}
+
+// On/off state of a blink whose half-period was (base / speed) 10 ms ticks
+static inline bool blinkOn(const LedEffectParams& p, uint8_t base) {
+    uint32_t halfPeriodMs = (p.speed >= base ? 1 : base / p.speed) * 10;
+    return (p.frame * LED_FRAME_MS / halfPeriodMs) & 1;
+}
+
+static void fill(CRGB* px, uint16_t count, const CRGB& color) {
+    for (uint16_t i = 0; i < count; i++) px[i] = color;
+}
+
+static void effectOff(CRGB* px, uint16_t count, const LedEffectParams&) {
+    fill(px, count, CRGB::Black);
+}
+
+static void effectSolid(CRGB* px, uint16_t count, const LedEffectParams& p) {
+    fill(px, count, p.color);
+}
+
+static void effectPulse(CRGB* px, uint16_t count, const LedEffectParams& p) {
+    // Linear up/down ramp, as fast as the speed allows up to 10
+    uint8_t step = p.speed < 1 ? 1 : (p.speed > 10 ? 10 : p.speed);
+    uint32_t ramp = (p.frame * step * LED_FRAME_MS / 10) % 510;
+    CRGB color = p.color;
+    color.nscale8(ramp < 256 ? ramp : 510 - ramp);
+    fill(px, count, color);
+}
+
+static void effectFlash(CRGB* px, uint16_t count, const LedEffectParams& p) {
+    fill(px, count, (p.frame * LED_FRAME_MS / 100) & 1 ? CRGB::Black : p.color);
+}
+
+static void effectRainbow(CRGB* px, uint16_t count, const LedEffectParams& p) {
+    uint8_t hue = phaseOf(p);
+    for (uint16_t i = 0; i < count; i++) {
+        px[i] = rainbowLut[(uint8_t)(hue + i * LED_RAINBOW_SPREAD)];
+    }
+}
+
+static void effectSparkle(CRGB* px, uint16_t count, const LedEffectParams& p) {
+    for (uint16_t i = 0; i < count; i++) {
+        // Age of the pixel's most recent sparkle, looking back one fade
+        uint8_t age = 0;
+        while (age < LED_SPARKLE_FRAMES && (p.frame < age || pixelHash(i, p.frame - age) % LED_SPARKLE_CHANCE)) {
+            age++;
+        }
+        if (age == LED_SPARKLE_FRAMES) {
+            px[i] = CRGB::Black;
+        } else {
+            px[i] = p.color;
+            px[i].nscale8(sparkleLut[age]);
+        }
+    }
+}
+
+static void effectBreathing(CRGB* px, uint16_t count, const LedEffectParams& p) {
+    // One breath every 2.56 s whatever the speed, starting dark
+    uint8_t theta = p.frame * LED_FRAME_MS / 10 - 64;
+    CRGB color = p.color;
+    color.nscale8(sineLut[theta]);
+    fill(px, count, color);
+}
+
+static void effectChase(CRGB* px, uint16_t count, const LedEffectParams& p) {
+    // Blocks of three marching along the strip
+    uint32_t offset = phaseOf(p) / 16;
+    for (uint16_t i = 0; i < count; i++) {
+        px[i] = ((i + offset) / 3) & 1 ? CRGB::Black : p.color;
+    }
+}
+
+static void effectFire(CRGB* px, uint16_t count, const LedEffectParams& p) {
+    uint32_t tick = phaseOf(p) / 8;  // New flicker per pixel every frame at speed 5
+    for (uint16_t i = 0; i < count; i++) {
+        uint32_t h = pixelHash(i, tick);
+        px[i] = CRGB(200 + h % 56, 50 + (h >> 8) % 100, 0);
+    }
+}
+
+static void effectOcean(CRGB* px, uint16_t count, const LedEffectParams& p) {
+    uint8_t phase = phaseOf(p);
+    for (uint16_t i = 0; i < count; i++) {
+        px[i] = oceanLut[sineLut[(uint8_t)(phase + i * 8)]];
+    }
+}
+
+static void effectPolice(CRGB* px, uint16_t count, const LedEffectParams& p) {
+    // Halves swap red and blue
+    bool swap = blinkOn(p, 20);
+    uint16_t half = count / 2;
+    for (uint16_t i = 0; i < count; i++) {
+        px[i] = (i < half) != swap ? CRGB::Red : CRGB::Blue;
+    }
+}
+
+static void effectStrobe(CRGB* px, uint16_t count, const LedEffectParams& p) {
+    fill(px, count, blinkOn(p, 15) ? p.color : CRGB::Black);
+}
+
+static void effectComet(CRGB* px, uint16_t count, const LedEffectParams& p) {
+    // White head crossing the strip once per 256 phase units, fading tail behind
+    uint16_t tail = count / 8 < 2 ? 2 : count / 8;
+    uint32_t head = (phaseOf(p) & 0xFF) * count / 256;
+    for (uint16_t i = 0; i < count; i++) {
+        uint32_t behind = head >= i ? head - i : head + count - i;
+        uint8_t level = behind >= tail ? 0 : 255 - behind * 255 / tail;
+        px[i] = CRGB(level, level, level);
+    }
+}
+
+// Indexed by rgb_mode_e. Countdown and error blink are LED sequences now;
+// as plain modes they just show their colour.
+static const LedEffectFn EFFECTS[RGB_MODE_COUNT] = {
+    effectOff,        // RGB_OFF
+    effectSolid,      // RGB_SOLID
+    effectPulse,      // RGB_PULSE
+    effectFlash,      // RGB_FLASH
+    effectSolid,      // RGB_COUNTDOWN
+    effectRainbow,    // RGB_RAINBOW_WAVE
+    effectSparkle,    // RGB_SPARKLE
+    effectBreathing,  // RGB_BREATHING
+    effectChase,      // RGB_CHASE
+    effectSolid,      // RGB_ERROR_BLINK
+    effectFire,       // RGB_FIRE
+    effectOcean,      // RGB_OCEAN
+    effectPolice,     // RGB_POLICE
+    effectStrobe,     // RGB_STROBE
+    effectComet,      // RGB_COMET
+};
+
+LedEffectFn ledEffectFor(rgb_mode_e mode) {
+    return mode < RGB_MODE_COUNT ? EFFECTS[mode] : effectSolid;
+}
+
+#endif // ESP32S3
@@ -0,0 +1,50 @@
+#pragma once
+
+#ifdef ESP32S3
+
+#include <FastLED.h>
+
+// Effect generators for the RGB strip. Each one fills the whole buffer from
+// the frame number and its parameters alone (no state between frames), so
+// the engine can render any frame at any time and only has to compare
+// buffers to know whether the strip needs a show(). Per-pixel maths goes
+// through the lookup tables built by ledEffectsInit().
+
+#define LED_FRAME_MS 20           // Engine frame clock (50 fps)
+#define LED_RAINBOW_SPREAD 4      // Hue step between neighbouring pixels
+#define LED_SPARKLE_CHANCE 5      // 1 in N pixels light up per frame
+#define LED_SPARKLE_FRAMES 12     // Frames a sparkle takes to fade out
+
+typedef enum : uint8_t {
+    RGB_OFF,
+    RGB_SOLID,
+    RGB_PULSE,
+    RGB_FLASH,
+    RGB_COUNTDOWN,
+    RGB_RAINBOW_WAVE,
+    RGB_SPARKLE,
+    RGB_BREATHING,
+    RGB_CHASE,
+    RGB_ERROR_BLINK,
+    RGB_FIRE,
+    RGB_OCEAN,
+    RGB_POLICE,
+    RGB_STROBE,
+    RGB_COMET,
+    RGB_MODE_COUNT
+} rgb_mode_e;
+
+struct LedEffectParams {
+    CRGB color;
+    uint8_t speed;    // 1-20; phase units per 10 ms, as the old per-effect timers used
+    uint32_t frame;   // Frames since the effect started
+};
+
+typedef void (*LedEffectFn)(CRGB* px, uint16_t count, const LedEffectParams& p);
+
+// Builds the sine and palette tables; call once before rendering
+void ledEffectsInit();
+// Generator for a mode; modes without an animation of their own render solid
+LedEffectFn ledEffectFor(rgb_mode_e mode);
+
+#endif // ESP32S3
@@ -3,97 +3,163 @@
 #include "rgbled.h"
 #include "debug.h"
 
-#define PULSE_SPEED 5
 #define FLASH_DURATION_MS 200
-#define COUNTDOWN_PHASE_MS 1000  // 1 second per phase (Red, Yellow, Green)
+#define COUNTDOWN_PHASE_MS 1000  // 1 second per phase (Red, Yellow), green comes with the start
+#define SEQUENCE_SPEED 5         // Effect speed inside cues, so their timing is fixed
+
+// Cues played over the base effect. Brightness 0 in a step means the
+// configured brightness, without the in-race dimming.
+enum : uint8_t {
+    CUE_RACE_START,
+    CUE_LAP,
+    CUE_FINAL_LAP,
+    CUE_FINISH,
+    CUE_RACE_STOP,
+    CUE_COUNTDOWN,
+    CUE_CALIBRATION_START,
+    CUE_CALIBRATION_STOP,
+    CUE_CELEBRATE_LAP,
+    CUE_NEW_RECORD,
+    CUE_RACE_END,
+    CUE_ERROR_CODE,
+    CUE_COUNT
+};
+
+// Cue flags
+#define CUE_ALIGN_END 0x01  // The event time is when the cue ends (countdowns)
+#define CUE_HOLD 0x02       // Cues scheduled while it plays wait for it to end
+#define CUE_CLEARS 0x04     // Drops cues still waiting to start
+
+static const LedStep RACE_START_STEPS[] = {
+    {RGB_SOLID, 0x00FF00, 300, 0},
+    {RGB_OFF, 0, 3000, 0},  // Dark while the pilots launch
+};
+static const LedStep LAP_STEPS[] = {
+    {RGB_SOLID, LED_STEP_PILOT_COLOR, FLASH_DURATION_MS, 255},
+};
+static const LedStep FINAL_LAP_STEPS[] = {
+    {RGB_SOLID, LED_STEP_PILOT_COLOR, 100, 255}, {RGB_OFF, 0, 100, 0},
+    {RGB_SOLID, LED_STEP_PILOT_COLOR, 100, 255}, {RGB_OFF, 0, 100, 0},
+    {RGB_SOLID, 0xFFFFFF, 400, 255},  // White: one to go
+};
+static const LedStep FINISH_STEPS[] = {
+    {RGB_RAINBOW_WAVE, 0, 1500, 255},
+    {RGB_SPARKLE, LED_STEP_PILOT_COLOR, 1500, 255},
+};
+static const LedStep RACE_STOP_STEPS[] = {
+    {RGB_SOLID, 0xFF0000, 200, 0}, {RGB_OFF, 0, 200, 0},
+    {RGB_SOLID, 0xFF0000, 200, 0}, {RGB_OFF, 0, 200, 0},
+    {RGB_SOLID, 0xFF0000, 200, 0}, {RGB_OFF, 0, 3200, 0},
+};
+static const LedStep COUNTDOWN_STEPS[] = {
+    {RGB_SOLID, 0xFF0000, COUNTDOWN_PHASE_MS, 0},
+    {RGB_SOLID, 0xFFFF00, COUNTDOWN_PHASE_MS, 0},
+};
+static const LedStep CALIBRATION_START_STEPS[] = {
+    {RGB_SOLID, 0x00FF00, 300, 0},
+};
+static const LedStep CALIBRATION_STOP_STEPS[] = {
+    {RGB_SOLID, 0xFF0000, 200, 0}, {RGB_OFF, 0, 200, 0},
+    {RGB_SOLID, 0xFF0000, 200, 0},
+};
+static const LedStep CELEBRATE_LAP_STEPS[] = {
+    {RGB_SOLID, 0xFF0000, 50, 0}, {RGB_SOLID, 0xFFA500, 50, 0}, {RGB_SOLID, 0xFFFF00, 50, 0},
+    {RGB_SOLID, 0x00FF00, 50, 0}, {RGB_SOLID, 0x0000FF, 50, 0},
+};
+static const LedStep NEW_RECORD_STEPS[] = {
+    {RGB_SPARKLE, 0xFFD700, 2000, 0},
+};
+static const LedStep RACE_END_STEPS[] = {
+    {RGB_PULSE, 0x00FF00, 510, 0},  // One ramp up at SEQUENCE_SPEED
+    {RGB_SOLID, 0x00FF00, 500, 0},
+};
+static const LedStep ERROR_CODE_STEPS[] = {
+    {RGB_SOLID, 0xFF0000, 300, 0},
+    {RGB_OFF, 0, 300, 0},
+};
+
+#define STEPS(steps) steps, sizeof(steps) / sizeof(steps[0])
+
+// Indexed by the CUE_ ids
+static const struct {
+    const LedStep* steps;
+    uint8_t count;
+    int8_t raceState;  // Sets inRace when the cue starts: 1, 0, or -1 to leave it
+    uint8_t flags;
+} CUES[CUE_COUNT] = {
+    {STEPS(RACE_START_STEPS), 1, 0},
+    {STEPS(LAP_STEPS), -1, 0},
+    {STEPS(FINAL_LAP_STEPS), -1, 0},
+    {STEPS(FINISH_STEPS), 0, CUE_HOLD},
+    {STEPS(RACE_STOP_STEPS), 0, CUE_CLEARS},
+    {STEPS(COUNTDOWN_STEPS), -1, CUE_ALIGN_END},
+    {STEPS(CALIBRATION_START_STEPS), -1, 0},
+    {STEPS(CALIBRATION_STOP_STEPS), -1, CUE_CLEARS},
+    {STEPS(CELEBRATE_LAP_STEPS), -1, 0},
+    {STEPS(NEW_RECORD_STEPS), -1, 0},
+    {STEPS(RACE_END_STEPS), -1, 0},
+    {STEPS(ERROR_CODE_STEPS), -1, 0},
+};
+
+// Indexed by race_event_e
+static const uint8_t EVENT_CUES[] = {
+    CUE_COUNTDOWN,          // RACE_EVENT_COUNTDOWN
+    CUE_RACE_START,         // RACE_EVENT_START
+    CUE_LAP,                // RACE_EVENT_LAP
+    CUE_FINAL_LAP,          // RACE_EVENT_FINAL_LAP
+    CUE_FINISH,             // RACE_EVENT_FINISH
+    CUE_RACE_STOP,          // RACE_EVENT_STOP
+    CUE_CALIBRATION_START,  // RACE_EVENT_CALIBRATION_START
+    CUE_CALIBRATION_STOP,   // RACE_EVENT_CALIBRATION_STOP
+};
+
+static uint32_t passMsOf(uint8_t id) {
+    uint32_t ms = 0;
+    for (uint8_t i = 0; i < CUES[id].count; i++) {
+        ms += CUES[id].steps[i].ms;
+    }
+    return ms;
+}
+
+static CRGB toCrgb(uint32_t colorHex) {
+    return CRGB((colorHex >> 16) & 0xFF, (colorHex >> 8) & 0xFF, colorHex & 0xFF);
+}
+
+static uint32_t toHex(const CRGB& color) {
+    return ((uint32_t)color.r << 16) | ((uint32_t)color.g << 8) | color.b;
+}
 
 void RgbLed::init() {
+    ledEffectsInit();
     // GPIO5 for external NeoPixel strip - must be compile-time constant for FastLED template
     FastLED.addLeds<WS2812, 5, GRB>(leds, NUM_LEDS);
-    FastLED.setBrightness(80); // Medium-high brightness
-    // Initialize all LEDs to off
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = CRGB::Black;
-    }
+    fill_solid(leds, NUM_LEDS, CRGB::Black);
+    memcpy(shown, leds, sizeof(shown));
+    shownBrightness = brightness;
+    FastLED.setBrightness(brightness);
     FastLED.show();
-    DEBUG("RGB LED initialized on GPIO5 with %d LEDs\n", NUM_LEDS);
+    stats.ledCount = NUM_LEDS;
+
+    queue = xQueueCreate(RGB_LED_QUEUE_SIZE, sizeof(Command));
+    xTaskCreatePinnedToCore(taskMain, "rgbled", RGB_LED_TASK_STACK, this, RGB_LED_TASK_PRIORITY, &task, 0);
+    LOG_I(LOG_LED, "RGB LED initialized on GPIO5 with %d LEDs\n", NUM_LEDS);
 }
 
-void RgbLed::handleRgbLed(uint32_t currentTimeMs) {
-    // Check if we need to re-enable LEDs after temporary disable
-    if (temporarilyDisabled && currentTimeMs >= disableUntilMs) {
-        temporarilyDisabled = false;
-        if (inRace) {
-            // Resume at 50% brightness during race
-            FastLED.setBrightness(savedBrightness / 2);
-        }
-        restoreSavedState();
-        DEBUG("RGB LED: Re-enabled after delay\n");
-    }
-    
-    // If temporarily disabled, keep LEDs off
-    if (temporarilyDisabled) {
-        return;
-    }
-    
-    // Handle countdown sequence - priority, no latency
-    if (isCountdown) {
-        updateCountdown(currentTimeMs);
-        return;
-    }
-    
-    // Handle flash timeout - priority, check immediately for race events
-    if (isFlashing && (currentTimeMs - flashStartMs) > flashDuration) {
-        if (flashesRemaining > 0) {
-            // More flashes to do - toggle between on and off
-            flashesRemaining--;
-            flashStartMs = currentTimeMs;
-            CRGB color = (flashesRemaining % 2 == 0) ? flashColor : CRGB::Black;
-            for (int i = 0; i < NUM_LEDS; i++) {
-                leds[i] = color;
-            }
-            FastLED.show();
-        } else {
-            isFlashing = false;
-            // If we're entering a temporarily disabled period, turn LEDs off
-            if (temporarilyDisabled) {
-                for (int i = 0; i < NUM_LEDS; i++) {
-                    leds[i] = CRGB::Black;
-                }
-                FastLED.show();
-            } else {
-                restoreSavedState();  // Restore previous state after flash
-            }
-        }
+void RgbLed::post(CommandType type, uint32_t value, uint8_t arg, uint32_t timeMs) {
+    if (!queue) return;
+    Command cmd = {type, arg, value, timeMs};
+    // Never wait: callers include the timing loop
+    if (xQueueSend(queue, &cmd, 0) != pdTRUE) {
+        stats.queueDrops++;
     }
-    
-    // Update animations
-    updateAnimation(currentTimeMs);
+}
+
+void RgbLed::getStats(RgbLedStats& out) const {
+    out = stats;  // Counters only; a torn read is harmless
 }
 
 void RgbLed::setStatus(rgb_status_e status) {
-    // Don't override an active flash or countdown
-    if (isFlashing || isCountdown) {
-        return;
-    }
-    
-    // Don't override manual preset mode with non-critical status changes
-    // Allow race events (countdown, flashes) to override, but not connection status
-    if (manualOverride) {
-        // Only update status for race events, not connection status
-        if (status != STATUS_USER_CONNECTED && status != STATUS_BOOTING) {
-            DEBUG("RGB LED: Setting status to %d (manual override active, allowing race event)\n", status);
-            currentStatus = status;
-            applyStatus();
-        } else {
-            DEBUG("RGB LED: Ignoring status %d (manual override active)\n", status);
-        }
-        return;
-    }
-    
-    DEBUG("RGB LED: Setting status to %d\n", status);
-    currentStatus = status;
-    applyStatus();
+    post(CMD_STATUS, status);
 }
 
 void RgbLed::startCountdown() {
@@ -102,637 +168,432 @@ void RgbLed::startCountdown() {
 }
 
 void RgbLed::flashGreen() {
-    saveCurrentState();  // Save current state before event
-    savedBrightness = FastLED.getBrightness();
-    
-    // Flash green for race start
-    isFlashing = true;
-    flashStartMs = millis();
-    flashDuration = 300;  // 300ms flash
-    flashesRemaining = 0; // Single flash
-    flashColor = CRGB::Green;
-    currentMode = RGB_SOLID;
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = flashColor;
-    }
-    FastLED.show();
-    
-    // Schedule: After flash ends (300ms), disable LEDs for 3 seconds
-    temporarilyDisabled = true;
-    disableUntilMs = millis() + 300 + 3000; // flash duration + 3 seconds
-    inRace = true;
-    DEBUG("RGB LED: Race start flash, will disable for 3s then resume at 50%% brightness\n");
+    post(CMD_CUE, CUE_RACE_START, 0, millis());
 }
 
 void RgbLed::flashLap() {
-    saveCurrentState();  // Save current state before event
-    
-    // Save current brightness and set to maximum for bright flash
-    uint8_t currentBrightness = FastLED.getBrightness();
-    FastLED.setBrightness(255); // Full brightness for bright white flash
-    
-    isFlashing = true;
-    flashStartMs = millis();
-    flashDuration = FLASH_DURATION_MS;
-    flashesRemaining = 0; // Single flash
-    flashColor = CRGB::White;
-    currentMode = RGB_SOLID;
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = flashColor;
-    }
-    FastLED.show();
-    
-    // Schedule brightness restore after flash
-    // Note: brightness will be restored in restoreSavedState() based on inRace flag
-    DEBUG("RGB LED: Bright white lap flash at full brightness\n");
+    post(CMD_CUE, CUE_LAP, 0, millis());
 }
 
 void RgbLed::flashReset() {
-    saveCurrentState();  // Save current state before event
-    
-    // Flash red 3 times for race end
-    isFlashing = true;
-    flashStartMs = millis();
-    flashDuration = 200;  // 200ms per flash phase
-    flashesRemaining = 5; // 3 flashes = 6 phases (on-off-on-off-on-off)
-    flashColor = CRGB::Red;
-    currentMode = RGB_SOLID;
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = flashColor;
-    }
-    FastLED.show();
-    
-    // Schedule: After flashes end (200*6=1200ms), disable LEDs for 3 seconds
-    temporarilyDisabled = true;
-    disableUntilMs = millis() + (200 * 6) + 3000; // all flash phases + 3 seconds
-    inRace = false;
-    
-    // Restore normal brightness when re-enabling
-    FastLED.setBrightness(savedBrightness);
-    DEBUG("RGB LED: Race end flash, will disable for 3s then resume at normal brightness\n");
+    post(CMD_CUE, CUE_RACE_STOP, 0, millis());
 }
 
 void RgbLed::off() {
-    currentStatus = STATUS_OFF;
-    currentMode = RGB_OFF;
-    targetColor = CRGB::Black;
-    isCountdown = false;
-    isFlashing = false;
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = CRGB::Black;
-    }
-    FastLED.show();
+    post(CMD_OFF);
+}
+
+void RgbLed::celebrateLap(uint8_t lapNumber) {
+    post(CMD_CUE, CUE_CELEBRATE_LAP, 0, millis());
+}
+
+void RgbLed::celebrateRaceEnd(bool newRecord) {
+    post(CMD_CUE, newRecord ? CUE_NEW_RECORD : CUE_RACE_END, 0, millis());
+}
+
+void RgbLed::showErrorCode(uint8_t errorCode) {
+    if (errorCode == 0) return;
+    post(CMD_CUE, CUE_ERROR_CODE, errorCode - 1, millis());
 }
 
 void RgbLed::setColor(CRGB color, rgb_mode_e mode) {
-    targetColor = color;
-    currentMode = mode;
-    if (mode == RGB_SOLID) {
-        for (int i = 0; i < NUM_LEDS; i++) {
-            leds[i] = color;
-        }
-        FastLED.show();
-    }
+    post(CMD_COLOR, toHex(color), mode);
 }
 
 void RgbLed::setBrightness(uint8_t brightness) {
-    FastLED.setBrightness(brightness);
-    FastLED.show();
+    post(CMD_BRIGHTNESS, brightness);
 }
 
-void RgbLed::updateCountdown(uint32_t currentTimeMs) {
-    uint32_t elapsed = currentTimeMs - countdownStartMs;
-    uint32_t phaseTime = elapsed / COUNTDOWN_PHASE_MS;
-    
-    if (phaseTime != countdownPhase && phaseTime < 3) {
-        countdownPhase = phaseTime;
-        
-        // Update color based on phase
-        CRGB color;
-        switch (countdownPhase) {
-            case 0:  // RED
-                color = CRGB::Red;
-                break;
-            case 1:  // YELLOW
-                color = CRGB::Yellow;
-                break;
-            case 2:  // GREEN
-                color = CRGB::Green;
-                break;
+void RgbLed::setManualColor(uint32_t colorHex) {
+    post(CMD_MANUAL_COLOR, colorHex);
+}
+
+void RgbLed::setFadeColor(uint32_t colorHex) {
+    post(CMD_FADE_COLOR, colorHex);
+}
+
+void RgbLed::setStrobeColor(uint32_t colorHex) {
+    post(CMD_STROBE_COLOR, colorHex);
+}
+
+void RgbLed::setManualMode(rgb_mode_e mode) {
+    post(CMD_MODE, mode);
+}
+
+void RgbLed::setRainbowWave(uint8_t speed) {
+    post(CMD_RAINBOW, speed);
+}
+
+void RgbLed::setEffectSpeed(uint8_t speed) {
+    post(CMD_SPEED, speed);
+}
+
+void RgbLed::setPreset(led_preset_e preset) {
+    manualOverride = true;
+    post(CMD_PRESET, preset);
+}
+
+void RgbLed::onRaceEvent(const RaceEvent& event) {
+    if (event.type >= sizeof(EVENT_CUES)) return;
+    post(CMD_CUE, EVENT_CUES[event.type], 0, event.timeMs);
+}
+
+void RgbLed::taskMain(void* arg) {
+    static_cast<RgbLed*>(arg)->run();
+}
+
+void RgbLed::run() {
+    const TickType_t period = pdMS_TO_TICKS(LED_FRAME_MS);
+    TickType_t wake = xTaskGetTickCount();
+    for (;;) {
+        // Sleep until the next frame or the next cue start; commands wake
+        // the task early so a cue due now doesn't wait for the frame
+        TickType_t now = xTaskGetTickCount();
+        TickType_t untilFrame = (int32_t)(wake + period - now) > 0 ? wake + period - now : 0;
+        TickType_t wait = min(untilFrame, ticksUntilCue());
+        Command cmd;
+        if (wait > 0 && xQueueReceive(queue, &cmd, wait) == pdTRUE) {
+            apply(cmd);
+            continue;
+        }
+
+        now = xTaskGetTickCount();
+        bool frameDue = (int32_t)(now - (wake + period)) >= 0;
+        if (frameDue) {
+            wake += period;
+            if ((TickType_t)(now - wake) >= period) {
+                // A whole frame late: carry on from now rather than rendering a burst
+                stats.overruns++;
+                wake = now;
+            }
+        }
+
+        uint32_t start = micros();
+        while (xQueueReceive(queue, &cmd, 0) == pdTRUE) {
+            apply(cmd);
+        }
+        startDueCues();
+        renderFrame();
+        stats.lastRenderUs = micros() - start;
+        if (stats.lastRenderUs > stats.maxRenderUs) {
+            stats.maxRenderUs = stats.lastRenderUs;
         }
-        for (int i = 0; i < NUM_LEDS; i++) {
-            leds[i] = color;
+        showIfChanged();
+        if (frameDue) {
+            frame++;
+            stats.frames++;
         }
-        FastLED.show();
     }
-    
-    // After 3 seconds (3 phases), countdown is done
-    if (elapsed >= (COUNTDOWN_PHASE_MS * 3)) {
-        isCountdown = false;
-        setStatus(STATUS_RACE_RUNNING);
+}
+
+void RgbLed::apply(const Command& cmd) {
+    switch (cmd.type) {
+        case CMD_STATUS: {
+            rgb_status_e status = (rgb_status_e)cmd.value;
+            // Manual presets only give way to race events, not connection status
+            if (manualOverride && (status == STATUS_USER_CONNECTED || status == STATUS_BOOTING)) {
+                LOG_D(LOG_LED, "RGB LED: Ignoring status %d (manual override active)\n", status);
+                break;
+            }
+            LOG_D(LOG_LED, "RGB LED: Setting status to %d\n", status);
+            currentStatus = status;
+            applyStatus();
+            break;
+        }
+        case CMD_CUE:
+            scheduleCue(cmd.value, cmd.arg, cmd.timeMs);
+            break;
+        case CMD_OFF:
+            currentStatus = STATUS_OFF;
+            cuePlaying = false;
+            timelineCount = 0;
+            setBase(RGB_OFF, CRGB::Black);
+            break;
+        case CMD_COLOR:
+            setBase((rgb_mode_e)cmd.arg, toCrgb(cmd.value));
+            break;
+        case CMD_BRIGHTNESS:
+            brightness = cmd.value;
+            break;
+        case CMD_MANUAL_COLOR:
+            manualColor = toCrgb(cmd.value);
+            currentStatus = STATUS_OFF;
+            setBase(RGB_SOLID, manualColor);
+            LOG_D(LOG_LED, "RGB LED: Manual color set to #%06X\n", cmd.value);
+            break;
+        case CMD_FADE_COLOR:
+            fadeColor = toCrgb(cmd.value);
+            if (currentPreset == PRESET_COLOR_FADE && baseMode == RGB_PULSE) {
+                baseColor = fadeColor;
+            }
+            break;
+        case CMD_STROBE_COLOR:
+            strobeColor = toCrgb(cmd.value);
+            if (baseMode == RGB_STROBE) {
+                baseColor = strobeColor;
+            }
+            break;
+        case CMD_MODE:
+            currentStatus = STATUS_OFF;
+            setBase((rgb_mode_e)cmd.value, baseColor);
+            break;
+        case CMD_RAINBOW:
+            effectSpeed = cmd.value;
+            currentStatus = STATUS_OFF;
+            setBase(RGB_RAINBOW_WAVE, baseColor);
+            break;
+        case CMD_SPEED:
+            effectSpeed = constrain(cmd.value, 1, 20);
+            break;
+        case CMD_PRESET:
+            currentPreset = (led_preset_e)cmd.value;
+            LOG_D(LOG_LED, "RGB LED: Setting preset %d\n", currentPreset);
+            applyPreset(currentPreset);
+            break;
+        case CMD_PILOT_COLOR:
+            // A pilot without a colour still gets visible lap flashes
+            pilotColor = cmd.value ? toCrgb(cmd.value) : CRGB::White;
+            break;
     }
 }
 
+void RgbLed::setBase(rgb_mode_e mode, CRGB color) {
+    baseMode = mode;
+    baseColor = color;
+    baseStartFrame = frame;  // Effects restart from their first frame
+}
+
 void RgbLed::applyStatus() {
     switch (currentStatus) {
         case STATUS_BOOTING:
-            targetColor = CRGB::Blue;
-            currentMode = RGB_PULSE;
+            setBase(RGB_PULSE, CRGB::Blue);
             break;
-        
         case STATUS_USER_CONNECTED:
-            targetColor = CRGB::Green;
-            currentMode = RGB_SOLID;
-            for (int i = 0; i < NUM_LEDS; i++) {
-                leds[i] = targetColor;
-            }
-            FastLED.show();
+            setBase(RGB_SOLID, CRGB::Green);
+            break;
+        case STATUS_RACE_COUNTDOWN: {
+            // Red, yellow, then green and the race running look underneath
+            uint32_t goMs = millis() + 2 * COUNTDOWN_PHASE_MS;
+            setBase(RGB_SOLID, CRGB::Cyan);
+            scheduleCue(CUE_COUNTDOWN, 0, goMs);
+            scheduleCue(CUE_RACE_START, 0, goMs);
             break;
-        
+        }
         case STATUS_RACE_RUNNING:
-            targetColor = CRGB::Cyan;
-            currentMode = RGB_SOLID;
-            for (int i = 0; i < NUM_LEDS; i++) {
-                leds[i] = targetColor;
-            }
-            FastLED.show();
+            setBase(RGB_SOLID, CRGB::Cyan);
+            break;
+        case STATUS_LAP_FLASH:
+            scheduleCue(CUE_LAP, 0, millis());
             break;
-        
         case STATUS_RACE_END:
-            targetColor = CRGB::Blue;
-            currentMode = RGB_SOLID;
-            for (int i = 0; i < NUM_LEDS; i++) {
-                leds[i] = targetColor;
-            }
-            FastLED.show();
+            setBase(RGB_SOLID, CRGB::Blue);
             break;
-        
         case STATUS_BATTERY_ALARM:
-            targetColor = CRGB::Red;
-            currentMode = RGB_FLASH;
+            setBase(RGB_FLASH, CRGB::Red);
             break;
-        
         case STATUS_RACE_RESET:
         case STATUS_OFF:
         default:
-            off();
+            setBase(RGB_OFF, CRGB::Black);
             break;
     }
 }
 
-void RgbLed::updateRainbowWave() {
-    // Create rainbow wave effect - both LEDs same color
-    CRGB color = CHSV(rainbowHue, 255, 255);
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = color;
-    }
-    rainbowHue += rainbowSpeed;
-    FastLED.show();
-}
-
-void RgbLed::updateAnimation(uint32_t currentTimeMs) {
-    // Throttle updates to reduce CPU usage - BUT NOT for race events
-    // Race events (flashing) bypass this throttle entirely via direct FastLED.show()
-    // Reduced to 10ms for more responsive animations (was 20ms)
-    if (currentTimeMs - lastUpdateMs < 10) {
-        return;
-    }
-    lastUpdateMs = currentTimeMs;
-    
-    // Handle error blinking
-    if (currentMode == RGB_ERROR_BLINK) {
-        updateErrorBlink(currentTimeMs);
-        return;
-    }
-    
-    switch (currentMode) {
-        case RGB_RAINBOW_WAVE:
-            updateRainbowWave();
-            break;
-        
-        case RGB_SPARKLE:
-            updateSparkle();
-            break;
-        
-        case RGB_BREATHING:
-            updateBreathing();
-            break;
-        
-        case RGB_CHASE:
-            updateChase();
+void RgbLed::applyPreset(led_preset_e preset) {
+    switch (preset) {
+        case PRESET_OFF:
+            setBase(RGB_OFF, CRGB::Black);
             break;
-        
-        case RGB_FIRE:
-            updateFire();
+        case PRESET_SOLID_COLOUR:
+        case PRESET_PILOT_COLOUR:
+            // Manual color (or the pilot color set through it), solid
+            setBase(RGB_SOLID, manualColor);
             break;
-        
-        case RGB_OCEAN:
-            updateOcean();
+        case PRESET_RAINBOW:
+            setBase(RGB_RAINBOW_WAVE, baseColor);
             break;
-        
-        case RGB_POLICE:
-            updatePolice();
+        case PRESET_COLOR_FADE:
+            setBase(RGB_PULSE, fadeColor);
             break;
-        
-        case RGB_STROBE:
-            updateStrobe();
+        case PRESET_FIRE:
+            setBase(RGB_FIRE, baseColor);
             break;
-        
-        case RGB_COMET:
-            updateComet();
+        case PRESET_OCEAN:
+            setBase(RGB_OCEAN, baseColor);
             break;
-        
-        case RGB_PULSE: {
-            // Smooth pulsing effect - speed controlled by effectSpeed
-            uint8_t pulseSpeed = constrain(effectSpeed, 1, 10);
-            if (pulseDirection) {
-                pulseValue += pulseSpeed;
-                if (pulseValue >= 255) {
-                    pulseValue = 255;
-                    pulseDirection = false;
-                }
-            } else {
-                if (pulseValue < pulseSpeed) {
-                    pulseValue = 0;
-                    pulseDirection = true;
-                } else {
-                    pulseValue -= pulseSpeed;
-                }
-            }
-            for (int i = 0; i < NUM_LEDS; i++) {
-                leds[i] = targetColor;
-                leds[i].nscale8(pulseValue);
-            }
-            FastLED.show();
+        case PRESET_POLICE:
+            setBase(RGB_POLICE, baseColor);
             break;
-        }
-        
-        case RGB_FLASH: {
-            // Fast on/off flashing
-            static bool flashState = false;
-            flashState = !flashState;
-            CRGB color = flashState ? targetColor : CRGB::Black;
-            for (int i = 0; i < NUM_LEDS; i++) {
-                leds[i] = color;
-            }
-            FastLED.show();
+        case PRESET_STROBE:
+            setBase(RGB_STROBE, strobeColor);
             break;
-        }
-        
-        case RGB_SOLID:
-        case RGB_OFF:
-        case RGB_COUNTDOWN:
-        default:
-            // No animation needed
+        case PRESET_COMET:
+            setBase(RGB_COMET, baseColor);
             break;
     }
 }
 
-void RgbLed::setManualColor(uint32_t colorHex) {
-    uint8_t r = (colorHex >> 16) & 0xFF;
-    uint8_t g = (colorHex >> 8) & 0xFF;
-    uint8_t b = colorHex & 0xFF;
-    targetColor = CRGB(r, g, b);
-    currentMode = RGB_SOLID;
-    currentStatus = STATUS_OFF;
-    savedMode = RGB_SOLID;
-    savedColor = targetColor;
-    
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = targetColor;
+void RgbLed::scheduleCue(uint8_t id, uint8_t repeats, uint32_t atMs) {
+    if (id >= CUE_COUNT) return;
+    uint32_t startMs = atMs;
+    if (CUES[id].flags & CUE_ALIGN_END) {
+        // Ends on the event; announced late, it joins part way through
+        startMs -= passMsOf(id) * (repeats + 1);
     }
-    FastLED.show();
-    DEBUG("RGB LED: Manual color set to #%06X\n", colorHex);
-}
-
-void RgbLed::setFadeColor(uint32_t colorHex) {
-    uint8_t r = (colorHex >> 16) & 0xFF;
-    uint8_t g = (colorHex >> 8) & 0xFF;
-    uint8_t b = colorHex & 0xFF;
-    fadeColor = CRGB(r, g, b);
-    DEBUG("RGB LED: Fade color set to #%06X\n", colorHex);
-    
-    // If currently using COLOR_FADE preset, apply immediately
-    if (currentPreset == PRESET_COLOR_FADE) {
-        targetColor = fadeColor;
+    if (cuePlaying && (cue.flags & CUE_HOLD)) {
+        uint32_t endMs = cueStartMs + cuePassMs * (cue.repeats + 1);
+        if ((int32_t)(endMs - startMs) > 0) {
+            startMs = endMs;
+        }
     }
-}
-
-void RgbLed::setStrobeColor(uint32_t colorHex) {
-    uint8_t r = (colorHex >> 16) & 0xFF;
-    uint8_t g = (colorHex >> 8) & 0xFF;
-    uint8_t b = colorHex & 0xFF;
-    strobeColor = CRGB(r, g, b);
-    DEBUG("RGB LED: Strobe color set to #%06X\n", colorHex);
-}
-
-void RgbLed::setManualMode(rgb_mode_e mode) {
-    currentMode = mode;
-    currentStatus = STATUS_OFF;
-    savedMode = mode;
-    
-    if (mode == RGB_RAINBOW_WAVE) {
-        rainbowHue = 0;
-        DEBUG("RGB LED: Rainbow wave enabled\n");
-    } else if (mode == RGB_OFF) {
-        off();
+    if (CUES[id].flags & CUE_CLEARS) {
+        timelineCount = 0;
+    }
+    if (timelineCount == RGB_LED_TIMELINE_SLOTS) {
+        stats.cuesDropped++;
+        LOG_W(LOG_LED, "RGB LED: Cue timeline full, dropped cue %u\n", id);
+        return;
     }
-}
 
-void RgbLed::setRainbowWave(uint8_t speed) {
-    rainbowSpeed = speed;
-    effectSpeed = speed;
-    currentMode = RGB_RAINBOW_WAVE;
-    currentStatus = STATUS_OFF;
-    savedMode = RGB_RAINBOW_WAVE;
-    rainbowHue = 0;
-    DEBUG("RGB LED: Rainbow wave enabled (speed=%d)\n", speed);
+    // Keep the timeline sorted; cues due together play in arrival order
+    uint8_t slot = timelineCount;
+    while (slot > 0 && (int32_t)(timeline[slot - 1].startMs - startMs) > 0) {
+        timeline[slot] = timeline[slot - 1];
+        slot--;
+    }
+    timeline[slot].id = id;
+    timeline[slot].repeats = repeats;
+    timeline[slot].ahead = (int32_t)(startMs - millis()) > 0;
+    timeline[slot].startMs = startMs;
+    timelineCount++;
 }
 
-void RgbLed::setEffectSpeed(uint8_t speed) {
-    effectSpeed = constrain(speed, 1, 20);
-    rainbowSpeed = effectSpeed;
-    DEBUG("RGB LED: Effect speed set to %d\n", effectSpeed);
+void RgbLed::startDueCues() {
+    uint32_t now = millis();
+    while (timelineCount > 0 && (int32_t)(now - timeline[0].startMs) >= 0) {
+        ScheduledCue next = timeline[0];
+        timelineCount--;
+        memmove(timeline, timeline + 1, timelineCount * sizeof(timeline[0]));
+        if (next.ahead && now - next.startMs > stats.maxCueLateMs) {
+            stats.maxCueLateMs = now - next.startMs;
+        }
+        playCue(next);
+    }
 }
 
-void RgbLed::saveCurrentState() {
-    // Save current state before event (flash, countdown, etc.)
-    if (!isFlashing && !isCountdown) {
-        savedMode = currentMode;
-        savedColor = targetColor;
+void RgbLed::playCue(const ScheduledCue& next) {
+    // Replaces whatever cue was playing
+    cue.steps = CUES[next.id].steps;
+    cue.count = CUES[next.id].count;
+    cue.repeats = next.repeats;
+    cue.flags = CUES[next.id].flags;
+    cuePassMs = passMsOf(next.id);
+    if (CUES[next.id].raceState >= 0) {
+        inRace = CUES[next.id].raceState;
     }
+    cueStartMs = next.startMs;
+    cuePlaying = true;
+    stats.cuesPlayed++;
 }
 
-void RgbLed::restoreSavedState() {
-    // Restore brightness based on race state
-    if (inRace) {
-        // During race: use 50% brightness
-        FastLED.setBrightness(savedBrightness / 2);
-    } else {
-        // Not in race: use normal brightness
-        FastLED.setBrightness(savedBrightness);
-    }
-    
-    // Restore state after event
+void RgbLed::finishCue() {
+    cuePlaying = false;
     if (manualOverride) {
         applyPreset(currentPreset);
-        return;
-    }
-    
-    currentMode = savedMode;
-    targetColor = savedColor;
-    
-    if (currentMode == RGB_SOLID) {
-        for (int i = 0; i < NUM_LEDS; i++) {
-            leds[i] = targetColor;
-        }
-        FastLED.show();
-    } else if (currentMode == RGB_OFF) {
-        off();
     }
 }
 
-void RgbLed::celebrateLap(uint8_t lapNumber) {
-    saveCurrentState();
-    // Quick rainbow flash sequence
-    CRGB colors[] = {CRGB::Red, CRGB::Orange, CRGB::Yellow, CRGB::Green, CRGB::Blue};
-    for (int c = 0; c < 5; c++) {
-        for (int i = 0; i < NUM_LEDS; i++) {
-            leds[i] = colors[c];
-        }
-        FastLED.show();
-        delay(50);
-    }
-    restoreSavedState();
+TickType_t RgbLed::ticksUntilCue() const {
+    if (timelineCount == 0) return portMAX_DELAY;
+    int32_t ms = timeline[0].startMs - millis();
+    if (ms <= 0) return 0;
+    TickType_t ticks = pdMS_TO_TICKS(ms);
+    return ticks > 0 ? ticks : 1;
 }
 
-void RgbLed::celebrateRaceEnd(bool newRecord) {
-    saveCurrentState();
-    if (newRecord) {
-        // Gold sparkle effect for new record
-        for (int loop = 0; loop < 20; loop++) {
-            for (int i = 0; i < NUM_LEDS; i++) {
-                leds[i] = (random(0, 3) == 0) ? CRGB(255, 215, 0) : CRGB::Black;
-            }
-            FastLED.show();
-            delay(100);
-        }
-    } else {
-        // Green pulse for race completion
-        for (int brightness = 0; brightness < 255; brightness += 5) {
-            for (int i = 0; i < NUM_LEDS; i++) {
-                leds[i] = CRGB(0, brightness, 0);
+void RgbLed::renderFrame() {
+    if (cuePlaying) {
+        uint32_t elapsed = millis() - cueStartMs;
+        if (elapsed >= cuePassMs * (cue.repeats + 1)) {
+            finishCue();
+        } else {
+            elapsed %= cuePassMs;
+            const LedStep* step = cue.steps;
+            while (elapsed >= step->ms) {
+                elapsed -= step->ms;
+                step++;
             }
-            FastLED.show();
-            delay(10);
+            CRGB color = step->color == LED_STEP_PILOT_COLOR ? pilotColor : toCrgb(step->color);
+            LedEffectParams params = {color, SEQUENCE_SPEED, elapsed / LED_FRAME_MS};
+            ledEffectFor(step->mode)(leds, NUM_LEDS, params);
+            frameBrightness = step->brightness ? step->brightness : brightness;
+            return;
         }
-        delay(500);
-    }
-    restoreSavedState();
-}
-
-void RgbLed::showErrorCode(uint8_t errorCode) {
-    DEBUG("RGB LED: Showing error code %d\n", errorCode);
-    errorBlinkCount = errorCode;
-    errorBlinksRemaining = errorCode * 2; // On + off = 2 blinks per code
-    errorBlinkTime = millis();
-    currentMode = RGB_ERROR_BLINK;
-}
-
-void RgbLed::updateErrorBlink(uint32_t currentTimeMs) {
-    if (currentTimeMs - errorBlinkTime < 300) return;
-    
-    errorBlinkTime = currentTimeMs;
-    errorBlinksRemaining--;
-    
-    if (errorBlinksRemaining <= 0) {
-        restoreSavedState();
-        return;
-    }
-    
-    // Toggle red on/off
-    CRGB color = (errorBlinksRemaining % 2 == 0) ? CRGB::Red : CRGB::Black;
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = color;
     }
-    FastLED.show();
+    LedEffectParams params = {baseColor, effectSpeed ? effectSpeed : (uint8_t)1, frame - baseStartFrame};
+    ledEffectFor(baseMode)(leds, NUM_LEDS, params);
+    frameBrightness = baseBrightness();
 }
 
-void RgbLed::updateSparkle() {
-    // Both LEDs sparkle together
-    CRGB color;
-    if (random(0, 10) == 0) {
-        color = targetColor;
-    } else {
-        color = leds[0];
-        color.nscale8(200); // Fade
-    }
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = color;
+void RgbLed::showIfChanged() {
+    if (frameBrightness == shownBrightness && memcmp(leds, shown, sizeof(shown)) == 0) {
+        return;  // Static effects cost one compare per frame
     }
+    uint32_t start = micros();
+    FastLED.setBrightness(frameBrightness);
     FastLED.show();
-}
-
-void RgbLed::updateBreathing() {
-    static uint8_t breath = 0;
-    static bool breathDir = true;
-    
-    if (breathDir) {
-        breath += 2;
-        if (breath >= 255) breathDir = false;
-    } else {
-        breath -= 2;
-        if (breath == 0) breathDir = true;
-    }
-    
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = targetColor;
-        leds[i].nscale8(breath);
+    stats.lastShowUs = micros() - start;
+    if (stats.lastShowUs > stats.maxShowUs) {
+        stats.maxShowUs = stats.lastShowUs;
     }
-    FastLED.show();
+    stats.shows++;
+    memcpy(shown, leds, sizeof(shown));
+    shownBrightness = frameBrightness;
 }
 
-void RgbLed::updateChase() {
-    // Both LEDs chase together (on/off blinking)
-    static bool chaseState = false;
-    chaseState = !chaseState;
-    CRGB color = chaseState ? targetColor : CRGB::Black;
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = color;
-    }
-    FastLED.show();
-}
+void RgbLed::onConfigChanged(Config& config, uint8_t groups) {
+    bool all = !configApplied;
+    configApplied = true;
 
-void RgbLed::updateFire() {
-    // Fire effect - warm flickering
-    firePhase += effectSpeed;
-    uint8_t red = 200 + random(0, 56);    // 200-255
-    uint8_t green = 50 + random(0, 100);   // 50-150  
-    uint8_t blue = 0;
-    
-    CRGB color = CRGB(red, green, blue);
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = color;
+    if (all || applied.brightness != config.getLedBrightness()) {
+        applied.brightness = config.getLedBrightness();
+        setBrightness(applied.brightness);
     }
-    FastLED.show();
-}
-
-void RgbLed::updateOcean() {
-    // Ocean effect - cool blue/cyan waves
-    oceanPhase += effectSpeed;
-    uint8_t wave = sin8(oceanPhase);
-    
-    CRGB color = CHSV(160 + (wave / 8), 255, 200 + (wave / 4)); // Blue-cyan range
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = color;
+    if (all || applied.speed != config.getLedSpeed()) {
+        applied.speed = config.getLedSpeed();
+        setEffectSpeed(applied.speed);
     }
-    FastLED.show();
-}
 
-void RgbLed::updatePolice() {
-    // Police lights - red/blue alternating (slower for visibility)
-    static uint8_t policeCounter = 0;
-    policeCounter++;
-    
-    // Toggle every 20 frames for slower effect (was every frame)
-    if (policeCounter >= (20 / effectSpeed)) {
-        policeCounter = 0;
-        policeState = !policeState;
+    bool look = all;
+    if (all || applied.color != config.getLedColor()) {
+        applied.color = config.getLedColor();
+        setManualColor(applied.color);
+        look = true;
     }
-    
-    CRGB color = policeState ? CRGB::Red : CRGB::Blue;
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = color;
+    if (all || applied.fadeColor != config.getLedFadeColor()) {
+        applied.fadeColor = config.getLedFadeColor();
+        setFadeColor(applied.fadeColor);
+        look = true;
     }
-    FastLED.show();
-}
-
-void RgbLed::updateStrobe() {
-    // Strobe effect - customizable color flashing (slower for visibility)
-    static uint8_t strobeCounter = 0;
-    static bool strobeState = false;
-    strobeCounter++;
-    
-    // Toggle every 15 frames for slower effect (was every frame)
-    if (strobeCounter >= (15 / effectSpeed)) {
-        strobeCounter = 0;
-        strobeState = !strobeState;
+    if (all || applied.strobeColor != config.getLedStrobeColor()) {
+        applied.strobeColor = config.getLedStrobeColor();
+        setStrobeColor(applied.strobeColor);
+        look = true;
     }
-    
-    CRGB color = strobeState ? strobeColor : CRGB::Black;
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = color;
+    if (all || applied.manualOverride != config.getLedManualOverride()) {
+        applied.manualOverride = config.getLedManualOverride();
+        enableManualOverride(applied.manualOverride);
     }
-    FastLED.show();
-}
 
-void RgbLed::updateComet() {
-    // Comet effect - shooting star
-    cometPos += effectSpeed;
-    if (cometPos > 255) cometPos = 0;
-    
-    // Create a fading tail effect
-    uint8_t brightness = cometPos > 200 ? 255 - (cometPos - 200) * 4 : 255;
-    CRGB color = CRGB(brightness, brightness, brightness);
-    
-    for (int i = 0; i < NUM_LEDS; i++) {
-        leds[i] = color;
+    if (all || applied.pilotColor != config.getPilotColor()) {
+        applied.pilotColor = config.getPilotColor();
+        post(CMD_PILOT_COLOR, applied.pilotColor);
     }
-    FastLED.show();
-}
 
-void RgbLed::setPreset(led_preset_e preset) {
-    currentPreset = preset;
-    manualOverride = true;
-    DEBUG("RGB LED: Setting preset %d\n", preset);
-    applyPreset(preset);
-}
-
-void RgbLed::applyPreset(led_preset_e preset) {
-    switch(preset) {
-        case PRESET_OFF:
-            off();
-            break;
-        case PRESET_SOLID_COLOUR:
-            // Use currently set manual color (solid)
-            currentMode = RGB_SOLID;
-            for (int i = 0; i < NUM_LEDS; i++) leds[i] = targetColor;
-            FastLED.show();
-            break;
-        case PRESET_RAINBOW:
-            setRainbowWave(effectSpeed);
-            break;
-        case PRESET_COLOR_FADE:
-            // Pulse the fade color (customizable)
-            targetColor = fadeColor;
-            currentMode = RGB_PULSE;
-            break;
-        case PRESET_FIRE:
-            currentMode = RGB_FIRE;
-            firePhase = 0;
-            break;
-        case PRESET_OCEAN:
-            currentMode = RGB_OCEAN;
-            oceanPhase = 0;
-            break;
-        case PRESET_POLICE:
-            currentMode = RGB_POLICE;
-            policeState = false;
-            break;
-        case PRESET_STROBE:
-            // Use custom strobe color
-            currentMode = RGB_STROBE;
-            break;
-        case PRESET_COMET:
-            currentMode = RGB_COMET;
-            cometPos = 0;
-            break;
-        case PRESET_PILOT_COLOUR:
-            // Use currently set manual color (pilot color) as solid
-            currentMode = RGB_SOLID;
-            for (int i = 0; i < NUM_LEDS; i++) leds[i] = targetColor;
-            FastLED.show();
-            break;
+    // Preset last so it runs with the current colours
+    if (look || applied.preset != config.getLedPreset()) {
+        applied.preset = config.getLedPreset();
+        setPreset((led_preset_e)applied.preset);
     }
 }
 
@@ -5,25 +5,20 @@
 #include <Arduino.h>
 #include <FastLED.h>
 
-#define NUM_LEDS 2
+#include "config.h"
+#include "ledeffects.h"
+#include "raceevents.h"
 
-typedef enum {
-    RGB_OFF,
-    RGB_SOLID,
-    RGB_PULSE,
-    RGB_FLASH,
-    RGB_COUNTDOWN,
-    RGB_RAINBOW_WAVE,
-    RGB_SPARKLE,
-    RGB_BREATHING,
-    RGB_CHASE,
-    RGB_ERROR_BLINK,
-    RGB_FIRE,
-    RGB_OCEAN,
-    RGB_POLICE,
-    RGB_STROBE,
-    RGB_COMET
-} rgb_mode_e;
+// Pixels on the strip; -DRGB_LED_COUNT=300 for a gate strip
+#ifndef RGB_LED_COUNT
+#define RGB_LED_COUNT 2
+#endif
+#define NUM_LEDS RGB_LED_COUNT
+
+#define RGB_LED_QUEUE_SIZE 16
+#define RGB_LED_TASK_STACK 3072
+#define RGB_LED_TASK_PRIORITY 1  // Above parallelTask, which never blocks
+#define RGB_LED_TIMELINE_SLOTS 4  // Cues waiting for their start time
 
 typedef enum {
     PRESET_OFF = 0,
@@ -50,10 +45,44 @@ typedef enum {
     STATUS_OFF
 } rgb_status_e;
 
-class RgbLed {
+// Per-frame cost of the engine, in the style of the other subsystem stats
+struct RgbLedStats {
+    uint32_t frames;
+    uint32_t shows;          // Frames that changed the strip
+    uint32_t overruns;       // Frames that started late
+    uint32_t queueDrops;     // Commands lost to a full queue
+    uint32_t cuesPlayed;
+    uint32_t cuesDropped;    // Cues lost to a full timeline
+    uint32_t maxCueLateMs;   // Worst start of a cue scheduled ahead of time
+    uint32_t lastRenderUs;
+    uint32_t maxRenderUs;
+    uint32_t lastShowUs;
+    uint32_t maxShowUs;
+    uint16_t ledCount;
+};
+
+// Step colour standing for the pilot colour (white until one is configured)
+#define LED_STEP_PILOT_COLOR 0xFF000000
+
+// One step of an LED cue: a mode and colour held for a while, optionally at
+// its own brightness (0 = the current one)
+struct LedStep {
+    rgb_mode_e mode;
+    uint32_t color;   // 0xRRGGBB or LED_STEP_PILOT_COLOR
+    uint16_t ms;
+    uint8_t brightness;
+};
+
+// All FastLED work happens in the engine task, which renders one frame every
+// LED_FRAME_MS: a cue step if one is playing, the base effect otherwise.
+// Race events become cues on a small timeline keyed by start time; the task
+// wakes for the next frame or the next cue start, whichever comes first, so
+// a cue starts on its millisecond rather than on the next frame boundary.
+// The public methods only queue a command, so they're safe to call from any
+// task (including the timing loop) and never wait on the strip.
+class RgbLed : public ConfigListener, public RaceEventListener {
    public:
     void init();
-    void handleRgbLed(uint32_t currentTimeMs);
     
     // Status-based methods
     void setStatus(rgb_status_e status);
@@ -79,84 +108,126 @@ class RgbLed {
     void setManualMode(rgb_mode_e mode);
     void setRainbowWave(uint8_t speed = 5);
     void setEffectSpeed(uint8_t speed);      // Set animation speed (1-20)
-    void enableIdleRainbow(bool enable) { idleRainbowEnabled = enable; }
-    rgb_mode_e getCurrentMode() const { return currentMode; }
-    CRGB getCurrentColor() const { return targetColor; }
+    rgb_mode_e getCurrentMode() const { return baseMode; }
+    CRGB getCurrentColor() const { return baseColor; }
     
     // Preset system
     void setPreset(led_preset_e preset);
     void enableManualOverride(bool enable) { manualOverride = enable; }
     bool isManualOverride() const { return manualOverride; }
 
+    void getStats(RgbLedStats& out) const;
+
+    // Applies saved LED settings (LED config group) and the pilot colour
+    // (pilot group) as they change
+    void onConfigChanged(Config& config, uint8_t groups) override;
+
+    // Schedules the cue for a race event (countdown, lap, final lap, finish...)
+    void onRaceEvent(const RaceEvent& event) override;
+
    private:
+    enum CommandType : uint8_t {
+        CMD_STATUS,
+        CMD_CUE,           // value = cue id, arg = repeats, timeMs = start
+        CMD_OFF,
+        CMD_COLOR,         // value = colour, arg = mode
+        CMD_BRIGHTNESS,
+        CMD_MANUAL_COLOR,
+        CMD_FADE_COLOR,
+        CMD_STROBE_COLOR,
+        CMD_MODE,
+        CMD_RAINBOW,
+        CMD_SPEED,
+        CMD_PRESET,
+        CMD_PILOT_COLOR,
+    };
+
+    struct Command {
+        CommandType type;
+        uint8_t arg;
+        uint32_t value;
+        uint32_t timeMs;
+    };
+
+    struct Cue {
+        const LedStep* steps;
+        uint8_t count;
+        uint8_t repeats;       // Extra passes over the steps
+        uint8_t flags;         // CUE_ flags from the cue table
+    };
+
+    struct ScheduledCue {
+        uint8_t id;
+        uint8_t repeats;
+        bool ahead;            // Scheduled before its start time, so lateness counts
+        uint32_t startMs;
+    };
+
     CRGB leds[NUM_LEDS];
+    CRGB shown[NUM_LEDS];  // Last frame sent to the strip
+    uint8_t shownBrightness = 0;
+    uint8_t frameBrightness = 0;
+
+    QueueHandle_t queue = nullptr;
+    TaskHandle_t task = nullptr;
+    RgbLedStats stats = {};
+    uint32_t frame = 0;
+
+    // Base effect (engine task only, apart from the getters above)
     rgb_status_e currentStatus = STATUS_OFF;
-    rgb_mode_e currentMode = RGB_OFF;
-    CRGB targetColor = CRGB::Black;
-    
-    // Animation state
-    uint32_t lastUpdateMs = 0;
-    uint32_t flashStartMs = 0;
-    uint8_t pulseValue = 0;
-    bool pulseDirection = true;
-    
-    // Flash parameters
-    bool isFlashing = false;
-    uint32_t flashDuration = 0;
-    uint8_t flashCount = 0;        // For multi-flash (reset)
-    uint8_t flashesRemaining = 0;  // Flashes left to do
-    CRGB flashColor = CRGB::White; // Color to flash
-    
-    // Countdown state
-    bool isCountdown = false;
-    uint32_t countdownStartMs = 0;
-    uint8_t countdownPhase = 0;  // 0=red, 1=yellow, 2=green, 3=done
-    
-    // Animation speed and state
-    uint8_t rainbowHue = 0;
-    uint8_t rainbowSpeed = 5;
-    uint8_t effectSpeed = 5;         // Global effect speed (1-20)
-    uint8_t firePhase = 0;           // Fire effect phase
-    uint8_t oceanPhase = 0;          // Ocean effect phase
-    bool policeState = false;        // Police effect state
-    uint8_t cometPos = 0;            // Comet position
-    bool idleRainbowEnabled = false;
-    rgb_mode_e savedMode = RGB_OFF;  // Mode to return to after events
-    CRGB savedColor = CRGB::Black;   // Color to return to after events
-    
+    rgb_mode_e baseMode = RGB_OFF;
+    CRGB baseColor = CRGB::Black;
+    uint32_t baseStartFrame = 0;
+    uint8_t effectSpeed = 5;           // Global effect speed (1-20)
+    uint8_t brightness = 80;           // Outside a race
+    bool inRace = false;               // Races run at half brightness
+
+    // Cue playing over the base effect, and the ones waiting to start
+    Cue cue = {};
+    uint32_t cueStartMs = 0;
+    uint32_t cuePassMs = 0;   // One pass over the steps
+    bool cuePlaying = false;
+    ScheduledCue timeline[RGB_LED_TIMELINE_SLOTS];  // Sorted by startMs
+    uint8_t timelineCount = 0;
+    CRGB pilotColor = CRGB::White;
+
     // Manual override and presets
     bool manualOverride = false;
     led_preset_e currentPreset = PRESET_RAINBOW;
+    CRGB manualColor = CRGB::Black;
     CRGB fadeColor = CRGB::Blue;      // Color for COLOR_FADE preset
     CRGB strobeColor = CRGB::White;   // Color for STROBE preset
     
-    // Error code state
-    uint8_t errorBlinkCount = 0;
-    uint8_t errorBlinksRemaining = 0;
-    uint32_t errorBlinkTime = 0;
-    
-    // Race timeline control
-    bool temporarilyDisabled = false;
-    uint32_t disableUntilMs = 0;
-    uint8_t savedBrightness = 80;
-    bool inRace = false;
-    
-    void updateAnimation(uint32_t currentTimeMs);
-    void updateCountdown(uint32_t currentTimeMs);
-    void updateRainbowWave();
-    void updateSparkle();
-    void updateBreathing();
-    void updateChase();
-    void updateFire();
-    void updateOcean();
-    void updatePolice();
-    void updateStrobe();
-    void updateComet();
-    void updateErrorBlink(uint32_t currentTimeMs);
+    // LED settings last taken from Config; only the ones that change are
+    // re-applied, since setPreset() restarts the running effect
+    struct {
+        uint8_t brightness;
+        uint8_t speed;
+        uint32_t color;
+        uint32_t fadeColor;
+        uint32_t strobeColor;
+        uint8_t manualOverride;
+        uint8_t preset;
+        uint32_t pilotColor;
+    } applied = {};
+    bool configApplied = false;
+
+    void post(CommandType type, uint32_t value = 0, uint8_t arg = 0, uint32_t timeMs = 0);
+    static void taskMain(void* arg);
+    void run();
+    void apply(const Command& cmd);
+    void renderFrame();
+    void showIfChanged();
+
+    void setBase(rgb_mode_e mode, CRGB color);
     void applyStatus();
     void applyPreset(led_preset_e preset);
-    void saveCurrentState();
-    void restoreSavedState();
+    void scheduleCue(uint8_t id, uint8_t repeats, uint32_t atMs);
+    void startDueCues();
+    void playCue(const ScheduledCue& next);
+    void finishCue();
+    TickType_t ticksUntilCue() const;
+    uint8_t baseBrightness() const { return inRace ? brightness / 2 : brightness; }
 };
 
 #endif // ESP32S3
@@ -29,10 +29,19 @@ void RX5808::init() {
     delay(50);
 }
 
-void RX5808::handleFrequencyChange(uint32_t currentTimeMs, uint16_t potentiallyNewFreq) {
-    if ((currentFrequency != potentiallyNewFreq) && ((currentTimeMs - lastSetFreqTimeMs) > RX5808_MIN_BUSTIME)) {
+void RX5808::onConfigChanged(Config& config, uint8_t groups) {
+    // Only record it; the bus transaction happens on the next handleFrequencyChange()
+    targetFrequency = config.getFrequency();
+}
+
+void RX5808::handleFrequencyChange(uint32_t currentTimeMs) {
+    if (tuningHeld) {
+        return;  // The holder owns the bus
+    }
+    uint16_t newFreq = targetFrequency;
+    if ((currentFrequency != newFreq) && ((currentTimeMs - lastSetFreqTimeMs) > RX5808_MIN_BUSTIME)) {
         lastSetFreqTimeMs = currentTimeMs;
-        setFrequency(potentiallyNewFreq);
+        setFrequency(newFreq);
     }
 
     if (recentSetFreqFlag && (currentTimeMs - lastSetFreqTimeMs) > RX5808_MIN_TUNETIME) {
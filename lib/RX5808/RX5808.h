@@ -3,19 +3,25 @@
 
 #include <stdint.h>
 
+#include "config.h"
+
 #define RX5808_MIN_TUNETIME 35    // after set freq need to wait this long before read RSSI
 #define RX5808_MIN_BUSTIME 30     // after set freq need to wait this long before setting again
 #define POWER_DOWN_FREQ_MHZ 1111  // signal to power down the module
 #define RSSI_READS 5              // number of analog RSSI reads per tick
 
-class RX5808 {
+class RX5808 : public ConfigListener {
    public:
     RX5808(uint8_t _rssiInputPin, uint8_t _rx5808DataPin, uint8_t _rx5808SelPin, uint8_t _rx5808ClkPin);
     void init();
     void setFrequency(uint16_t frequency);
     uint8_t readRssi();
-    void handleFrequencyChange(uint32_t currentTimeMs, uint16_t potentiallyNewFreq);
+    void handleFrequencyChange(uint32_t currentTimeMs);  // Retunes to the configured frequency
+    void onConfigChanged(Config& config, uint8_t groups) override;
     bool verifyFrequency();
+    // While held, handleFrequencyChange() leaves the module on whatever
+    // setFrequency() last chose (self-test scans); releasing retunes to Config
+    void holdTuning(bool held) { tuningHeld = held; }
     bool recentSetFreqFlag = false;
 
    private:
@@ -25,6 +31,8 @@ class RX5808 {
     uint8_t rssiInputPin = 0;   // RSSI input from RX5808
 
     uint16_t currentFrequency = 0;
+    volatile uint16_t targetFrequency = 0;  // From Config (RF group)
+    volatile bool tuningHeld = false;
 
     bool rxPoweredDown = false;
     uint32_t lastSetFreqTimeMs = 0;
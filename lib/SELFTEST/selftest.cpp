@@ -8,6 +8,7 @@
 #include "racehistory.h"
 #include "trackmanager.h"
 #include "webhook.h"
+#include "kalman.h"
 #include <EEPROM.h>
 #include <LittleFS.h>
 #include <WiFi.h>
@@ -17,62 +18,401 @@
 #include <SD.h>
 #include "rgbled.h"
 #include "USB.h"
+extern RgbLed* g_rgbLed;
 #endif
 
-SelfTest::SelfTest() : storage(nullptr), allPassed(true) {
+SelfTest::SelfTest() : storage(nullptr), allPassed(true), benchState(BENCH_IDLE) {
+    benchJson[0] = '\0';
 }
 
 void SelfTest::init(Storage* stor) {
     storage = stor;
+    if (!jobLock) {
+        jobLock = xSemaphoreCreateMutex();
+        eventQueue = xQueueCreate(SELFTEST_EVENT_QUEUE, sizeof(EventSlot));
+    }
 }
 
-bool SelfTest::runAllTests() {
-    DEBUG("Starting self-tests...\n");
-    results.clear();
-    allPassed = true;
+void SelfTest::setTargets(Config* config, RX5808* rx5808, LapTimer* timer, Buzzer* buzzer, RaceHistory* history) {
+    conf = config;
+    rx = rx5808;
+    lapTimer = timer;
+    buz = buzzer;
+    raceHistory = history;
+}
 
-    // Test RX5808
-    RX5808 *rx;
-    TestResult RX5808Test = testRX5808(rx);  // Pass nullptr for RX5808 instance
-    results.push_back(RX5808Test);  
-    if (!RX5808Test.passed) allPassed = false;
-    
-    // Test storage
-    TestResult storageTest = testStorage();
-    results.push_back(storageTest);
-    if (!storageTest.passed) allPassed = false;
-    
-    // Test LittleFS
-    TestResult littleFSTest = testLittleFS();
-    results.push_back(littleFSTest);
-    if (!littleFSTest.passed) allPassed = false;
-    
+// Tests the job knows; JOB_PLAN picks the ones this board runs, in order
+enum : uint8_t {
+    JOB_RX5808,
+    JOB_LAP_TIMER,
+    JOB_AUDIO,
+    JOB_CONFIG,
+    JOB_RACE_HISTORY,
+    JOB_WEB_SERVER,
+    JOB_OTA,
+    JOB_STORAGE,
+    JOB_LITTLEFS,
+    JOB_EEPROM,
+    JOB_WIFI,
+    JOB_BATTERY,
+    JOB_TRACK_MANAGER,
+    JOB_WEBHOOKS,
+    JOB_TRANSPORT,
+    JOB_RGB_LED,
+    JOB_SD_CARD,
+    JOB_BENCH_HEAP,
+    JOB_BENCH_SAMPLING,
+    JOB_BENCH_DETECTION,
+    JOB_BENCH_RETUNE,
+    JOB_BENCH_LITTLEFS,
+    JOB_BENCH_SD,
+    JOB_BENCH_JSON,
+    JOB_BENCH_EVENTS,
+};
+
+// Indexed by the JOB_ ids; what progress events call the test before it has a result
+static const char* const JOB_NAMES[] = {
+    "RX5808 RF Receive", "Lap Timer", "Audio", "Configuration", "Race History",
+    "Web Server", "OTA Updates", "Storage", "LittleFS", "EEPROM", "WiFi",
+    "Battery Monitor", "Track Manager", "Webhooks", "Transport Layer", "RGB LED", "SD Card",
+    "Heap", "ADC Sampling", "Filter + Detection", "RX5808 Retune", "LittleFS Throughput",
+    "SD Throughput", "Race History JSON", "SSE Events",
+};
+
+static const uint8_t JOB_PLAN[] = {
+    JOB_RX5808,
+    JOB_LAP_TIMER,
+    JOB_AUDIO,
+    JOB_CONFIG,
+#ifdef PIN_SD_CS
+    JOB_RACE_HISTORY,
+#endif
+    JOB_WEB_SERVER,
+    JOB_OTA,
+#ifdef PIN_SD_CS
+    JOB_STORAGE,
+#endif
+    JOB_LITTLEFS,
+    JOB_EEPROM,
+    JOB_WIFI,
+#ifdef PIN_VBAT
+    JOB_BATTERY,
+#endif
+#ifdef PIN_SD_CS
+    JOB_TRACK_MANAGER,
+#endif
+    JOB_WEBHOOKS,
+    JOB_TRANSPORT,
 #ifdef ESP32S3
-    // Test SD card
-    TestResult sdTest = testSDCard();
-    results.push_back(sdTest);
-    // SD card failure is not critical - don't fail overall test
+    JOB_RGB_LED,
+    JOB_SD_CARD,
 #endif
-    
-    // Test EEPROM
-    TestResult eepromTest = testEEPROM();
-    results.push_back(eepromTest);
-    if (!eepromTest.passed) allPassed = false;
-    
-    // Test WiFi
-    TestResult wifiTest = testWiFi();
-    results.push_back(wifiTest);
-    if (!wifiTest.passed) allPassed = false;
-    
+};
+
+// Heap first, before the other benchmarks have allocated anything
+static const uint8_t BENCH_PLAN[] = {
+    JOB_BENCH_HEAP,
+    JOB_BENCH_SAMPLING,
+    JOB_BENCH_DETECTION,
+    JOB_BENCH_RETUNE,
+    JOB_BENCH_LITTLEFS,
 #ifdef ESP32S3
-    // Test USB Serial CDC
-    TestResult usbTest = testUSB();
-    results.push_back(usbTest);
-    // USB failure is not critical - don't fail overall test
+    JOB_BENCH_SD,
 #endif
-    
-    DEBUG("Self-tests complete: %s\n", allPassed ? "PASSED" : "FAILED");
-    return allPassed;
+    JOB_BENCH_JSON,
+    JOB_BENCH_EVENTS,
+};
+
+static const char* const JOB_STATES[] = {"idle", "running", "done", "failed"};
+static const char* const JOB_CATEGORIES[] = {"diagnostics", "benchmark"};
+
+uint32_t SelfTest::startJob(selftest_category_e category) {
+    if (!jobLock) return 0;
+    xSemaphoreTake(jobLock, portMAX_DELAY);
+    if (jobState == BENCH_RUNNING) {
+        xSemaphoreGive(jobLock);
+        return 0;
+    }
+    jobId++;
+    jobCategory = category;
+    if (category == SELFTEST_BENCHMARK) {
+        jobPlan = BENCH_PLAN;
+        jobTotal = sizeof(BENCH_PLAN);
+    } else {
+        jobPlan = JOB_PLAN;
+        jobTotal = sizeof(JOB_PLAN);
+    }
+    jobResultCount = 0;
+    jobIndex = 0;
+    jobProgress = 0;
+    jobCancel = false;
+    allPassed = true;
+    jobState = BENCH_RUNNING;
+    uint32_t id = jobId;
+    xSemaphoreGive(jobLock);
+
+    // Core 0 at the lowest priority, away from the lap timing loop
+    if (xTaskCreatePinnedToCore(jobTask, "selfTest", SELFTEST_TASK_STACK, this, 0, nullptr, 0) != pdPASS) {
+        LOG_E(LOG_CORE, "Self-test: could not start job task\n");
+        jobState = BENCH_FAILED;
+        return 0;
+    }
+    LOG_I(LOG_CORE, "Self-test job %u started: %s, %u tests\n", id, JOB_CATEGORIES[category], jobTotal);
+    return id;
+}
+
+bool SelfTest::cancelJob() {
+    if (jobState != BENCH_RUNNING) return false;
+    jobCancel = true;
+    return true;
+}
+
+// Benchmark numbers as [{"name","value","unit"}], left out when there are none
+static void addMetrics(JsonObject obj, const TestResult& result) {
+    if (result.metricCount == 0) return;
+    JsonArray metrics = obj.createNestedArray("metrics");
+    for (uint8_t i = 0; i < result.metricCount; i++) {
+        JsonObject metric = metrics.createNestedObject();
+        metric["name"] = result.metrics[i].name;
+        metric["value"] = result.metrics[i].value;
+        metric["unit"] = result.metrics[i].unit;
+    }
+}
+
+void SelfTest::jobTask(void* arg) {
+    static_cast<SelfTest*>(arg)->runJob();
+    vTaskDelete(nullptr);
+}
+
+void SelfTest::runJob() {
+    uint8_t passedCount = 0;
+    for (uint8_t i = 0; i < jobTotal && !jobCancel; i++) {
+        uint8_t test = jobPlan[i];
+        xSemaphoreTake(jobLock, portMAX_DELAY);
+        jobIndex = i;
+        jobProgress = 0;
+        xSemaphoreGive(jobLock);
+
+        DynamicJsonDocument doc(SELFTEST_EVENT_SIZE);
+        doc["job"] = jobId;
+        doc["event"] = "test";
+        doc["index"] = i;
+        doc["total"] = jobTotal;
+        doc["name"] = JOB_NAMES[test];
+        postEvent(doc);
+
+        TestRun run = {};
+        run.startMs = millis();
+        while (!stepJobTest(test, run)) {
+            if (run.progress != jobProgress) {
+                xSemaphoreTake(jobLock, portMAX_DELAY);
+                jobProgress = run.progress;
+                xSemaphoreGive(jobLock);
+                doc["event"] = "progress";
+                doc["progress"] = run.progress;
+                postEvent(doc);
+            }
+            vTaskDelay(pdMS_TO_TICKS(run.waitMs ? run.waitMs : 1));
+        }
+
+        xSemaphoreTake(jobLock, portMAX_DELAY);
+        jobResults[jobResultCount++] = run.result;
+        jobProgress = 100;
+        if (run.result.passed) {
+            passedCount++;
+        } else {
+            allPassed = false;
+        }
+        xSemaphoreGive(jobLock);
+
+        doc.clear();
+        doc["job"] = jobId;
+        doc["event"] = "result";
+        doc["index"] = i;
+        doc["total"] = jobTotal;
+        doc["name"] = run.result.name;
+        doc["passed"] = run.result.passed;
+        doc["details"] = run.result.details;
+        doc["duration"] = run.result.duration_ms;
+        addMetrics(doc.as<JsonObject>(), run.result);
+        postEvent(doc);
+    }
+
+    DynamicJsonDocument doc(SELFTEST_EVENT_SIZE);
+    doc["job"] = jobId;
+    doc["event"] = "done";
+    doc["total"] = jobTotal;
+    doc["passed"] = passedCount;
+    doc["allPassed"] = allPassed;
+    doc["cancelled"] = (bool)jobCancel;
+    postEvent(doc);
+    LOG_I(LOG_CORE, "Self-test job %u %s: %u/%u passed\n", jobId, jobCancel ? "cancelled" : "complete",
+          passedCount, jobTotal);
+    jobState = BENCH_DONE;
+}
+
+bool SelfTest::stepJobTest(uint8_t test, TestRun& run) {
+    switch (test) {
+        case JOB_RX5808:
+            return stepRX5808(rx, run);
+        case JOB_LAP_TIMER:
+            run.result = testLapTimer(lapTimer);
+            return true;
+        case JOB_AUDIO:
+            return stepAudio(buz, run);
+        case JOB_CONFIG:
+            run.result = testConfig(conf);
+            return true;
+        case JOB_RACE_HISTORY:
+            run.result = testRaceHistory(raceHistory);
+            return true;
+        case JOB_WEB_SERVER:
+            run.result = testWebServer();
+            return true;
+        case JOB_OTA:
+            run.result = testOTA();
+            return true;
+        case JOB_STORAGE:
+            run.result = testStorage();
+            return true;
+        case JOB_LITTLEFS:
+            run.result = testLittleFS();
+            return true;
+        case JOB_EEPROM:
+            run.result = testEEPROM();
+            return true;
+        case JOB_WIFI:
+            run.result = testWiFi();
+            return true;
+        case JOB_BATTERY:
+            run.result = testBattery();
+            return true;
+        case JOB_TRACK_MANAGER:
+            run.result = testTrackManager();
+            return true;
+        case JOB_WEBHOOKS:
+            run.result = testWebhooks();
+            return true;
+        case JOB_TRANSPORT:
+            run.result = testTransport();
+            return true;
+#ifdef ESP32S3
+        case JOB_RGB_LED:
+            return stepRGBLED(g_rgbLed, run);
+        case JOB_SD_CARD:
+            run.result = testSDCard();
+            return true;
+#endif
+        case JOB_BENCH_HEAP:
+            run.result = benchHeap();
+            return true;
+        case JOB_BENCH_SAMPLING:
+            return stepBenchSampling(run);
+        case JOB_BENCH_DETECTION:
+            return stepBenchDetection(run);
+        case JOB_BENCH_RETUNE:
+            return stepBenchRetune(run);
+        case JOB_BENCH_LITTLEFS:
+            run.result = benchStorage(false);
+            return true;
+        case JOB_BENCH_SD:
+            run.result = benchStorage(true);
+            return true;
+        case JOB_BENCH_JSON:
+            run.result = benchRaceJson();
+            return true;
+        case JOB_BENCH_EVENTS:
+            return stepBenchEvents(run);
+        default:
+            run.result.name = JOB_NAMES[test];
+            run.result.passed = false;
+            run.result.details = "Not available on this board";
+            return true;
+    }
+}
+
+void SelfTest::postEvent(JsonDocument& doc) {
+    EventSlot slot;
+    size_t len = serializeJson(doc, slot.json, sizeof(slot.json));
+    if (len == 0 || len >= sizeof(slot.json) - 1) {
+        // Cut short: only long details and metrics do this, and the job JSON
+        // still has them
+        doc.remove("details");
+        len = serializeJson(doc, slot.json, sizeof(slot.json));
+        if (len == 0 || len >= sizeof(slot.json) - 1) {
+            doc.remove("metrics");
+            serializeJson(doc, slot.json, sizeof(slot.json));
+        }
+    }
+    slot.queuedUs = micros();
+    // Never wait: a slow client just misses events it can re-read from getJobJSON()
+    if (xQueueSend(eventQueue, &slot, 0) != pdTRUE) {
+        eventDrops++;
+    }
+}
+
+bool SelfTest::pollEvent(char* json, size_t len) {
+    EventSlot slot;
+    if (!eventQueue || xQueueReceive(eventQueue, &slot, 0) != pdTRUE) {
+        return false;
+    }
+    strlcpy(json, slot.json, len);
+    polledQueuedUs = slot.queuedUs;
+    return true;
+}
+
+void SelfTest::eventSent() {
+    uint32_t latencyUs = micros() - polledQueuedUs;
+    eventLatencyUs += latencyUs;
+    if (latencyUs > eventMaxLatencyUs) {
+        eventMaxLatencyUs = latencyUs;
+    }
+    eventsSent++;
+}
+
+String SelfTest::getJobJSON() {
+    DynamicJsonDocument doc(6144);
+    if (jobLock) xSemaphoreTake(jobLock, portMAX_DELAY);
+    doc["job"] = jobId;
+    doc["category"] = JOB_CATEGORIES[jobCategory];
+    doc["state"] = JOB_STATES[jobState];
+    doc["total"] = jobTotal;
+    doc["completed"] = jobResultCount;
+    if (jobState == BENCH_RUNNING) {
+        doc["current"] = JOB_NAMES[jobPlan[jobIndex]];
+        doc["progress"] = jobProgress;
+    }
+    doc["allPassed"] = allPassed;
+    doc["cancelled"] = (bool)jobCancel;
+    doc["eventDrops"] = eventDrops;
+    // What the numbers were measured on, so runs can be compared
+    JsonObject device = doc.createNestedObject("device");
+    device["firmware"] = FPVGATE_VERSION;
+    device["build"] = __DATE__ " " __TIME__;
+#ifdef ARDUINO_BOARD
+    device["board"] = ARDUINO_BOARD;
+#endif
+    device["chip"] = ESP.getChipModel();
+    device["revision"] = ESP.getChipRevision();
+    device["cpuMhz"] = getCpuFrequencyMhz();
+    device["flashMB"] = ESP.getFlashChipSize() / (1024 * 1024);
+    device["psramKB"] = ESP.getPsramSize() / 1024;
+    device["sdk"] = ESP.getSdkVersion();
+    device["storage"] = storage ? storage->getStorageType() : String("none");
+    JsonArray tests = doc.createNestedArray("tests");
+    for (uint8_t i = 0; i < jobResultCount; i++) {
+        JsonObject test = tests.createNestedObject();
+        test["name"] = jobResults[i].name;
+        test["passed"] = jobResults[i].passed;
+        test["details"] = jobResults[i].details;
+        test["duration"] = jobResults[i].duration_ms;
+        addMetrics(test, jobResults[i]);
+    }
+    if (jobLock) xSemaphoreGive(jobLock);
+
+    String output;
+    serializeJson(doc, output);
+    return output;
 }
 
 TestResult SelfTest::testStorage() {
@@ -172,6 +512,7 @@ TestResult SelfTest::testSDCard() {
     
     result.passed = writeSuccess;
     result.details = String("Size: ") + String(cardSize / (1024*1024)) + "MB, " +
+                    "SPI: " + String(storage->getSDClockHz() / 1000000.0f, 1) + "MHz, " +
                     "Free: " + String(freeBytes / (1024*1024)) + "MB, " +
                     "Voices: " + String(voiceDirsFound) + "/4, " +
                     "Audio files: " + String(audioFilesFound) + "/2, " +
@@ -286,64 +627,94 @@ TestResult SelfTest::testBattery() {
     return result;
 }
 
-TestResult SelfTest::testRX5808(RX5808* rx5808) {
-    TestResult result;
-    result.name = "RX5808 RF Receive";
-    uint32_t start = millis();
-
-    if (!rx5808) {
-        result.passed = false;
-        result.details = "RX5808 pointer is null";
-        result.duration_ms = millis() - start;
-        return result;
-    }
+bool SelfTest::raceInProgress() const {
+    return lapTimer && (lapTimer->getState() == RUNNING || lapTimer->getState() == WAITING);
+}
 
+bool SelfTest::stepRX5808(RX5808* rx5808, TestRun& run) {
     // We can't truly "verify frequency" (RX5808 has no readback).
     // Instead, infer operation by scanning a few common channels and looking
     // for RSSI variation / peaks that suggest real RF energy is being received.
 
     // Common channels (mix of bands) - chosen to catch typical VTX usage.
-    const uint16_t freqs[] = {
+    static const uint16_t freqs[] = {
         5645, 5685, 5705, 5740, 5760, 5780, 5800, 5806, 5820, 5840, 5860, 5880, 5917
     };
-    const int nFreqs = (int)(sizeof(freqs) / sizeof(freqs[0]));
+    const uint8_t nFreqs = (uint8_t)(sizeof(freqs) / sizeof(freqs[0]));
 
     // Sampling params
     const uint16_t tuneDelayMs = RX5808_MIN_TUNETIME;       // allow RX to settle after tune
     const uint8_t samplesPerFreq = 6;      // average a few reads
     const uint16_t sampleDelayMs = 6;
 
-    uint8_t minRssi = 255;
-    uint8_t maxRssi = 0;
-    uint16_t minFreq = 0;
-    uint16_t maxFreq = 0;
-
-    // For reporting: keep a couple representative points
-    uint8_t firstAvg = 0;
-    uint8_t midAvg = 0;
-    uint8_t lastAvg = 0;
+    TestResult& result = run.result;
+    if (run.phase == 0 && run.sub == 0) {
+        result.name = "RX5808 RF Receive";
+        if (!rx5808) {
+            result.passed = false;
+            result.details = "RX5808 pointer is null";
+            result.duration_ms = millis() - run.startMs;
+            return true;
+        }
+        if (raceInProgress()) {
+            result.passed = false;
+            result.details = "Skipped: race in progress";
+            result.duration_ms = millis() - run.startMs;
+            return true;
+        }
+        rx5808->holdTuning(true);
+        scan.minRssi = 255;
+        scan.maxRssi = 0;
+        scan.minFreq = 0;
+        scan.maxFreq = 0;
+        scan.firstAvg = scan.midAvg = scan.lastAvg = 0;
+    }
 
-    for (int i = 0; i < nFreqs; i++) {
-        rx5808->setFrequency(freqs[i]);
-        delay(tuneDelayMs);
+    // One phase per frequency: tune, then a sample per step
+    if (run.phase < nFreqs) {
+        if (raceInProgress()) {
+            // Started mid-scan: give the RX back to the timer at once
+            rx5808->holdTuning(false);
+            result.passed = false;
+            result.details = "Stopped: race started";
+            result.duration_ms = millis() - run.startMs;
+            return true;
+        }
+        if (run.sub == 0) {
+            rx5808->setFrequency(freqs[run.phase]);
+            scan.sum = 0;
+            run.sub = 1;
+            run.waitMs = tuneDelayMs;
+            return false;
+        }
         rx5808->recentSetFreqFlag = false;  // Allow RSSI reads now
-
-        uint16_t sum = 0;
-        for (uint8_t s = 0; s < samplesPerFreq; s++) {
-            Serial.println("RX5808 RSSI: " + String(rx5808->readRssi()));
-            sum += rx5808->readRssi();
-            delay(sampleDelayMs);
+        scan.sum += rx5808->readRssi();
+        if (run.sub < samplesPerFreq) {
+            run.sub++;
+            run.waitMs = sampleDelayMs;
+            return false;
         }
-        uint8_t avg = (uint8_t)(sum / samplesPerFreq);
 
-        if (i == 0) firstAvg = avg;
-        if (i == nFreqs / 2) midAvg = avg;
-        if (i == nFreqs - 1) lastAvg = avg;
+        uint8_t avg = (uint8_t)(scan.sum / samplesPerFreq);
+        LOG_D(LOG_RX, "Self-test: %u MHz RSSI %u\n", freqs[run.phase], avg);
+        if (run.phase == 0) scan.firstAvg = avg;
+        if (run.phase == nFreqs / 2) scan.midAvg = avg;
+        if (run.phase == nFreqs - 1) scan.lastAvg = avg;
 
-        if (avg < minRssi) { minRssi = avg; minFreq = freqs[i]; }
-        if (avg > maxRssi) { maxRssi = avg; maxFreq = freqs[i]; }
+        if (avg < scan.minRssi) { scan.minRssi = avg; scan.minFreq = freqs[run.phase]; }
+        if (avg > scan.maxRssi) { scan.maxRssi = avg; scan.maxFreq = freqs[run.phase]; }
+
+        run.phase++;
+        run.sub = 0;
+        run.progress = run.phase * 100 / nFreqs;
+        run.waitMs = 0;
+        return false;
     }
 
+    // Released, the RX goes back to the configured channel on its own (handleFrequencyChange)
+    rx5808->holdTuning(false);
+    const uint8_t minRssi = scan.minRssi;
+    const uint8_t maxRssi = scan.maxRssi;
     const uint8_t span = (uint8_t)(maxRssi - minRssi);
 
     // Heuristics:
@@ -353,13 +724,13 @@ TestResult SelfTest::testRX5808(RX5808* rx5808) {
     const uint8_t kMinPeak = 8;     // "saw something above dead-flat"
     const uint8_t kMinSpan = 6;     // "variation indicates signal vs flatline"
 
+    result.duration_ms = millis() - run.startMs;
     if (maxRssi == 0 && minRssi == 0) {
         result.passed = false;
         result.details =
             "RSSI flatlined at 0 across scan. "
             "If receiver works elsewhere, this may be ADC scaling/attenuation or no RF present.";
-        result.duration_ms = millis() - start;
-        return result;
+        return true;
     }
 
     // Pass if we saw either a decent peak or decent variation.
@@ -368,22 +739,20 @@ TestResult SelfTest::testRX5808(RX5808* rx5808) {
     if (!inferred) {
         result.passed = false;
         result.details =
-            "RX5808 RSSI is very low/flat during scan (min=" + String(minRssi) + " @ " + String(minFreq) +
-            " MHz, max=" + String(maxRssi) + " @ " + String(maxFreq) +
+            "RX5808 RSSI is very low/flat during scan (min=" + String(minRssi) + " @ " + String(scan.minFreq) +
+            " MHz, max=" + String(maxRssi) + " @ " + String(scan.maxFreq) +
             " MHz, span=" + String(span) + "). "
             "Try powering a VTX near the gate and re-run selftest.";
-        result.duration_ms = millis() - start;
-        return result;
+        return true;
     }
 
     result.passed = true;
     result.details =
-        "RF receive (min=" + String(minRssi) + " @ " + String(minFreq) +
-        " MHz, max=" + String(maxRssi) + " @ " + String(maxFreq) +
+        "RF receive (min=" + String(minRssi) + " @ " + String(scan.minFreq) +
+        " MHz, max=" + String(maxRssi) + " @ " + String(scan.maxFreq) +
         " MHz, span=" + String(span) +
-        ", samples=" + String(firstAvg) + "/" + String(midAvg) + "/" + String(lastAvg) + ").";
-    result.duration_ms = millis() - start;
-    return result;
+        ", samples=" + String(scan.firstAvg) + "/" + String(scan.midAvg) + "/" + String(scan.lastAvg) + ").";
+    return true;
 }
 
 
@@ -408,26 +777,26 @@ TestResult SelfTest::testLapTimer(LapTimer* timer) {
     return result;
 }
 
-TestResult SelfTest::testAudio(Buzzer* buzzer) {
+bool SelfTest::stepAudio(Buzzer* buzzer, TestRun& run) {
+    TestResult& result = run.result;
     #ifdef PIN_BUZZER
-        TestResult result;
         result.name = "Audio/Buzzer";
-        uint32_t start = millis();
-        
-        if (!buzzer) {
-            result.passed = false;
-            result.details = "Buzzer not initialized";
-            result.duration_ms = millis() - start;
-            return result;
+        if (run.phase == 0) {
+            if (!buzzer) {
+                result.passed = false;
+                result.details = "Buzzer not initialized";
+                result.duration_ms = millis() - run.startMs;
+                return true;
+            }
+            
+            // Test buzzer beep
+            buzzer->beep(100);
+            run.phase = 1;
+            run.waitMs = 150;
+            return false;
         }
-        
-        // Test buzzer beep
-        buzzer->beep(100);
-        delay(150);
     #else
-        TestResult result;
         result.name = "Audio";
-        uint32_t start = millis();
     #endif
     
     // Check if audio announcer JavaScript exists
@@ -436,8 +805,8 @@ TestResult SelfTest::testAudio(Buzzer* buzzer) {
     if (!audioJsExists) {
         result.passed = false;
         result.details = "audio-announcer.js not found";
-        result.duration_ms = millis() - start;
-        return result;
+        result.duration_ms = millis() - run.startMs;
+        return true;
     }
     
     result.passed = true;
@@ -446,8 +815,8 @@ TestResult SelfTest::testAudio(Buzzer* buzzer) {
     #else
         result.details = "Audio JS loaded";
     #endif
-    result.duration_ms = millis() - start;
-    return result;
+    result.duration_ms = millis() - run.startMs;
+    return true;
 }
 
 TestResult SelfTest::testConfig(Config* config) {
@@ -553,33 +922,34 @@ TestResult SelfTest::testOTA() {
 }
 
 #ifdef ESP32S3
-TestResult SelfTest::testRGBLED(RgbLed* rgbLed) {
-    TestResult result;
+bool SelfTest::stepRGBLED(RgbLed* rgbLed, TestRun& run) {
+    // Red, green, blue to test all channels, 200 ms each
+    static const uint32_t colors[] = {0xFF0000, 0x00FF00, 0x0000FF};
+    TestResult& result = run.result;
     result.name = "RGB LED";
-    uint32_t start = millis();
     
     if (!rgbLed) {
         result.passed = false;
         result.details = "RGB LED not initialized";
-        result.duration_ms = millis() - start;
-        return result;
+        result.duration_ms = millis() - run.startMs;
+        return true;
     }
     
-    // Flash red, green, blue to test all channels
-    rgbLed->setManualColor(0xFF0000); // Red
-    delay(200);
-    rgbLed->setManualColor(0x00FF00); // Green
-    delay(200);
-    rgbLed->setManualColor(0x0000FF); // Blue
-    delay(200);
+    if (run.phase < 3) {
+        rgbLed->setManualColor(colors[run.phase]);
+        run.phase++;
+        run.progress = run.phase * 33;
+        run.waitMs = 200;
+        return false;
+    }
     
     // Restore rainbow
     rgbLed->setRainbowWave();
     
     result.passed = true;
     result.details = "All channels tested (R,G,B)";
-    result.duration_ms = millis() - start;
-    return result;
+    result.duration_ms = millis() - run.startMs;
+    return true;
 }
 
 TestResult SelfTest::testUSB() {
@@ -692,21 +1062,415 @@ TestResult SelfTest::testTransport() {
     return result;
 }
 
-String SelfTest::getResultsJSON() {
-    DynamicJsonDocument doc(2048);
-    doc["allPassed"] = allPassed;
-    doc["totalTests"] = results.size();
-    
-    JsonArray testsArray = doc.createNestedArray("tests");
-    for (const auto& result : results) {
-        JsonObject test = testsArray.createNestedObject();
-        test["name"] = result.name;
-        test["passed"] = result.passed;
-        test["details"] = result.details;
-        test["duration_ms"] = result.duration_ms;
+bool SelfTest::startStorageBenchmark() {
+    if (!storage || benchState == BENCH_RUNNING) {
+        return false;
     }
-    
-    String output;
-    serializeJson(doc, output);
-    return output;
+    benchState = BENCH_RUNNING;
+    // Core 0 at the lowest priority, away from the lap timing loop
+    if (xTaskCreatePinnedToCore(storageBenchmarkTask, "storageBench", 4096, this, 0, nullptr, 0) != pdPASS) {
+        benchState = BENCH_FAILED;
+        return false;
+    }
+    return true;
+}
+
+void SelfTest::storageBenchmarkTask(void* arg) {
+    SelfTest* self = static_cast<SelfTest*>(arg);
+    StorageBenchResult result;
+    bool ok = self->storage->runBenchmark(result);
+    StorageBench::toJson(result, self->benchJson, sizeof(self->benchJson));
+    self->benchState = ok ? BENCH_DONE : BENCH_FAILED;
+    vTaskDelete(nullptr);
+}
+
+String SelfTest::getStorageBenchmarkJSON() {
+    static const char* states[] = {"idle", "running", "done", "failed"};
+    String json = String("{\"state\":\"") + states[benchState] + "\",\"storage\":\"" +
+                  (storage ? storage->getStorageType() : String("none")) + "\"";
+    if (storage && storage->isSDAvailable()) {
+        json += ",\"sdClockHz\":" + String(storage->getSDClockHz());
+    }
+    if (benchState == BENCH_DONE || benchState == BENCH_FAILED) {
+        json += ",\"result\":";
+        json += benchJson;
+    }
+    json += "}";
+    return json;
+}
+
+// Benchmarks. Each one reports its numbers as metrics with fixed names and
+// units; details is the same thing in words.
+
+TestResult SelfTest::benchHeap() {
+    TestResult result;
+    result.name = "Heap";
+    uint32_t start = millis();
+
+    uint32_t freeHeap = ESP.getFreeHeap();
+    uint32_t largestBlock = ESP.getMaxAllocHeap();
+    float fragmentation = freeHeap ? 100.0f * (1.0f - (float)largestBlock / freeHeap) : 0.0f;
+
+    result.addMetric("freeKB", freeHeap / 1024.0f, "KB");
+    result.addMetric("minFreeKB", ESP.getMinFreeHeap() / 1024.0f, "KB");
+    result.addMetric("largestBlockKB", largestBlock / 1024.0f, "KB");
+    result.addMetric("fragmentation", fragmentation, "%");
+    if (ESP.getPsramSize()) {
+        result.addMetric("psramFreeKB", ESP.getFreePsram() / 1024.0f, "KB");
+    }
+
+    result.passed = true;
+    result.details = String(freeHeap / 1024) + " KB free (low " + String(ESP.getMinFreeHeap() / 1024) +
+                     " KB), largest block " + String(largestBlock / 1024) + " KB, " +
+                     String(fragmentation, 1) + "% fragmented";
+    result.duration_ms = millis() - start;
+    return result;
+}
+
+bool SelfTest::stepBenchSampling(TestRun& run) {
+    const uint32_t windowMs = 1000;
+    const uint16_t reads = 1000;
+    TestResult& result = run.result;
+    result.name = "ADC Sampling";
+
+    if (!lapTimer || !rx) {
+        result.passed = false;
+        result.details = "Lap timer not initialized";
+        result.duration_ms = millis() - run.startMs;
+        return true;
+    }
+
+    LapTimerLoopStats loop;
+    lapTimer->getLoopStats(loop);
+    if (run.phase == 0) {
+        // Count what the timing loop samples over a window
+        bench.samples = loop.samples;
+        bench.startUs = micros();
+        run.phase = 1;
+        run.waitMs = windowMs;
+        return false;
+    }
+    uint32_t elapsedUs = micros() - bench.startUs;
+    float samplesPerSec = (loop.samples - bench.samples) * 1000000.0f / elapsedUs;
+    result.addMetric("samplesPerSec", samplesPerSec, "Hz");
+
+    // Then the cost of one read, back to back (a retune makes readRssi() skip the ADC)
+    if (rx->recentSetFreqFlag) {
+        result.passed = false;
+        result.details = String((uint32_t)samplesPerSec) + " samples/s; read cost not measured, RX was retuning";
+        result.duration_ms = millis() - run.startMs;
+        return true;
+    }
+    uint32_t startUs = micros();
+    for (uint16_t i = 0; i < reads; i++) {
+        rx->readRssi();
+    }
+    float readUs = (float)(micros() - startUs) / reads;
+    result.addMetric("readUs", readUs, "us");
+    result.addMetric("maxReadRate", readUs > 0 ? 1000000.0f / readUs : 0.0f, "Hz");
+
+    result.passed = samplesPerSec > 0;
+    result.details = String((uint32_t)samplesPerSec) + " samples/s in the timing loop, " +
+                     String(readUs, 1) + " us per ADC read";
+    if (!result.passed) {
+        result.details += " (timing loop not sampling)";
+    }
+    result.duration_ms = millis() - run.startMs;
+    return true;
+}
+
+bool SelfTest::stepBenchDetection(TestRun& run) {
+    const uint32_t windowMs = 1000;
+    const uint16_t filterRuns = 1000;
+    TestResult& result = run.result;
+    result.name = "Filter + Detection";
+
+    if (!lapTimer) {
+        result.passed = false;
+        result.details = "Lap timer not initialized";
+        result.duration_ms = millis() - run.startMs;
+        return true;
+    }
+
+    LapTimerLoopStats loop;
+    lapTimer->getLoopStats(loop);
+    if (run.phase == 0) {
+        bench.samples = loop.samples;
+        bench.processUs = loop.processUs;
+        bench.startUs = micros();
+        run.phase = 1;
+        run.waitMs = windowMs;
+        return false;
+    }
+    uint32_t elapsedUs = micros() - bench.startUs;
+    uint32_t samples = loop.samples - bench.samples;
+    uint32_t processUs = loop.processUs - bench.processUs;
+    if (samples == 0) {
+        result.passed = false;
+        result.details = "Timing loop not sampling";
+        result.duration_ms = millis() - run.startMs;
+        return true;
+    }
+    float perSampleUs = (float)processUs / samples;
+    float load = 100.0f * processUs / elapsedUs;
+
+    // The Kalman stage on its own, on a filter of our own
+    KalmanFilter filter;
+    volatile float sink = 0;
+    uint32_t startUs = micros();
+    for (uint16_t i = 0; i < filterRuns; i++) {
+        sink = filter.filter(i & 0xFF, 0);
+    }
+    (void)sink;
+    float kalmanUs = (float)(micros() - startUs) / filterRuns;
+
+    result.addMetric("perSampleUs", perSampleUs, "us");
+    result.addMetric("maxSampleUs", loop.maxProcessUs, "us");
+    result.addMetric("kalmanUs", kalmanUs, "us");
+    result.addMetric("coreLoad", load, "%");
+
+    result.passed = true;
+    result.details = String(perSampleUs, 2) + " us per sample (worst " + String(loop.maxProcessUs) +
+                     " us since boot), Kalman " + String(kalmanUs, 2) + " us, " + String(load, 1) +
+                     "% of the timing core";
+    result.duration_ms = millis() - run.startMs;
+    return true;
+}
+
+bool SelfTest::stepBenchRetune(TestRun& run) {
+    // Across the band and back, R1 <-> R8
+    static const uint16_t freqs[] = {5658, 5917};
+    const uint8_t tunes = 6;
+    const uint16_t maxSettleMs = 100;
+    const uint8_t stableReads = 3;  // In a row, within 1 of each other
+    TestResult& result = run.result;
+    result.name = "RX5808 Retune";
+
+    if (run.phase == 0 && run.sub == 0) {
+        if (!rx) {
+            result.passed = false;
+            result.details = "RX5808 pointer is null";
+            result.duration_ms = millis() - run.startMs;
+            return true;
+        }
+        if (raceInProgress()) {
+            result.passed = false;
+            result.details = "Skipped: race in progress";
+            result.duration_ms = millis() - run.startMs;
+            return true;
+        }
+        rx->holdTuning(true);
+        bench.totalUs = 0;
+        bench.maxUs = 0;
+        bench.settleMs = 0;
+    }
+
+    if (run.phase < tunes) {
+        if (run.sub == 0) {
+            uint32_t startUs = micros();
+            rx->setFrequency(freqs[run.phase & 1]);
+            uint32_t tuneUs = micros() - startUs;
+            bench.totalUs += tuneUs;
+            if (tuneUs > bench.maxUs) bench.maxUs = tuneUs;
+            bench.startUs = micros();
+            bench.last = 0;
+            bench.stable = 0;
+            run.sub = 1;
+            run.waitMs = 1;
+            return false;
+        }
+        // Settled once the RSSI stops moving
+        rx->recentSetFreqFlag = false;
+        uint8_t rssi = rx->readRssi();
+        bench.stable = abs((int)rssi - (int)bench.last) <= 1 ? bench.stable + 1 : 0;
+        bench.last = rssi;
+        uint32_t settleMs = (micros() - bench.startUs) / 1000;
+        if (bench.stable < stableReads && settleMs < maxSettleMs) {
+            run.sub++;
+            run.waitMs = 1;
+            return false;
+        }
+        bench.settleMs += settleMs;
+        run.phase++;
+        run.sub = 0;
+        run.progress = run.phase * 100 / tunes;
+        run.waitMs = RX5808_MIN_BUSTIME;
+        return false;
+    }
+
+    // Released, the RX goes back to the configured channel
+    rx->holdTuning(false);
+
+    float retuneMs = bench.totalUs / 1000.0f / tunes;
+    float settleMs = (float)bench.settleMs / tunes;
+    result.addMetric("retuneMs", retuneMs, "ms");
+    result.addMetric("retuneMaxMs", bench.maxUs / 1000.0f, "ms");
+    result.addMetric("settleMs", settleMs, "ms");
+
+    result.passed = true;
+    result.details = String(retuneMs, 2) + " ms per retune (worst " + String(bench.maxUs / 1000.0f, 2) +
+                     " ms), RSSI steady after " + String(settleMs, 1) + " ms";
+    result.duration_ms = millis() - run.startMs;
+    return true;
+}
+
+TestResult SelfTest::benchStorage(bool sd) {
+    TestResult result;
+    result.name = sd ? "SD Throughput" : "LittleFS Throughput";
+    uint32_t start = millis();
+
+    if (!storage) {
+        result.passed = false;
+        result.details = "Storage not initialized";
+        result.duration_ms = millis() - start;
+        return result;
+    }
+
+    StorageBenchResult fsResult;
+    if (!storage->runQuickBenchmark(sd ? STORAGE_TIER_BULK : STORAGE_TIER_HOT, fsResult)) {
+        result.passed = false;
+        result.details = String("Failed: ") + (fsResult.error ? fsResult.error : "unknown");
+        result.duration_ms = millis() - start;
+        return result;
+    }
+
+    result.addMetric("seqWriteMBs", fsResult.seqWriteMBs, "MB/s");
+    result.addMetric("seqReadMBs", fsResult.seqReadMBs, "MB/s");
+    result.addMetric("randWriteMBs", fsResult.randWriteMBs, "MB/s");
+    result.addMetric("randReadMBs", fsResult.randReadMBs, "MB/s");
+    result.addMetric("openUs", fsResult.openLatencyUs, "us");
+    result.addMetric("dirListMs", fsResult.dirListMs, "ms");
+
+    result.passed = true;
+    result.details = String("Write ") + String(fsResult.seqWriteMBs, 2) + " MB/s, read " + String(fsResult.seqReadMBs, 2) +
+                     " MB/s, open " + String(fsResult.openLatencyUs) + " us (" + String(fsResult.fileSize / 1024) + " KB file)";
+    result.duration_ms = millis() - start;
+    return result;
+}
+
+// Print that only counts, so serialization is timed without any I/O
+class CountingPrint : public Print {
+   public:
+    size_t count = 0;
+    size_t write(uint8_t) override {
+        count++;
+        return 1;
+    }
+    size_t write(const uint8_t*, size_t size) override {
+        count += size;
+        return size;
+    }
+};
+
+TestResult SelfTest::benchRaceJson() {
+    const uint8_t races = 50;
+    const uint8_t laps = 20;
+    const uint8_t passes = 4;
+    TestResult result;
+    result.name = "Race History JSON";
+    uint32_t start = millis();
+
+    // A full-size race as /races serves it
+    RaceSummary race = {};
+    race.timestamp = 1700000000;
+    race.lapCount = laps;
+    race.fastestLap = 21345;
+    race.medianLap = 23456;
+    race.best3LapsTotal = 65432;
+    race.totalTime = 470000;
+    race.frequency = 5800;
+    race.channel = 6;
+    race.trackId = 1;
+    race.totalDistance = 1234.5f;
+    strlcpy(race.name, "Benchmark race", sizeof(race.name));
+    strlcpy(race.tag, "bench", sizeof(race.tag));
+    strlcpy(race.pilotName, "Benchmark Pilot", sizeof(race.pilotName));
+    strlcpy(race.pilotCallsign, "BENCH", sizeof(race.pilotCallsign));
+    strlcpy(race.band, "F", sizeof(race.band));
+    strlcpy(race.trackName, "Benchmark Track", sizeof(race.trackName));
+    std::vector<uint32_t> lapTimes;
+    for (uint8_t i = 0; i < laps; i++) {
+        lapTimes.push_back(21345 + i * 137);
+    }
+
+    CountingPrint out;
+    uint32_t startUs = micros();
+    for (uint8_t pass = 0; pass < passes; pass++) {
+        out.print('[');
+        for (uint8_t i = 0; i < races; i++) {
+            if (i) out.print(',');
+            race.timestamp++;
+            RaceHistory::raceToJson(out, race, &lapTimes, true);
+        }
+        out.print(']');
+    }
+    uint32_t elapsedUs = micros() - startUs;
+    if (elapsedUs == 0) elapsedUs = 1;
+
+    float historyMs = elapsedUs / 1000.0f / passes;
+    float racesPerSec = (float)races * passes * 1000000.0f / elapsedUs;
+    float kbPerSec = out.count / 1024.0f * 1000000.0f / elapsedUs;
+    result.addMetric("historyMs", historyMs, "ms");
+    result.addMetric("racesPerSec", racesPerSec, "races/s");
+    result.addMetric("kbPerSec", kbPerSec, "KB/s");
+    result.addMetric("historyKB", out.count / 1024.0f / passes, "KB");
+
+    result.passed = true;
+    result.details = String(races) + " races of " + String(laps) + " laps in " + String(historyMs, 1) + " ms (" +
+                     String((uint32_t)racesPerSec) + " races/s, " + String((uint32_t)kbPerSec) + " KB/s)";
+    result.duration_ms = millis() - start;
+    return result;
+}
+
+bool SelfTest::stepBenchEvents(TestRun& run) {
+    const uint8_t pings = 20;
+    const uint16_t spacingMs = 20;     // Well inside what the queue absorbs
+    const uint16_t deliveryMs = 1000;  // Wait for stragglers
+    TestResult& result = run.result;
+    result.name = "SSE Events";
+
+    if (run.phase == 0) {
+        if (run.sub == 0) {
+            bench.samples = eventsSent;
+            bench.processUs = eventLatencyUs;
+            eventMaxLatencyUs = 0;
+        }
+        // Posted like any job event and timed until parallelTask has sent it
+        DynamicJsonDocument doc(SELFTEST_EVENT_SIZE);
+        doc["job"] = jobId;
+        doc["event"] = "ping";
+        doc["seq"] = run.sub;
+        postEvent(doc);
+        run.sub++;
+        run.waitMs = spacingMs;
+        if (run.sub == pings) {
+            run.phase = 1;
+            run.sub = 0;
+        }
+        return false;
+    }
+
+    uint32_t delivered = eventsSent - bench.samples;
+    if (delivered < pings && run.sub * spacingMs < deliveryMs) {
+        run.sub++;
+        run.waitMs = spacingMs;
+        return false;
+    }
+
+    if (delivered == 0) {
+        result.passed = false;
+        result.details = "No events delivered";
+        result.duration_ms = millis() - run.startMs;
+        return true;
+    }
+    float avgUs = (float)(eventLatencyUs - bench.processUs) / delivered;
+    result.addMetric("avgLatencyUs", avgUs, "us");
+    result.addMetric("maxLatencyUs", eventMaxLatencyUs, "us");
+    result.addMetric("delivered", delivered, "events");
+
+    result.passed = delivered >= pings;
+    result.details = String(delivered) + "/" + String(pings) + " events sent, avg " + String((uint32_t)avgUs) +
+                     " us, worst " + String(eventMaxLatencyUs) + " us from the job to the clients";
+    result.duration_ms = millis() - run.startMs;
+    return true;
 }
@@ -3,7 +3,11 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
-#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "storagebench.h"
 
 // Forward declarations
 class Config;
@@ -17,20 +21,82 @@ class RaceHistory;
 class RgbLed;
 #endif
 
+typedef enum {
+    BENCH_IDLE,
+    BENCH_RUNNING,
+    BENCH_DONE,
+    BENCH_FAILED
+} bench_state_e;
+
+#define SELFTEST_MAX_TESTS 20
+#define SELFTEST_EVENT_SIZE 384     // One formatted progress/result event
+#define SELFTEST_EVENT_QUEUE 8
+#define SELFTEST_TASK_STACK 6144
+#define SELFTEST_MAX_METRICS 6
+
+// Release the benchmark results are tagged with; the build can override it
+#ifndef FPVGATE_VERSION
+#define FPVGATE_VERSION "1.4.1"
+#endif
+
+typedef enum : uint8_t {
+    SELFTEST_DIAGNOSTICS,   // Pass/fail of each subsystem
+    SELFTEST_BENCHMARK      // Performance measurements, for comparing builds
+} selftest_category_e;
+
+// One measurement; name and unit are string literals. Names stay fixed
+// between releases so results can be compared run to run.
+struct BenchMetric {
+    const char* name;
+    float value;
+    const char* unit;
+};
+
 struct TestResult {
     String name;
     bool passed;
     String details;
     uint32_t duration_ms;
+    BenchMetric metrics[SELFTEST_MAX_METRICS];
+    uint8_t metricCount = 0;
+
+    void addMetric(const char* metricName, float value, const char* unit) {
+        if (metricCount < SELFTEST_MAX_METRICS) {
+            metrics[metricCount++] = {metricName, value, unit};
+        }
+    }
+};
+
+// State of one test while the job steps through it. A step either finishes
+// the test (fills in result, returns true) or asks to be called again after
+// waitMs, so waits never block anything but the job task.
+struct TestRun {
+    TestResult result;
+    uint16_t phase;     // Test-defined, starts at 0
+    uint16_t sub;
+    uint8_t progress;   // 0-100 within the test, for progress events
+    uint32_t waitMs;
+    uint32_t startMs;
 };
 
 class SelfTest {
    public:
     SelfTest();
     void init(Storage* stor);
+    // Subsystems the job tests; any of them may be null
+    void setTargets(Config* config, RX5808* rx5808, LapTimer* timer, Buzzer* buzzer, RaceHistory* history);
     
-    // Run all tests
-    bool runAllTests();
+    // A test suite runs as a background job on core 0. Returns the new job
+    // id, or 0 if a job is already running. Progress and results come out of
+    // pollEvent() as they happen; getJobJSON() has the whole picture.
+    uint32_t startJob(selftest_category_e category = SELFTEST_DIAGNOSTICS);
+    bool cancelJob();   // Stops after the test in progress
+    String getJobJSON();
+    // Next formatted job event ({"job":..,"event":"test"|"progress"|"result"|"done",..})
+    bool pollEvent(char* json, size_t len);
+    // Called once the event from pollEvent() has gone out to the clients;
+    // times the hop for the SSE benchmark
+    void eventSent();
     
     // Individual tests
     TestResult testStorage();
@@ -39,9 +105,9 @@ class SelfTest {
     TestResult testEEPROM();
     TestResult testWiFi();
     TestResult testBattery();
-    TestResult testRX5808(RX5808* rx5808);
+    bool stepRX5808(RX5808* rx5808, TestRun& run);
     TestResult testLapTimer(LapTimer* timer);
-    TestResult testAudio(Buzzer* buzzer);
+    bool stepAudio(Buzzer* buzzer, TestRun& run);
     TestResult testConfig(Config* config);
     TestResult testRaceHistory(RaceHistory* history);
     TestResult testWebServer();
@@ -51,18 +117,89 @@ class SelfTest {
     TestResult testTransport();
     
 #ifdef ESP32S3
-    TestResult testRGBLED(RgbLed* rgbLed);
+    bool stepRGBLED(RgbLed* rgbLed, TestRun& run);
     TestResult testUSB();
 #endif
+
+    // Benchmarks; results carry their numbers as metrics
+    TestResult benchHeap();
+    bool stepBenchSampling(TestRun& run);    // ADC rate and read cost
+    bool stepBenchDetection(TestRun& run);   // Filters and lap detection per sample
+    bool stepBenchRetune(TestRun& run);
+    TestResult benchStorage(bool sd);
+    TestResult benchRaceJson();
+    bool stepBenchEvents(TestRun& run);
     
-    // Get results
-    String getResultsJSON();
     bool allTestsPassed() const { return allPassed; }
     
+    // Storage benchmark takes seconds, so it runs in its own task.
+    // Returns false if one is already running; poll getStorageBenchmarkJSON().
+    bool startStorageBenchmark();
+    String getStorageBenchmarkJSON();
+    
    private:
     Storage* storage;
-    std::vector<TestResult> results;
+    Config* conf = nullptr;
+    RX5808* rx = nullptr;
+    LapTimer* lapTimer = nullptr;
+    Buzzer* buz = nullptr;
+    RaceHistory* raceHistory = nullptr;
     bool allPassed;
+    volatile bench_state_e benchState;
+    char benchJson[STORAGEBENCH_JSON_SIZE];
+
+    // Job state; results and the progress fields are guarded by jobLock
+    SemaphoreHandle_t jobLock = nullptr;
+    QueueHandle_t eventQueue = nullptr;
+    volatile bench_state_e jobState = BENCH_IDLE;
+    volatile bool jobCancel = false;
+    uint32_t jobId = 0;
+    selftest_category_e jobCategory = SELFTEST_DIAGNOSTICS;
+    const uint8_t* jobPlan = nullptr;
+    TestResult jobResults[SELFTEST_MAX_TESTS];
+    uint8_t jobResultCount = 0;
+    uint8_t jobTotal = 0;
+    uint8_t jobIndex = 0;
+    uint8_t jobProgress = 0;
+    uint32_t eventDrops = 0;
+
+    // RX5808 scan, carried between steps
+    struct {
+        uint8_t minRssi, maxRssi;
+        uint16_t minFreq, maxFreq;
+        uint8_t firstAvg, midAvg, lastAvg;
+        uint16_t sum;
+    } scan;
+
+    // Benchmark window, carried between steps
+    struct {
+        uint32_t samples;       // Lap timer loop counters at the window start
+        uint32_t processUs;
+        uint32_t startUs;
+        uint32_t totalUs;
+        uint32_t maxUs;
+        uint32_t settleMs;
+        uint8_t last;
+        uint8_t stable;
+        uint16_t count;
+    } bench;
+
+    // Event delivery times (parallelTask writes, the benchmark reads)
+    struct EventSlot {
+        uint32_t queuedUs;
+        char json[SELFTEST_EVENT_SIZE];
+    };
+    uint32_t polledQueuedUs = 0;
+    volatile uint32_t eventsSent = 0;
+    volatile uint32_t eventLatencyUs = 0;     // Total, queue to sent
+    volatile uint32_t eventMaxLatencyUs = 0;  // Since the benchmark reset it
+    
+    static void storageBenchmarkTask(void* arg);
+    static void jobTask(void* arg);
+    void runJob();
+    bool stepJobTest(uint8_t test, TestRun& run);
+    bool raceInProgress() const;  // Tests that retune the RX would blind the timer
+    void postEvent(JsonDocument& doc);
 };
 
 #endif
@@ -2,57 +2,85 @@
 #include "debug.h"
 #include "config.h"
 #include <FS.h>
+#include <algorithm>
 
-Storage::Storage() : sdAvailable(false) {
+#ifdef ESP32S3
+#include <Preferences.h>
+
+// Candidate SPI clocks, slowest first. The ESP32 SPI clock is 80MHz divided
+// by an integer, so these are speeds the bus can actually run at.
+static const uint32_t SD_SPI_CLOCKS[] = {4000000, 10000000, 20000000, 26666667, 40000000};
+#endif
+
+Storage::Storage() : sdAvailable(false), sdClockHz(0), tierRuleCount(0), migrationRequested(false),
+                     capacityStale(true), lastCapacityMs(0), queueLock(nullptr), ioLock(nullptr), flushTask(nullptr) {
+    memset(&wbStats, 0, sizeof(wbStats));
+    memset(tierStats, 0, sizeof(tierStats));
 #ifdef ESP32S3
     spi = nullptr;
 #endif
 }
 
 bool Storage::init() {
-    DEBUG("Initializing storage...\n");
+    LOG_I(LOG_STORAGE, "Initializing storage...\n");
+    
+    // Write-behind flush task (init may be called more than once)
+    if (!queueLock) {
+        queueLock = xSemaphoreCreateMutex();
+        ioLock = xSemaphoreCreateMutex();
+        xTaskCreatePinnedToCore(flushTaskMain, "storageFlush", WRITE_BEHIND_TASK_STACK, this,
+                                WRITE_BEHIND_TASK_PRIORITY, &flushTask, 0);
+    }
     
     // SD card init deferred to after boot to prevent watchdog timeout
     sdAvailable = false;
-    DEBUG("Storage: Using LittleFS (SD card will be initialized after boot)\n");
+    LOG_I(LOG_STORAGE, "Storage: Using LittleFS (SD card will be initialized after boot)\n");
     return true;
 }
 
 bool Storage::initSDDeferred() {
-    DEBUG("Attempting deferred SD card initialization...\n");
+    LOG_I(LOG_STORAGE, "Attempting deferred SD card initialization...\n");
     
 #ifdef ESP32S3
     if (sdAvailable) {
-        DEBUG("SD card already initialized\n");
+        LOG_I(LOG_STORAGE, "SD card already initialized\n");
         return true;
     }
     
+    // Queued writes belong to the filesystem they were issued against
+    flush();
+    
     uint32_t startTime = millis();
     bool success = initSD();
     uint32_t duration = millis() - startTime;
     
     if (success) {
         sdAvailable = true;
-        DEBUG("SD card initialized successfully (took %dms)\n", duration);
+        capacityStale = true;
+        LOG_I(LOG_STORAGE, "SD card initialized successfully (took %dms)\n", duration);
+        // Groups move before anyone can reach them on the card; other files
+        // written before the mount move to their tier in the background
+        migrateGroups();
+        requestMigration();
         return true;
     } else {
-        DEBUG("SD card init failed after %dms\n", duration);
+        LOG_W(LOG_STORAGE, "SD card init failed after %dms\n", duration);
         return false;
     }
 #else
-    DEBUG("SD card not supported on this platform\n");
+    LOG_I(LOG_STORAGE, "SD card not supported on this platform\n");
     return false;
 #endif
 }
 
 #ifdef ESP32S3
 bool Storage::initSD() {
-    DEBUG("\n=== SD Card Initialization ===\n");
-    DEBUG("Pin Configuration:\n");
-    DEBUG("  CS   = GPIO %d\n", PIN_SD_CS);
-    DEBUG("  SCK  = GPIO %d\n", PIN_SD_SCK);
-    DEBUG("  MOSI = GPIO %d\n", PIN_SD_MOSI);
-    DEBUG("  MISO = GPIO %d\n", PIN_SD_MISO);
+    LOG_D(LOG_STORAGE, "\n=== SD Card Initialization ===\n");
+    LOG_D(LOG_STORAGE, "Pin Configuration:\n");
+    LOG_D(LOG_STORAGE, "  CS   = GPIO %d\n", PIN_SD_CS);
+    LOG_D(LOG_STORAGE, "  SCK  = GPIO %d\n", PIN_SD_SCK);
+    LOG_D(LOG_STORAGE, "  MOSI = GPIO %d\n", PIN_SD_MOSI);
+    LOG_D(LOG_STORAGE, "  MISO = GPIO %d\n", PIN_SD_MISO);
     
     // Initialize CS pin
     pinMode(PIN_SD_CS, OUTPUT);
@@ -60,111 +88,143 @@ bool Storage::initSD() {
     
     // Create custom SPI bus for SD card
     spi = new SPIClass(HSPI);
-    DEBUG("SPI bus object created\n");
+    LOG_D(LOG_STORAGE, "SPI bus object created\n");
     
     // Begin SPI bus with correct pin order: SCK, MISO, MOSI, SS
     spi->begin(PIN_SD_SCK, PIN_SD_MISO, PIN_SD_MOSI, PIN_SD_CS);
-    DEBUG("SPI bus initialized\n");
-    
-    // Try to initialize SD card at 10MHz (safe for short wires)
-    DEBUG("Attempting SD.begin() at 10MHz...\n");
-    if (!SD.begin(PIN_SD_CS, *spi, 10000000)) {
-        DEBUG("ERROR: SD.begin() failed!\n");
-        DEBUG("Possible causes:\n");
-        DEBUG("  1. Card not inserted\n");
-        DEBUG("  2. Card not FAT32 formatted\n");
-        DEBUG("  3. Loose wiring\n");
-        DEBUG("  4. Incompatible card\n");
-        DEBUG("  5. Insufficient power\n");
-        spi->end();
-        delete spi;
-        spi = nullptr;
-        return false;
-    }
+    LOG_D(LOG_STORAGE, "SPI bus initialized\n");
     
-    uint8_t cardType = SD.cardType();
-    if (cardType == CARD_NONE) {
-        DEBUG("No SD card attached\n");
-        SD.end();
-        spi->end();
-        delete spi;
-        spi = nullptr;
-        return false;
+    // Start from the last clock that verified; re-probe if it no longer does
+    // (different card, longer wires, ...)
+    Preferences prefs;
+    prefs.begin(SD_CLOCK_PREFS_NAMESPACE, false);
+    uint32_t savedHz = prefs.getUInt(SD_CLOCK_PREFS_KEY, 0);
+    
+    if (savedHz && mountSD(savedHz)) {
+        sdClockHz = savedHz;
+        LOG_I(LOG_STORAGE, "SD card mounted at saved clock %uHz\n", savedHz);
+    } else {
+        // Walk up the clock list; the highest speed that passes read-back wins
+        uint32_t bestHz = 0;
+        bool mounted = false;
+        for (uint32_t clockHz : SD_SPI_CLOCKS) {
+            LOG_D(LOG_STORAGE, "Probing SD card at %uHz...\n", clockHz);
+            mounted = mountSD(clockHz);
+            if (!mounted) {
+                break;
+            }
+            bestHz = clockHz;
+        }
+        if (bestHz && !mounted) {
+            // The failed probe above the best clock left the card unmounted
+            mounted = mountSD(bestHz);
+        }
+        
+        if (!bestHz || !mounted) {
+            prefs.end();
+            LOG_E(LOG_STORAGE, "ERROR: SD.begin() failed!\n");
+            LOG_E(LOG_STORAGE, "Possible causes:\n");
+            LOG_E(LOG_STORAGE, "  1. Card not inserted\n");
+            LOG_E(LOG_STORAGE, "  2. Card not FAT32 formatted\n");
+            LOG_E(LOG_STORAGE, "  3. Loose wiring\n");
+            LOG_E(LOG_STORAGE, "  4. Incompatible card\n");
+            LOG_E(LOG_STORAGE, "  5. Insufficient power\n");
+            spi->end();
+            delete spi;
+            spi = nullptr;
+            return false;
+        }
+        
+        sdClockHz = bestHz;
+        prefs.putUInt(SD_CLOCK_PREFS_KEY, bestHz);
+        LOG_I(LOG_STORAGE, "SD card clock negotiated: %uHz (saved)\n", bestHz);
     }
+    prefs.end();
     
-    DEBUG("✅ SD card mounted successfully\n");
-    DEBUG("SD Card Type: ");
+    uint8_t cardType = SD.cardType();
+    LOG_I(LOG_STORAGE, "✅ SD card mounted successfully\n");
+    LOG_I(LOG_STORAGE, "SD Card Type: ");
     if (cardType == CARD_MMC) {
-        DEBUG("MMC\n");
+        LOG_I(LOG_STORAGE, "MMC\n");
     } else if (cardType == CARD_SD) {
-        DEBUG("SDSC\n");
+        LOG_I(LOG_STORAGE, "SDSC\n");
     } else if (cardType == CARD_SDHC) {
-        DEBUG("SDHC/SDXC\n");
+        LOG_I(LOG_STORAGE, "SDHC/SDXC\n");
     } else {
-        DEBUG("UNKNOWN\n");
+        LOG_I(LOG_STORAGE, "UNKNOWN\n");
     }
     
     uint64_t cardSize = SD.cardSize() / (1024 * 1024);
-    DEBUG("SD Card Size: %lluMB\n", cardSize);
+    LOG_I(LOG_STORAGE, "SD Card Size: %lluMB\n", cardSize);
     
     uint64_t usedBytes = SD.usedBytes() / (1024 * 1024);
-    DEBUG("SD Card Used: %lluMB\n", usedBytes);
+    LOG_I(LOG_STORAGE, "SD Card Used: %lluMB\n", usedBytes);
     
     return true;
 }
-#endif
 
-bool Storage::writeFile(const String& path, const String& data) {
-    DEBUG("Storage: Writing to %s (%d bytes)\n", path.c_str(), data.length());
-    
-#ifdef ESP32S3
-    if (sdAvailable) {
-        File file = SD.open(path, FILE_WRITE);
-        if (!file) {
-            DEBUG("Failed to open file on SD: %s\n", path.c_str());
-            return false;
-        }
-        size_t written = file.print(data);
-        file.close();
-        return written > 0;
+// Mounts the card at one SPI clock and checks that data survives a round trip
+bool Storage::mountSD(uint32_t clockHz) {
+    SD.end();
+    if (!SD.begin(PIN_SD_CS, *spi, clockHz)) {
+        return false;
     }
-#endif
-    
-    // Fall back to LittleFS
-    File file = LittleFS.open(path, "w");
-    if (!file) {
-        DEBUG("Failed to open file on LittleFS: %s\n", path.c_str());
+    if (SD.cardType() == CARD_NONE || !verifySD()) {
+        SD.end();
         return false;
     }
-    size_t written = file.print(data);
-    file.close();
-    return written > 0;
+    return true;
 }
 
-bool Storage::readFile(const String& path, String& data) {
-#ifdef ESP32S3
-    if (sdAvailable) {
-        if (!SD.exists(path)) {
-            return false;
+bool Storage::verifySD() {
+    uint8_t buffer[512];
+    File file = SD.open(SD_PROBE_FILE, FILE_WRITE);
+    if (!file) {
+        return false;
+    }
+    bool ok = true;
+    for (uint32_t offset = 0; ok && offset < SD_PROBE_BYTES; offset += sizeof(buffer)) {
+        for (size_t i = 0; i < sizeof(buffer); i++) {
+            buffer[i] = (uint8_t)(((offset + i) * 2654435761u) >> 24);
         }
-        File file = SD.open(path, FILE_READ);
-        if (!file) {
-            DEBUG("Failed to open file on SD: %s\n", path.c_str());
-            return false;
+        ok = file.write(buffer, sizeof(buffer)) == sizeof(buffer);
+    }
+    file.close();
+    
+    if (ok) {
+        file = SD.open(SD_PROBE_FILE, FILE_READ);
+        ok = file && file.size() == SD_PROBE_BYTES;
+        for (uint32_t offset = 0; ok && offset < SD_PROBE_BYTES; offset += sizeof(buffer)) {
+            ok = file.read(buffer, sizeof(buffer)) == sizeof(buffer);
+            for (size_t i = 0; ok && i < sizeof(buffer); i++) {
+                ok = buffer[i] == (uint8_t)(((offset + i) * 2654435761u) >> 24);
+            }
         }
-        data = file.readString();
-        file.close();
-        return true;
+        if (file) file.close();
+    }
+    SD.remove(SD_PROBE_FILE);
+    if (!ok) {
+        LOG_W(LOG_STORAGE, "SD read-back verification failed\n");
     }
+    return ok;
+}
 #endif
+
+bool Storage::writeFile(const String& path, const String& data) {
+    LOG_D(LOG_STORAGE, "Storage: Writing to %s (%d bytes)\n", path.c_str(), data.length());
     
-    // Fall back to LittleFS
-    if (!LittleFS.exists(path)) {
+    StorageWriter writer;
+    if (!openWrite(path, writer)) {
         return false;
     }
-    File file = LittleFS.open(path, "r");
+    writer.write((const uint8_t*)data.c_str(), data.length());
+    return writer.commit();
+}
+
+bool Storage::readFile(const String& path, String& data) {
+    // openRead() syncs any queued write to this path
+    File file = openRead(path);
     if (!file) {
-        DEBUG("Failed to open file on LittleFS: %s\n", path.c_str());
         return false;
     }
     data = file.readString();
@@ -173,67 +233,578 @@ bool Storage::readFile(const String& path, String& data) {
 }
 
 bool Storage::deleteFile(const String& path) {
-#ifdef ESP32S3
-    if (sdAvailable) {
-        return SD.remove(path);
+    syncPath(path);
+    // A file may be on either tier while it waits for migration
+    fs::FS& preferred = tierFS(getTier(path));
+    bool removed = preferred.exists(path) && preferred.remove(path);
+    fs::FS* other = otherFS(preferred);
+    if (other && other->exists(path)) {
+        removed = other->remove(path) || removed;
     }
-#endif
-    return LittleFS.remove(path);
+    return removed;
 }
 
-bool Storage::exists(const String& path) {
-#ifdef ESP32S3
-    if (sdAvailable) {
-        return SD.exists(path);
+bool Storage::renameFile(const String& from, const String& to) {
+    syncPath(from);
+    syncPath(to);
+    fs::FS* fs = locate(from);
+    if (!fs) {
+        return false;
     }
-#endif
-    return LittleFS.exists(path);
+    fs::FS* other = otherFS(*fs);
+    if (other && other->exists(to)) {
+        other->remove(to);
+    }
+    return fs->rename(from, to);
+}
+
+bool Storage::exists(const String& path) {
+    syncPath(path);
+    return locate(path) != nullptr;
 }
 
 bool Storage::mkdir(const String& path) {
+    // Directories are cheap: create them on both tiers so either can take the files
+    bool success = LittleFS.exists(path) || LittleFS.mkdir(path);
 #ifdef ESP32S3
     if (sdAvailable) {
-        return SD.mkdir(path);
+        success = (SD.exists(path) || SD.mkdir(path)) && success;
     }
 #endif
-    return LittleFS.mkdir(path);
+    return success;
 }
 
 bool Storage::listDir(const String& path, std::vector<String>& files) {
     files.clear();
+    flush();  // Queued files must show up in the listing
     
+    // Held so a file being migrated is seen on exactly one tier
+    if (ioLock) xSemaphoreTake(ioLock, portMAX_DELAY);
+    bool found = false;
+    File root = LittleFS.open(path);
+    if (root && root.isDirectory()) {
+        root.close();
+        listInto(LittleFS, path, files);
+        found = true;
+    }
 #ifdef ESP32S3
     if (sdAvailable) {
-        File root = SD.open(path);
-        if (!root || !root.isDirectory()) {
-            return false;
+        root = SD.open(path);
+        if (root && root.isDirectory()) {
+            root.close();
+            listInto(SD, path, files);
+            found = true;
         }
-        
-        File file = root.openNextFile();
-        while (file) {
-            if (!file.isDirectory()) {
-                files.push_back(String(file.name()));
+    }
+#endif
+    if (ioLock) xSemaphoreGive(ioLock);
+    return found;
+}
+
+void Storage::listInto(fs::FS& fs, const String& path, std::vector<String>& files) {
+    size_t existing = files.size();
+    File root = fs.open(path);
+    File file = root.openNextFile();
+    while (file) {
+        if (!file.isDirectory()) {
+            String name = String(file.name());
+            if (std::find(files.begin(), files.begin() + existing, name) == files.begin() + existing) {
+                files.push_back(name);
             }
-            file = root.openNextFile();
         }
-        return true;
+        file = root.openNextFile();
+    }
+}
+
+fs::FS& Storage::activeFS() {
+#ifdef ESP32S3
+    if (sdAvailable) {
+        return SD;
     }
 #endif
+    return LittleFS;
+}
+
+// Puts back the previous version if a reset hit a commit between moving the
+// old file aside and renaming the new one into place
+void Storage::restoreInterrupted(fs::FS& fs, const String& path) {
+    String oldPath = path + STORAGE_OLD_SUFFIX;
+    if (!fs.exists(path) && fs.exists(oldPath)) {
+        LOG_W(LOG_STORAGE, "Storage: Restoring %s after interrupted write\n", path.c_str());
+        fs.rename(oldPath, path);
+    }
+}
+
+bool Storage::openWrite(const String& path, StorageWriter& writer, size_t expectedSize) {
+    // Synchronous writes go out after everything queued before them
+    flush();
+    return openWriteDirect(path, writer, expectedSize);
+}
+
+bool Storage::openWriteDirect(const String& path, StorageWriter& writer, size_t expectedSize) {
+    fs::FS* fs = writeTarget(path, expectedSize);
+    if (!fs || !openWriteOn(*fs, path, writer)) {
+        return false;
+    }
+    writer.staleFS = otherFS(*fs);
+    return true;
+}
+
+bool Storage::openWriteOn(fs::FS& fs, const String& path, StorageWriter& writer) {
+    writer.abort();
+    writer.file = fs.open(path + STORAGE_TMP_SUFFIX, FILE_WRITE);
+    if (!writer.file) {
+        LOG_E(LOG_STORAGE, "Failed to open file for writing: %s\n", path.c_str());
+        return false;
+    }
+    writer.fs = &fs;
+    writer.staleFS = nullptr;
+    writer.path = path;
+    writer.buffered = 0;
+    writer.total = 0;
+    writer.error = false;
+    return true;
+}
+
+File Storage::openRead(const String& path) {
+    syncPath(path);
+    fs::FS& preferred = homeFS(path);
+    restoreInterrupted(preferred, path);
+    fs::FS* fs = locate(path);
+    if (!fs) {
+        return File();
+    }
+    File file = fs->open(path, FILE_READ);
+    if (!file) {
+        LOG_E(LOG_STORAGE, "Failed to open file for reading: %s\n", path.c_str());
+    }
+    return file;
+}
+
+StorageWriter::StorageWriter() : fs(nullptr), staleFS(nullptr), buffered(0), total(0), error(false) {
+}
+
+StorageWriter::~StorageWriter() {
+    abort();
+}
+
+bool StorageWriter::flushBuffer() {
+    if (buffered == 0) return !error;
+    if (file.write(buffer, buffered) != buffered) {
+        error = true;
+    }
+    buffered = 0;
+    return !error;
+}
+
+size_t StorageWriter::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t StorageWriter::write(const uint8_t* data, size_t len) {
+    if (!fs || error) return 0;
+    size_t remaining = len;
+    while (remaining > 0) {
+        if (buffered == 0 && remaining >= sizeof(buffer)) {
+            // Large chunks skip the copy
+            if (file.write(data, remaining) != remaining) {
+                error = true;
+                return 0;
+            }
+            break;
+        }
+        size_t n = std::min(remaining, sizeof(buffer) - buffered);
+        memcpy(buffer + buffered, data, n);
+        buffered += n;
+        data += n;
+        remaining -= n;
+        if (buffered == sizeof(buffer) && !flushBuffer()) {
+            return 0;
+        }
+    }
+    total += len;
+    return len;
+}
+
+bool StorageWriter::commit() {
+    if (!fs) return false;
+    flushBuffer();
+    file.close();
+
+    String tmpPath = path + STORAGE_TMP_SUFFIX;
+    if (error) {
+        LOG_W(LOG_STORAGE, "Storage: Write to %s failed, keeping previous version\n", path.c_str());
+        abort();
+        return false;
+    }
+
+    bool success = fs->rename(tmpPath, path);
+    if (!success) {
+        // FAT won't rename over an existing file: move the old one aside first
+        // so there is always one complete version on disk
+        String oldPath = path + STORAGE_OLD_SUFFIX;
+        fs->remove(oldPath);
+        fs->rename(path, oldPath);
+        success = fs->rename(tmpPath, path);
+        if (success) {
+            fs->remove(oldPath);
+        } else {
+            fs->rename(oldPath, path);
+        }
+    }
+    if (!success) {
+        LOG_E(LOG_STORAGE, "Storage: Failed to commit %s\n", path.c_str());
+        fs->remove(tmpPath);
+    } else if (staleFS && staleFS->exists(path)) {
+        // The previous version lived on the other tier
+        staleFS->remove(path);
+    }
+
+    fs = nullptr;
+    return success;
+}
+
+void StorageWriter::abort() {
+    if (!fs) return;
+    file.close();
+    fs->remove(path + STORAGE_TMP_SUFFIX);
+    fs = nullptr;
+    buffered = 0;
+}
+
+bool Storage::writeBytes(const String& path, const uint8_t* data, size_t len) {
+    flush();
+    fs::FS* fs = writeTarget(path, len);
+    if (!fs) {
+        return false;
+    }
+    File file = fs->open(path, FILE_WRITE);
+    if (!file) {
+        LOG_E(LOG_STORAGE, "Failed to open file for writing: %s\n", path.c_str());
+        return false;
+    }
+    size_t written = len ? file.write(data, len) : 0;
+    file.close();
+    fs::FS* other = otherFS(*fs);
+    if (other && other->exists(path)) {
+        other->remove(path);
+    }
+    return written == len;
+}
+
+bool Storage::appendBytes(const String& path, const uint8_t* data, size_t len) {
+    flush();
+    return appendDirect(path, data, len);
+}
+
+bool Storage::appendDirect(const String& path, const uint8_t* data, size_t len) {
+    // Appends stay with the existing file; splitting it across tiers would lose data
+    fs::FS* fs = locate(path);
+    if (!fs) {
+        fs = writeTarget(path, len);
+    } else if (!hasSpace(*fs, len)) {
+        StorageTier tier = getTier(path);
+        lockStats();
+        tierStats[tier].fullFailures++;
+        unlockStats();
+        LOG_W(LOG_STORAGE, "Storage: No space to append %d bytes to %s\n", len, path.c_str());
+        fs = nullptr;
+    }
+    if (!fs) {
+        return false;
+    }
+    File file = fs->open(path, FILE_APPEND);
+    if (!file) {
+        LOG_E(LOG_STORAGE, "Failed to open file for appending: %s\n", path.c_str());
+        return false;
+    }
+    size_t written = len ? file.write(data, len) : 0;
+    file.close();
+    return written == len;
+}
+
+size_t Storage::readBytes(const String& path, uint32_t offset, uint8_t* buf, size_t len) {
+    syncPath(path);
+    fs::FS* fs = locate(path);
+    if (!fs) {
+        return 0;
+    }
+    File file = fs->open(path, FILE_READ);
+    if (!file) {
+        LOG_E(LOG_STORAGE, "Failed to open file for reading: %s\n", path.c_str());
+        return 0;
+    }
+    size_t bytesRead = 0;
+    if (offset == 0 || file.seek(offset)) {
+        bytesRead = file.read(buf, len);
+    }
+    file.close();
+    return bytesRead;
+}
+
+size_t Storage::fileSize(const String& path) {
+    syncPath(path);
+    fs::FS* fs = locate(path);
+    if (!fs) {
+        return 0;
+    }
+    File file = fs->open(path, FILE_READ);
+    if (!file) {
+        return 0;
+    }
+    size_t size = file.size();
+    file.close();
+    return size;
+}
+
+bool Storage::queueWrite(const String& path, const uint8_t* data, size_t len) {
+    return enqueue(path, data, len, false);
+}
+
+bool Storage::queueAppend(const String& path, const uint8_t* data, size_t len) {
+    return enqueue(path, data, len, true);
+}
+
+bool Storage::enqueue(const String& path, const uint8_t* data, size_t len, bool append) {
+    if (!queueLock || len > WRITE_BEHIND_MAX_BYTES) {
+        // No flush task yet, or too big to buffer: write in the caller, after
+        // whatever is already queued so this write doesn't overtake it
+        if (queueLock) {
+            xSemaphoreTake(queueLock, portMAX_DELAY);
+            wbStats.syncFallbacks++;
+            xSemaphoreGive(queueLock);
+            flush();
+        }
+        if (append) {
+            return appendBytes(path, data, len);
+        }
+        StorageWriter writer;
+        return openWrite(path, writer) && writer.write(data, len) == len && writer.commit();
+    }
+
+    for (;;) {
+        xSemaphoreTake(queueLock, portMAX_DELAY);
+        // Only the newest entry takes more data: merging into an older one
+        // would write this ahead of everything queued after that entry
+        PendingWrite* existing = nullptr;
+        if (!pending.empty() && pending.back().path == path) {
+            existing = &pending.back();
+        }
+        size_t replaced = (existing && !append) ? existing->data.size() : 0;
+        if (wbStats.queuedBytes - replaced + len <= WRITE_BEHIND_MAX_BYTES) {
+            if (existing) {
+                if (append) {
+                    existing->data.insert(existing->data.end(), data, data + len);
+                } else {
+                    existing->data.assign(data, data + len);
+                    existing->append = false;
+                }
+                wbStats.coalescedWrites++;
+            } else {
+                PendingWrite entry;
+                entry.path = path;
+                entry.data.assign(data, data + len);
+                entry.append = append;
+                pending.push_back(std::move(entry));
+                wbStats.queuedFiles++;
+            }
+            wbStats.queuedBytes = wbStats.queuedBytes - replaced + len;
+            wbStats.peakQueuedBytes = std::max(wbStats.peakQueuedBytes, wbStats.queuedBytes);
+            xSemaphoreGive(queueLock);
+            xTaskNotifyGive(flushTask);
+            return true;
+        }
+        // Queue full: drain it here, then queue into the empty buffer
+        wbStats.syncFallbacks++;
+        xSemaphoreGive(queueLock);
+        flush();
+    }
+}
+
+bool Storage::popPending(PendingWrite& out) {
+    bool found = false;
+    xSemaphoreTake(queueLock, portMAX_DELAY);
+    if (!pending.empty()) {
+        out = std::move(pending.front());
+        pending.erase(pending.begin());
+        wbStats.queuedBytes -= out.data.size();
+        wbStats.queuedFiles--;
+        found = true;
+    }
+    xSemaphoreGive(queueLock);
+    return found;
+}
+
+void Storage::writePending(const PendingWrite& entry) {
+    uint32_t start = micros();
+    bool success;
+    if (entry.append) {
+        success = appendDirect(entry.path, entry.data.data(), entry.data.size());
+    } else {
+        StorageWriter writer;
+        success = openWriteDirect(entry.path, writer) &&
+                  writer.write(entry.data.data(), entry.data.size()) == entry.data.size() &&
+                  writer.commit();
+    }
+    uint32_t elapsed = micros() - start;
+
+    xSemaphoreTake(queueLock, portMAX_DELAY);
+    if (success) {
+        wbStats.flushedWrites++;
+        wbStats.flushedBytes += entry.data.size();
+    } else {
+        wbStats.failedWrites++;
+    }
+    wbStats.lastFlushUs = elapsed;
+    wbStats.maxFlushUs = std::max(wbStats.maxFlushUs, elapsed);
+    xSemaphoreGive(queueLock);
+
+    if (!success) {
+        LOG_E(LOG_STORAGE, "Storage: Write-behind to %s failed (%d bytes)\n", entry.path.c_str(), entry.data.size());
+    }
+}
+
+// Read-your-writes: anything queued for this path is written before it is read.
+// The queue is written in order up to the path's last entry, so the path's
+// data never reaches the disk ahead of writes queued before it.
+void Storage::syncPath(const String& path) {
+    if (!ioLock) return;
+    xSemaphoreTake(ioLock, portMAX_DELAY);  // Also waits out an in-flight write
+    size_t count = 0;
+    xSemaphoreTake(queueLock, portMAX_DELAY);
+    for (size_t i = 0; i < pending.size(); i++) {
+        if (pending[i].path == path) {
+            count = i + 1;
+        }
+    }
+    xSemaphoreGive(queueLock);
+    PendingWrite entry;
+    while (count-- > 0 && popPending(entry)) {
+        writePending(entry);
+    }
+    xSemaphoreGive(ioLock);
+}
+
+void Storage::flush() {
+    if (!ioLock) return;
+    xSemaphoreTake(ioLock, portMAX_DELAY);
+    PendingWrite entry;
+    while (popPending(entry)) {
+        writePending(entry);
+    }
+    xSemaphoreGive(ioLock);
+}
+
+WriteBehindStats Storage::getWriteBehindStats() {
+    WriteBehindStats stats;
+    if (!queueLock) {
+        return wbStats;
+    }
+    xSemaphoreTake(queueLock, portMAX_DELAY);
+    stats = wbStats;
+    xSemaphoreGive(queueLock);
+    return stats;
+}
+
+// Benchmark adapter for an Arduino filesystem
+class FsBenchTarget : public BenchTarget {
+   public:
+    explicit FsBenchTarget(fs::FS& fs) : fs(fs) {}
     
-    // LittleFS
-    File root = LittleFS.open(path);
-    if (!root || !root.isDirectory()) {
+    bool openRead(const char* path) override { return open(path, FILE_READ); }
+    bool openWrite(const char* path) override { return open(path, FILE_WRITE); }
+    bool openUpdate(const char* path) override { return open(path, "r+"); }
+    size_t read(uint8_t* buf, size_t len) override { return file.read(buf, len); }
+    size_t write(const uint8_t* data, size_t len) override { return file.write(data, len); }
+    bool seek(uint32_t pos) override { return file.seek(pos); }
+    void close() override { file.close(); }
+    bool remove(const char* path) override { return fs.remove(path); }
+    bool mkdir(const char* path) override { return fs.mkdir(path); }
+    bool rmdir(const char* path) override { return fs.rmdir(path); }
+    int listDir(const char* path) override {
+        File dir = fs.open(path);
+        if (!dir || !dir.isDirectory()) return -1;
+        int count = 0;
+        File entry = dir.openNextFile();
+        while (entry) {
+            count++;
+            entry = dir.openNextFile();
+        }
+        return count;
+    }
+    uint32_t micros() override { return ::micros(); }
+    
+   private:
+    fs::FS& fs;
+    File file;
+    
+    bool open(const char* path, const char* mode) {
+        file.close();
+        file = fs.open(path, mode);
+        return (bool)file;
+    }
+};
+
+bool Storage::runBenchmark(StorageBenchResult& result) {
+    flush();
+    
+    StorageBenchConfig config = StorageBench::defaults();
+    if (!sdAvailable) {
+        // LittleFS shares the flash with the firmware: keep it small
+        config.fileSize = 256 * 1024;
+        config.dirFiles = 100;
+    }
+    
+    LOG_I(LOG_STORAGE, "Storage: Running benchmark on %s (%u bytes, %u files)\n",
+          getStorageType().c_str(), config.fileSize, config.dirFiles);
+    FsBenchTarget target(activeFS());
+    bool ok = StorageBench::run(target, config, result);
+    if (!ok) {
+        LOG_W(LOG_STORAGE, "Storage: Benchmark failed at %s\n", result.error);
+    }
+    return ok;
+}
+
+bool Storage::runQuickBenchmark(StorageTier tier, StorageBenchResult& result) {
+    memset(&result, 0, sizeof(result));
+    if (tier == STORAGE_TIER_BULK && !sdAvailable) {
+        result.error = "no SD card";
         return false;
     }
+    flush();
     
-    File file = root.openNextFile();
-    while (file) {
-        if (!file.isDirectory()) {
-            files.push_back(String(file.name()));
+    // Small enough to finish in a second or two on LittleFS
+    StorageBenchConfig config = StorageBench::defaults();
+    config.dir = "/qbench";
+    config.fileSize = 64 * 1024;
+    config.randomOps = 32;
+    config.openIterations = 10;
+    config.dirFiles = 20;
+    
+    FsBenchTarget target(tierFS(tier));
+    bool ok = StorageBench::run(target, config, result);
+    if (!ok) {
+        LOG_W(LOG_STORAGE, "Storage: Quick benchmark failed at %s\n", result.error);
+    }
+    return ok;
+}
+
+void Storage::flushTaskMain(void* arg) {
+    Storage* storage = static_cast<Storage*>(arg);
+    for (;;) {
+        if (storage->capacityStale || millis() - storage->lastCapacityMs >= STORAGE_CAPACITY_REFRESH_MS) {
+            storage->refreshCapacity();
+        }
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STORAGE_CAPACITY_REFRESH_MS)) == 0) {
+            continue;
+        }
+        vTaskDelay(pdMS_TO_TICKS(WRITE_BEHIND_DELAY_MS));
+        storage->flush();
+        if (storage->migrationRequested) {
+            storage->migrate();
+            storage->capacityStale = true;
         }
-        file = root.openNextFile();
     }
-    return true;
 }
 
 uint64_t Storage::getTotalBytes() {
@@ -258,109 +829,423 @@ uint64_t Storage::getFreeBytes() {
     return getTotalBytes() - getUsedBytes();
 }
 
-bool Storage::migrateSoundsToSD() {
-#ifdef ESP32S3
-    if (!sdAvailable) {
-        DEBUG("SD card not available, cannot migrate sounds\n");
+// Directory to scan for a tier rule: "/tracks/images/" -> "/tracks/images",
+// "/sounds" -> "/" (matches /sounds and /sounds_* alike)
+static String ruleDir(const char* prefix) {
+    String dir(prefix);
+    int slash = dir.lastIndexOf('/');
+    return slash > 0 ? dir.substring(0, slash) : String("/");
+}
+
+static size_t littleFSFree() {
+    size_t total = LittleFS.totalBytes();
+    size_t used = LittleFS.usedBytes();
+    return total > used ? total - used : 0;
+}
+
+static void makeParents(fs::FS& fs, const String& path) {
+    for (int slash = path.indexOf('/', 1); slash > 0; slash = path.indexOf('/', slash + 1)) {
+        String dir = path.substring(0, slash);
+        if (!fs.exists(dir)) {
+            fs.mkdir(dir);
+        }
+    }
+}
+
+void Storage::lockStats() {
+    if (queueLock) xSemaphoreTake(queueLock, portMAX_DELAY);
+}
+
+void Storage::unlockStats() {
+    if (queueLock) xSemaphoreGive(queueLock);
+}
+
+bool Storage::setTier(const char* prefix, StorageTier tier, uint8_t flags) {
+    if (strlen(prefix) >= STORAGE_TIER_PREFIX_LEN) {
+        LOG_W(LOG_STORAGE, "Storage: Tier prefix too long: %s\n", prefix);
         return false;
     }
-    
-    // Check if sounds already exist on SD
-    if (SD.exists("/sounds")) {
-        DEBUG("Sounds directory already exists on SD card\n");
-        return true;
+    for (size_t i = 0; i < tierRuleCount; i++) {
+        if (strcmp(tierRules[i].prefix, prefix) == 0) {
+            tierRules[i].tier = tier;
+            tierRules[i].flags = flags;
+            tierRules[i].home = nullptr;
+            return true;
+        }
     }
-    
-    // Check if sounds exist in LittleFS
-    if (!LittleFS.exists("/sounds")) {
-        DEBUG("No sounds directory in LittleFS to migrate\n");
+    if (tierRuleCount >= STORAGE_MAX_TIER_RULES) {
+        LOG_W(LOG_STORAGE, "Storage: No room for tier rule %s\n", prefix);
         return false;
     }
+    TierRule& rule = tierRules[tierRuleCount++];
+    strlcpy(rule.prefix, prefix, sizeof(rule.prefix));
+    rule.tier = tier;
+    rule.flags = flags;
+    rule.home = nullptr;
+    return true;
+}
+
+const Storage::TierRule* Storage::findRule(const String& path) const {
+    const TierRule* best = nullptr;
+    size_t bestLen = 0;
+    for (size_t i = 0; i < tierRuleCount; i++) {
+        size_t len = strlen(tierRules[i].prefix);
+        if (len > bestLen && path.startsWith(tierRules[i].prefix)) {
+            best = &tierRules[i];
+            bestLen = len;
+        }
+    }
+    return best;
+}
+
+StorageTier Storage::getTier(const String& path) const {
+    const TierRule* rule = findRule(path);
+    return rule ? rule->tier : STORAGE_TIER_BULK;
+}
+
+fs::FS& Storage::tierFS(StorageTier tier) {
+    if (tier == STORAGE_TIER_HOT) {
+        return LittleFS;
+    }
+    return activeFS();
+}
+
+fs::FS& Storage::groupFS(const TierRule& rule) {
+    return rule.home ? *rule.home : tierFS(rule.tier);
+}
+
+// Where path is written: its tier's filesystem, or for a group wherever the
+// group currently lives
+fs::FS& Storage::homeFS(const String& path) {
+    const TierRule* rule = findRule(path);
+    if (rule && (rule->flags & TIER_FLAG_GROUP)) {
+        return groupFS(*rule);
+    }
+    return tierFS(rule ? rule->tier : STORAGE_TIER_BULK);
+}
+
+fs::FS* Storage::otherFS(fs::FS& fs) {
+#ifdef ESP32S3
+    if (sdAvailable) {
+        return &fs == &SD ? static_cast<fs::FS*>(&LittleFS) : static_cast<fs::FS*>(&SD);
+    }
+#endif
+    return nullptr;
+}
+
+// Preferred tier first, then the other one (not yet migrated, or spilled)
+fs::FS* Storage::locate(const String& path) {
+    fs::FS& preferred = homeFS(path);
+    if (preferred.exists(path)) {
+        return &preferred;
+    }
+    const TierRule* rule = findRule(path);
+    if (rule && (rule->flags & TIER_FLAG_GROUP)) {
+        return nullptr;  // A copy on the other side is left over from before the group moved
+    }
+    fs::FS* other = otherFS(preferred);
+    if (other && other->exists(path)) {
+        return other;
+    }
+    return nullptr;
+}
+
+fs::FS* Storage::writeTarget(const String& path, size_t len) {
+    const TierRule* rule = findRule(path);
+    StorageTier tier = rule ? rule->tier : STORAGE_TIER_BULK;
+    bool grouped = rule && (rule->flags & TIER_FLAG_GROUP);
+    fs::FS& target = homeFS(path);
+    if (hasSpace(target, len)) {
+        return &target;
+    }
     
-    DEBUG("\n=== Migrating sounds to SD card ===\n");
+    // A group is never split, so it doesn't spill either
+    fs::FS* other = grouped ? nullptr : otherFS(target);
+    if (other && hasSpace(*other, len)) {
+        lockStats();
+        tierStats[tier].spilledWrites++;
+        unlockStats();
+        LOG_W(LOG_STORAGE, "Storage: %s tier full, writing %s to the other tier\n",
+              tier == STORAGE_TIER_HOT ? "Hot" : "Bulk", path.c_str());
+        return other;
+    }
     
-    // Create sounds directory on SD
-    if (!SD.mkdir("/sounds")) {
-        DEBUG("Failed to create /sounds directory on SD\n");
+    // Only LittleFS is ever found full (see hasSpace()). Without a card
+    // nothing can be evicted, so the write fails and the caller reports it.
+    lockStats();
+    tierStats[tier].fullFailures++;
+    unlockStats();
+    LOG_E(LOG_STORAGE, "Storage: %s tier full, cannot write %s (LittleFS, %u bytes free)\n",
+          tier == STORAGE_TIER_HOT ? "Hot" : "Bulk", path.c_str(), littleFSFree());
+    return nullptr;
+}
+
+bool Storage::hasSpace(fs::FS& fs, size_t len) {
+    // Only LittleFS is checked: cards are large and a FAT free-space query
+    // can take seconds
+    if (&fs != &LittleFS) {
+        return true;
+    }
+    if (littleFSFree() >= len + STORAGE_MIN_FREE_BYTES) {
+        return true;
+    }
+    return evict(fs, len);
+}
+
+// Deletes LittleFS copies of files that are also on the card, oldest first,
+// until len bytes plus the reserve are free. A file's only copy is never
+// deleted, so without a card this frees nothing.
+bool Storage::evict(fs::FS& fs, size_t len) {
+    struct Candidate {
+        String path;
+        time_t lastWrite;
+        size_t size;
+        StorageTier tier;
+    };
+    std::vector<Candidate> candidates;
+    fs::FS* other = otherFS(fs);
+    if (!other) {
         return false;
     }
     
-    // Copy all files from LittleFS /sounds to SD /sounds
-    bool success = copyDirectory("/sounds", "/sounds", false);
-    
-    if (success) {
-        DEBUG("✅ Migration complete!\n");
-        DEBUG("You can now delete /sounds from LittleFS to free space\n");
-    } else {
-        DEBUG("❌ Migration failed\n");
+    for (size_t i = 0; i < tierRuleCount; i++) {
+        const TierRule& rule = tierRules[i];
+        if (!(rule.flags & TIER_FLAG_KEEP_SOURCE)) {
+            continue;
+        }
+        std::vector<String> paths;
+        collectFiles(fs, rule, ruleDir(rule.prefix), 0, paths);
+        for (const String& path : paths) {
+            if (!other->exists(path)) {
+                continue;  // Not copied yet
+            }
+            File file = fs.open(path, FILE_READ);
+            if (!file) {
+                continue;
+            }
+            candidates.push_back({path, file.getLastWrite(), file.size(), rule.tier});
+        }
     }
     
-    return success;
-#else
-    return false;
-#endif
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.lastWrite < b.lastWrite;
+    });
+    
+    for (const Candidate& candidate : candidates) {
+        if (littleFSFree() >= len + STORAGE_MIN_FREE_BYTES) {
+            break;
+        }
+        if (fs.remove(candidate.path)) {
+            LOG_I(LOG_STORAGE, "Storage: Evicted %s (%u bytes)\n", candidate.path.c_str(), candidate.size);
+            lockStats();
+            tierStats[candidate.tier].evictedFiles++;
+            tierStats[candidate.tier].evictedBytes += candidate.size;
+            unlockStats();
+        }
+    }
+    return littleFSFree() >= len + STORAGE_MIN_FREE_BYTES;
 }
 
-bool Storage::copyDirectory(const String& srcPath, const String& dstPath, bool deleteSource) {
-    DEBUG("Copying %s to SD card...\n", srcPath.c_str());
-    
-    File srcDir = LittleFS.open(srcPath);
-    if (!srcDir || !srcDir.isDirectory()) {
-        DEBUG("Failed to open source directory: %s\n", srcPath.c_str());
+// Files under dir (recursively) that belong to this rule and not to a longer one
+void Storage::collectFiles(fs::FS& fs, const TierRule& rule, const String& dir, int depth, std::vector<String>& out) {
+    File root = fs.open(dir);
+    if (!root || !root.isDirectory()) {
+        return;
+    }
+    File entry = root.openNextFile();
+    while (entry) {
+        String path = entry.path();
+        bool isDir = entry.isDirectory();
+        entry.close();
+        if (isDir) {
+            bool related = path.startsWith(rule.prefix) || String(rule.prefix).startsWith(path + "/");
+            if (related && depth < STORAGE_MIGRATE_MAX_DEPTH) {
+                collectFiles(fs, rule, path, depth + 1, out);
+            }
+        } else if (path.startsWith(rule.prefix) && findRule(path) == &rule &&
+                   !path.endsWith(STORAGE_TMP_SUFFIX) && !path.endsWith(STORAGE_OLD_SUFFIX)) {
+            out.push_back(path);
+        }
+        entry = root.openNextFile();
+    }
+}
+
+bool Storage::copyFile(fs::FS& src, fs::FS& dst, const String& path) {
+    File in = src.open(path, FILE_READ);
+    if (!in) {
+        return false;
+    }
+    size_t size = in.size();
+    if (!hasSpace(dst, size)) {
         return false;
     }
+    makeParents(dst, path);
     
-    int fileCount = 0;
-    int errorCount = 0;
-    uint32_t totalBytes = 0;
+    StorageWriter writer;
+    if (!openWriteOn(dst, path, writer)) {
+        return false;
+    }
+    uint8_t buffer[STORAGE_IO_BUFFER_SIZE];
+    size_t n;
+    while ((n = in.read(buffer, sizeof(buffer))) > 0) {
+        if (writer.write(buffer, n) != n) {
+            break;
+        }
+    }
+    in.close();
+    return writer.bytesWritten() == size && writer.commit();
+}
+
+void Storage::requestMigration() {
+    migrationRequested = true;
+    if (flushTask) {
+        xTaskNotifyGive(flushTask);
+    }
+}
+
+// Moves files that sit on the wrong filesystem for their tier. One file at a
+// time under ioLock, so readers always find a complete copy on one side.
+void Storage::migrate() {
+    migrationRequested = false;
+#ifdef ESP32S3
+    if (!sdAvailable) {
+        return;
+    }
     
-    File file = srcDir.openNextFile();
-    while (file) {
-        if (!file.isDirectory()) {
-            String fileName = String(file.name());
-            String dstFilePath = dstPath + "/" + fileName.substring(fileName.lastIndexOf('/') + 1);
-            
-            DEBUG("  Copying: %s -> %s", fileName.c_str(), dstFilePath.c_str());
-            
-            // Open destination file on SD
+    uint32_t start = millis();
+    uint32_t moved = 0;
+    for (size_t i = 0; i < tierRuleCount; i++) {
+        const TierRule& rule = tierRules[i];
+        if (rule.flags & TIER_FLAG_GROUP) {
+            continue;  // Moved as a whole by migrateGroups()
+        }
+        fs::FS& dst = tierFS(rule.tier);
+        fs::FS* src = otherFS(dst);
+        std::vector<String> paths;
+        collectFiles(*src, rule, ruleDir(rule.prefix), 0, paths);
+        
+        for (const String& path : paths) {
+            bool keepSource = rule.flags & TIER_FLAG_KEEP_SOURCE;
+            xSemaphoreTake(ioLock, portMAX_DELAY);
+            if (dst.exists(path)) {
+                // Writes always land on the preferred tier, so this copy is stale
+                if (!keepSource) {
+                    src->remove(path);
+                }
+            } else if (copyFile(*src, dst, path)) {
+                File file = dst.open(path, FILE_READ);
+                size_t size = file ? file.size() : 0;
+                if (!keepSource) {
+                    src->remove(path);
+                }
+                lockStats();
+                tierStats[rule.tier].migratedFiles++;
+                tierStats[rule.tier].migratedBytes += size;
+                unlockStats();
+                moved++;
+            } else {
+                LOG_W(LOG_STORAGE, "Storage: Failed to migrate %s\n", path.c_str());
+            }
+            xSemaphoreGive(ioLock);
+            vTaskDelay(1);  // Let the web server and flushes in between files
+        }
+    }
+    LOG_I(LOG_STORAGE, "Storage: Tier migration moved %u files in %ums\n", moved, millis() - start);
+#endif
+}
+
+// Moves each group whose files are on the wrong filesystem in one go under
+// ioLock, removing the sources only once every file has been copied. Runs
+// from initSDDeferred() before its caller (or the flush task) can touch the
+// group on the card. A group already on the card wins over leftovers in
+// flash; one that can't be moved stays where it is until the next mount.
+void Storage::migrateGroups() {
 #ifdef ESP32S3
-            File dstFile = SD.open(dstFilePath, FILE_WRITE);
-            if (!dstFile) {
-                DEBUG(" [FAIL - can't open dest]\n");
-                errorCount++;
-                file = srcDir.openNextFile();
-                continue;
+    for (size_t i = 0; i < tierRuleCount; i++) {
+        TierRule& rule = tierRules[i];
+        if (!(rule.flags & TIER_FLAG_GROUP)) {
+            continue;
+        }
+        rule.home = nullptr;
+        fs::FS& dst = tierFS(rule.tier);
+        fs::FS* src = otherFS(dst);
+        std::vector<String> paths;
+        collectFiles(*src, rule, ruleDir(rule.prefix), 0, paths);
+        if (paths.empty()) {
+            continue;
+        }
+        std::vector<String> existing;
+        collectFiles(dst, rule, ruleDir(rule.prefix), 0, existing);
+        
+        xSemaphoreTake(ioLock, portMAX_DELAY);
+        if (!existing.empty()) {
+            LOG_I(LOG_STORAGE, "Storage: Dropping %u stale files of %s\n", (unsigned)paths.size(), rule.prefix);
+            for (const String& path : paths) {
+                src->remove(path);
             }
-            
-            // Copy data in chunks
-            uint8_t buffer[512];
-            size_t fileSize = file.size();
-            size_t bytesRead;
-            
-            while ((bytesRead = file.read(buffer, sizeof(buffer))) > 0) {
-                dstFile.write(buffer, bytesRead);
+            xSemaphoreGive(ioLock);
+            continue;
+        }
+        
+        size_t copied = 0;
+        uint32_t bytes = 0;
+        for (; copied < paths.size(); copied++) {
+            if (!copyFile(*src, dst, paths[copied])) {
+                break;
             }
-            
-            dstFile.close();
-            totalBytes += fileSize;
-            fileCount++;
-            
-            DEBUG(" [OK - %d bytes]\n", fileSize);
-            
-            // Delete source file if requested
-            if (deleteSource) {
-                LittleFS.remove(fileName);
-                DEBUG("  Deleted source file\n");
+            File file = dst.open(paths[copied], FILE_READ);
+            bytes += file ? file.size() : 0;
+        }
+        if (copied == paths.size()) {
+            for (const String& path : paths) {
+                src->remove(path);
             }
+            lockStats();
+            tierStats[rule.tier].migratedFiles += copied;
+            tierStats[rule.tier].migratedBytes += bytes;
+            unlockStats();
+            LOG_I(LOG_STORAGE, "Storage: Moved %u files of %s\n", (unsigned)copied, rule.prefix);
+        } else {
+            LOG_W(LOG_STORAGE, "Storage: Failed to move %s, keeping it on the other tier\n", paths[copied].c_str());
+            for (size_t n = 0; n < copied; n++) {
+                dst.remove(paths[n]);
+            }
+            rule.home = src;
+        }
+        xSemaphoreGive(ioLock);
+    }
 #endif
+}
+
+// Runs on the flush task only, so the slow SD scan never holds up a request
+void Storage::refreshCapacity() {
+    capacityStale = false;
+    lastCapacityMs = millis();
+    uint64_t total[STORAGE_TIER_COUNT];
+    uint64_t used[STORAGE_TIER_COUNT];
+    for (int t = 0; t < STORAGE_TIER_COUNT; t++) {
+#ifdef ESP32S3
+        if (&tierFS((StorageTier)t) != &LittleFS) {
+            total[t] = SD.totalBytes();
+            used[t] = SD.usedBytes();
+            continue;
         }
-        file = srcDir.openNextFile();
+#endif
+        total[t] = LittleFS.totalBytes();
+        used[t] = LittleFS.usedBytes();
     }
-    
-    srcDir.close();
-    
-    DEBUG("\nCopied %d files (%d KB) with %d errors\n", 
-          fileCount, totalBytes / 1024, errorCount);
-    
-    return errorCount == 0;
+    lockStats();
+    for (int t = 0; t < STORAGE_TIER_COUNT; t++) {
+        tierStats[t].totalBytes = total[t];
+        tierStats[t].usedBytes = used[t];
+    }
+    unlockStats();
+}
+
+TierStats Storage::getTierStats(StorageTier tier) {
+    lockStats();
+    TierStats stats = tierStats[tier];
+    unlockStats();
+    stats.onSD = &tierFS(tier) != &LittleFS;
+    return stats;
 }
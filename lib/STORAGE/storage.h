@@ -10,6 +10,107 @@
 #endif
 
 #include <LittleFS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "storagebench.h"
+
+#define STORAGE_IO_BUFFER_SIZE 512
+#define STORAGE_TMP_SUFFIX ".tmp"
+#define STORAGE_OLD_SUFFIX ".old"
+
+// Write-behind queue
+#define WRITE_BEHIND_MAX_BYTES 16384   // Larger backlogs fall back to synchronous writes
+#define WRITE_BEHIND_DELAY_MS 200      // Lets repeated writes to a path coalesce before flushing
+#define WRITE_BEHIND_TASK_STACK 4096
+#define WRITE_BEHIND_TASK_PRIORITY 1   // Just above idle / parallelTask
+
+// SD SPI clock negotiation
+#define SD_PROBE_FILE "/.sdprobe"
+#define SD_PROBE_BYTES 16384           // Written and read back at each candidate clock
+#define SD_CLOCK_PREFS_NAMESPACE "storage"
+#define SD_CLOCK_PREFS_KEY "sdHz"
+
+// Tiers
+#define STORAGE_MAX_TIER_RULES 8
+#define STORAGE_TIER_PREFIX_LEN 32
+#define STORAGE_MIN_FREE_BYTES 32768     // Kept free on LittleFS; eviction starts below this
+#define STORAGE_MIGRATE_MAX_DEPTH 3
+#define STORAGE_CAPACITY_REFRESH_MS 30000  // Tier sizes are re-read on the flush task this often
+
+// Hot data is small and rewritten often (journal, track metadata) and lives
+// on LittleFS so it survives without a card. Bulk data goes to SD when one
+// is mounted and shares LittleFS otherwise. Paths without a rule are bulk.
+enum StorageTier {
+    STORAGE_TIER_HOT = 0,
+    STORAGE_TIER_BULK = 1,
+    STORAGE_TIER_COUNT
+};
+
+// Eviction only ever deletes a LittleFS file whose copy is on the card, so
+// without a card nothing is evicted
+#define TIER_FLAG_KEEP_SOURCE 0x02  // Migration copies instead of moving; the source copy is evictable
+#define TIER_FLAG_GROUP 0x04        // Files under the prefix always share one filesystem (never spilled;
+                                    // moved together when the card is mounted)
+
+struct TierStats {
+    uint64_t totalBytes;
+    uint64_t usedBytes;
+    bool onSD;
+    uint32_t migratedFiles;   // Moved onto this tier by the background migration
+    uint32_t migratedBytes;
+    uint32_t evictedFiles;
+    uint32_t evictedBytes;
+    uint32_t spilledWrites;   // Written to the other tier because this one was full
+    uint32_t fullFailures;    // Writes refused for lack of space even after eviction
+};
+
+struct WriteBehindStats {
+    uint32_t queuedBytes;
+    uint32_t queuedFiles;
+    uint32_t peakQueuedBytes;
+    uint32_t flushedWrites;
+    uint32_t flushedBytes;
+    uint32_t coalescedWrites;   // Writes merged into the newest queued one for the same path
+    uint32_t syncFallbacks;     // Writes done in the caller because the queue was full
+    uint32_t failedWrites;
+    uint32_t lastFlushUs;       // Latency of the most recent file flush
+    uint32_t maxFlushUs;
+};
+
+// Streams a file to storage through one fixed buffer (a Print, so JSON can be
+// serialized straight into it). Data goes to <path>.tmp and only replaces
+// <path> on commit(); a reset mid-write leaves the previous version intact.
+// A writer destroyed without commit() discards the temp file.
+class StorageWriter : public Print {
+   public:
+    StorageWriter();
+    ~StorageWriter();
+    StorageWriter(const StorageWriter&) = delete;
+    StorageWriter& operator=(const StorageWriter&) = delete;
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* data, size_t len) override;
+    bool commit();
+    void abort();
+
+    bool isOpen() const { return fs != nullptr; }
+    bool hasError() const { return error; }
+    size_t bytesWritten() const { return total; }
+
+   private:
+    friend class Storage;
+    fs::FS* fs;
+    fs::FS* staleFS;  // Other tier's copy of path, removed once this one commits
+    File file;
+    String path;
+    uint8_t buffer[STORAGE_IO_BUFFER_SIZE];
+    size_t buffered;
+    size_t total;
+    bool error;
+
+    bool flushBuffer();
+};
 
 class Storage {
    public:
@@ -17,30 +118,122 @@ class Storage {
     bool init();
     bool initSDDeferred();  // Initialize SD card after boot
     bool isSDAvailable() const { return sdAvailable; }
+    uint32_t getSDClockHz() const { return sdClockHz; }  // Negotiated SPI clock, 0 if not mounted
     
     // File operations - automatically use SD if available, fall back to LittleFS
     bool writeFile(const String& path, const String& data);
     bool readFile(const String& path, String& data);
     bool deleteFile(const String& path);
+    bool renameFile(const String& from, const String& to);
     bool exists(const String& path);
     bool mkdir(const String& path);
     bool listDir(const String& path, std::vector<String>& files);
     
+    // Binary file operations (no String copies, safe for embedded NULs)
+    bool writeBytes(const String& path, const uint8_t* data, size_t len);
+    bool appendBytes(const String& path, const uint8_t* data, size_t len);
+    size_t readBytes(const String& path, uint32_t offset, uint8_t* buf, size_t len);
+    size_t fileSize(const String& path);
+    
+    // Streaming I/O - peak heap is one fixed buffer regardless of file size
+    // Atomic on commit(). expectedSize (if known) is checked against free space up front.
+    bool openWrite(const String& path, StorageWriter& writer, size_t expectedSize = 0);
+    File openRead(const String& path);                          // File is a Stream
+    
+    // Write-behind: data is copied into a bounded queue and written by a
+    // low-priority task, in the order they were queued. A write to the same
+    // path as the newest queued one is merged into it (a whole-file write
+    // replaces it). Reads of a path see its queued data.
+    bool queueWrite(const String& path, const uint8_t* data, size_t len);
+    bool queueAppend(const String& path, const uint8_t* data, size_t len);
+    void flush();  // Blocks until everything queued is on disk (shutdown, OTA)
+    WriteBehindStats getWriteBehindStats();
+    
+    // Tiers: owners register where their paths belong (longest prefix wins).
+    // Reads find a file on either filesystem, so files can be migrated in the
+    // background after the card is mounted.
+    bool setTier(const char* prefix, StorageTier tier, uint8_t flags = 0);
+    StorageTier getTier(const String& path) const;
+    // Cheap enough for status pages: sizes come from the flush task's last
+    // refresh (SD used bytes is a FAT scan), never from the filesystem here
+    TierStats getTierStats(StorageTier tier);
+    void requestMigration();  // Runs on the flush task; also started by initSDDeferred()
+    
+    // Throughput/latency benchmark on the active filesystem (takes seconds on SD)
+    bool runBenchmark(StorageBenchResult& result);
+    // Short run on one tier's filesystem, for the self-test benchmark suite.
+    // Fails if the tier has no filesystem of its own (bulk without a card).
+    bool runQuickBenchmark(StorageTier tier, StorageBenchResult& result);
+    
     // Storage info
     uint64_t getTotalBytes();
     uint64_t getUsedBytes();
     uint64_t getFreeBytes();
     String getStorageType() const { return sdAvailable ? "SD" : "LittleFS"; }
     
-    // Migration helpers
-    bool migrateSoundsToSD();
-    bool copyDirectory(const String& srcPath, const String& dstPath, bool deleteSource = false);
-    
    private:
+    struct PendingWrite {
+        String path;
+        std::vector<uint8_t> data;
+        bool append;  // false = replaces the whole file
+    };
+
+    struct TierRule {
+        char prefix[STORAGE_TIER_PREFIX_LEN];
+        StorageTier tier;
+        uint8_t flags;
+        fs::FS* home;  // Groups only: set while the group is stuck on the other tier
+    };
+
     bool sdAvailable;
+    uint32_t sdClockHz;
+    fs::FS& activeFS();
+    void restoreInterrupted(fs::FS& fs, const String& path);
+    
+    TierRule tierRules[STORAGE_MAX_TIER_RULES];
+    size_t tierRuleCount;
+    TierStats tierStats[STORAGE_TIER_COUNT];  // Counters, and sizes as of lastCapacityMs
+    volatile bool migrationRequested;
+    volatile bool capacityStale;  // Tier filesystems changed (card mounted, files migrated)
+    uint32_t lastCapacityMs;
+    
+    const TierRule* findRule(const String& path) const;
+    fs::FS& tierFS(StorageTier tier);
+    fs::FS& groupFS(const TierRule& rule);
+    fs::FS& homeFS(const String& path);
+    fs::FS* otherFS(fs::FS& fs);
+    fs::FS* locate(const String& path);
+    fs::FS* writeTarget(const String& path, size_t len);
+    bool hasSpace(fs::FS& fs, size_t len);
+    bool evict(fs::FS& fs, size_t len);
+    bool copyFile(fs::FS& src, fs::FS& dst, const String& path);
+    void migrate();
+    void migrateGroups();
+    void refreshCapacity();
+    void collectFiles(fs::FS& fs, const TierRule& rule, const String& dir, int depth, std::vector<String>& out);
+    void listInto(fs::FS& fs, const String& path, std::vector<String>& files);
+    bool openWriteOn(fs::FS& fs, const String& path, StorageWriter& writer);
+    void lockStats();
+    void unlockStats();
+    
+    std::vector<PendingWrite> pending;  // FIFO; a path may have several entries
+    WriteBehindStats wbStats;
+    SemaphoreHandle_t queueLock;  // Guards pending and wbStats
+    SemaphoreHandle_t ioLock;     // Held while a pending write is on its way to disk
+    TaskHandle_t flushTask;
+    
+    bool enqueue(const String& path, const uint8_t* data, size_t len, bool append);
+    bool popPending(PendingWrite& out);  // Oldest entry
+    void writePending(const PendingWrite& entry);
+    void syncPath(const String& path);
+    bool openWriteDirect(const String& path, StorageWriter& writer, size_t expectedSize = 0);
+    bool appendDirect(const String& path, const uint8_t* data, size_t len);
+    static void flushTaskMain(void* arg);
     
 #ifdef ESP32S3
     bool initSD();
+    bool mountSD(uint32_t clockHz);
+    bool verifySD();
     SPIClass* spi;
 #endif
 };
@@ -0,0 +1,189 @@
+#include "storagebench.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// Pattern byte for a file offset; lets the read pass verify every byte
+static inline uint8_t patternAt(uint32_t offset) {
+    return (uint8_t)((offset * 2654435761u) >> 24);
+}
+
+static void fillPattern(uint8_t* buf, uint32_t offset, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = patternAt(offset + i);
+    }
+}
+
+static float mbPerSec(uint64_t bytes, uint32_t us) {
+    // 1 byte/us == 1 MB/s (10^6 bytes)
+    return us ? (float)bytes / (float)us : 0.0f;
+}
+
+StorageBenchConfig StorageBench::defaults() {
+    StorageBenchConfig config;
+    config.dir = "/bench";
+    config.fileSize = 1024 * 1024;
+    config.blockSize = 4096;
+    config.randomOps = 128;
+    config.openIterations = 20;
+    config.dirFiles = 500;
+    return config;
+}
+
+bool StorageBench::run(BenchTarget& t, const StorageBenchConfig& config, StorageBenchResult& r) {
+    memset(&r, 0, sizeof(r));
+    r.fileSize = config.fileSize;
+    r.blockSize = config.blockSize;
+    r.dirFiles = config.dirFiles;
+
+    if (config.blockSize == 0 || config.blockSize > STORAGEBENCH_MAX_BLOCK || config.fileSize < config.blockSize) {
+        r.error = "config";
+        return false;
+    }
+
+    std::vector<uint8_t> buffer(config.blockSize);
+    uint8_t* block = buffer.data();
+    const uint32_t blocks = config.fileSize / config.blockSize;
+    const uint32_t fileBytes = blocks * config.blockSize;
+    char path[96];
+    snprintf(path, sizeof(path), "%s/seq.bin", config.dir);
+    t.mkdir(config.dir);
+
+    // Sequential write (close included: that is when buffered data hits the card)
+    uint32_t start = t.micros();
+    if (!t.openWrite(path)) {
+        r.error = "open for write";
+        return false;
+    }
+    for (uint32_t i = 0; i < blocks; i++) {
+        fillPattern(block, i * config.blockSize, config.blockSize);
+        if (t.write(block, config.blockSize) != config.blockSize) {
+            t.close();
+            r.error = "sequential write";
+            return false;
+        }
+    }
+    t.close();
+    r.seqWriteMBs = mbPerSec(fileBytes, t.micros() - start);
+
+    // Sequential read with verification
+    uint32_t elapsed = 0;
+    if (!t.openRead(path)) {
+        r.error = "open for read";
+        return false;
+    }
+    for (uint32_t i = 0; i < blocks; i++) {
+        start = t.micros();
+        size_t got = t.read(block, config.blockSize);
+        elapsed += t.micros() - start;
+        if (got != config.blockSize) {
+            t.close();
+            r.error = "sequential read";
+            return false;
+        }
+        for (uint16_t j = 0; j < config.blockSize; j++) {
+            if (block[j] != patternAt(i * config.blockSize + j)) {
+                t.close();
+                r.error = "read-back mismatch";
+                return false;
+            }
+        }
+    }
+    t.close();
+    r.seqReadMBs = mbPerSec(fileBytes, elapsed);
+
+    // Random reads, block aligned, fixed LCG so runs are comparable
+    uint32_t seed = 12345;
+    if (!t.openRead(path)) {
+        r.error = "open for random read";
+        return false;
+    }
+    start = t.micros();
+    for (uint16_t i = 0; i < config.randomOps; i++) {
+        seed = seed * 1103515245u + 12345u;
+        if (!t.seek((seed >> 8) % blocks * config.blockSize) || t.read(block, config.blockSize) != config.blockSize) {
+            t.close();
+            r.error = "random read";
+            return false;
+        }
+    }
+    r.randReadMBs = mbPerSec((uint64_t)config.randomOps * config.blockSize, t.micros() - start);
+    t.close();
+
+    // Random writes in place
+    if (!t.openUpdate(path)) {
+        r.error = "open for random write";
+        return false;
+    }
+    start = t.micros();
+    for (uint16_t i = 0; i < config.randomOps; i++) {
+        seed = seed * 1103515245u + 12345u;
+        uint32_t offset = (seed >> 8) % blocks * config.blockSize;
+        fillPattern(block, offset, config.blockSize);
+        if (!t.seek(offset) || t.write(block, config.blockSize) != config.blockSize) {
+            t.close();
+            r.error = "random write";
+            return false;
+        }
+    }
+    t.close();
+    r.randWriteMBs = mbPerSec((uint64_t)config.randomOps * config.blockSize, t.micros() - start);
+
+    // Open latency
+    start = t.micros();
+    for (uint16_t i = 0; i < config.openIterations; i++) {
+        if (!t.openRead(path)) {
+            r.error = "open latency";
+            return false;
+        }
+        t.close();
+    }
+    r.openLatencyUs = config.openIterations ? (t.micros() - start) / config.openIterations : 0;
+    t.remove(path);
+
+    // Directory listing
+    if (config.dirFiles > 0) {
+        char dirPath[80];
+        snprintf(dirPath, sizeof(dirPath), "%s/dir", config.dir);
+        t.mkdir(dirPath);
+        start = t.micros();
+        for (uint16_t i = 0; i < config.dirFiles; i++) {
+            snprintf(path, sizeof(path), "%s/f%03u.bin", dirPath, i);
+            if (!t.openWrite(path)) {
+                r.error = "create directory entries";
+                return false;
+            }
+            t.close();
+        }
+        r.dirCreateMs = (t.micros() - start) / 1000;
+
+        start = t.micros();
+        int listed = t.listDir(dirPath);
+        r.dirListMs = (t.micros() - start) / 1000;
+
+        for (uint16_t i = 0; i < config.dirFiles; i++) {
+            snprintf(path, sizeof(path), "%s/f%03u.bin", dirPath, i);
+            t.remove(path);
+        }
+        t.rmdir(dirPath);
+        if (listed != config.dirFiles) {
+            r.error = "directory listing count";
+            return false;
+        }
+    }
+    t.rmdir(config.dir);
+
+    r.ok = true;
+    return true;
+}
+
+int StorageBench::toJson(const StorageBenchResult& r, char* buf, size_t len) {
+    return snprintf(buf, len,
+                    "{\"ok\":%s,\"error\":\"%s\",\"fileSize\":%u,\"blockSize\":%u,"
+                    "\"seqWriteMBs\":%.2f,\"seqReadMBs\":%.2f,\"randWriteMBs\":%.2f,\"randReadMBs\":%.2f,"
+                    "\"openLatencyUs\":%u,\"dirFiles\":%u,\"dirCreateMs\":%u,\"dirListMs\":%u}",
+                    r.ok ? "true" : "false", r.error ? r.error : "",
+                    (unsigned)r.fileSize, (unsigned)r.blockSize,
+                    r.seqWriteMBs, r.seqReadMBs, r.randWriteMBs, r.randReadMBs,
+                    (unsigned)r.openLatencyUs, (unsigned)r.dirFiles, (unsigned)r.dirCreateMs, (unsigned)r.dirListMs);
+}
@@ -0,0 +1,72 @@
+#ifndef STORAGEBENCH_H
+#define STORAGEBENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Storage benchmark
+ *
+ * Plain C++ with no Arduino dependency: the device runs it against the active
+ * fs::FS (see Storage::runBenchmark), and tools/storagebench runs the same code
+ * on a host against a directory on disk.
+ *
+ *   sequential write/read  - fileSize bytes in blockSize chunks, read is verified
+ *   random read/write      - randomOps block-aligned blockSize accesses
+ *   open latency           - average open+close of an existing file
+ *   directory listing      - time to list a directory of dirFiles files
+ */
+
+#define STORAGEBENCH_JSON_SIZE 384
+#define STORAGEBENCH_MAX_BLOCK 4096
+
+// Filesystem operations the benchmark needs; one file open at a time
+class BenchTarget {
+   public:
+    virtual ~BenchTarget() {}
+    virtual bool openRead(const char* path) = 0;
+    virtual bool openWrite(const char* path) = 0;   // Create/truncate
+    virtual bool openUpdate(const char* path) = 0;  // Existing file, read/write in place
+    virtual size_t read(uint8_t* buf, size_t len) = 0;
+    virtual size_t write(const uint8_t* data, size_t len) = 0;
+    virtual bool seek(uint32_t pos) = 0;
+    virtual void close() = 0;
+    virtual bool remove(const char* path) = 0;
+    virtual bool mkdir(const char* path) = 0;
+    virtual bool rmdir(const char* path) = 0;
+    virtual int listDir(const char* path) = 0;  // Number of entries, -1 on error
+    virtual uint32_t micros() = 0;
+};
+
+struct StorageBenchConfig {
+    const char* dir;       // Scratch directory, created and removed by the run
+    uint32_t fileSize;
+    uint16_t blockSize;    // <= STORAGEBENCH_MAX_BLOCK
+    uint16_t randomOps;
+    uint16_t openIterations;
+    uint16_t dirFiles;
+};
+
+struct StorageBenchResult {
+    bool ok;
+    const char* error;     // Step that failed, nullptr when ok
+    float seqWriteMBs;
+    float seqReadMBs;
+    float randWriteMBs;
+    float randReadMBs;
+    uint32_t openLatencyUs;
+    uint32_t dirCreateMs;  // Creating the dirFiles files
+    uint32_t dirListMs;
+    uint16_t dirFiles;
+    uint32_t fileSize;
+    uint16_t blockSize;
+};
+
+class StorageBench {
+   public:
+    static StorageBenchConfig defaults();
+    static bool run(BenchTarget& target, const StorageBenchConfig& config, StorageBenchResult& result);
+    static int toJson(const StorageBenchResult& result, char* buf, size_t len);
+};
+
+#endif
@@ -3,7 +3,7 @@
 #include <time.h>
 #include "debug.h"
 
-TrackManager::TrackManager() : storage(nullptr) {
+TrackManager::TrackManager() : storage(nullptr), imageTrackId(0), imageSize(0) {
 }
 
 bool TrackManager::init(Storage* storageBackend) {
@@ -13,6 +13,10 @@ bool TrackManager::init(Storage* storageBackend) {
         return false;
     }
     
+    // Track metadata stays in flash; images are bulk and move to the card
+    storage->setTier(TRACKS_DIR "/", STORAGE_TIER_HOT);
+    storage->setTier(TRACK_IMAGES_DIR "/", STORAGE_TIER_BULK);
+    
     // Create tracks directory if it doesn't exist
     storage->mkdir(TRACKS_DIR);
     storage->mkdir(TRACK_IMAGES_DIR);
@@ -30,33 +34,38 @@ String TrackManager::generateFilename(uint32_t trackId) {
     return String(TRACKS_DIR) + "/" + String(filename);
 }
 
-bool TrackManager::createTrack(const Track& track) {
+bool TrackManager::writeTrackFile(const Track& track) {
     String filepath = generateFilename(track.trackId);
     
     // Create JSON for single track
     DynamicJsonDocument doc(2048);
     JsonObject trackObj = doc.to<JsonObject>();
     trackObj["trackId"] = track.trackId;
-    trackObj["name"] = track.name;
-    trackObj["tags"] = track.tags;
+    trackObj["name"] = track.name.c_str();
+    trackObj["tags"] = track.tags.c_str();
     trackObj["distance"] = track.distance;
-    trackObj["notes"] = track.notes;
-    trackObj["imagePath"] = track.imagePath;
-    
-    String json;
-    serializeJson(doc, json);
+    trackObj["notes"] = track.notes.c_str();
+    trackObj["imagePath"] = track.imagePath.c_str();
     
-    bool success = storage->writeFile(filepath, json);
+    // Handed to the write-behind queue so the web request doesn't wait on the card
+    std::vector<uint8_t> json(measureJson(doc) + 1);
+    size_t len = serializeJson(doc, (char*)json.data(), json.size());
+    if (!storage->queueWrite(filepath, json.data(), len)) {
+        DEBUG("Failed to save track to %s\n", filepath.c_str());
+        return false;
+    }
+    DEBUG("Queued track save to %s (%d bytes)\n", filepath.c_str(), len);
+    return true;
+}
+
+bool TrackManager::createTrack(const Track& track) {
+    bool success = writeTrackFile(track);
     if (success) {
-        DEBUG("Saved track to %s (%d bytes)\n", filepath.c_str(), json.length());
-        
         // Add to in-memory list
         tracks.insert(tracks.begin(), track);
         if (tracks.size() > MAX_TRACKS) {
             tracks.resize(MAX_TRACKS);
         }
-    } else {
-        DEBUG("Failed to save track to %s\n", filepath.c_str());
     }
     
     return success;
@@ -78,20 +87,22 @@ bool TrackManager::loadTracks() {
     }
     
     // Load each track file
+    tracks.reserve(std::min(files.size(), (size_t)MAX_TRACKS));
     for (const String& filename : files) {
         if (!filename.endsWith(".json")) {
             continue;
         }
         
         String filepath = String(TRACKS_DIR) + "/" + filename;
-        String json;
-        if (!storage->readFile(filepath, json)) {
+        File file = storage->openRead(filepath);
+        if (!file) {
             DEBUG("Failed to read %s\n", filepath.c_str());
             continue;
         }
         
         DynamicJsonDocument doc(2048);
-        DeserializationError error = deserializeJson(doc, json);
+        DeserializationError error = deserializeJson(doc, file);
+        file.close();
         if (error) {
             DEBUG("Failed to parse %s: %s\n", filepath.c_str(), error.c_str());
             continue;
@@ -117,7 +128,8 @@ bool TrackManager::loadTracks() {
         tracks.resize(MAX_TRACKS);
     }
     
-    DEBUG("Loaded %d tracks from individual files\n", tracks.size());
+    DEBUG("Loaded %d tracks from individual files (heap free %u, largest block %u)\n",
+          tracks.size(), ESP.getFreeHeap(), ESP.getMaxAllocHeap());
     return true;
 }
 
@@ -161,21 +173,7 @@ bool TrackManager::updateTrack(uint32_t trackId, const Track& updatedTrack) {
     }
     
     // Write updated track to file
-    String filepath = generateFilename(trackId);
-    
-    DynamicJsonDocument doc(2048);
-    JsonObject trackObj = doc.to<JsonObject>();
-    trackObj["trackId"] = targetTrack->trackId;
-    trackObj["name"] = targetTrack->name;
-    trackObj["tags"] = targetTrack->tags;
-    trackObj["distance"] = targetTrack->distance;
-    trackObj["notes"] = targetTrack->notes;
-    trackObj["imagePath"] = targetTrack->imagePath;
-    
-    String json;
-    serializeJson(doc, json);
-    
-    return storage->writeFile(filepath, json);
+    return writeTrackFile(*targetTrack);
 }
 
 bool TrackManager::clearAll() {
@@ -210,11 +208,11 @@ String TrackManager::toJsonString() {
     for (const auto& track : tracks) {
         JsonObject trackObj = tracksArray.createNestedObject();
         trackObj["trackId"] = track.trackId;
-        trackObj["name"] = track.name;
-        trackObj["tags"] = track.tags;
+        trackObj["name"] = track.name.c_str();
+        trackObj["tags"] = track.tags.c_str();
         trackObj["distance"] = track.distance;
-        trackObj["notes"] = track.notes;
-        trackObj["imagePath"] = track.imagePath;
+        trackObj["notes"] = track.notes.c_str();
+        trackObj["imagePath"] = track.imagePath.c_str();
     }
     
     String output;
@@ -231,37 +229,103 @@ Track* TrackManager::getTrackById(uint32_t trackId) {
     return nullptr;
 }
 
-bool TrackManager::saveTrackImage(uint32_t trackId, const uint8_t* imageData, size_t imageSize) {
-    if (!storage || imageSize == 0) {
-        return false;
+TrackImageResult TrackManager::beginTrackImage(uint32_t trackId, size_t size) {
+    if (!storage) {
+        return TRACK_IMAGE_STORAGE_ERROR;
     }
-    
-    // Limit image size to 500KB
-    if (imageSize > 512000) {
-        DEBUG("Track image too large: %d bytes (max 500KB)\n", imageSize);
-        return false;
+    if (imageWriter.isOpen()) {
+        return TRACK_IMAGE_BUSY;
+    }
+    if (!getTrackById(trackId)) {
+        return TRACK_IMAGE_NOT_FOUND;
+    }
+    if (size > TRACK_IMAGE_MAX_BYTES) {
+        DEBUG("Track image too large: %d bytes (max 500KB)\n", size);
+        return TRACK_IMAGE_TOO_LARGE;
+    }
+    if (size < 3) {
+        return TRACK_IMAGE_BAD_TYPE;
     }
     
-    String imagePath = String(TRACK_IMAGES_DIR) + "/" + String(trackId) + ".jpg";
+    // Rejected up front if the tier can't take it, not after half the upload
+    if (!storage->openWrite(getTrackImagePath(trackId), imageWriter, size)) {
+        return TRACK_IMAGE_STORAGE_ERROR;
+    }
+    imageTrackId = trackId;
+    imageSize = size;
+    return TRACK_IMAGE_OK;
+}
+
+TrackImageResult TrackManager::writeTrackImage(const uint8_t* data, size_t len) {
+    if (!imageWriter.isOpen()) {
+        return TRACK_IMAGE_STORAGE_ERROR;
+    }
     
-    // Convert byte array to String for storage (not ideal but works with current storage API)
-    String imageDataStr;
-    imageDataStr.reserve(imageSize);
-    for (size_t i = 0; i < imageSize; i++) {
-        imageDataStr += (char)imageData[i];
+    size_t received = imageWriter.bytesWritten();
+    if (received + len > imageSize) {
+        abortTrackImage();
+        return TRACK_IMAGE_TOO_LARGE;
     }
     
-    bool success = storage->writeFile(imagePath, imageDataStr);
-    if (success) {
-        // Update track's imagePath
-        Track* track = getTrackById(trackId);
-        if (track) {
-            track->imagePath = imagePath;
-            updateTrack(trackId, *track);
+    // JPEG start-of-image marker, checked byte by byte in case the first chunk is tiny
+    static const uint8_t JPEG_SOI[] = {0xFF, 0xD8, 0xFF};
+    for (size_t i = 0; i < len && received + i < sizeof(JPEG_SOI); i++) {
+        if (data[i] != JPEG_SOI[received + i]) {
+            DEBUG("Track image rejected: not a JPEG\n");
+            abortTrackImage();
+            return TRACK_IMAGE_BAD_TYPE;
         }
     }
     
-    return success;
+    if (imageWriter.write(data, len) != len) {
+        abortTrackImage();
+        return TRACK_IMAGE_STORAGE_ERROR;
+    }
+    return TRACK_IMAGE_OK;
+}
+
+TrackImageResult TrackManager::commitTrackImage() {
+    if (!imageWriter.isOpen()) {
+        return TRACK_IMAGE_STORAGE_ERROR;
+    }
+    if (imageWriter.bytesWritten() != imageSize) {
+        DEBUG("Track image incomplete: %d of %d bytes\n", imageWriter.bytesWritten(), imageSize);
+        abortTrackImage();
+        return TRACK_IMAGE_INCOMPLETE;
+    }
+    if (!imageWriter.commit()) {
+        return TRACK_IMAGE_STORAGE_ERROR;
+    }
+    
+    DEBUG("Track image saved for %u (%d bytes)\n", imageTrackId, imageSize);
+    Track* track = getTrackById(imageTrackId);
+    if (track) {
+        track->imagePath = getTrackImagePath(imageTrackId);
+        writeTrackFile(*track);
+    }
+    return TRACK_IMAGE_OK;
+}
+
+void TrackManager::abortTrackImage() {
+    imageWriter.abort();
+}
+
+const char* TrackManager::imageResultMessage(TrackImageResult result) {
+    switch (result) {
+        case TRACK_IMAGE_OK: return "OK";
+        case TRACK_IMAGE_BUSY: return "Another image upload is in progress";
+        case TRACK_IMAGE_NOT_FOUND: return "Track not found";
+        case TRACK_IMAGE_TOO_LARGE: return "Image too large (max 500KB)";
+        case TRACK_IMAGE_BAD_TYPE: return "Image must be a JPEG";
+        case TRACK_IMAGE_INCOMPLETE: return "Upload incomplete";
+        default: return "Storage error";
+    }
+}
+
+bool TrackManager::saveTrackImage(uint32_t trackId, const uint8_t* imageData, size_t size) {
+    return beginTrackImage(trackId, size) == TRACK_IMAGE_OK &&
+           writeTrackImage(imageData, size) == TRACK_IMAGE_OK &&
+           commitTrackImage() == TRACK_IMAGE_OK;
 }
 
 bool TrackManager::deleteTrackImage(uint32_t trackId) {
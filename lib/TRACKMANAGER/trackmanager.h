@@ -4,19 +4,40 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <vector>
+#include <type_traits>
 #include "storage.h"
+#include "fixedstring.h"
 
 #define MAX_TRACKS 50
 #define TRACKS_DIR "/tracks"
 #define TRACK_IMAGES_DIR "/tracks/images"
+#define TRACK_IMAGE_MAX_BYTES 512000   // 500KB
 
+// Field capacities (including terminator)
+#define TRACK_NAME_LEN 51
+#define TRACK_TAGS_LEN 101
+#define TRACK_NOTES_LEN 201
+#define TRACK_IMAGE_PATH_LEN 33
+
+// Flat, trivially copyable record: the track list is one contiguous block
 struct Track {
-    uint32_t trackId;           // Timestamp-based unique ID
-    String name;                // Track name (max 50 chars)
-    String tags;                // Comma-separated tags (max 100 chars)
-    float distance;             // Track distance in meters
-    String notes;               // Track notes (max 200 chars)
-    String imagePath;           // Path to track image (optional)
+    uint32_t trackId;                                 // Timestamp-based unique ID
+    FixedString<TRACK_NAME_LEN> name;                 // Track name (max 50 chars)
+    FixedString<TRACK_TAGS_LEN> tags;                 // Comma-separated tags (max 100 chars)
+    float distance;                                   // Track distance in meters
+    FixedString<TRACK_NOTES_LEN> notes;               // Track notes (max 200 chars)
+    FixedString<TRACK_IMAGE_PATH_LEN> imagePath;      // Path to track image (optional)
+};
+static_assert(std::is_trivially_copyable<Track>::value, "Track must stay flat");
+
+enum TrackImageResult {
+    TRACK_IMAGE_OK,
+    TRACK_IMAGE_BUSY,           // Another upload is in flight
+    TRACK_IMAGE_NOT_FOUND,      // No such track
+    TRACK_IMAGE_TOO_LARGE,      // Declared or received size over the limit / declared size
+    TRACK_IMAGE_BAD_TYPE,       // Not a JPEG
+    TRACK_IMAGE_INCOMPLETE,     // Fewer bytes than declared
+    TRACK_IMAGE_STORAGE_ERROR
 };
 
 class TrackManager {
@@ -33,7 +54,14 @@ class TrackManager {
     const std::vector<Track>& getTracks() const { return tracks; }
     size_t getTrackCount() const { return tracks.size(); }
     
-    // Image handling
+    // Image handling. Uploads are streamed: begin with the declared size,
+    // feed chunks in order, then commit. Chunks go straight to a temp file and
+    // replace the previous image only on commit. One upload at a time.
+    TrackImageResult beginTrackImage(uint32_t trackId, size_t imageSize);
+    TrackImageResult writeTrackImage(const uint8_t* data, size_t len);
+    TrackImageResult commitTrackImage();
+    void abortTrackImage();
+    static const char* imageResultMessage(TrackImageResult result);
     bool saveTrackImage(uint32_t trackId, const uint8_t* imageData, size_t imageSize);
     bool deleteTrackImage(uint32_t trackId);
     String getTrackImagePath(uint32_t trackId);
@@ -41,7 +69,11 @@ class TrackManager {
    private:
     std::vector<Track> tracks;
     Storage* storage;
+    StorageWriter imageWriter;
+    uint32_t imageTrackId;
+    size_t imageSize;
     String generateFilename(uint32_t trackId);
+    bool writeTrackFile(const Track& track);
 };
 
 #endif
@@ -2,6 +2,7 @@
 #define TRANSPORT_H
 
 #include <Arduino.h>
+#include "racestats.h"
 
 // Abstract transport interface for sending events to clients
 // Supports multiple simultaneous transports (WiFi, USB, etc.)
@@ -12,12 +13,18 @@ class TransportInterface {
     // Send lap time event to all connected clients
     virtual void sendLapEvent(uint32_t lapTimeMs) = 0;
     
+    // Send live race statistics (JSON object) following a lap event
+    virtual void sendLapStatsEvent(const char* statsJson) = 0;
+    
     // Send RSSI value to all connected clients (if streaming enabled)
     virtual void sendRssiEvent(uint8_t rssi) = 0;
     
     // Send race state event (started/stopped)
     virtual void sendRaceStateEvent(const char* state) = 0;
     
+    // Send self-test job progress or result (JSON object)
+    virtual void sendSelfTestEvent(const char* json) = 0;
+    
     // Check if transport is ready/connected
     virtual bool isConnected() = 0;
     
@@ -46,6 +53,19 @@ class TransportManager {
         }
     }
     
+    // Broadcast race statistics to all transports (formatted once for all of them)
+    void broadcastLapStatsEvent(const RaceStats& stats) {
+        char json[RACESTATS_JSON_SIZE];
+        if (stats.toJson(json, sizeof(json)) == 0) {
+            return;
+        }
+        for (uint8_t i = 0; i < transportCount; i++) {
+            if (transports[i] && transports[i]->isConnected()) {
+                transports[i]->sendLapStatsEvent(json);
+            }
+        }
+    }
+    
     // Broadcast RSSI event to all transports
     void broadcastRssiEvent(uint8_t rssi) {
         for (uint8_t i = 0; i < transportCount; i++) {
@@ -64,6 +84,15 @@ class TransportManager {
         }
     }
     
+    // Broadcast self-test job event to all transports
+    void broadcastSelfTestEvent(const char* json) {
+        for (uint8_t i = 0; i < transportCount; i++) {
+            if (transports[i] && transports[i]->isConnected()) {
+                transports[i]->sendSelfTestEvent(json);
+            }
+        }
+    }
+    
     // Update all transports
     void updateAll(uint32_t currentTimeMs) {
         for (uint8_t i = 0; i < transportCount; i++) {
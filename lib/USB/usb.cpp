@@ -44,6 +44,15 @@ void USBTransport::sendLapEvent(uint32_t lapTimeMs) {
     Serial.println();
 }
 
+void USBTransport::sendLapStatsEvent(const char* statsJson) {
+    if (!isConnected()) return;
+    
+    // Already JSON - write it through instead of re-parsing into a document
+    Serial.print("{\"event\":\"lapStats\",\"data\":");
+    Serial.print(statsJson);
+    Serial.println("}");
+}
+
 void USBTransport::sendRssiEvent(uint8_t rssi) {
     if (!isConnected() || !rssiStreamingEnabled) return;
     
@@ -66,6 +75,14 @@ void USBTransport::sendRaceStateEvent(const char* state) {
     Serial.println();
 }
 
+void USBTransport::sendSelfTestEvent(const char* json) {
+    if (!isConnected()) return;
+    
+    Serial.print("{\"event\":\"selftest\",\"data\":");
+    Serial.print(json);
+    Serial.println("}");
+}
+
 bool USBTransport::isConnected() {
     // Check if USB CDC is connected
     return Serial && Serial.availableForWrite() > 0;
@@ -120,7 +137,8 @@ void USBTransport::processCommand(const char* cmdLine) {
     
     // Timer commands
     if (strcmp(cmd, "timer/start") == 0) {
-        timer->start();
+        // Optional data.epoch: the client's clock, used to date a recovered race
+        timer->start(doc["data"]["epoch"] | 0u);
         sendResponse(id, "OK");
         
     } else if (strcmp(cmd, "timer/stop") == 0) {
@@ -128,18 +146,29 @@ void USBTransport::processCommand(const char* cmdLine) {
         sendResponse(id, "OK");
         
     } else if (strcmp(cmd, "timer/lap") == 0) {
-#ifdef ESP32S3
-        if (g_rgbLed) g_rgbLed->flashLap();
-#endif
+        RaceEvent lap = {RACE_EVENT_LAP, 0, 0, millis()};
+        timer->publish(lap);
         sendResponse(id, "OK");
         
+    } else if (strcmp(cmd, "timer/countdown") == 0) {
+        if (doc.containsKey("data") && doc["data"].containsKey("ms")) {
+            long ms = doc["data"]["ms"].as<long>();
+            if (ms < 0 || ms > RACE_COUNTDOWN_MAX_MS) {
+                sendResponse(id, "ERROR", "ms out of range");
+                return;
+            }
+            timer->announceStart(ms);
+            sendResponse(id, "OK");
+        } else {
+            sendResponse(id, "ERROR", "Missing ms");
+        }
+        
     } else if (strcmp(cmd, "timer/addLap") == 0) {
         if (doc.containsKey("data") && doc["data"].containsKey("lapTime")) {
             uint32_t lapTimeMs = doc["data"]["lapTime"];
             sendLapEvent(lapTimeMs);
-#ifdef ESP32S3
-            if (g_rgbLed) g_rgbLed->flashLap();
-#endif
+            RaceEvent lap = {RACE_EVENT_LAP, 0, lapTimeMs, millis()};
+            timer->publish(lap);
             sendResponse(id, "OK");
         } else {
             sendResponse(id, "ERROR", "Missing lapTime");
@@ -169,17 +198,13 @@ void USBTransport::processCommand(const char* cmdLine) {
         sendStatusResponse(id);
         
     } else if (strcmp(cmd, "races/get") == 0) {
-        DynamicJsonDocument respDoc(4096);
-        respDoc["id"] = id;
-        respDoc["status"] = "OK";
-        
-        String racesJson = history->toJsonString();
-        DynamicJsonDocument racesDoc(4096);
-        deserializeJson(racesDoc, racesJson);
-        respDoc["data"] = racesDoc;
-        
-        serializeJson(respDoc, Serial);
-        Serial.println();
+        // Stream straight to serial instead of building the whole list in a document
+        size_t offset = doc["data"]["offset"] | 0;
+        size_t limit = doc["data"]["limit"] | SIZE_MAX;
+        bool includeLaps = doc["data"]["laps"] | true;
+        Serial.printf("{\"id\":%u,\"status\":\"OK\",\"data\":", id);
+        history->toJson(Serial, offset, limit, includeLaps);
+        Serial.println("}");
         
     } else if (strcmp(cmd, "races/save") == 0) {
         if (doc.containsKey("data")) {
@@ -210,20 +235,53 @@ void USBTransport::processCommand(const char* cmdLine) {
         bool success = history->clearAll();
         sendResponse(id, success ? "OK" : "ERROR");
         
+    } else if (strcmp(cmd, "debug/log") == 0) {
+        // Same cursor protocol as GET /debug/log
+        uint32_t since = doc["data"]["since"] | 0;
+        uint16_t maxLines = doc["data"]["max"] | DEBUG_LOG_JSON_MAX;
+        if (maxLines == 0 || maxLines > DEBUG_LOG_RECORDS) maxLines = DEBUG_LOG_RECORDS;
+        Serial.printf("{\"id\":%u,\"status\":\"OK\",\"data\":", id);
+        DebugLogger::getInstance().toJson(Serial, since, maxLines);
+        Serial.println("}");
+
+    } else if (strcmp(cmd, "debug/level") == 0) {
+        // No data reads the levels back; {"module":"timer","level":"debug"} sets one
+        if (doc["data"].containsKey("module") || doc["data"].containsKey("level")) {
+            int module;
+            uint8_t level;
+            if (!DebugLogger::parseModule(doc["data"]["module"], module) ||
+                !DebugLogger::parseLevel(doc["data"]["level"], level)) {
+                sendResponse(id, "ERROR", "Unknown module or level");
+                return;
+            }
+            DebugLogger::setLevel(module, level);
+        }
+        Serial.printf("{\"id\":%u,\"status\":\"OK\",\"data\":", id);
+        DebugLogger::levelsToJson(Serial);
+        Serial.println("}");
+
     } else if (strcmp(cmd, "selftest") == 0) {
-        selftest->runAllTests();
-        
-        DynamicJsonDocument respDoc(4096);
-        respDoc["id"] = id;
-        respDoc["status"] = "OK";
+        // Runs in the background; results follow as "selftest" events.
+        // data.category "benchmark" runs the performance benchmarks.
+        bool benchmark = doc.containsKey("data") && doc["data"]["category"] == "benchmark";
+        uint32_t job = selftest->startJob(benchmark ? SELFTEST_BENCHMARK : SELFTEST_DIAGNOSTICS);
+        if (job == 0) {
+            sendResponse(id, "ERROR", "Self-test already running");
+        } else {
+            Serial.printf("{\"id\":%u,\"status\":\"OK\",\"data\":{\"job\":%u}}\n", id, job);
+        }
         
-        String testJson = selftest->getResultsJSON();
-        DynamicJsonDocument testDoc(4096);
-        deserializeJson(testDoc, testJson);
-        respDoc["data"] = testDoc;
+    } else if (strcmp(cmd, "selftest/status") == 0) {
+        Serial.printf("{\"id\":%u,\"status\":\"OK\",\"data\":", id);
+        Serial.print(selftest->getJobJSON());
+        Serial.println("}");
         
-        serializeJson(respDoc, Serial);
-        Serial.println();
+    } else if (strcmp(cmd, "selftest/cancel") == 0) {
+        if (selftest->cancelJob()) {
+            sendResponse(id, "OK");
+        } else {
+            sendResponse(id, "ERROR", "No self-test running");
+        }
         
     // LED commands
     } else if (strcmp(cmd, "led/preset") == 0) {
@@ -373,32 +431,14 @@ void USBTransport::sendResponse(uint32_t id, const char* status, const char* mes
 }
 
 void USBTransport::sendConfigResponse(uint32_t id) {
-    DynamicJsonDocument doc(2048);
-    doc["id"] = id;
-    doc["status"] = "OK";
-    
-    JsonObject data = doc.createNestedObject("data");
-    
-    // Build config JSON manually (Config::toJson uses AsyncResponseStream)
-    data["freq"] = conf->getFrequency();
-    data["minLap"] = (uint8_t)(conf->getMinLapMs() / 100);
-    data["alarm"] = conf->getAlarmThreshold();
-    data["enterRssi"] = conf->getEnterRssi();
-    data["exitRssi"] = conf->getExitRssi();
-    data["maxLaps"] = conf->getMaxLaps();
-    data["ledMode"] = conf->getLedMode();
-    data["ledBrightness"] = conf->getLedBrightness();
-    data["ledColor"] = conf->getLedColor();
-    data["opMode"] = conf->getOperationMode();
-    data["ssid"] = conf->getSsid();
-    data["pwd"] = conf->getPassword();
-    
-    serializeJson(doc, Serial);
-    Serial.println();
+    // Same document as GET /config, streamed straight to the port
+    Serial.printf("{\"id\":%u,\"status\":\"OK\",\"data\":", id);
+    conf->toJson(Serial);
+    Serial.println("}");
 }
 
 void USBTransport::sendStatusResponse(uint32_t id) {
-    DynamicJsonDocument doc(2048);
+    DynamicJsonDocument doc(3072);
     doc["id"] = id;
     doc["status"] = "OK";
     
@@ -413,10 +453,73 @@ void USBTransport::sendStatusResponse(uint32_t id) {
     
     // Storage info
     JsonObject stor = data.createNestedObject("storage");
+    // The bulk tier is on the active filesystem; its cached sizes spare
+    // the SD used-bytes scan on every status request
+    TierStats active = storage->getTierStats(STORAGE_TIER_BULK);
     stor["type"] = storage->getStorageType();
-    stor["used"] = storage->getUsedBytes();
-    stor["total"] = storage->getTotalBytes();
-    stor["free"] = storage->getFreeBytes();
+    stor["used"] = active.usedBytes;
+    stor["total"] = active.totalBytes;
+    stor["free"] = active.totalBytes - active.usedBytes;
+    
+    WriteBehindStats wb = storage->getWriteBehindStats();
+    JsonObject writeBehind = stor.createNestedObject("writeBehind");
+    writeBehind["queuedBytes"] = wb.queuedBytes;
+    writeBehind["queuedFiles"] = wb.queuedFiles;
+    writeBehind["peakQueuedBytes"] = wb.peakQueuedBytes;
+    writeBehind["flushedWrites"] = wb.flushedWrites;
+    writeBehind["flushedBytes"] = wb.flushedBytes;
+    writeBehind["coalescedWrites"] = wb.coalescedWrites;
+    writeBehind["syncFallbacks"] = wb.syncFallbacks;
+    writeBehind["failedWrites"] = wb.failedWrites;
+    writeBehind["lastFlushUs"] = wb.lastFlushUs;
+    writeBehind["maxFlushUs"] = wb.maxFlushUs;
+    
+    JsonObject tiers = stor.createNestedObject("tiers");
+    const char* tierNames[STORAGE_TIER_COUNT] = {"hot", "bulk"};
+    for (int t = 0; t < STORAGE_TIER_COUNT; t++) {
+        TierStats ts = storage->getTierStats((StorageTier)t);
+        JsonObject tier = tiers.createNestedObject(tierNames[t]);
+        tier["fs"] = ts.onSD ? "SD" : "LittleFS";
+        tier["used"] = ts.usedBytes;
+        tier["total"] = ts.totalBytes;
+        tier["migratedFiles"] = ts.migratedFiles;
+        tier["migratedBytes"] = ts.migratedBytes;
+        tier["evictedFiles"] = ts.evictedFiles;
+        tier["evictedBytes"] = ts.evictedBytes;
+        tier["spilledWrites"] = ts.spilledWrites;
+        tier["fullFailures"] = ts.fullFailures;
+    }
+    
+    const ConfigPersistStats& cps = conf->getPersistStats();
+    JsonObject persist = data.createNestedObject("configPersist");
+    persist["commits"] = cps.commits;
+    persist["groupWrites"] = cps.groupWrites;
+    persist["bytesWritten"] = cps.bytesWritten;
+    persist["lifetimeWrites"] = cps.lifetimeWrites;
+    persist["failedWrites"] = cps.failedWrites;
+    persist["lastWriteUs"] = cps.lastWriteUs;
+    persist["maxWriteUs"] = cps.maxWriteUs;
+    persist["lastDirtyMask"] = cps.lastDirtyMask;
+    
+#ifdef ESP32S3
+    if (g_rgbLed) {
+        RgbLedStats ls;
+        g_rgbLed->getStats(ls);
+        JsonObject rgb = data.createNestedObject("rgbLed");
+        rgb["leds"] = ls.ledCount;
+        rgb["frames"] = ls.frames;
+        rgb["shows"] = ls.shows;
+        rgb["overruns"] = ls.overruns;
+        rgb["queueDrops"] = ls.queueDrops;
+        rgb["cuesPlayed"] = ls.cuesPlayed;
+        rgb["cuesDropped"] = ls.cuesDropped;
+        rgb["maxCueLateMs"] = ls.maxCueLateMs;
+        rgb["lastRenderUs"] = ls.lastRenderUs;
+        rgb["maxRenderUs"] = ls.maxRenderUs;
+        rgb["lastShowUs"] = ls.lastShowUs;
+        rgb["maxShowUs"] = ls.maxShowUs;
+    }
+#endif
     
     // Chip info
     JsonObject chip = data.createNestedObject("chip");
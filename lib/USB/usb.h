@@ -49,8 +49,10 @@ class USBTransport : public TransportInterface {
     
     // TransportInterface implementation
     void sendLapEvent(uint32_t lapTimeMs) override;
+    void sendLapStatsEvent(const char* statsJson) override;
     void sendRssiEvent(uint8_t rssi) override;
     void sendRaceStateEvent(const char* state) override;
+    void sendSelfTestEvent(const char* json) override;
     bool isConnected() override;
     void update(uint32_t currentTimeMs) override;
     
@@ -1,42 +1,78 @@
 #include "webhook.h"
 #include "debug.h"
-#include <HTTPClient.h>
 #include <WiFi.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <lwip/netdb.h>
+#include <lwip/sockets.h>
+#include <unistd.h>
 
-WebhookManager::WebhookManager() : webhookCount(0), enabled(true), queueHead(0), queueTail(0), queueCount(0), lastWebhookMs(0) {
+static const char* const WEBHOOK_PATHS[WEBHOOK_EVENT_COUNT] = {
+    "/Lap", "/GhostLap", "/RaceStart", "/RaceStop", "/off", "/flash"};
+
+WebhookManager::WebhookManager()
+    : webhookCount(0), listVersion(0), enabled(true), listLock(nullptr), eventQueue(nullptr), task(nullptr),
+      queueDrops(0), targetCount(0), syncedVersion(0) {
     memset(webhookIPs, 0, sizeof(webhookIPs));
-    memset(requestQueue, 0, sizeof(requestQueue));
+    for (auto& t : targets) {
+        t.fd = -1;
+        resetTarget(t, "");
+    }
+}
+
+void WebhookManager::begin() {
+    if (task) return;
+    listLock = xSemaphoreCreateMutex();
+    eventQueue = xQueueCreate(WEBHOOK_QUEUE_SIZE, sizeof(uint8_t));
+    xTaskCreatePinnedToCore(taskMain, "webhooks", WEBHOOK_TASK_STACK, this, WEBHOOK_TASK_PRIORITY, &task, 0);
+}
+
+void WebhookManager::lockList() {
+    if (listLock) xSemaphoreTake(listLock, portMAX_DELAY);
+}
+
+void WebhookManager::unlockList() {
+    if (listLock) xSemaphoreGive(listLock);
 }
 
 bool WebhookManager::addWebhook(const char* ip) {
     if (!ip || strlen(ip) == 0) {
-        DEBUG("Invalid webhook IP\n");
+        LOG_W(LOG_WEBHOOK, "Invalid webhook IP\n");
         return false;
     }
-    
+    if (strlen(ip) >= WEBHOOK_ADDR_LEN) {
+        LOG_W(LOG_WEBHOOK, "Webhook address too long: %s\n", ip);
+        return false;
+    }
+
+    lockList();
     // Check if already exists
     for (uint8_t i = 0; i < webhookCount; i++) {
         if (strcmp(webhookIPs[i], ip) == 0) {
-            DEBUG("Webhook IP already exists: %s\n", ip);
+            unlockList();
+            LOG_W(LOG_WEBHOOK, "Webhook IP already exists: %s\n", ip);
             return false;
         }
     }
-    
+
     // Check max limit
     if (webhookCount >= MAX_WEBHOOKS) {
-        DEBUG("Max webhooks reached (%d)\n", MAX_WEBHOOKS);
+        unlockList();
+        LOG_W(LOG_WEBHOOK, "Max webhooks reached (%d)\n", MAX_WEBHOOKS);
         return false;
     }
-    
+
     // Copy IP to fixed buffer
-    strncpy(webhookIPs[webhookCount], ip, 15);
-    webhookIPs[webhookCount][15] = '\0';  // Ensure null termination
+    strlcpy(webhookIPs[webhookCount], ip, sizeof(webhookIPs[0]));
     webhookCount++;
-    DEBUG("Webhook added: %s (total: %d)\n", ip, webhookCount);
+    listVersion++;
+    unlockList();
+    LOG_I(LOG_WEBHOOK, "Webhook added: %s (total: %d)\n", ip, webhookCount);
     return true;
 }
 
 bool WebhookManager::removeWebhook(const char* ip) {
+    lockList();
     for (uint8_t i = 0; i < webhookCount; i++) {
         if (strcmp(webhookIPs[i], ip) == 0) {
             // Shift remaining IPs down
@@ -44,35 +80,96 @@ bool WebhookManager::removeWebhook(const char* ip) {
                 strcpy(webhookIPs[j], webhookIPs[j + 1]);
             }
             webhookCount--;
-            memset(webhookIPs[webhookCount], 0, 16);  // Clear last slot
-            DEBUG("Webhook removed: %s (remaining: %d)\n", ip, webhookCount);
+            memset(webhookIPs[webhookCount], 0, sizeof(webhookIPs[0]));  // Clear last slot
+            listVersion++;
+            unlockList();
+            LOG_I(LOG_WEBHOOK, "Webhook removed: %s (remaining: %d)\n", ip, webhookCount);
             return true;
         }
     }
-    DEBUG("Webhook not found: %s\n", ip);
+    unlockList();
+    LOG_W(LOG_WEBHOOK, "Webhook not found: %s\n", ip);
     return false;
 }
 
+void WebhookManager::onConfigChanged(Config& config, uint8_t groups) {
+    bool configEnabled = config.getWebhooksEnabled();
+    if (enabled != configEnabled) {
+        setEnabled(configEnabled);
+    }
+
+    // Build the new list first and swap it in under one lock, so the
+    // dispatcher never sees it half-replaced (targets it loses are reset)
+    char next[MAX_WEBHOOKS][WEBHOOK_ADDR_LEN];
+    memset(next, 0, sizeof(next));
+    uint8_t nextCount = 0;
+    uint8_t count = config.getWebhookCount();
+    for (uint8_t i = 0; i < count && nextCount < MAX_WEBHOOKS; i++) {
+        const char* ip = config.getWebhookIP(i);
+        if (!ip || strlen(ip) == 0 || strlen(ip) >= WEBHOOK_ADDR_LEN) {
+            continue;
+        }
+        bool duplicate = false;
+        for (uint8_t j = 0; j < nextCount && !duplicate; j++) {
+            duplicate = strcmp(next[j], ip) == 0;
+        }
+        if (!duplicate) {
+            strlcpy(next[nextCount++], ip, sizeof(next[0]));
+        }
+    }
+
+    // Endpoints that edit the list update both sides, so usually this matches already
+    lockList();
+    bool same = (nextCount == webhookCount);
+    for (uint8_t i = 0; same && i < nextCount; i++) {
+        same = strcmp(webhookIPs[i], next[i]) == 0;
+    }
+    if (!same) {
+        memcpy(webhookIPs, next, sizeof(webhookIPs));
+        webhookCount = nextCount;
+        listVersion++;
+    }
+    unlockList();
+    if (!same) {
+        LOG_I(LOG_WEBHOOK, "Webhooks updated from config (total: %d)\n", nextCount);
+    }
+}
+
 void WebhookManager::clearWebhooks() {
+    lockList();
     webhookCount = 0;
     memset(webhookIPs, 0, sizeof(webhookIPs));
-    DEBUG("All webhooks cleared\n");
+    listVersion++;
+    unlockList();
+    LOG_I(LOG_WEBHOOK, "All webhooks cleared\n");
 }
 
-uint8_t WebhookManager::getWebhookCount() const {
-    return webhookCount;
+uint8_t WebhookManager::getWebhookCount() {
+    lockList();
+    uint8_t count = webhookCount;
+    unlockList();
+    return count;
 }
 
-const char* WebhookManager::getWebhookIP(uint8_t index) const {
-    if (index < webhookCount) {
-        return webhookIPs[index];
-    }
-    return nullptr;
+bool WebhookManager::getWebhookIP(uint8_t index, char* out, size_t len) {
+    lockList();
+    bool valid = index < webhookCount;
+    if (valid) strlcpy(out, webhookIPs[index], len);
+    unlockList();
+    return valid;
+}
+
+bool WebhookManager::getTargetStats(uint8_t index, WebhookTargetStats& out) {
+    lockList();
+    bool valid = index < targetCount;
+    if (valid) out = targets[index].stats;
+    unlockList();
+    return valid;
 }
 
 void WebhookManager::setEnabled(bool en) {
     enabled = en;
-    DEBUG("Webhooks %s\n", enabled ? "enabled" : "disabled");
+    LOG_I(LOG_WEBHOOK, "Webhooks %s\n", enabled ? "enabled" : "disabled");
 }
 
 bool WebhookManager::isEnabled() const {
@@ -80,123 +177,388 @@ bool WebhookManager::isEnabled() const {
 }
 
 void WebhookManager::triggerLap() {
-    if (!enabled) return;
-    queueRequest("/Lap");
+    trigger(WEBHOOK_LAP);
 }
 
 void WebhookManager::triggerGhostLap() {
-    if (!enabled) return;
-    queueRequest("/GhostLap");
+    trigger(WEBHOOK_GHOST_LAP);
 }
 
 void WebhookManager::triggerRaceStart() {
-    if (!enabled) return;
-    queueRequest("/RaceStart");
+    trigger(WEBHOOK_RACE_START);
 }
 
 void WebhookManager::triggerRaceStop() {
-    if (!enabled) return;
-    queueRequest("/RaceStop");
+    trigger(WEBHOOK_RACE_STOP);
 }
 
 void WebhookManager::triggerOff() {
-    if (!enabled) return;
-    queueRequest("/off");
+    trigger(WEBHOOK_OFF);
 }
 
 void WebhookManager::triggerFlash() {
-    if (!enabled) return;
-    queueRequest("/flash");
+    trigger(WEBHOOK_FLASH);
 }
 
-void WebhookManager::queueRequest(const char* endpoint) {
-    // Don't queue webhooks if WiFi isn't ready yet
+void WebhookManager::trigger(webhook_event_e event) {
+    // Called from the timing loop: no locks, no logging, no waiting
+    if (!enabled || !eventQueue) return;
+    uint8_t id = event;
+    if (xQueueSend(eventQueue, &id, 0) != pdTRUE) {
+        queueDrops++;
+    }
+}
+
+void WebhookManager::taskMain(void* arg) {
+    static_cast<WebhookManager*>(arg)->dispatchLoop();
+}
+
+void WebhookManager::dispatchLoop() {
+    for (;;) {
+        syncTargets();
+
+        // Sleep on the queue while nothing is in flight, otherwise just drain it
+        TickType_t wait = anyInFlight() ? 0 : pdMS_TO_TICKS(WEBHOOK_IDLE_WAKE_MS);
+        uint8_t event;
+        while (xQueueReceive(eventQueue, &event, wait) == pdTRUE) {
+            dispatchEvent(event, millis());
+            wait = 0;
+        }
+
+        startPending(millis());
+        if (anyInFlight()) {
+            pollSockets(WEBHOOK_POLL_MS);
+        }
+        expire(millis());
+    }
+}
+
+void WebhookManager::resetTarget(Target& t, const char* ip) {
+    closeTarget(t);
+    memset(&t, 0, sizeof(t));
+    t.fd = -1;
+    strlcpy(t.ip, ip, sizeof(t.ip));
+}
+
+void WebhookManager::syncTargets() {
+    if (syncedVersion == listVersion) return;
+
+    lockList();
+    for (uint8_t i = 0; i < MAX_WEBHOOKS; i++) {
+        const char* ip = (i < webhookCount) ? webhookIPs[i] : "";
+        if (strcmp(targets[i].ip, ip) != 0) {
+            resetTarget(targets[i], ip);  // Drops its connection, queue and stats
+        }
+    }
+    targetCount = webhookCount;
+    syncedVersion = listVersion;
+    unlockList();
+}
+
+void WebhookManager::dispatchEvent(uint8_t event, uint32_t now) {
+    if (event >= WEBHOOK_EVENT_COUNT) return;
     if (WiFi.status() != WL_CONNECTED) {
-        DEBUG("Webhook skipped (WiFi not ready): %s\n", endpoint);
+        LOG_D(LOG_WEBHOOK, "Webhook skipped (WiFi not ready): %s\n", WEBHOOK_PATHS[event]);
         return;
     }
-    
-    if (queueCount >= WEBHOOK_QUEUE_SIZE) {
-        DEBUG("Webhook queue full, dropping request: %s\n", endpoint);
+
+    for (uint8_t i = 0; i < targetCount; i++) {
+        Target& t = targets[i];
+        if (t.retryAtMs && (int32_t)(now - t.retryAtMs) < 0) {
+            t.stats.dropped++;  // Still backing off
+            continue;
+        }
+        if (t.pendingCount >= WEBHOOK_TARGET_QUEUE) {
+            t.stats.dropped++;
+            continue;
+        }
+        t.pending[t.pendingCount++] = event;
+    }
+}
+
+void WebhookManager::startPending(uint32_t now) {
+    for (uint8_t i = 0; i < targetCount; i++) {
+        Target& t = targets[i];
+        if (t.state != TARGET_IDLE || t.pendingCount == 0) continue;
+        uint8_t event = t.pending[0];
+        memmove(t.pending, t.pending + 1, --t.pendingCount);
+        beginRequest(t, event, now);
+    }
+}
+
+bool WebhookManager::anyInFlight() const {
+    for (uint8_t i = 0; i < targetCount; i++) {
+        if (targets[i].state != TARGET_IDLE || targets[i].pendingCount) return true;
+    }
+    return false;
+}
+
+void WebhookManager::beginRequest(Target& t, uint8_t event, uint32_t now) {
+    t.current = event;
+    t.startUs = micros();
+    t.deadlineMs = now + WEBHOOK_TIMEOUT_MS;
+    t.requestLen = snprintf(t.request, sizeof(t.request),
+                            "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Length: 0\r\nConnection: keep-alive\r\n\r\n",
+                            WEBHOOK_PATHS[event], t.ip);
+    t.requestSent = 0;
+    t.responseLen = 0;
+    t.headersDone = false;
+    t.lengthKnown = false;
+    t.bodyRemaining = 0;
+    t.status = 0;
+
+    t.reused = (t.fd >= 0);
+    if (t.reused) {
+        t.state = TARGET_SENDING;
+        sendRequest(t, now);
         return;
     }
-    
-    strncpy(requestQueue[queueTail].endpoint, endpoint, 31);
-    requestQueue[queueTail].endpoint[31] = '\0';
-    requestQueue[queueTail].timestamp = millis();
-    
-    queueTail = (queueTail + 1) % WEBHOOK_QUEUE_SIZE;
-    queueCount++;
-    
-    DEBUG("Webhook queued: %s (queue: %d/%d)\n", endpoint, queueCount, WEBHOOK_QUEUE_SIZE);
+    if (!openConnection(t)) {
+        finishRequest(t, false, now);
+    }
 }
 
-void WebhookManager::process() {
-    if (!enabled || queueCount == 0 || webhookCount == 0) {
+bool WebhookManager::openConnection(Target& t) {
+    if (!t.resolved) {
+        char host[WEBHOOK_ADDR_LEN];
+        strlcpy(host, t.ip, sizeof(host));
+        char* colon = strchr(host, ':');
+        t.port = WEBHOOK_PORT;
+        if (colon) {
+            *colon = '\0';
+            t.port = atoi(colon + 1);
+        }
+        struct in_addr addr;
+        if (inet_pton(AF_INET, host, &addr) != 1) {
+            // Hostnames resolve here, on the dispatcher task, never on the timing path
+            struct hostent* he = gethostbyname(host);
+            if (!he || he->h_addrtype != AF_INET) {
+                LOG_W(LOG_WEBHOOK, "Webhook target %s did not resolve\n", t.ip);
+                return false;
+            }
+            memcpy(&addr, he->h_addr_list[0], sizeof(addr));
+        }
+        t.addr = addr.s_addr;
+        t.resolved = true;
+    }
+
+    t.fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (t.fd < 0) {
+        return false;
+    }
+    fcntl(t.fd, F_SETFL, fcntl(t.fd, F_GETFL, 0) | O_NONBLOCK);
+    int one = 1;
+    setsockopt(t.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(t.port);
+    sa.sin_addr.s_addr = t.addr;
+    t.stats.connects++;
+    if (connect(t.fd, (struct sockaddr*)&sa, sizeof(sa)) == 0) {
+        t.state = TARGET_SENDING;
+    } else if (errno == EINPROGRESS) {
+        t.state = TARGET_CONNECTING;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void WebhookManager::pollSockets(uint32_t timeoutMs) {
+    fd_set readSet, writeSet;
+    FD_ZERO(&readSet);
+    FD_ZERO(&writeSet);
+    int maxFd = -1;
+    for (uint8_t i = 0; i < targetCount; i++) {
+        Target& t = targets[i];
+        if (t.fd < 0 || t.state == TARGET_IDLE) continue;
+        if (t.state == TARGET_AWAITING) {
+            FD_SET(t.fd, &readSet);
+        } else {
+            FD_SET(t.fd, &writeSet);
+        }
+        if (t.fd > maxFd) maxFd = t.fd;
+    }
+    if (maxFd < 0) return;
+
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = timeoutMs * 1000;
+    if (select(maxFd + 1, &readSet, &writeSet, nullptr, &tv) <= 0) {
         return;
     }
-    
-    // Rate limit: don't send more than once every 50ms to avoid overwhelming network
+
     uint32_t now = millis();
-    if (now - lastWebhookMs < 50) {
-        return;
+    for (uint8_t i = 0; i < targetCount; i++) {
+        Target& t = targets[i];
+        if (t.fd < 0) continue;
+        if (t.state == TARGET_CONNECTING && FD_ISSET(t.fd, &writeSet)) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(t.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err != 0) {
+                finishRequest(t, false, now);
+                continue;
+            }
+            t.state = TARGET_SENDING;
+            sendRequest(t, now);
+        } else if (t.state == TARGET_SENDING && FD_ISSET(t.fd, &writeSet)) {
+            sendRequest(t, now);
+        } else if (t.state == TARGET_AWAITING && FD_ISSET(t.fd, &readSet)) {
+            readResponse(t, now);
+        }
     }
-    
-    processNextRequest();
-    lastWebhookMs = now;
 }
 
-void WebhookManager::processNextRequest() {
-    if (queueCount == 0) return;
-    
-    const char* endpoint = requestQueue[queueHead].endpoint;
-    DEBUG("Processing webhook: %s\n", endpoint);
-    
-    sendToAll(endpoint);
-    
-    // Remove from queue
-    queueHead = (queueHead + 1) % WEBHOOK_QUEUE_SIZE;
-    queueCount--;
+void WebhookManager::sendRequest(Target& t, uint32_t now) {
+    while (t.requestSent < t.requestLen) {
+        int n = send(t.fd, t.request + t.requestSent, t.requestLen - t.requestSent, 0);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;  // Wait for writable
+            finishRequest(t, false, now);
+            return;
+        }
+        t.requestSent += n;
+    }
+    t.state = TARGET_AWAITING;
 }
 
-void WebhookManager::sendToAll(const char* endpoint) {
-    for (uint8_t i = 0; i < webhookCount; i++) {
-        sendWebhook(webhookIPs[i], endpoint);
+// Looks at the status line and the headers that decide how much to read.
+// Returns false if the buffer filled up before the end of the headers.
+bool WebhookManager::parseHeaders(Target& t) {
+    t.response[t.responseLen] = '\0';
+    char* end = strstr(t.response, "\r\n\r\n");
+    if (!end) {
+        return t.responseLen + 1 < sizeof(t.response);
+    }
+    *end = '\0';
+    size_t bodyBytes = t.responseLen - (end + 4 - t.response);
+
+    const char* space = strchr(t.response, ' ');
+    t.status = space ? atoi(space + 1) : 0;
+    for (char* p = t.response; *p; p++) {
+        *p = tolower(*p);
     }
+    t.keepAlive = strncmp(t.response, "http/1.1", 8) == 0 && !strstr(t.response, "connection: close");
+    const char* length = strstr(t.response, "content-length:");
+    if (length && !strstr(t.response, "transfer-encoding")) {
+        t.lengthKnown = true;
+        t.bodyRemaining = atoi(length + 15) - (int32_t)bodyBytes;
+    } else {
+        t.keepAlive = false;  // Body runs until the peer closes
+    }
+    t.headersDone = true;
+    return true;
 }
 
-void WebhookManager::sendWebhook(const char* ip, const char* endpoint) {
-    // Create HTTPClient on stack (safer than static)
-    HTTPClient http;
-    
-    // Build URL in fixed buffer to avoid String allocation
-    char url[64];
-    snprintf(url, sizeof(url), "http://%s%s", ip, endpoint);
-    
-    http.setTimeout(WEBHOOK_TIMEOUT_MS);
-    
-    // Check WiFi is connected before attempting HTTP
-    if (WiFi.status() != WL_CONNECTED) {
-        DEBUG("Webhook skipped - WiFi not connected\n");
-        return;
+void WebhookManager::readResponse(Target& t, uint32_t now) {
+    for (;;) {
+        char scratch[64];
+        char* dst = t.headersDone ? scratch : t.response + t.responseLen;
+        size_t room = t.headersDone ? sizeof(scratch) : sizeof(t.response) - 1 - t.responseLen;
+        int n = recv(t.fd, dst, room, 0);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            finishRequest(t, false, now);
+            return;
+        }
+        if (n == 0) {
+            // Peer closed: complete only if the headers arrived and the length was open-ended
+            t.keepAlive = false;
+            finishRequest(t, t.headersDone && (!t.lengthKnown || t.bodyRemaining <= 0), now);
+            return;
+        }
+        if (t.headersDone) {
+            t.bodyRemaining -= n;
+        } else {
+            t.responseLen += n;
+            if (!parseHeaders(t)) {
+                // Oversized headers: take the status and stop reading
+                const char* space = strchr(t.response, ' ');
+                t.status = space ? atoi(space + 1) : 0;
+                t.keepAlive = false;
+                finishRequest(t, t.status > 0, now);
+                return;
+            }
+        }
+        if (t.headersDone && t.lengthKnown && t.bodyRemaining <= 0) {
+            finishRequest(t, true, now);
+            return;
+        }
     }
-    
-    if (!http.begin(url)) {
-        DEBUG("Webhook failed to begin: %s\n", url);
+}
+
+void WebhookManager::finishRequest(Target& t, bool ok, uint32_t now) {
+    if (!ok && t.reused && t.responseLen == 0) {
+        // The kept-alive connection was closed by the target while idle;
+        // retry once on a fresh one before counting a failure
+        closeTarget(t);
+        uint8_t event = t.current;
+        uint32_t deadline = t.deadlineMs;
+        beginRequest(t, event, now);
+        t.deadlineMs = deadline;
         return;
     }
-    
-    int httpCode = http.POST("");  // Empty POST body
-    
-    if (httpCode > 0) {
-        if (httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_ACCEPTED) {
-            DEBUG("Webhook OK: %s (code: %d)\n", url, httpCode);
+
+    uint32_t latency = micros() - t.startUs;
+    t.state = TARGET_IDLE;
+    t.idleSinceMs = now;
+
+    lockList();  // Stats are read by the web server
+    WebhookTargetStats& s = t.stats;
+    if (ok) {
+        s.lastLatencyUs = latency;
+        s.avgLatencyUs = s.avgLatencyUs ? s.avgLatencyUs - (s.avgLatencyUs >> 3) + (latency >> 3) : latency;
+        if (latency > s.maxLatencyUs) s.maxLatencyUs = latency;
+        if (t.status >= 200 && t.status < 300) {
+            s.ok++;
         } else {
-            DEBUG("Webhook code %d: %s\n", httpCode, url);
+            s.httpErrors++;
+            LOG_W(LOG_WEBHOOK, "Webhook code %d: %s%s\n", t.status, t.ip, WEBHOOK_PATHS[t.current]);
         }
+        s.consecutiveFailures = 0;
+        s.backoffMs = 0;
+        t.retryAtMs = 0;
     } else {
-        DEBUG("Webhook failed: %s\n", url);
+        s.failed++;
+        if (s.consecutiveFailures < 255) s.consecutiveFailures++;
+        uint8_t shift = s.consecutiveFailures - 1 < 16 ? s.consecutiveFailures - 1 : 16;
+        uint32_t backoff = (uint32_t)WEBHOOK_BACKOFF_BASE_MS << shift;
+        s.backoffMs = backoff < WEBHOOK_BACKOFF_MAX_MS ? backoff : WEBHOOK_BACKOFF_MAX_MS;
+        t.retryAtMs = (now + s.backoffMs) | 1;  // 0 means "not backing off"
+        // Queued events would only be late now; drop them with the dead connection
+        s.dropped += t.pendingCount;
+        t.pendingCount = 0;
+        t.resolved = false;  // Re-resolve hostnames on the next attempt
+        LOG_W(LOG_WEBHOOK, "Webhook failed: %s%s (retry in %ums)\n", t.ip, WEBHOOK_PATHS[t.current], s.backoffMs);
+    }
+    unlockList();
+
+    if (!ok || !t.keepAlive) {
+        closeTarget(t);
+    }
+}
+
+void WebhookManager::expire(uint32_t now) {
+    for (uint8_t i = 0; i < targetCount; i++) {
+        Target& t = targets[i];
+        if (t.state != TARGET_IDLE) {
+            if ((int32_t)(now - t.deadlineMs) >= 0) {
+                t.reused = false;  // A timeout is a real failure, no silent retry
+                finishRequest(t, false, now);
+            }
+        } else if (t.fd >= 0 && now - t.idleSinceMs > WEBHOOK_KEEPALIVE_MS) {
+            closeTarget(t);
+        }
+    }
+}
+
+void WebhookManager::closeTarget(Target& t) {
+    if (t.fd >= 0) {
+        close(t.fd);
+        t.fd = -1;
     }
-    
-    http.end();
+    t.state = TARGET_IDLE;
 }
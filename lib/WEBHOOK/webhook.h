@@ -2,68 +2,159 @@
 #define WEBHOOK_H
 
 #include <Arduino.h>
-#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include "config.h"
 
 #define MAX_WEBHOOKS 10
-#define WEBHOOK_TIMEOUT_MS 300  // Reduced timeout
-#define WEBHOOK_QUEUE_SIZE 10   // Max pending webhook requests
+#define WEBHOOK_ADDR_LEN CONFIG_WEBHOOK_ADDR_LEN  // Longer targets are rejected, not truncated
+#define WEBHOOK_PORT 80               // Default when the target has no ":port"
+#define WEBHOOK_TIMEOUT_MS 300        // Connect + response, per request
+#define WEBHOOK_QUEUE_SIZE 16         // Events waiting for the dispatcher task
+#define WEBHOOK_TARGET_QUEUE 4        // Events waiting per target while one is in flight
+#define WEBHOOK_KEEPALIVE_MS 20000    // Idle connections are closed after this
+#define WEBHOOK_BACKOFF_BASE_MS 500   // First retry delay after a target fails
+#define WEBHOOK_BACKOFF_MAX_MS 30000  // Doubles per consecutive failure up to this
+#define WEBHOOK_POLL_MS 10            // select() slice while requests are in flight
+#define WEBHOOK_IDLE_WAKE_MS 1000     // Wakeup to reap idle connections
+#define WEBHOOK_TASK_STACK 4096
+#define WEBHOOK_TASK_PRIORITY 1       // Same core as parallelTask, never the timing loop's
+
+typedef enum : uint8_t {
+    WEBHOOK_LAP,
+    WEBHOOK_GHOST_LAP,
+    WEBHOOK_RACE_START,
+    WEBHOOK_RACE_STOP,
+    WEBHOOK_OFF,
+    WEBHOOK_FLASH,
+    WEBHOOK_EVENT_COUNT
+} webhook_event_e;
 
-struct WebhookRequest {
-    char endpoint[32];  // Fixed size to avoid String allocation
-    uint32_t timestamp;
+struct WebhookTargetStats {
+    uint32_t ok;              // 2xx responses
+    uint32_t httpErrors;      // Other responses (target is alive, no backoff)
+    uint32_t failed;          // Connect errors and timeouts
+    uint32_t dropped;         // Events skipped while backing off or with the target queue full
+    uint32_t connects;        // New TCP connections; other requests reused a kept-alive one
+    uint32_t lastLatencyUs;
+    uint32_t avgLatencyUs;    // Moving average (1/8 weight)
+    uint32_t maxLatencyUs;
+    uint32_t backoffMs;       // Current retry delay, 0 while healthy
+    uint8_t consecutiveFailures;
 };
 
-class WebhookManager {
+// Delivers gate LED webhooks (HTTP POST with an empty body) from its own
+// task. The trigger*() calls made by the timing code only push an event id
+// into a FreeRTOS queue without blocking, so lap detection never waits on
+// the network. The dispatcher keeps one non-blocking, kept-alive socket
+// per target, so a dead or slow controller only delays itself and is
+// backed off exponentially.
+class WebhookManager : public ConfigListener {
    public:
     WebhookManager();
-    
-    // Add/remove webhook IPs - use const char* to avoid String copies
+    void begin();  // Starts the dispatcher task
+
+    // Add/remove targets ("a.b.c.d" or "a.b.c.d:port", under WEBHOOK_ADDR_LEN)
     bool addWebhook(const char* ip);
     bool removeWebhook(const char* ip);
     void clearWebhooks();
-    uint8_t getWebhookCount() const;
-    const char* getWebhookIP(uint8_t index) const;
-    
-    // Trigger webhook events (queued, truly non-blocking)
+    uint8_t getWebhookCount();
+    bool getWebhookIP(uint8_t index, char* out, size_t len);  // Copied under the lock
+    bool getTargetStats(uint8_t index, WebhookTargetStats& out);
+    uint32_t getQueueDrops() const { return queueDrops; }
+
+    // Trigger webhook events; never block
     void triggerLap();
     void triggerGhostLap();
     void triggerRaceStart();
     void triggerRaceStop();
     void triggerOff();
     void triggerFlash();
-    
-    // Process queued webhooks (call from main loop)
-    void process();
-    
+
     // Enable/disable webhooks
     void setEnabled(bool enabled);
     bool isEnabled() const;
-    
+
+    // Follows the webhook list and enable flag in Config
+    void onConfigChanged(Config& config, uint8_t groups) override;
+
    private:
-    char webhookIPs[MAX_WEBHOOKS][16];  // Fixed-size IP storage (xxx.xxx.xxx.xxx\0)
+    enum TargetState : uint8_t {
+        TARGET_IDLE,
+        TARGET_CONNECTING,
+        TARGET_SENDING,
+        TARGET_AWAITING
+    };
+
+    // Owned by the dispatcher task, except stats (copied out under listLock)
+    struct Target {
+        char ip[WEBHOOK_ADDR_LEN];
+        bool resolved;
+        uint32_t addr;              // Network byte order
+        uint16_t port;
+        int fd;                     // -1 = no connection
+        TargetState state;
+        bool reused;                // Request went out on a kept-alive connection
+        bool keepAlive;             // Response allows reusing the connection
+        bool headersDone;
+        bool lengthKnown;
+        int32_t bodyRemaining;
+        int status;
+        uint8_t current;            // Event in flight
+        uint8_t pending[WEBHOOK_TARGET_QUEUE];
+        uint8_t pendingCount;
+        uint32_t startUs;
+        uint32_t deadlineMs;
+        uint32_t idleSinceMs;
+        uint32_t retryAtMs;         // Backing off until then (0 = not)
+        char request[112];
+        uint16_t requestLen;
+        uint16_t requestSent;
+        char response[192];         // Status line and headers only
+        uint16_t responseLen;
+        WebhookTargetStats stats;
+    };
+
+    // Target list as configured; guarded by listLock
+    char webhookIPs[MAX_WEBHOOKS][WEBHOOK_ADDR_LEN];
     uint8_t webhookCount;
-    bool enabled;
-    
-    // Queue for webhook requests
-    WebhookRequest requestQueue[WEBHOOK_QUEUE_SIZE];
-    uint8_t queueHead;
-    uint8_t queueTail;
-    uint8_t queueCount;
-    
-    // Rate limiting
-    uint32_t lastWebhookMs;
-    
-    // Queue a webhook request
-    void queueRequest(const char* endpoint);
-    
-    // Process one queued request
-    void processNextRequest();
-    
-    // Send to all IPs (called from process loop)
-    void sendToAll(const char* endpoint);
-    
-    // Send to specific IP
-    void sendWebhook(const char* ip, const char* endpoint);
+    uint32_t listVersion;
+    volatile bool enabled;
+
+    SemaphoreHandle_t listLock;
+    QueueHandle_t eventQueue;
+    TaskHandle_t task;
+    volatile uint32_t queueDrops;
+
+    // Dispatcher task state
+    Target targets[MAX_WEBHOOKS];
+    uint8_t targetCount;
+    uint32_t syncedVersion;
+
+    void trigger(webhook_event_e event);
+    void lockList();
+    void unlockList();
+
+    static void taskMain(void* arg);
+    void dispatchLoop();
+    void syncTargets();
+    void dispatchEvent(uint8_t event, uint32_t now);
+    void startPending(uint32_t now);
+    bool anyInFlight() const;
+    void pollSockets(uint32_t timeoutMs);
+    void expire(uint32_t now);
+
+    void beginRequest(Target& t, uint8_t event, uint32_t now);
+    bool openConnection(Target& t);
+    void sendRequest(Target& t, uint32_t now);
+    void readResponse(Target& t, uint32_t now);
+    bool parseHeaders(Target& t);
+    void finishRequest(Target& t, bool ok, uint32_t now);
+    void closeTarget(Target& t);
+    void resetTarget(Target& t, const char* ip);
 };
 
 #endif // WEBHOOK_H
@@ -0,0 +1,96 @@
+#include "soundcache.h"
+
+#include "debug.h"
+
+SoundFileCache::SoundFileCache() : storage(nullptr), tick(0), hits(0), misses(0), sdWasAvailable(false) {
+    clear();
+}
+
+void SoundFileCache::init(Storage* storageBackend) {
+    storage = storageBackend;
+    sdWasAvailable = storage && storage->isSDAvailable();
+    clear();
+}
+
+void SoundFileCache::clear() {
+    for (auto& entry : entries) {
+        entry.path[0] = '\0';
+        entry.lastUsed = 0;
+    }
+}
+
+void SoundFileCache::invalidate(const String& path) {
+    for (auto& entry : entries) {
+        if (entry.path[0] != '\0' && path.equals(entry.path)) {
+            entry.path[0] = '\0';
+            entry.lastUsed = 0;
+            return;
+        }
+    }
+}
+
+bool SoundFileCache::probe(fs::FS& fs, const String& path, SoundFileInfo& info) {
+    // One open() answers existence, size and mtime together
+    File file = fs.open(path, "r");
+    if (!file || file.isDirectory()) {
+        return false;
+    }
+    info.fs = &fs;
+    info.size = file.size();
+    info.lastWrite = file.getLastWrite();
+    file.close();
+    return true;
+}
+
+bool SoundFileCache::resolve(const String& path, SoundFileInfo& info) {
+    bool sdAvailable = storage && storage->isSDAvailable();
+    if (sdAvailable != sdWasAvailable) {
+        // Card mounted or removed: every cached location may be stale
+        sdWasAvailable = sdAvailable;
+        clear();
+    }
+
+    uint32_t now = millis();
+    bool cacheable = path.length() < SOUND_CACHE_PATH_LEN;
+    Entry* victim = &entries[0];
+    if (cacheable) {
+        for (auto& entry : entries) {
+            if (entry.path[0] != '\0' && path.equals(entry.path)) {
+                uint32_t ttl = entry.info.fs ? SOUND_CACHE_TTL_MS : SOUND_CACHE_MISS_TTL_MS;
+                if (now - entry.resolvedMs < ttl) {
+                    entry.lastUsed = ++tick;
+                    hits++;
+                    info = entry.info;
+                    return info.fs != nullptr;
+                }
+                victim = &entry;  // Expired: re-probe into the same slot
+                break;
+            }
+            if (entry.lastUsed < victim->lastUsed) {
+                victim = &entry;
+            }
+        }
+    }
+
+    misses++;
+    info.fs = nullptr;
+    info.onSD = false;
+    info.size = 0;
+    info.lastWrite = 0;
+#ifdef ESP32S3
+    if (sdAvailable && probe(SD, path, info)) {
+        info.onSD = true;
+    } else
+#endif
+    if (!probe(LittleFS, path, info)) {
+        info.fs = nullptr;
+    }
+
+    if (cacheable) {
+        strlcpy(victim->path, path.c_str(), sizeof(victim->path));
+        victim->info = info;
+        victim->resolvedMs = now;
+        victim->lastUsed = ++tick;
+    }
+    return info.fs != nullptr;
+}
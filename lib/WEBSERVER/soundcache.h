@@ -0,0 +1,57 @@
+#ifndef SOUNDCACHE_H
+#define SOUNDCACHE_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "storage.h"
+
+#define SOUND_CACHE_ENTRIES 48          // Announcer clips whose location is remembered
+#define SOUND_CACHE_PATH_LEN 48         // Longer paths are resolved every time
+#define SOUND_CACHE_TTL_MS 60000        // Re-probe found files after this long
+#define SOUND_CACHE_MISS_TTL_MS 5000    // ... and missing ones after this long
+
+struct SoundFileInfo {
+    fs::FS* fs;         // nullptr if the file exists nowhere
+    bool onSD;
+    uint32_t size;
+    time_t lastWrite;
+};
+
+// Remembers where each sound file lives (SD or LittleFS) along with its size
+// and modification time, so repeated clips cost no filesystem probes at all
+// when answered with 304 and a single open() otherwise. Only used from the
+// async web server task, so it needs no locking.
+class SoundFileCache {
+   public:
+    SoundFileCache();
+    void init(Storage* storage);
+
+    // Returns false if the file is on neither filesystem
+    bool resolve(const String& path, SoundFileInfo& info);
+    // Forgets one path, e.g. when opening its cached location failed
+    void invalidate(const String& path);
+    void clear();
+
+    uint32_t getHits() const { return hits; }
+    uint32_t getMisses() const { return misses; }
+
+   private:
+    struct Entry {
+        char path[SOUND_CACHE_PATH_LEN];   // "" = empty slot
+        SoundFileInfo info;
+        uint32_t resolvedMs;
+        uint32_t lastUsed;
+    };
+
+    Storage* storage;
+    Entry entries[SOUND_CACHE_ENTRIES];
+    uint32_t tick;
+    uint32_t hits;
+    uint32_t misses;
+    bool sdWasAvailable;
+
+    static bool probe(fs::FS& fs, const String& path, SoundFileInfo& info);
+};
+
+#endif
@@ -12,6 +12,7 @@ extern "C" {
 #include "esp_netif.h"
 
 #include "debug.h"
+#include "soundcache.h"
 
 #ifdef ESP32S3
 #include "rgbled.h"
@@ -30,6 +31,8 @@ static DNSServer dnsServer;
 static IPAddress ipAddress;
 static AsyncWebServer server(80);
 static AsyncEventSource events("/events");
+static SoundFileCache soundCache;
+static AsyncWebServerRequest *imageUploadRequest = nullptr;  // Request that owns the track image upload
 
 static const char *wifi_hostname = "FPVGate";
 static const char *wifi_ap_ssid_prefix = "FPVGate";
@@ -49,6 +52,7 @@ void Webserver::init(Config *config, LapTimer *lapTimer, BatteryMonitor *batMoni
     history = raceHist;
     storage = stor;
     g_storage = stor;  // Set global pointer for static functions
+    soundCache.init(stor);
     selftest = test;
     rx = rx5808;
     trackManager = trackMgr;
@@ -92,6 +96,11 @@ void Webserver::sendLapEvent(uint32_t lapTimeMs) {
     events.send(buf, "lap");
 }
 
+void Webserver::sendLapStatsEvent(const char* statsJson) {
+    if (!servicesStarted) return;
+    events.send(statsJson, "lapStats");
+}
+
 void Webserver::sendRssiEvent(uint8_t rssi) {
     if (!servicesStarted) return;
     char buf[16];
@@ -104,6 +113,11 @@ void Webserver::sendRaceStateEvent(const char* state) {
     events.send(state, "raceState");
 }
 
+void Webserver::sendSelfTestEvent(const char* json) {
+    if (!servicesStarted) return;
+    events.send(json, "selftest");
+}
+
 bool Webserver::isConnected() {
     // WiFi transport is always "connected" if services are started
     // Individual clients connect/disconnect via SSE but that's transparent
@@ -288,6 +302,185 @@ static void handleRoot(AsyncWebServerRequest *request) {
     request->send(LittleFS, "/index.html", "text/html");
 }
 
+// Parses a single "bytes=a-b", "bytes=a-" or "bytes=-n" range. Returns false
+// for anything else (multiple ranges included) so the whole file is sent.
+static bool parseByteRange(const String &header, uint32_t size, uint32_t &start, uint32_t &end, bool &satisfiable) {
+    satisfiable = true;
+    if (!header.startsWith("bytes=") || header.indexOf(',') >= 0) {
+        return false;
+    }
+    int dash = header.indexOf('-', 6);
+    if (dash < 0) {
+        return false;
+    }
+    String first = header.substring(6, dash);
+    String last = header.substring(dash + 1);
+    first.trim();
+    last.trim();
+    if (first.isEmpty() && last.isEmpty()) {
+        return false;
+    }
+
+    if (first.isEmpty()) {
+        // Suffix range: the last n bytes
+        uint32_t suffix = strtoul(last.c_str(), nullptr, 10);
+        if (suffix == 0 || size == 0) {
+            satisfiable = false;
+            return true;
+        }
+        start = suffix >= size ? 0 : size - suffix;
+        end = size - 1;
+        return true;
+    }
+
+    start = strtoul(first.c_str(), nullptr, 10);
+    end = last.isEmpty() ? size - 1 : strtoul(last.c_str(), nullptr, 10);
+    if (start >= size || end < start) {
+        satisfiable = false;
+        return true;
+    }
+    if (end >= size) {
+        end = size - 1;
+    }
+    return true;
+}
+
+static bool formatHttpDate(time_t t, char *out, size_t len) {
+    // FAT and LittleFS report 0 or 1980-era stamps when the clock was never set
+    if (t < 946684800) {  // 2000-01-01
+        return false;
+    }
+    struct tm tmUtc;
+    gmtime_r(&t, &tmUtc);
+    return strftime(out, len, "%a, %d %b %Y %H:%M:%S GMT", &tmUtc) > 0;
+}
+
+// Validators for a stored file: ETag from size and mtime, plus Last-Modified
+// when the file carries a plausible timestamp
+struct FileValidators {
+    uint32_t size;
+    char etag[32];
+    char lastModified[32];
+    bool hasLastModified;
+};
+
+static void makeValidators(uint32_t size, time_t lastWrite, FileValidators &v) {
+    v.size = size;
+    snprintf(v.etag, sizeof(v.etag), "\"%lx-%lx\"", (unsigned long)size, (unsigned long)lastWrite);
+    v.hasLastModified = formatHttpDate(lastWrite, v.lastModified, sizeof(v.lastModified));
+}
+
+// Answers with 304 (and returns true) if the client's cached copy is current
+static bool sendIfNotModified(AsyncWebServerRequest *request, const FileValidators &v, const char *cacheControl) {
+    // If-None-Match wins over If-Modified-Since when both are present (RFC 9110)
+    bool notModified = false;
+    if (request->hasHeader("If-None-Match")) {
+        String inm = request->header("If-None-Match");
+        notModified = inm.indexOf(v.etag) >= 0 || inm == "*";
+    } else if (v.hasLastModified && request->hasHeader("If-Modified-Since")) {
+        notModified = request->header("If-Modified-Since") == v.lastModified;
+    }
+    if (!notModified) {
+        return false;
+    }
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    response->addHeader("ETag", v.etag);
+    response->addHeader("Cache-Control", cacheControl);
+    request->send(response);
+    return true;
+}
+
+// Streams an open file from the filesystem in TCP-sized chunks, honouring a
+// single byte range. Nothing but the chunk being sent is held in RAM.
+static void sendFileStream(AsyncWebServerRequest *request, File file, const FileValidators &v,
+                           const char *contentType, const char *cacheControl) {
+    uint32_t start = 0;
+    uint32_t end = v.size ? v.size - 1 : 0;
+    bool partial = false;
+    if (request->hasHeader("Range")) {
+        // A stale If-Range means the client's partial copy is of another version
+        bool rangeValid = !request->hasHeader("If-Range") || request->header("If-Range") == v.etag;
+        bool satisfiable = true;
+        if (rangeValid && parseByteRange(request->header("Range"), v.size, start, end, satisfiable)) {
+            if (!satisfiable) {
+                char contentRange[32];
+                snprintf(contentRange, sizeof(contentRange), "bytes */%lu", (unsigned long)v.size);
+                AsyncWebServerResponse *response = request->beginResponse(416);
+                response->addHeader("Content-Range", contentRange);
+                request->send(response);
+                return;
+            }
+            partial = true;
+        } else {
+            start = 0;
+            end = v.size ? v.size - 1 : 0;
+        }
+    }
+
+    if (start > 0 && !file.seek(start)) {
+        request->send(500, "text/plain", "Seek failed");
+        return;
+    }
+
+    size_t length = v.size ? end - start + 1 : 0;
+    AsyncWebServerResponse *response = request->beginResponse(contentType, length,
+        [file, length](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+            if (index >= length) {
+                return 0;
+            }
+            size_t chunk = std::min(maxLen, length - index);
+            return file.read(buffer, chunk);
+        });
+    if (partial) {
+        char contentRange[48];
+        snprintf(contentRange, sizeof(contentRange), "bytes %lu-%lu/%lu",
+                 (unsigned long)start, (unsigned long)end, (unsigned long)v.size);
+        response->setCode(206);
+        response->addHeader("Content-Range", contentRange);
+    }
+    response->addHeader("Accept-Ranges", "bytes");
+    response->addHeader("ETag", v.etag);
+    if (v.hasLastModified) {
+        response->addHeader("Last-Modified", v.lastModified);
+    }
+    response->addHeader("Cache-Control", cacheControl);
+    request->send(response);
+}
+
+// Serves an announcer clip with validators and byte ranges. The browser
+// revalidates repeated clips with a 304 that never touches the filesystem,
+// and seeking/resuming fetches only the requested span.
+static void serveSoundFile(AsyncWebServerRequest *request) {
+    String path = request->url();
+
+    // A cached location can go stale (clip moved between SD and LittleFS,
+    // or replaced); on a failed open the path is resolved once more afresh
+    for (uint8_t attempt = 0; attempt < 2; attempt++) {
+        SoundFileInfo info;
+        if (!soundCache.resolve(path, info)) {
+            break;
+        }
+
+        FileValidators validators;
+        makeValidators(info.size, info.lastWrite, validators);
+        if (sendIfNotModified(request, validators, "max-age=3600")) {
+            return;
+        }
+
+        File file = info.fs->open(path, "r");
+        if (file) {
+            DEBUG("Serving audio from %s: %s\n", info.onSD ? "SD" : "LittleFS", path.c_str());
+            sendFileStream(request, file, validators, "audio/mpeg", "max-age=3600");
+            return;
+        }
+        DEBUG("Audio file vanished: %s\n", path.c_str());
+        soundCache.invalidate(path);
+    }
+
+    DEBUG("Audio file not found: %s\n", path.c_str());
+    request->send(404, "text/plain", "Audio file not found");
+}
+
 static void handleNotFound(AsyncWebServerRequest *request) {
     if (captivePortal(request)) {  // If captive portal redirect instead of displaying the error page.
         return;
@@ -295,6 +488,11 @@ static void handleNotFound(AsyncWebServerRequest *request) {
 
     String path = request->url();
 
+    if (request->method() == HTTP_GET && path.endsWith(".mp3")) {
+        serveSoundFile(request);
+        return;
+    }
+
 #ifdef ESP32S3
     // Try SD card as a fallback for any unknown path (e.g. /sounds_*/file.mp3)
     if (g_storage && g_storage->isSDAvailable() && SD.exists(path)) {
@@ -398,9 +596,9 @@ void Webserver::startServices() {
     server.on("/fwlink", handleRoot);
 
     server.on("/status", [this](AsyncWebServerRequest *request) {
-        char buf[1536];
-        char configBuf[256];
-        conf->toJsonString(configBuf);
+        char buf[2048];
+        char configBuf[640];
+        conf->toJsonString(configBuf, sizeof(configBuf));
         const char *format =
             "\
 Heap:\n\
@@ -413,6 +611,11 @@ Storage:\n\
 \tUsed:\t%llu\n\
 \tTotal:\t%llu\n\
 \tFree:\t%llu\n\
+\tQueued:\t%u bytes, %u files (peak %u)\n\
+\tFlushed:\t%u writes, %u bytes, %u coalesced, %u sync, %u failed\n\
+\tFlush:\t%uus last, %uus max\n\
+\tHot:\t%s %llu/%llu, %u migrated, %u evicted, %u spilled, %u full\n\
+\tBulk:\t%s %llu/%llu, %u migrated, %u evicted, %u spilled, %u full\n\
 Chip:\n\
 \tModel:\t%s Rev %i, %i Cores, SDK %s\n\
 \tFlashSize:\t%i\n\
@@ -421,20 +624,42 @@ Chip:\n\
 Network:\n\
 \tIP:\t%s\n\
 \tMAC:\t%s\n\
-EEPROM:\n\
+Config:\n\
+\tNVS:\t%u commits, %u group writes, %u bytes, %u lifetime, %u failed\n\
+\tWrite:\t%uus last, %uus max\n\
 %s";
 
+        WriteBehindStats wb = storage->getWriteBehindStats();
+        TierStats hot = storage->getTierStats(STORAGE_TIER_HOT);
+        // Bulk is on the active filesystem, so its cached sizes stand in for
+        // getUsedBytes(), which scans the FAT on SD
+        TierStats bulk = storage->getTierStats(STORAGE_TIER_BULK);
+        const ConfigPersistStats& cps = conf->getPersistStats();
         snprintf(buf, sizeof(buf), format,
                  ESP.getFreeHeap(), ESP.getMinFreeHeap(), ESP.getHeapSize(), ESP.getMaxAllocHeap(),
-                 storage->getStorageType().c_str(), storage->getUsedBytes(), storage->getTotalBytes(), storage->getFreeBytes(),
+                 storage->getStorageType().c_str(), bulk.usedBytes, bulk.totalBytes, bulk.totalBytes - bulk.usedBytes,
+                 wb.queuedBytes, wb.queuedFiles, wb.peakQueuedBytes,
+                 wb.flushedWrites, wb.flushedBytes, wb.coalescedWrites, wb.syncFallbacks, wb.failedWrites,
+                 wb.lastFlushUs, wb.maxFlushUs,
+                 hot.onSD ? "SD" : "LittleFS", hot.usedBytes, hot.totalBytes,
+                 hot.migratedFiles, hot.evictedFiles, hot.spilledWrites, hot.fullFailures,
+                 bulk.onSD ? "SD" : "LittleFS", bulk.usedBytes, bulk.totalBytes,
+                 bulk.migratedFiles, bulk.evictedFiles, bulk.spilledWrites, bulk.fullFailures,
                  ESP.getChipModel(), ESP.getChipRevision(), ESP.getChipCores(), ESP.getSdkVersion(), ESP.getFlashChipSize(), ESP.getFlashChipSpeed() / 1000000, getCpuFrequencyMhz(),
-                 WiFi.localIP().toString().c_str(), WiFi.macAddress().c_str(), configBuf);
+                 WiFi.localIP().toString().c_str(), WiFi.macAddress().c_str(),
+                 cps.commits, cps.groupWrites, cps.bytesWritten, cps.lifetimeWrites, cps.failedWrites,
+                 cps.lastWriteUs, cps.maxWriteUs, configBuf);
         request->send(200, "text/plain", buf);
         led->on(200);
     });
 
     server.on("/timer/start", HTTP_POST, [this](AsyncWebServerRequest *request) {
-        timer->start();
+        // Optional: the client's clock at the start, used to date a recovered race
+        uint32_t epoch = 0;
+        if (request->hasParam("epoch", true)) {
+            epoch = strtoul(request->getParam("epoch", true)->value().c_str(), nullptr, 10);
+        }
+        timer->start(epoch);
         if (transportMgr) {
             transportMgr->broadcastRaceStateEvent("started");
         }
@@ -450,11 +675,23 @@ EEPROM:\n\
     });
 
     server.on("/timer/lap", HTTP_POST, [this](AsyncWebServerRequest *request) {
-#ifdef ESP32S3
-        if (g_rgbLed) {
-            g_rgbLed->flashLap();
+        RaceEvent lap = {RACE_EVENT_LAP, 0, 0, millis()};
+        timer->publish(lap);
+        request->send(200, "application/json", "{\"status\": \"OK\"}");
+    });
+
+    // Race start announced ahead of time so LED cues can count down to it
+    server.on("/timer/countdown", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        if (!request->hasParam("ms", true)) {
+            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing ms\"}");
+            return;
         }
-#endif
+        long ms = request->getParam("ms", true)->value().toInt();
+        if (ms < 0 || ms > RACE_COUNTDOWN_MAX_MS) {
+            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"ms out of range\"}");
+            return;
+        }
+        timer->announceStart(ms);
         request->send(200, "application/json", "{\"status\": \"OK\"}");
     });
 
@@ -466,11 +703,8 @@ EEPROM:\n\
             if (transportMgr) {
                 transportMgr->broadcastLapEvent(lapTimeMs);
             }
-#ifdef ESP32S3
-            if (g_rgbLed) {
-                g_rgbLed->flashLap();
-            }
-#endif
+            RaceEvent lap = {RACE_EVENT_LAP, 0, lapTimeMs, millis()};
+            timer->publish(lap);
             // Trigger lap webhook if Gate LEDs enabled and Lap enabled
             if (webhooks && conf->getGateLEDsEnabled() && conf->getWebhookLap()) {
                 webhooks->triggerLap();
@@ -500,11 +734,8 @@ EEPROM:\n\
             if (transportMgr) {
                 transportMgr->broadcastLapEvent(lapTimeMs);
             }
-#ifdef ESP32S3
-            if (g_rgbLed) {
-                g_rgbLed->flashLap();
-            }
-#endif
+            RaceEvent lap = {RACE_EVENT_LAP, 0, lapTimeMs, millis()};
+            timer->publish(lap);
             // Trigger lap webhook if Gate LEDs enabled and Lap enabled
             if (webhooks && conf->getGateLEDsEnabled() && conf->getWebhookLap()) {
                 webhooks->triggerLap();
@@ -564,54 +795,9 @@ EEPROM:\n\
     });
 
     // Serve audio files from SD card voice directories (sounds_default, sounds_rachel, etc.)
-    server.on("^\\/sounds_.+\\/.+\\.mp3$", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        String path = request->url();
-        
-#ifdef ESP32S3
-        // Try SD card first if available
-        if (storage->isSDAvailable() && SD.exists(path)) {
-            DEBUG("Serving audio from SD: %s\n", path.c_str());
-            request->send(SD, path, "audio/mpeg");
-            return;
-        }
-#endif
-        
-        // Fall back to LittleFS
-        if (LittleFS.exists(path)) {
-            DEBUG("Serving audio from LittleFS: %s\n", path.c_str());
-            request->send(LittleFS, path, "audio/mpeg");
-            return;
-        }
-        
-        // File not found
-        DEBUG("Audio file not found: %s\n", path.c_str());
-        request->send(404, "text/plain", "Audio file not found");
-    });
-    
-    // Serve audio files from SD /sounds/ directory (legacy/fallback)
-    server.on("^\\/sounds\\/.+\\.mp3$", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        String path = request->url();
-        
-#ifdef ESP32S3
-        // Try SD card first if available
-        if (storage->isSDAvailable() && SD.exists(path)) {
-            DEBUG("Serving audio from SD: %s\n", path.c_str());
-            request->send(SD, path, "audio/mpeg");
-            return;
-        }
-#endif
-        
-        // Fall back to LittleFS
-        if (LittleFS.exists(path)) {
-            DEBUG("Serving audio from LittleFS: %s\n", path.c_str());
-            request->send(LittleFS, path, "audio/mpeg");
-            return;
-        }
-        
-        // File not found
-        DEBUG("Audio file not found: %s\n", path.c_str());
-        request->send(404, "text/plain", "Audio file not found");
-    });
+    // and the legacy /sounds/ directory, SD first with LittleFS as fallback
+    server.on("^\\/sounds_.+\\/.+\\.mp3$", HTTP_GET, serveSoundFile);
+    server.on("^\\/sounds\\/.+\\.mp3$", HTTP_GET, serveSoundFile);
     
     // WiFi status endpoint (register before serveStatic to prevent VFS errors)
     server.on("/api/wifi", HTTP_GET, [this](AsyncWebServerRequest *request) {
@@ -670,16 +856,19 @@ EEPROM:\n\
 
     // Race history endpoints
     server.on("/races", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        String json = history->toJsonString();
-        request->send(200, "application/json", json);
+        // Paged summaries only; lap data is fetched per race via /races/downloadOne
+        size_t offset = request->hasParam("offset") ? request->getParam("offset")->value().toInt() : 0;
+        size_t limit = request->hasParam("limit") ? request->getParam("limit")->value().toInt() : RACES_PAGE_DEFAULT;
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        history->toJson(*response, offset, limit, false);
+        request->send(response);
         led->on(200);
     });
 
     server.on("/races/download", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        String json = history->toJsonString();
-        AsyncWebServerResponse *response = request->beginResponse(200, "application/octet-stream", json);
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
         response->addHeader("Content-Disposition", "attachment; filename=\"races.json\"");
-        response->addHeader("Content-Type", "application/json");
+        history->toJson(*response);
         request->send(response);
         led->on(200);
     });
@@ -784,41 +973,20 @@ EEPROM:\n\
         if (request->hasParam("timestamp")) {
             uint32_t timestamp = request->getParam("timestamp")->value().toInt();
             
-            // Find the race
-            const auto& races = history->getRaces();
-            for (const auto& race : races) {
-                if (race.timestamp == timestamp) {
-                    // Create JSON for single race
-                    DynamicJsonDocument doc(16384);
-                    JsonArray racesArray = doc.createNestedArray("races");
-                    JsonObject raceObj = racesArray.createNestedObject();
-                    raceObj["timestamp"] = race.timestamp;
-                    raceObj["fastestLap"] = race.fastestLap;
-                    raceObj["medianLap"] = race.medianLap;
-                    raceObj["best3LapsTotal"] = race.best3LapsTotal;
-                    raceObj["name"] = race.name;
-                    raceObj["tag"] = race.tag;
-                    raceObj["pilotName"] = race.pilotName;
-                    raceObj["pilotCallsign"] = race.pilotCallsign;
-                    raceObj["frequency"] = race.frequency;
-                    raceObj["band"] = race.band;
-                    raceObj["channel"] = race.channel;
-                    JsonArray lapsArray = raceObj.createNestedArray("lapTimes");
-                    for (uint32_t lap : race.lapTimes) {
-                        lapsArray.add(lap);
-                    }
-                    
-                    String json;
-                    serializeJson(doc, json);
-                    
-                    String filename = "race_" + String(timestamp) + ".json";
-                    AsyncWebServerResponse *response = request->beginResponse(200, "application/octet-stream", json);
-                    response->addHeader("Content-Disposition", "attachment; filename=\"" + filename + "\"");
-                    response->addHeader("Content-Type", "application/json");
-                    request->send(response);
-                    led->on(200);
-                    return;
-                }
+            // Summary from the index, laps from the lap cache; written in the
+            // same form as /races/download, one race in the "races" array
+            const RaceSummary* race = history->findRace(timestamp);
+            const std::vector<uint32_t>* lapTimes = race ? history->getLapTimes(timestamp) : nullptr;
+            if (lapTimes) {
+                String filename = "race_" + String(timestamp) + ".json";
+                AsyncResponseStream *response = request->beginResponseStream("application/json");
+                response->addHeader("Content-Disposition", "attachment; filename=\"" + filename + "\"");
+                response->print("{\"races\":[");
+                RaceHistory::raceToJson(*response, *race, lapTimes, true);
+                response->print("]}");
+                request->send(response);
+                led->on(200);
+                return;
             }
             request->send(404, "application/json", "{\"status\": \"ERROR\", \"message\": \"Race not found\"}");
         } else {
@@ -831,7 +999,102 @@ EEPROM:\n\
     server.addHandler(raceUploadHandler);
     server.addHandler(updateLapsHandler);
 
-    // Track endpoints
+    // Track endpoints (image routes first: "/tracks" would also match "/tracks/image")
+    server.on("/tracks/image", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        if (!request->hasParam("trackId")) {
+            request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Missing trackId\"}");
+            return;
+        }
+        uint32_t trackId = request->getParam("trackId")->value().toInt();
+        Track *track = trackManager->getTrackById(trackId);
+        File file;
+        if (track && !track->imagePath.isEmpty()) {
+            file = storage->openRead(track->imagePath.c_str());
+        }
+        if (!file) {
+            request->send(404, "application/json", "{\"status\": \"ERROR\", \"message\": \"No image\"}");
+            return;
+        }
+        
+        // The same URL is reused when an image is replaced: always revalidate
+        FileValidators validators;
+        makeValidators(file.size(), file.getLastWrite(), validators);
+        if (sendIfNotModified(request, validators, "no-cache")) {
+            file.close();
+            return;
+        }
+        sendFileStream(request, file, validators, "image/jpeg", "no-cache");
+    });
+    
+    // Image upload: the raw JPEG is the request body (not multipart), written
+    // to a temp file chunk by chunk as it arrives
+    server.on("/tracks/image", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        TrackImageResult *result = (TrackImageResult *)request->_tempObject;
+        TrackImageResult outcome = result ? *result : TRACK_IMAGE_BAD_TYPE;  // No raw body
+        if (imageUploadRequest == request) {
+            if (outcome == TRACK_IMAGE_OK) {
+                outcome = trackManager->commitTrackImage();
+            } else {
+                trackManager->abortTrackImage();
+            }
+            imageUploadRequest = nullptr;
+        }
+        
+        int code;
+        switch (outcome) {
+            case TRACK_IMAGE_OK: code = 200; break;
+            case TRACK_IMAGE_BUSY: code = 409; break;
+            case TRACK_IMAGE_NOT_FOUND: code = 404; break;
+            case TRACK_IMAGE_TOO_LARGE: code = 413; break;
+            case TRACK_IMAGE_BAD_TYPE: code = 415; break;
+            case TRACK_IMAGE_INCOMPLETE: code = 400; break;
+            default: code = 507; break;
+        }
+        char response[128];
+        if (outcome == TRACK_IMAGE_OK) {
+            snprintf(response, sizeof(response), "{\"status\": \"OK\"}");
+        } else {
+            snprintf(response, sizeof(response), "{\"status\": \"ERROR\", \"message\": \"%s\"}",
+                     TrackManager::imageResultMessage(outcome));
+        }
+        request->send(code, "application/json", response);
+        led->on(200);
+    }, nullptr, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        if (index == 0) {
+            // Freed by the request, as the JSON body handler does
+            TrackImageResult *result = (TrackImageResult *)malloc(sizeof(TrackImageResult));
+            if (!result) {
+                return;
+            }
+            request->_tempObject = result;
+            
+            uint32_t trackId = request->hasParam("trackId") ? request->getParam("trackId")->value().toInt() : 0;
+            if (!request->contentType().startsWith("image/jpeg")) {
+                *result = TRACK_IMAGE_BAD_TYPE;
+            } else {
+                // Size is checked against the limit and free space before any data is written
+                *result = trackManager->beginTrackImage(trackId, total);
+            }
+            if (*result == TRACK_IMAGE_OK) {
+                imageUploadRequest = request;
+                request->onDisconnect([this, request]() {
+                    if (imageUploadRequest == request) {
+                        trackManager->abortTrackImage();
+                        imageUploadRequest = nullptr;
+                    }
+                });
+            }
+        }
+        
+        TrackImageResult *result = (TrackImageResult *)request->_tempObject;
+        if (result && *result == TRACK_IMAGE_OK && imageUploadRequest == request) {
+            *result = trackManager->writeTrackImage(data, len);
+            if (*result != TRACK_IMAGE_OK) {
+                imageUploadRequest = nullptr;  // Already aborted
+            }
+        }
+    });
+    
     server.on("/tracks", HTTP_GET, [this](AsyncWebServerRequest *request) {
         String json = trackManager->toJsonString();
         request->send(200, "application/json", json);
@@ -939,7 +1202,7 @@ EEPROM:\n\
         Track* selectedTrack = timer->getSelectedTrack();
         if (selectedTrack) {
             doc["trackId"] = selectedTrack->trackId;
-            doc["trackName"] = selectedTrack->name;
+            doc["trackName"] = selectedTrack->name.c_str();
             doc["trackDistance"] = selectedTrack->distance;
         } else {
             doc["trackId"] = 0;
@@ -966,28 +1229,68 @@ EEPROM:\n\
     });
     */
     
-    // Debug log endpoint for serial monitor
+    // Debug log endpoint for serial monitor: the most recent lines, formatted here
     server.on("/api/debuglog", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        const auto& buffer = DebugLogger::getInstance().getBuffer();
-        DynamicJsonDocument doc(8192);
-        JsonArray logs = doc.createNestedArray("logs");
-        
-        for (const auto& entry : buffer) {
-            JsonObject log = logs.createNestedObject();
-            log["timestamp"] = entry.timestamp;
-            log["message"] = entry.message;
+        DebugLogger &logger = DebugLogger::getInstance();
+        uint32_t end = logger.getNextSeq();
+        uint32_t seq = logger.getOldestSeq();
+        if (end - seq > WEB_DEBUGLOG_LINES) seq = end - WEB_DEBUGLOG_LINES;
+
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        response->print("{\"logs\":[");
+        char line[DEBUG_LOG_LINE_SIZE];
+        bool first = true;
+        for (; seq != end; seq++) {
+            uint32_t timeMs;
+            if (!logger.format(seq, line, sizeof(line), &timeMs)) continue;
+            response->printf("%s{\"seq\":%u,\"timestamp\":%u,\"message\":", first ? "" : ",", seq, timeMs);
+            DebugLogger::printJsonString(*response, line);
+            response->print('}');
+            first = false;
         }
-        
-        String json;
-        serializeJson(doc, json);
-        request->send(200, "application/json", json);
+        response->print("]}");
+        request->send(response);
         led->on(200);
     });
-    
+
+    // Incremental log stream: pass the returned "next" back as since
+    server.on("/debug/log", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        uint32_t since = request->hasParam("since") ? strtoul(request->getParam("since")->value().c_str(), nullptr, 10) : 0;
+        long maxLines = request->hasParam("max") ? request->getParam("max")->value().toInt() : DEBUG_LOG_JSON_MAX;
+        if (maxLines <= 0 || maxLines > DEBUG_LOG_RECORDS) maxLines = DEBUG_LOG_RECORDS;
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        DebugLogger::getInstance().toJson(*response, since, maxLines);
+        request->send(response);
+    });
+
+    server.on("/debug/level", HTTP_GET, [](AsyncWebServerRequest *request) {
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        DebugLogger::levelsToJson(*response);
+        request->send(response);
+    });
+
+    // module=<name|all>&level=<none|error|warn|info|debug|verbose>
+    server.on("/debug/level", HTTP_POST, [](AsyncWebServerRequest *request) {
+        int module;
+        uint8_t level;
+        if (!request->hasParam("module", true) || !request->hasParam("level", true) ||
+            !DebugLogger::parseModule(request->getParam("module", true)->value().c_str(), module) ||
+            !DebugLogger::parseLevel(request->getParam("level", true)->value().c_str(), level)) {
+            request->send(400, "application/json", "{\"status\":\"ERROR\",\"message\":\"Unknown module or level\"}");
+            return;
+        }
+        DebugLogger::setLevel(module, level);
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        DebugLogger::levelsToJson(*response);
+        request->send(response);
+    });
+
     // Reboot endpoint
     server.on("/reboot", HTTP_POST, [this](AsyncWebServerRequest *request) {
         request->send(200, "application/json", "{\"status\": \"OK\", \"message\": \"Rebooting...\"}");
         led->on(200);
+        // Queued writes must reach the card before the reset
+        storage->flush();
         // Restart immediately without delay to avoid blocking async_tcp task
         ESP.restart();
     });
@@ -1191,6 +1494,21 @@ EEPROM:\n\
         led->on(200);
     });
 
+    // Frame engine cost: render and show times in microseconds
+    server.on("/led/stats", HTTP_GET, [](AsyncWebServerRequest *request) {
+        RgbLedStats st = {};
+        if (g_rgbLed) g_rgbLed->getStats(st);
+        char json[384];
+        snprintf(json, sizeof(json),
+                 "{\"leds\":%u,\"frameMs\":%u,\"frames\":%u,\"shows\":%u,\"overruns\":%u,\"queueDrops\":%u,"
+                 "\"cuesPlayed\":%u,\"cuesDropped\":%u,\"maxCueLateMs\":%u,"
+                 "\"lastRenderUs\":%u,\"maxRenderUs\":%u,\"lastShowUs\":%u,\"maxShowUs\":%u}",
+                 st.ledCount, LED_FRAME_MS, st.frames, st.shows, st.overruns, st.queueDrops,
+                 st.cuesPlayed, st.cuesDropped, st.maxCueLateMs,
+                 st.lastRenderUs, st.maxRenderUs, st.lastShowUs, st.maxShowUs);
+        request->send(200, "application/json", json);
+    });
+
     server.on("/led/strobecolor", HTTP_POST, [this](AsyncWebServerRequest *request) {
         if (request->hasParam("color", true)) {
             String colorStr = request->getParam("color", true)->value();
@@ -1235,130 +1553,87 @@ EEPROM:\n\
         led->on(200);
     });
 
-    // Self-test endpoint
+    // Self-test: POST starts the suite as a background job and returns its id
+    // at once; progress and results arrive as "selftest" events, GET polls.
+    // category=benchmark runs the performance benchmarks instead.
+    server.on("/api/selftest", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        bool benchmark = request->hasParam("category", true) && request->getParam("category", true)->value() == "benchmark";
+        uint32_t job = selftest->startJob(benchmark ? SELFTEST_BENCHMARK : SELFTEST_DIAGNOSTICS);
+        if (job == 0) {
+            request->send(409, "application/json", "{\"status\": \"ERROR\", \"message\": \"Self-test already running\"}");
+            return;
+        }
+        char json[48];
+        snprintf(json, sizeof(json), "{\"status\": \"OK\", \"job\": %u}", job);
+        request->send(202, "application/json", json);
+        led->on(200);
+    });
+
     server.on("/api/selftest", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        // Run RX5808 test
-        TestResult rxTest = selftest->testRX5808(rx);
-        
-        // Run Lap Timer test
-        TestResult timerTest = selftest->testLapTimer(timer);
-        
-        // Run Audio test
-        TestResult audioTest = selftest->testAudio(buz);
-        
-        // Run Config test
-        TestResult configTest = selftest->testConfig(conf);
-        
-        #ifdef PIN_SD_CS
-            // Run Race History test
-            TestResult historyTest = selftest->testRaceHistory(history);
-        #endif
-        
-        // Run Web Server test
-        TestResult webTest = selftest->testWebServer();
-        
-        // Run OTA test
-        TestResult otaTest = selftest->testOTA();
-        
-        #ifdef PIN_SD_CS
-            // Run Storage test
-            TestResult storageTest = selftest->testStorage();
-        #endif
-        
-        // Run LittleFS test
-        TestResult littleFSTest = selftest->testLittleFS();
-        
-        // Run EEPROM test
-        TestResult eepromTest = selftest->testEEPROM();
-        
-        // Run WiFi test
-        TestResult wifiTest = selftest->testWiFi();
-        
-        #ifdef PIN_VBAT
-            // Run Battery test
-            TestResult batteryTest = selftest->testBattery();
-        #endif
-        
-        #ifdef PIN_SD_CS
-        // Run Track Manager test
-        TestResult trackTest = selftest->testTrackManager();
-        #endif
-        
-        // Run Webhooks test
-        TestResult webhookTest = selftest->testWebhooks();
-        
-        // Run Transport test
-        TestResult transportTest = selftest->testTransport();
-        
-#ifdef ESP32S3
-        // Run RGB LED test
-        TestResult ledTest = selftest->testRGBLED(g_rgbLed);
-        
-        // Run SD Card test
-        TestResult sdTest = selftest->testSDCard();
-#endif
-        
-        // Build JSON response
-        String json = "{\"tests\":[";
-        
-        auto addTest = [&json](const TestResult& test, bool first = false) {
-            if (!first) json += ",";
-            json += "{\"name\":\"" + test.name + "\",\"passed\":" + String(test.passed ? "true" : "false") + 
-                   ",\"details\":\"" + test.details + "\",\"duration\":" + String(test.duration_ms) + "}";
-        };
-        
-        addTest(rxTest, true);
-        addTest(timerTest);
-        addTest(audioTest);
-        addTest(configTest);
-        #ifdef PIN_SD_CS
-            addTest(historyTest);
-        #endif
-        addTest(webTest);
-        addTest(otaTest);
-        #ifdef PIN_SD_CS
-            addTest(storageTest);
-        #endif
-        addTest(littleFSTest);
-        addTest(eepromTest);
-        addTest(wifiTest);
-        #ifdef PIN_VBAT
-            addTest(batteryTest);
-        #endif
-        #ifdef PIN_SD_CS
-            addTest(trackTest);
-        #endif
-        addTest(webhookTest);
-        addTest(transportTest);
-#ifdef ESP32S3
-        addTest(ledTest);
-        addTest(sdTest);
-#endif
-        
-        json += "]}";
-        
-        request->send(200, "application/json", json);
+        request->send(200, "application/json", selftest->getJobJSON());
+    });
+
+    server.on("/api/selftest/cancel", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        bool cancelled = selftest->cancelJob();
+        request->send(200, "application/json", cancelled ? "{\"status\": \"OK\"}" : "{\"status\": \"ERROR\", \"message\": \"No self-test running\"}");
+    });
+
+    // Storage benchmark: POST starts it in the background, GET polls state/result
+    server.on("/api/storagebench", HTTP_POST, [this](AsyncWebServerRequest *request) {
+        if (!selftest->startStorageBenchmark()) {
+            request->send(409, "application/json", "{\"status\": \"ERROR\", \"message\": \"Benchmark already running\"}");
+            return;
+        }
+        request->send(202, "application/json", selftest->getStorageBenchmarkJSON());
         led->on(200);
     });
 
+    server.on("/api/storagebench", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        request->send(200, "application/json", selftest->getStorageBenchmarkJSON());
+    });
+
     // Webhook management endpoints
     server.on("/webhooks", HTTP_GET, [this](AsyncWebServerRequest *request) {
-        String json = "{\"enabled\":" + String(webhooks ? (webhooks->isEnabled() ? "true" : "false") : "false") + ",\"webhooks\":[";
-        if (webhooks) {
-            uint8_t count = webhooks->getWebhookCount();
-            for (uint8_t i = 0; i < count; i++) {
-                if (i > 0) json += ",";
-                json += "\"" + String(webhooks->getWebhookIP(i)) + "\"";
-            }
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        response->printf("{\"enabled\":%s,\"webhooks\":[", (webhooks && webhooks->isEnabled()) ? "true" : "false");
+        char ip[WEBHOOK_ADDR_LEN];
+        for (uint8_t i = 0; webhooks && webhooks->getWebhookIP(i, ip, sizeof(ip)); i++) {
+            response->printf("%s\"%s\"", i ? "," : "", ip);
         }
-        json += "]}";
-        request->send(200, "application/json", json);
+        // Delivery stats per target, in the same order
+        response->print("],\"targets\":[");
+        WebhookTargetStats ts;
+        for (uint8_t i = 0; webhooks && webhooks->getTargetStats(i, ts); i++) {
+            response->printf("%s{\"ok\":%u,\"httpErrors\":%u,\"failed\":%u,\"dropped\":%u,\"connects\":%u,"
+                             "\"lastLatencyUs\":%u,\"avgLatencyUs\":%u,\"maxLatencyUs\":%u,\"backoffMs\":%u}",
+                             i ? "," : "", ts.ok, ts.httpErrors, ts.failed, ts.dropped, ts.connects,
+                             ts.lastLatencyUs, ts.avgLatencyUs, ts.maxLatencyUs, ts.backoffMs);
+        }
+        response->printf("],\"queueDrops\":%u", webhooks ? webhooks->getQueueDrops() : 0);
+        // UDP gate events
+        if (gateUdp) {
+            GateUdpStats us;
+            gateUdp->getStats(us);
+            char dest[24];
+            gateUdp->getDestination(dest, sizeof(dest));
+            response->printf(",\"udp\":{\"enabled\":%s,\"destination\":\"%s\",\"events\":%u,\"datagrams\":%u,"
+                             "\"sendErrors\":%u,\"queueDrops\":%u,\"lastLatencyUs\":%u,\"maxLatencyUs\":%u}",
+                             gateUdp->isEnabled() ? "true" : "false", dest, us.events, us.datagrams, us.sendErrors,
+                             us.queueDrops, us.lastLatencyUs, us.maxLatencyUs);
+        }
+        response->print("}");
+        request->send(response);
         led->on(200);
     });
 
     server.on("/webhooks/add", HTTP_POST, [this](AsyncWebServerRequest *request) {
         if (request->hasParam("ip", true)) {
             String ip = request->getParam("ip", true)->value();
+            if (ip.length() >= WEBHOOK_ADDR_LEN) {
+                request->send(400, "application/json", "{\"status\": \"ERROR\", \"message\": \"Webhook address too long\"}");
+                led->on(200);
+                return;
+            }
             if (webhooks && webhooks->addWebhook(ip.c_str())) {
                 conf->addWebhookIP(ip.c_str());
                 request->send(200, "application/json", "{\"status\": \"OK\", \"message\": \"Webhook added\"}");
@@ -1442,6 +1717,10 @@ EEPROM:\n\
     });
 
     ElegantOTA.setAutoReboot(true);
+    // Nothing may be left in the write-behind queue when the update reboots us
+    ElegantOTA.onStart([]() {
+        if (g_storage) g_storage->flush();
+    });
     ElegantOTA.begin(&server);
 
     server.begin();
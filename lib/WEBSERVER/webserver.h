@@ -9,22 +9,27 @@
 #include "transport.h"
 #include "trackmanager.h"
 #include "webhook.h"
+#include "gateudp.h"
 
 #define WIFI_CONNECTION_TIMEOUT_MS 30000
 #define WIFI_RECONNECT_TIMEOUT_MS 500
 #define WEB_RSSI_SEND_TIMEOUT_MS 200
 #define WEB_SSE_KEEPALIVE_MS 15000
+#define WEB_DEBUGLOG_LINES 100  // Lines returned by /api/debuglog
 
 class Webserver : public TransportInterface {
    public:
     void init(Config *config, LapTimer *lapTimer, BatteryMonitor *batMonitor, Buzzer *buzzer, Led *l, RaceHistory *raceHist, Storage *stor, SelfTest *test, RX5808 *rx5808, TrackManager *trackMgr, WebhookManager *webhookMgr);
     void setTransportManager(TransportManager *tm);
+    void setGateUdp(GateUdpSender *sender) { gateUdp = sender; }
     void handleWebUpdate(uint32_t currentTimeMs);
     
     // TransportInterface implementation
     void sendLapEvent(uint32_t lapTimeMs) override;
+    void sendLapStatsEvent(const char* statsJson) override;
     void sendRssiEvent(uint8_t rssi) override;
     void sendRaceStateEvent(const char* state) override;
+    void sendSelfTestEvent(const char* json) override;
     bool isConnected() override;
     void update(uint32_t currentTimeMs) override;
 
@@ -43,6 +48,7 @@ class Webserver : public TransportInterface {
     TrackManager *trackManager;
     WebhookManager *webhooks;
     TransportManager *transportMgr;
+    GateUdpSender *gateUdp = nullptr;
 
     wifi_mode_t wifiMode = WIFI_OFF;
     wl_status_t lastStatus = WL_IDLE_STATUS;
@@ -2,47 +2,43 @@
 #include "led.h"
 #include "webserver.h"
 #include "racehistory.h"
+#include "racejournal.h"
 #include "storage.h"
 #include "selftest.h"
 #include "transport.h"
 #include "trackmanager.h"
 #include "usb.h"
 #include "webhook.h"
-// DISABLED FOR NOW: #include "nodemode.h"  // Uncomment to re-enable RotorHazard support
+#include "gateudp.h"
+#include "nodemode.h"
 #include <ElegantOTA.h>
 #ifdef ESP32S3
 #include "rgbled.h"
 #endif
 
-// ====================================================================
-// ROTORHAZARD MODE - CURRENTLY DISABLED
-// To re-enable RotorHazard support in the future:
-// 1. Uncomment the OperationMode enum below
-// 2. Uncomment nodeMode initialization and usage throughout this file
-// 3. Uncomment the mode detection logic in setup()
-// 4. Uncomment the mode-specific code in loop()
-// ====================================================================
+enum OperationMode {
+    MODE_WIFI,
+    MODE_ROTORHAZARD
+};
 
-// DISABLED: Operation mode enumeration
-// enum OperationMode {
-//     MODE_WIFI,
-//     MODE_ROTORHAZARD
-// };
-// 
-// OperationMode currentMode = MODE_WIFI;
-// static NodeMode nodeMode;  // RotorHazard node mode controller
+static OperationMode currentMode = MODE_WIFI;
+static NodeMode nodeMode;  // RotorHazard node mode controller
 
 // Mode Switching Information:
 // =========================
 // SOFTWARE MODE SWITCH:
 // - Change "opMode" in config via web interface (0=WiFi, 1=RotorHazard)
 // - Requires REBOOT to take effect
-// - Setting is stored in EEPROM and persists across reboots
+// - Setting is stored in NVS (one key per group in CONFIG_SCHEMA) and
+//   persists across reboots
 //
-// PHYSICAL MODE SWITCH (when installed):
-// - GPIO9 to GND = Force WiFi mode (overrides software setting)
-// - GPIO9 floating = Use software config setting
+// PHYSICAL MODE SWITCH (boards defining PIN_MODE_SWITCH):
+// - PIN_MODE_SWITCH to GND = Force WiFi mode (overrides software setting)
+// - PIN_MODE_SWITCH floating = Use software config setting
 // - Hardware switch always takes priority over software setting
+//
+// In RotorHazard mode Serial carries only the node protocol: no debug
+// output, no USB JSON transport, and no WiFi or web server.
 
 static RX5808 rx(PIN_RX5808_RSSI, PIN_RX5808_DATA, PIN_RX5808_SELECT, PIN_RX5808_CLOCK);
 static Config config;
@@ -54,8 +50,10 @@ static TransportManager transportManager;
 static Buzzer buzzer;
 static Led led;
 static RaceHistory raceHistory;
+static RaceJournal raceJournal;
 static TrackManager trackManager;
 static WebhookManager webhookManager;
+static GateUdpSender gateUdp;
 #ifdef ESP32S3
 static RgbLed rgbLed;
 RgbLed* g_rgbLed = &rgbLed;
@@ -74,13 +72,18 @@ static void parallelTask(void *pvArgs) {
         uint32_t currentTimeMs = millis();
         buzzer.handleBuzzer(currentTimeMs);
         led.handleLed(currentTimeMs);
-#ifdef ESP32S3
-        rgbLed.handleRgbLed(currentTimeMs);
-#endif
+        // RGB strip frames are rendered by the rgbled task
         ws.handleWebUpdate(currentTimeMs);
         usbTransport.update(currentTimeMs);
         config.handleEeprom(currentTimeMs);
-        rx.handleFrequencyChange(currentTimeMs, config.getFrequency());
+        raceJournal.process(currentTimeMs);
+        rx.handleFrequencyChange(currentTimeMs);
+        // Self-test job progress, formatted by the job task
+        char selfTestEvent[SELFTEST_EVENT_SIZE];
+        while (selfTest.pollEvent(selfTestEvent, sizeof(selfTestEvent))) {
+            transportManager.broadcastSelfTestEvent(selfTestEvent);
+            selfTest.eventSent();
+        }
         // Battery monitoring removed
         // monitor.checkBatteryState(currentTimeMs, config.getAlarmThreshold());
         buzzer.handleBuzzer(currentTimeMs);
@@ -107,49 +110,33 @@ void setup() {
     #endif
 
 
-    // ====================================================================
-    // ROTORHAZARD MODE DETECTION - CURRENTLY DISABLED
-    // Mode switching has been disabled - system now runs in WiFi mode only
-    // To re-enable: uncomment the mode detection block below
-    // ====================================================================
-    
     // Initialize storage first (LittleFS only at boot)
     storage.init();
+    // Sound packs ship on LittleFS; once a card is mounted they are copied to
+    // it and the flash copies become evictable
+    storage.setTier("/sounds", STORAGE_TIER_BULK, TIER_FLAG_KEEP_SOURCE);
     
     // Initialize config and connect to storage for SD backup/restore
     config.setStorage(&storage);
     config.init();
     
-    /* DISABLED: RotorHazard mode detection
-    // Check physical mode switch
-    pinMode(PIN_MODE_SWITCH, INPUT_PULLUP);
-    delay(10);  // Allow pin to settle
-    
-    int modePin = digitalRead(PIN_MODE_SWITCH);
-    
     // Physical switch overrides software setting
     // If pin is explicitly pulled LOW (to GND), force WiFi mode
     // If pin reads HIGH (floating with pullup), use software config
-    if (modePin == WIFI_MODE) {
-        // Physical switch connected to GND = force WiFi mode
-        currentMode = MODE_WIFI;
-    } else {
-        // Pin is HIGH (floating) = use software config
-        uint8_t configMode = config.getOperationMode();
-        if (configMode == 0) {
-            currentMode = MODE_WIFI;
-        } else {
-            currentMode = MODE_ROTORHAZARD;
-        }
-    }
-    */
+    bool forceWifi = false;
+#ifdef PIN_MODE_SWITCH
+    pinMode(PIN_MODE_SWITCH, INPUT_PULLUP);
+    delay(10);  // Allow pin to settle
+    forceWifi = digitalRead(PIN_MODE_SWITCH) == WIFI_MODE;
+#endif
+    currentMode = (!forceWifi && config.getOperationMode() != 0) ? MODE_ROTORHAZARD : MODE_WIFI;
 
     // set LED pin
     pinMode(LED_BUILTIN, OUTPUT);
     digitalWrite(LED_BUILTIN, HIGH);
     
     // Initialize serial (115200)
-    Serial.begin(115200);
+    Serial.begin(NODE_SERIAL_BAUD);
     delay(100);
     
     // Clear serial buffer
@@ -157,20 +144,24 @@ void setup() {
         Serial.read();
     }
     
-    // Always enable debug output (WiFi mode only)
-    DEBUG_INIT;
+    // Debug output (WiFi mode only; log lines stay in the ring buffer in
+    // RotorHazard mode, where any text would corrupt the node protocol)
+    if (currentMode == MODE_WIFI) {
+        DEBUG_INIT;
+    }
     
     // Suppress VFS file-not-found errors (reduces spam from API endpoint checks)
     esp_log_level_set("vfs_api", ESP_LOG_NONE);
     
 #ifdef ESP32S3
-        DEBUG("ESP32S3 build detected - WiFi Mode\n");
+        DEBUG("ESP32S3 build detected - %s Mode\n", currentMode == MODE_WIFI ? "WiFi" : "RotorHazard");
 #else
-        DEBUG("Generic ESP32 build - WiFi Mode\n");
+        DEBUG("Generic ESP32 build - %s Mode\n", currentMode == MODE_WIFI ? "WiFi" : "RotorHazard");
 #endif
     
     // Note: config.init() already called above
     rx.init();
+    config.subscribe(&rx, CONFIG_GROUP_BIT(CONFIG_GROUP_RF));
 #ifdef PIN_BUZZER
     buzzer.init(PIN_BUZZER, BUZZER_INVERTED);
 #endif
@@ -179,22 +170,34 @@ void setup() {
 #endif
 #ifdef ESP32S3
     rgbLed.init();
-    // Apply saved LED configuration from config
-    rgbLed.setBrightness(config.getLedBrightness());
-    rgbLed.setEffectSpeed(config.getLedSpeed());
-    rgbLed.setManualColor(config.getLedColor());
-    rgbLed.setFadeColor(config.getLedFadeColor());
-    rgbLed.setStrobeColor(config.getLedStrobeColor());
-    rgbLed.enableManualOverride(config.getLedManualOverride());
-    // Apply preset last so all colors are set
-    rgbLed.setPreset((led_preset_e)config.getLedPreset());
+    // Applies the saved LED configuration (and pilot colour for lap cues) now
+    // and on every later change
+    config.subscribe(&rgbLed, CONFIG_GROUP_BIT(CONFIG_GROUP_LED) | CONFIG_GROUP_BIT(CONFIG_GROUP_PILOT));
 #endif
     timer.init(&config, &rx, &buzzer, &led, &webhookManager);
+#ifdef ESP32S3
+    // LED cues follow race events; the timer never touches the strip itself
+    timer.subscribe(&rgbLed);
+#endif
     // Battery monitoring removed
     // monitor.init(PIN_VBAT, VBAT_SCALE, VBAT_ADD, &buzzer, &led);
     
-    // WiFi mode initialization (RotorHazard mode disabled)
+    if (currentMode == MODE_ROTORHAZARD) {
+        // RotorHazard mode - start node protocol
+        nodeMode.begin(&timer, &config);
+        // Frequency and levels written by RotorHazard come back through Config
+        config.subscribe(&nodeMode, CONFIG_GROUP_BIT(CONFIG_GROUP_RF) | CONFIG_GROUP_BIT(CONFIG_GROUP_TIMING));
+    #ifdef PIN_LED
+        led.blink(100, 1900);  // Slow blink = node mode active (100ms on, 1900ms off)
+    #endif
+        // NO parallel task (avoid WiFi interference, and usbTransport would read Serial)
+        // NO buzzer beep (silent operation)
+        return;
+    }
+    
+    // WiFi mode initialization
     selfTest.init(&storage);
+    selfTest.setTargets(&config, &rx, &timer, &buzzer, &raceHistory);
     
     // Initialize race history with storage backend
     // Note: This uses LittleFS initially; SD card will be mounted later in loop()
@@ -204,6 +207,18 @@ void setup() {
         DEBUG("Race history initialization failed\n");
     }
     
+    // Lap journal: recover a race interrupted by a reset, then start journaling.
+    // With a card slot the recovered race belongs in the SD race store, so
+    // recovery waits for the deferred mount below; a race started before
+    // then stays queued in the journal until recover() has run.
+    raceJournal.init(&storage);
+#ifndef PIN_SD_CS
+    if (raceJournal.recover(&raceHistory)) {
+        DEBUG("Interrupted race recovered from journal\n");
+    }
+#endif
+    timer.setJournal(&raceJournal);
+    
     // Initialize track manager
     if (trackManager.init(&storage)) {
         DEBUG("Track manager initialized, %d tracks loaded\n", trackManager.getTrackCount());
@@ -220,15 +235,13 @@ void setup() {
         }
     }
     
-    // Initialize webhook manager and load webhooks from config
-    webhookManager.setEnabled(config.getWebhooksEnabled());
-    for (uint8_t i = 0; i < config.getWebhookCount(); i++) {
-        const char* ip = config.getWebhookIP(i);
-        if (ip) {
-            webhookManager.addWebhook(ip);
-            DEBUG("Loaded webhook: %s\n", ip);
-        }
-    }
+    // Webhook manager loads its list from config and follows later edits
+    config.subscribe(&webhookManager, CONFIG_GROUP_BIT(CONFIG_GROUP_WEBHOOKS));
+    webhookManager.begin();
+    // UDP gate events share the webhook event toggles; the pilot color goes in each packet
+    config.subscribe(&gateUdp, CONFIG_GROUP_BIT(CONFIG_GROUP_WEBHOOKS) | CONFIG_GROUP_BIT(CONFIG_GROUP_PILOT));
+    gateUdp.begin();
+    timer.setGateUdp(&gateUdp);
     
     ws.init(&config, &timer, nullptr, &buzzer, &led, &raceHistory, &storage, &selfTest, &rx, &trackManager, &webhookManager);
     
@@ -241,6 +254,7 @@ void setup() {
     
     // Set TransportManager in webserver for event broadcasting
     ws.setTransportManager(&transportManager);
+    ws.setGateUdp(&gateUdp);
     
     DEBUG("Transport system initialized (WiFi + USB)\n");
     
@@ -252,23 +266,6 @@ void setup() {
         buzzer.beep(200);
     #endif
     initParallelTask();  // Start Core 0 task
-    
-    /* DISABLED: RotorHazard mode initialization
-    if (currentMode == MODE_WIFI) {
-        // WiFi mode - start web server and services
-        selfTest.init(&storage);
-        ws.init(&config, &timer, &monitor, &buzzer, &led, &raceHistory, &storage, &selfTest, &rx);
-        led.on(400);
-        buzzer.beep(200);
-        initParallelTask();  // Start Core 0 task
-    } else {
-        // RotorHazard mode - start node protocol
-        nodeMode.begin(&timer, &config);
-        led.blink(100, 1900);  // Slow blink = node mode active (100ms on, 1900ms off)
-        // NO parallel task (avoid WiFi interference)
-        // NO buzzer beep (silent operation)
-    }
-    */
 }
 
 void loop() {
@@ -286,16 +283,26 @@ void loop() {
     // Timing always runs
     timer.handleLapTimerUpdate(currentTimeMs);
     
+    if (currentMode == MODE_ROTORHAZARD) {
+        // RotorHazard mode - run node protocol
+        nodeMode.process(currentTimeMs);
+        
+        // Still update hardware (LED, buzzer) but NOT web server
+        buzzer.handleBuzzer(currentTimeMs);
+        led.handleLed(currentTimeMs);
+        rx.handleFrequencyChange(currentTimeMs);
+        config.handleEeprom(currentTimeMs);
+        return;
+    }
+    
     // Broadcast lap events to all transports (WiFi + USB)
     if (timer.isLapAvailable()) {
         uint32_t lapTime = timer.getLapTime();
         transportManager.broadcastLapEvent(lapTime);
+        transportManager.broadcastLapStatsEvent(timer.getStats());
     }
     
-    // Process queued webhooks (non-blocking)
-    webhookManager.process();
-    
-    // WiFi mode - original behavior (RotorHazard mode disabled)
+    // WiFi mode - original behavior
     ElegantOTA.loop();
     
     // Initialize SD card after boot (deferred to prevent watchdog timeout)
@@ -314,12 +321,6 @@ void loop() {
                 DEBUG("Config restored from SD backup after SD mount\n");
             }
             
-            // Migrate sounds from LittleFS to SD card
-            if (storage.migrateSoundsToSD()) {
-                DEBUG("Sound files migrated successfully!\n");
-                DEBUG("Recommend: delete /sounds from LittleFS to reclaim space\n");
-            }
-            
             // Reload race history from SD card
             if (raceHistory.loadRaces()) {
                 DEBUG("Race history reloaded from SD card, %d races available\n", raceHistory.getRaceCount());
@@ -345,26 +346,12 @@ void loop() {
         } else {
             DEBUG("SD card not available - using LittleFS only\n");
         }
-    }
-    
-    /* DISABLED: RotorHazard mode loop
-    if (currentMode == MODE_WIFI) {
-        // WiFi mode - original behavior
-        ElegantOTA.loop();
         
-        // ... SD card initialization code ...
-    } else {
-        // RotorHazard mode - run node protocol
-        nodeMode.process();
-        
-        // Still update hardware (LED, buzzer) but NOT web server
-        buzzer.handleBuzzer(currentTimeMs);
-        led.handleLed(currentTimeMs);
-#ifdef ESP32S3
-        rgbLed.handleRgbLed(currentTimeMs);
+#ifdef PIN_SD_CS
+        // The journal is on LittleFS (or on the card, from older firmware)
+        if (raceJournal.recover(&raceHistory)) {
+            DEBUG("Interrupted race recovered from journal\n");
+        }
 #endif
-        rx.handleFrequencyChange(currentTimeMs, config.getFrequency());
-        monitor.checkBatteryState(currentTimeMs, config.getAlarmThreshold());
     }
-    */
 }
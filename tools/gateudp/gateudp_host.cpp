@@ -0,0 +1,147 @@
+// Host side of the FPVGate UDP gate event protocol, built from the same
+// codec as the firmware (lib/GATEUDP/gateudpproto.cpp).
+//
+//   g++ -O2 -std=c++17 -I../../lib/GATEUDP gateudp_host.cpp ../../lib/GATEUDP/gateudpproto.cpp -o gateudp
+//   ./gateudp listen [address] [port]            print events from the timer (or from "send")
+//   ./gateudp send [address] [port] [repeats]    emit a short race: start, Gate 1 + 3 laps, stop
+//
+// address defaults to the firmware's multicast group; a broadcast or
+// unicast address works too. Running both on one machine tests a receiver
+// without hardware.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#include "gateudpproto.h"
+
+static uint32_t nowMs() {
+    using namespace std::chrono;
+    static const steady_clock::time_point start = steady_clock::now();
+    return (uint32_t)duration_cast<milliseconds>(steady_clock::now() - start).count();
+}
+
+static bool isMulticast(in_addr_t addr) {
+    return (ntohl(addr) & 0xF0000000) == 0xE0000000;
+}
+
+static int runListen(const char* address, uint16_t port) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in local = {};
+    local.sin_family = AF_INET;
+    local.sin_port = htons(port);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, (sockaddr*)&local, sizeof(local)) < 0) {
+        perror("bind");
+        return 1;
+    }
+    in_addr_t group = inet_addr(address);
+    if (isMulticast(group)) {
+        ip_mreq mreq = {};
+        mreq.imr_multiaddr.s_addr = group;
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+            perror("IP_ADD_MEMBERSHIP");
+            return 1;
+        }
+    }
+    printf("Listening on %s:%u\n", address, port);
+
+    bool seenAny = false;
+    uint32_t newest = 0;
+    uint32_t firstSeenMs[GATE_UDP_DUPLICATE_WINDOW] = {};
+    for (;;) {
+        uint8_t buf[64];
+        sockaddr_in from = {};
+        socklen_t fromLen = sizeof(from);
+        ssize_t len = recvfrom(fd, buf, sizeof(buf), 0, (sockaddr*)&from, &fromLen);
+        if (len < 0) {
+            perror("recvfrom");
+            return 1;
+        }
+        GateUdpEvent event;
+        if (!gateUdpDecode(buf, len, event)) {
+            printf("Ignored %zd bytes from %s\n", len, inet_ntoa(from.sin_addr));
+            continue;
+        }
+        uint32_t now = nowMs();
+        uint32_t previous = newest;
+        bool hadAny = seenAny;
+        // What a gate would do: act on the first copy, drop the repeats
+        bool isNew = gateUdpIsNew(event.sequence, newest, seenAny);
+        uint32_t& first = firstSeenMs[event.sequence % GATE_UDP_DUPLICATE_WINDOW];
+        if (isNew) {
+            first = now;
+        }
+        printf("%-15s seq=%-6u %-9s lap=%-3u color=#%06X t=%ums copy=%u%s\n", inet_ntoa(from.sin_addr),
+               event.sequence, gateUdpEventName(event.type), event.lap, event.color, event.timeMs, event.copy,
+               isNew ? " (new)" : "");
+        if (!isNew) {
+            printf("%15s repeat arrived %ums after the first copy\n", "", now - first);
+        } else if (hadAny && event.sequence > previous + 1) {
+            printf("%15s %u event(s) missed entirely\n", "", event.sequence - previous - 1);
+        }
+        fflush(stdout);
+    }
+}
+
+static int runSend(const char* address, uint16_t port, uint8_t repeats) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+    uint8_t ttl = 1;
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    uint8_t loop = 1;  // Deliver to a listener on this machine too
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    sockaddr_in dest = {};
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(port);
+    dest.sin_addr.s_addr = inet_addr(address);
+
+    const uint8_t script[] = {GATE_UDP_RACE_START, GATE_UDP_LAP, GATE_UDP_LAP, GATE_UDP_LAP, GATE_UDP_LAP,
+                              GATE_UDP_RACE_STOP};
+    uint16_t lap = 0;
+    for (size_t i = 0; i < sizeof(script); i++) {
+        GateUdpEvent event = {};
+        event.type = script[i];
+        event.sequence = i + 1;
+        event.timeMs = nowMs();
+        event.color = 0x0080FF;
+        event.lap = (event.type == GATE_UDP_LAP) ? lap++ : 0;
+        uint8_t packet[GATE_UDP_PACKET_SIZE];
+        gateUdpEncode(event, packet, sizeof(packet));
+        for (uint8_t copy = 0; copy <= repeats; copy++) {
+            packet[GATE_UDP_COPY_OFFSET] = copy;
+            if (sendto(fd, packet, sizeof(packet), 0, (sockaddr*)&dest, sizeof(dest)) != sizeof(packet)) {
+                perror("sendto");
+                return 1;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(3));
+        }
+        printf("Sent %s seq=%u lap=%u (%u repeats)\n", gateUdpEventName(event.type), event.sequence, event.lap,
+               repeats);
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || (strcmp(argv[1], "listen") && strcmp(argv[1], "send"))) {
+        fprintf(stderr, "usage: %s listen|send [address] [port] [repeats]\n", argv[0]);
+        return 2;
+    }
+    const char* address = argc > 2 ? argv[2] : GATE_UDP_DEFAULT_ADDRESS;
+    uint16_t port = argc > 3 ? atoi(argv[3]) : GATE_UDP_DEFAULT_PORT;
+    if (strcmp(argv[1], "listen") == 0) {
+        return runListen(address, port);
+    }
+    uint8_t repeats = argc > 4 ? atoi(argv[4]) : 1;
+    return runSend(address, port, repeats);
+}
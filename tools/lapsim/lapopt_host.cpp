@@ -0,0 +1,560 @@
+// Offline threshold optimizer. Replays a recorded RSSI trace through the
+// firmware's LapDetector for every combination of enter/exit threshold,
+// minimum lap time and RSSI filter on a grid, on every core, and ranks them
+// by how many passes they get wrong, how many neighbouring grid points also
+// get it right, and how steady the timing is. The winner is printed as a
+// config file the web UI's Import (or POST /config) takes as is.
+//
+//   g++ -O2 -std=c++17 -pthread -I../../lib/LAPTIMER -I../../lib/KALMAN lapopt_host.cpp lapscore.cpp
+//     ../../lib/LAPTIMER/lapdetector.cpp ../../lib/KALMAN/kalman.cpp -o lapopt
+//   ./lapopt race.csv                          time_ms,rssi[,pass] (lapsim --trace), passes from the pass column
+//   ./lapopt --passes 11 calibration.json      GET /calibration/data, Gate 1 plus 10 laps
+//   ./lapopt --enter 60:100:2 --exit 50:90:2 --min-lap-ms 2000:12000:500 --out config.json race.csv
+//
+// CSV samples are readRssi() values before the filter, so the filter is
+// swept too. The calibration wizard records filtered values: those traces
+// (and CSVs given --filtered) keep the device's filter and the config
+// leaves it out.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lapscore.h"
+
+#define LAPOPT_MAX_LINE 256
+#define LAPOPT_TIMING_NONE 1e9f     // No timing figure (fewer than two laps)
+
+struct Trace {
+    std::vector<uint32_t> timeMs;
+    std::vector<uint8_t> rssi;
+    std::vector<uint32_t> truthMs;  // Marked passes, empty if the trace has none
+    bool filtered;                  // Samples are already LapDetector::filter() output
+};
+
+struct Range {
+    uint32_t first;
+    uint32_t last;
+    uint32_t step;
+
+    size_t count() const { return last < first ? 0 : (last - first) / step + 1; }
+    uint32_t at(size_t i) const { return first + (uint32_t)i * step; }
+};
+
+// One grid point's outcome
+struct Result {
+    uint16_t errors;      // Missed + extra against the marked passes, or |detected - passes|
+    uint16_t detected;
+    uint16_t missed;
+    uint16_t extra;
+    float timingMs;       // p95 |pass error| with marked passes, else lap time standard deviation
+};
+
+#define LAPOPT_INVALID 0xFFFF  // exit >= enter
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [options] TRACE\n"
+            "  TRACE              CSV time_ms,rssi[,pass] or calibration wizard JSON\n"
+            "  --passes N         gate passes in the trace, Gate 1 included (default: pass column)\n"
+            "  --filtered         CSV samples are already filtered (as the calibration wizard's)\n"
+            "  --enter A:B[:S]    enter RSSI range (median + 2 to max)\n"
+            "  --exit A:B[:S]     exit RSSI range (median + 1 to max - 6), always below enter\n"
+            "  --min-lap-ms A:B[:S]  minimum lap range, 100 ms steps (1000 to 0.8 x shortest lap)\n"
+            "  --filter-q LIST    Kalman measurement noise x100 (250,500,1000,2000)\n"
+            "  --filter-r LIST    Kalman process noise x10000 (25,50,100)\n"
+            "  --window LIST      moving average samples (1,3,5)\n"
+            "  --tolerance-ms N   match window for a marked pass (500)\n"
+            "  --threads N        worker threads (all cores)\n"
+            "  --top N            rows in the ranking (10)\n"
+            "  --out FILE         write the config there instead of stdout\n",
+            name);
+}
+
+static bool parseRange(const char* arg, Range& range) {
+    char* end;
+    range.first = strtoul(arg, &end, 10);
+    range.last = range.first;
+    range.step = 1;
+    if (*end == ':') {
+        range.last = strtoul(end + 1, &end, 10);
+        if (*end == ':') range.step = strtoul(end + 1, &end, 10);
+    }
+    return *end == '\0' && range.step > 0 && range.last >= range.first;
+}
+
+static bool parseList(const char* arg, std::vector<uint16_t>& list) {
+    list.clear();
+    const char* p = arg;
+    while (*p) {
+        char* end;
+        unsigned long v = strtoul(p, &end, 10);
+        if (end == p || v > 10000) return false;
+        list.push_back((uint16_t)v);
+        p = *end == ',' ? end + 1 : end;
+    }
+    return !list.empty();
+}
+
+static bool loadCsv(FILE* f, Trace& trace) {
+    char line[LAPOPT_MAX_LINE];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] < '0' || line[0] > '9') continue;  // Header
+        unsigned long timeMs;
+        unsigned rssi;
+        int pass = 0;
+        if (sscanf(line, "%lu,%u,%d", &timeMs, &rssi, &pass) < 2 || rssi > 255) {
+            fprintf(stderr, "bad line: %s", line);
+            return false;
+        }
+        trace.timeMs.push_back((uint32_t)timeMs);
+        trace.rssi.push_back((uint8_t)rssi);
+        if (pass) trace.truthMs.push_back((uint32_t)timeMs);
+    }
+    return true;
+}
+
+// {"count":N,"data":[{"rssi":R,"time":T},...]} from GET /calibration/data
+static bool loadWizardJson(FILE* f, Trace& trace) {
+    std::string text;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        text.append(buf, n);
+    }
+    const char* p = strstr(text.c_str(), "\"data\"");
+    if (!p) return false;
+    while ((p = strchr(p, '{')) != nullptr) {
+        const char* close = strchr(p, '}');
+        const char* r = strstr(p, "\"rssi\":");
+        const char* t = strstr(p, "\"time\":");
+        if (!close || !r || !t || r > close || t > close) return false;
+        trace.rssi.push_back((uint8_t)strtoul(r + 7, nullptr, 10));
+        trace.timeMs.push_back((uint32_t)strtoul(t + 7, nullptr, 10));
+        p = close;
+    }
+    trace.filtered = true;
+    return true;
+}
+
+static bool loadTrace(const char* path, Trace& trace) {
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+    int c;
+    while ((c = fgetc(f)) == ' ' || c == '\n' || c == '\r' || c == '\t') {
+    }
+    ungetc(c, f);
+    bool ok = c == '{' ? loadWizardJson(f, trace) : loadCsv(f, trace);
+    fclose(f);
+    for (size_t i = 1; ok && i < trace.timeMs.size(); i++) {
+        if (trace.timeMs[i] < trace.timeMs[i - 1]) {
+            fprintf(stderr, "samples out of time order at %zu\n", i);
+            ok = false;
+        }
+    }
+    return ok && trace.rssi.size() > 1;
+}
+
+// The trace as one filter setting's LapDetector sees it, with every run of
+// samples below `floor` (the lowest exit level swept) cut down to its last
+// sample. Those samples can't raise a peak and all meet the exit test the
+// same way, and a lap is timed from its peak rather than from the sample
+// that ends it, so the detector ends up in the same state either way.
+struct FilteredTrace {
+    LapFilterSettings filter;
+    std::vector<uint32_t> timeMs;
+    std::vector<uint8_t> rssi;
+};
+
+static void filterTrace(const Trace& trace, const LapFilterSettings& filter, uint8_t floor, FilteredTrace& out) {
+    LapDetector detector;
+    detector.setFilter(filter);
+    out.filter = filter;
+    out.timeMs.clear();
+    out.rssi.clear();
+    bool below = false;
+    for (size_t i = 0; i < trace.rssi.size(); i++) {
+        uint8_t value = trace.filtered ? trace.rssi[i] : detector.filter(trace.rssi[i]);
+        if (value < floor && below) {
+            out.timeMs.back() = trace.timeMs[i];
+            out.rssi.back() = value;
+            continue;
+        }
+        below = value < floor;
+        out.timeMs.push_back(trace.timeMs[i]);
+        out.rssi.push_back(value);
+    }
+}
+
+// Same calls as LapTimer::handleLapTimerUpdate() in a race started at the
+// first sample. Also returns [minLapLo, minLapHi): every minimum lap time in
+// it finds the same passes. Only samples at or above enterRssi can change the
+// detector while a lap's window runs (it has no peak, so nothing else
+// registers), so only their skip decisions need to stay the same.
+static void replay(const FilteredTrace& t, uint32_t startMs, const LapDetectorSettings& levels,
+                   std::vector<uint32_t>& passMs, uint32_t& minLapLo, uint32_t& minLapHi) {
+    LapDetector detector;
+    detector.setLevels(levels);
+    detector.startRace(startMs);
+    passMs.clear();
+    minLapLo = 0;
+    minLapHi = UINT32_MAX;
+    for (size_t i = 0; i < t.rssi.size(); i++) {
+        if (detector.getLapCount() > 0 && t.rssi[i] >= levels.enterRssi) {
+            uint32_t sinceMs = t.timeMs[i] - detector.getLapStartMs();
+            if (sinceMs <= levels.minLapMs) {
+                if (sinceMs > minLapLo) minLapLo = sinceMs;
+            } else if (sinceMs < minLapHi) {
+                minLapHi = sinceMs;
+            }
+        }
+        if (detector.update(t.rssi[i], t.timeMs[i])) {
+            passMs.push_back(detector.getPeakTimeMs());
+            detector.beginLap();
+        }
+    }
+}
+
+static float lapTimeStdDev(const std::vector<uint32_t>& passMs) {
+    if (passMs.size() < 3) return LAPOPT_TIMING_NONE;
+    double sum = 0.0;
+    double sqSum = 0.0;
+    size_t laps = passMs.size() - 1;
+    for (size_t i = 1; i < passMs.size(); i++) {
+        double lap = passMs[i] - passMs[i - 1];
+        sum += lap;
+        sqSum += lap * lap;
+    }
+    double mean = sum / laps;
+    double var = sqSum / laps - mean * mean;
+    return var > 0.0 ? (float)sqrt(var) : 0.0f;
+}
+
+static uint8_t percentile(std::vector<uint8_t> values, double p) {
+    size_t k = (size_t)(p * (values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+int main(int argc, char** argv) {
+    Range enterGrid = {0, 0, 0};
+    Range exitGrid = {0, 0, 0};
+    Range minLapGrid = {0, 0, 0};
+    std::vector<uint16_t> filterQ = {250, 500, 1000, 2000};
+    std::vector<uint16_t> filterR = {25, 50, 100};
+    std::vector<uint16_t> windows = {1, 3, 5};
+    uint32_t passes = 0;
+    bool filtered = false;
+    uint32_t toleranceMs = 500;
+    uint32_t threads = std::thread::hardware_concurrency();
+    uint32_t top = 10;
+    const char* outPath = nullptr;
+    const char* tracePath = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        const char* opt = argv[i];
+        if (opt[0] != '-') {
+            tracePath = opt;
+            continue;
+        }
+        if (!strcmp(opt, "--filtered")) {
+            filtered = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char* val = argv[++i];
+        bool ok = true;
+        if (!strcmp(opt, "--passes")) passes = strtoul(val, nullptr, 10);
+        else if (!strcmp(opt, "--enter")) ok = parseRange(val, enterGrid) && enterGrid.last <= 255;
+        else if (!strcmp(opt, "--exit")) ok = parseRange(val, exitGrid) && exitGrid.last <= 255;
+        else if (!strcmp(opt, "--min-lap-ms")) ok = parseRange(val, minLapGrid);
+        else if (!strcmp(opt, "--filter-q")) ok = parseList(val, filterQ);
+        else if (!strcmp(opt, "--filter-r")) ok = parseList(val, filterR);
+        else if (!strcmp(opt, "--window")) ok = parseList(val, windows);
+        else if (!strcmp(opt, "--tolerance-ms")) toleranceMs = strtoul(val, nullptr, 10);
+        else if (!strcmp(opt, "--threads")) threads = strtoul(val, nullptr, 10);
+        else if (!strcmp(opt, "--top")) top = strtoul(val, nullptr, 10);
+        else if (!strcmp(opt, "--out")) outPath = val;
+        else ok = false;
+        if (!ok) {
+            fprintf(stderr, "bad option: %s %s\n", opt, val);
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!tracePath) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Trace trace;
+    trace.filtered = filtered;
+    if (!loadTrace(tracePath, trace)) {
+        fprintf(stderr, "can't read a trace from %s\n", tracePath);
+        return 1;
+    }
+    bool marked = !trace.truthMs.empty();
+    if (passes == 0) passes = trace.truthMs.size();
+    if (passes == 0) {
+        fprintf(stderr, "%s has no pass column: give the number of gate passes with --passes\n", tracePath);
+        return 1;
+    }
+    if (marked && passes != trace.truthMs.size()) {
+        fprintf(stderr, "--passes %u but %zu passes are marked in %s\n", passes, trace.truthMs.size(), tracePath);
+        return 1;
+    }
+    uint32_t startMs = trace.timeMs.front();
+    uint32_t durationMs = trace.timeMs.back() - startMs;
+
+    // Default grid from the trace: thresholds between the background level
+    // and the strongest pass, minimum lap up to well under the shortest lap
+    uint8_t median = percentile(trace.rssi, 0.5);
+    uint8_t peakRssi = *std::max_element(trace.rssi.begin(), trace.rssi.end());
+    if (enterGrid.step == 0) enterGrid = {median + 2U, peakRssi, 1};
+    if (exitGrid.step == 0) exitGrid = {median + 1U, peakRssi > median + 7U ? peakRssi - 6U : median + 1U, 1};
+    if (minLapGrid.step == 0) {
+        uint32_t shortestMs = passes > 1 ? durationMs / (passes - 1) : durationMs;
+        for (size_t i = 1; i < trace.truthMs.size(); i++) {
+            shortestMs = std::min(shortestMs, trace.truthMs[i] - trace.truthMs[i - 1]);
+        }
+        uint32_t lastMs = std::min<uint32_t>(25500, shortestMs * 4 / 5);  // minLap is uint8_t x 100 ms
+        minLapGrid = {1000, std::max<uint32_t>(1000, lastMs / 100 * 100), 500};
+    }
+    minLapGrid.first = (minLapGrid.first + 99) / 100 * 100;
+    minLapGrid.step = std::max<uint32_t>(100, minLapGrid.step / 100 * 100);
+    minLapGrid.last = std::min<uint32_t>(minLapGrid.last, 25500);
+    if (enterGrid.count() == 0 || exitGrid.count() == 0 || minLapGrid.count() == 0) {
+        fprintf(stderr, "empty threshold grid (trace median %u, max %u)\n", median, peakRssi);
+        return 1;
+    }
+
+    std::vector<LapFilterSettings> filters;
+    if (trace.filtered) {
+        filters.push_back({0, 1, 1});  // Pass-through: the samples are already filtered
+    } else {
+        for (uint16_t q : filterQ) {
+            for (uint16_t r : filterR) {
+                for (uint16_t w : windows) {
+                    if (w < 1 || w > LAPDETECT_WINDOW_MAX) {
+                        fprintf(stderr, "--window must be 1..%d\n", LAPDETECT_WINDOW_MAX);
+                        return 1;
+                    }
+                    filters.push_back({q, r, (uint8_t)w});
+                }
+            }
+        }
+    }
+
+    size_t enterCount = enterGrid.count();
+    size_t exitCount = exitGrid.count();
+    size_t minLapCount = minLapGrid.count();
+    size_t points = filters.size() * enterCount * exitCount * minLapCount;
+    if (threads == 0) threads = 1;
+    auto index = [&](size_t f, size_t e, size_t x, size_t m) {
+        return ((f * enterCount + e) * exitCount + x) * minLapCount + m;
+    };
+    fprintf(stderr, "%zu samples over %.1f s, %u passes%s; %zu filters x %zu enter x %zu exit x %zu min lap = %zu points\n",
+            trace.rssi.size(), durationMs / 1000.0, passes, marked ? " (marked)" : "", filters.size(), enterCount,
+            exitCount, minLapCount, points);
+    auto begin = std::chrono::steady_clock::now();
+
+    // Each filter setting's trace once, then every threshold combination
+    // replays it; both are spread over the workers one job at a time
+    std::vector<FilteredTrace> traces(filters.size());
+    std::atomic<size_t> nextTrace(0);
+    std::vector<Result> results(points);
+    std::atomic<size_t> nextJob(0);
+    std::atomic<uint64_t> replays(0);
+    std::atomic<uint64_t> samples(0);
+    LapScoreConfig scoring = {};
+    scoring.toleranceMs = toleranceMs;
+    LapScorer scorer(scoring);
+
+    std::vector<std::thread> workers;
+    for (uint32_t w = 0; w < threads; w++) {
+        workers.emplace_back([&]() {
+            for (size_t f = nextTrace++; f < filters.size(); f = nextTrace++) {
+                filterTrace(trace, filters[f], (uint8_t)exitGrid.first, traces[f]);
+            }
+        });
+    }
+    for (std::thread& t : workers) {
+        t.join();
+    }
+    workers.clear();
+
+    for (uint32_t w = 0; w < threads; w++) {
+        workers.emplace_back([&]() {
+            std::vector<uint32_t> passMs;
+            LapScore score;
+            size_t jobs = filters.size() * enterCount;
+            for (size_t job = nextJob++; job < jobs; job = nextJob++) {
+                size_t f = job / enterCount;
+                size_t e = job % enterCount;
+                const FilteredTrace& t = traces[f];
+                for (size_t x = 0; x < exitCount; x++) {
+                    LapDetectorSettings levels = {(uint8_t)enterGrid.at(e), (uint8_t)exitGrid.at(x), 0};
+                    if (levels.exitRssi >= levels.enterRssi) {
+                        for (size_t m = 0; m < minLapCount; m++) {
+                            results[index(f, e, x, m)].errors = LAPOPT_INVALID;
+                        }
+                        continue;
+                    }
+                    // One replay covers every minimum lap time with the same skip decisions
+                    size_t m = 0;
+                    while (m < minLapCount) {
+                        levels.minLapMs = minLapGrid.at(m);
+                        uint32_t lo;
+                        uint32_t hi;
+                        replay(t, startMs, levels, passMs, lo, hi);
+                        replays++;
+                        samples += t.rssi.size();
+
+                        Result r = {};
+                        r.detected = (uint16_t)std::min<size_t>(passMs.size(), 0xFFFE);
+                        if (marked) {
+                            score.reset();
+                            scorer.compare(passMs, trace.truthMs, score);
+                            r.missed = score.missed;
+                            r.extra = score.extra;
+                            r.errors = (uint16_t)std::min<uint32_t>(score.missed + score.extra, 0xFFFE);
+                            r.timingMs = score.matched ? score.absErrorPercentile(0.95) : LAPOPT_TIMING_NONE;
+                        } else {
+                            r.missed = r.detected < passes ? passes - r.detected : 0;
+                            r.extra = r.detected > passes ? r.detected - passes : 0;
+                            r.errors = r.missed + r.extra;
+                            r.timingMs = lapTimeStdDev(passMs);
+                        }
+                        while (m < minLapCount && minLapGrid.at(m) >= lo && minLapGrid.at(m) < hi) {
+                            results[index(f, e, x, m++)] = r;
+                        }
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& t : workers) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    fprintf(stderr, "%llu replays of %.1f M samples on %u threads in %.2f s\n", (unsigned long long)replays.load(),
+            samples / 1e6, threads, seconds);
+
+    // Robustness: how many of the 26 neighbours in enter, exit and minimum
+    // lap are also right, so a little drift on the day doesn't cost laps,
+    // lap, and then how far the point sits from the nearest wrong one (or
+    // the grid's edge) along any of them, so ties pick the middle of the
+    // region that works
+    struct Ranked {
+        size_t f, e, x, m;
+        uint8_t neighbours;
+        uint8_t margin;
+    };
+    std::vector<Ranked> ranked;
+    uint16_t bestErrors = LAPOPT_INVALID;
+    for (size_t i = 0; i < points; i++) {
+        bestErrors = std::min(bestErrors, results[i].errors);
+    }
+    if (bestErrors == LAPOPT_INVALID) {
+        fprintf(stderr, "no valid enter/exit pair in the grid\n");
+        return 1;
+    }
+    for (size_t f = 0; f < filters.size(); f++) {
+        for (size_t e = 0; e < enterCount; e++) {
+            for (size_t x = 0; x < exitCount; x++) {
+                for (size_t m = 0; m < minLapCount; m++) {
+                    if (results[index(f, e, x, m)].errors != bestErrors) continue;
+                    uint8_t neighbours = 0;
+                    for (int de = -1; de <= 1; de++) {
+                        for (int dx = -1; dx <= 1; dx++) {
+                            for (int dm = -1; dm <= 1; dm++) {
+                                size_t ne = e + de;
+                                size_t nx = x + dx;
+                                size_t nm = m + dm;
+                                if ((de || dx || dm) && ne < enterCount && nx < exitCount && nm < minLapCount &&
+                                    results[index(f, ne, nx, nm)].errors == bestErrors) {
+                                    neighbours++;
+                                }
+                            }
+                        }
+                    }
+                    uint8_t margin = 0;
+                    if (neighbours == 26) {
+                        auto steps = [&](int de, int dx, int dm) {
+                            uint8_t n = 0;
+                            size_t ne = e + de;
+                            size_t nx = x + dx;
+                            size_t nm = m + dm;
+                            while (n < 255 && ne < enterCount && nx < exitCount && nm < minLapCount &&
+                                   results[index(f, ne, nx, nm)].errors == bestErrors) {
+                                n++;
+                                ne += de;
+                                nx += dx;
+                                nm += dm;
+                            }
+                            return n;
+                        };
+                        margin = std::min({steps(-1, 0, 0), steps(1, 0, 0), steps(0, -1, 0), steps(0, 1, 0),
+                                           steps(0, 0, -1), steps(0, 0, 1)});
+                    }
+                    ranked.push_back({f, e, x, m, neighbours, margin});
+                }
+            }
+        }
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [&](const Ranked& a, const Ranked& b) {
+        if (a.neighbours != b.neighbours) return a.neighbours > b.neighbours;
+        float ta = results[index(a.f, a.e, a.x, a.m)].timingMs;
+        float tb = results[index(b.f, b.e, b.x, b.m)].timingMs;
+        if (ta != tb) return ta < tb;
+        return a.margin > b.margin;
+    });
+
+    fprintf(stderr, "%zu points with %u wrong passes; best:\n", ranked.size(), bestErrors);
+    fprintf(stderr, "  enter exit minLap     q     r win  found missed extra  robust margin  %s\n",
+            marked ? "p95 error" : "lap stddev");
+    for (size_t i = 0; i < ranked.size() && i < top; i++) {
+        const Ranked& k = ranked[i];
+        const Result& r = results[index(k.f, k.e, k.x, k.m)];
+        const LapFilterSettings& filter = filters[k.f];
+        char timing[16];
+        if (r.timingMs >= LAPOPT_TIMING_NONE) snprintf(timing, sizeof(timing), "-");
+        else snprintf(timing, sizeof(timing), "%.0f ms", r.timingMs);
+        fprintf(stderr, "  %5u %4u %6u %5u %5u %3u  %5u %6u %5u  %3u/26 %6u  %s\n", enterGrid.at(k.e), exitGrid.at(k.x),
+                minLapGrid.at(k.m), filter.q, filter.r, filter.window, r.detected, r.missed, r.extra, k.neighbours,
+                k.margin, timing);
+    }
+
+    // Keys the timer's config takes; everything else is left as it is on import
+    const Ranked& best = ranked.front();
+    const LapFilterSettings& filter = filters[best.f];
+    char json[160];
+    int len = snprintf(json, sizeof(json), "{\"enterRssi\":%u,\"exitRssi\":%u,\"minLap\":%u", enterGrid.at(best.e),
+                       exitGrid.at(best.x), minLapGrid.at(best.m) / 100);
+    if (!trace.filtered) {
+        len += snprintf(json + len, sizeof(json) - len, ",\"filterQ\":%u,\"filterR\":%u,\"filterWindow\":%u", filter.q,
+                        filter.r, filter.window);
+    }
+    snprintf(json + len, sizeof(json) - len, "}");
+
+    FILE* out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "can't write %s\n", outPath);
+        return 1;
+    }
+    fprintf(out, "%s\n", json);
+    if (outPath) {
+        fclose(out);
+        fprintf(stderr, "wrote %s\n", outPath);
+    }
+    return 0;
+}
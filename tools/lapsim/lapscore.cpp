@@ -0,0 +1,131 @@
+#include "lapscore.h"
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+void LapScore::reset() {
+    memset(this, 0, sizeof(*this));
+}
+
+void LapScore::merge(const LapScore& o) {
+    races += o.races;
+    cleanRaces += o.cleanRaces;
+    passes += o.passes;
+    detected += o.detected;
+    matched += o.matched;
+    missed += o.missed;
+    extra += o.extra;
+    errorSum += o.errorSum;
+    errorSqSum += o.errorSqSum;
+    if (o.maxAbsError > maxAbsError) maxAbsError = o.maxAbsError;
+    for (int i = 0; i < LAPSCORE_ERROR_BUCKETS; i++) {
+        errorHist[i] += o.errorHist[i];
+    }
+}
+
+double LapScore::meanError() const {
+    return matched ? errorSum / matched : 0.0;
+}
+
+double LapScore::errorStdDev() const {
+    if (matched < 2) return 0.0;
+    double mean = meanError();
+    double var = errorSqSum / matched - mean * mean;
+    return var > 0.0 ? sqrt(var) : 0.0;
+}
+
+uint32_t LapScore::absErrorPercentile(double p) const {
+    if (matched == 0) return 0;
+    uint64_t want = (uint64_t)ceil(p * matched);
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LAPSCORE_ERROR_BUCKETS; i++) {
+        seen += errorHist[i];
+        if (seen >= want) return i;
+    }
+    return maxAbsError;
+}
+
+int LapScore::toJson(char* buf, size_t len) const {
+    return snprintf(buf, len,
+                    "{\"races\":%u,\"cleanRaces\":%u,\"passes\":%u,\"detected\":%u,\"matched\":%u,"
+                    "\"missed\":%u,\"extra\":%u,\"meanErrorMs\":%.2f,\"stdDevMs\":%.2f,"
+                    "\"p50AbsErrorMs\":%u,\"p95AbsErrorMs\":%u,\"maxAbsErrorMs\":%u}",
+                    races, cleanRaces, passes, detected, matched, missed, extra, meanError(), errorStdDev(),
+                    absErrorPercentile(0.50), absErrorPercentile(0.95), maxAbsError);
+}
+
+void LapScorer::detect(const uint8_t* rssi, size_t count, uint32_t sampleUs, std::vector<uint32_t>& passMs) const {
+    // Same calls, in the same order, as LapTimer::handleLapTimerUpdate()
+    // in a race started with the trace
+    LapDetector detector;
+    detector.setFilter(config.filter);
+    detector.setLevels(config.levels);
+    detector.startRace(0);
+    passMs.clear();
+    for (size_t i = 0; i < count; i++) {
+        uint32_t timeMs = (uint32_t)((uint64_t)i * sampleUs / 1000);
+        uint8_t filtered = detector.filter(rssi[i]);
+        if (detector.update(filtered, timeMs)) {
+            passMs.push_back(detector.getPeakTimeMs());
+            detector.beginLap();
+        }
+    }
+}
+
+void LapScorer::score(const uint8_t* rssi, size_t count, uint32_t sampleUs, const std::vector<uint32_t>& truthMs,
+                      LapScore& s) const {
+    std::vector<uint32_t> detectedMs;
+    detect(rssi, count, sampleUs, detectedMs);
+    compare(detectedMs, truthMs, s);
+}
+
+void LapScorer::compare(const std::vector<uint32_t>& detectedMs, const std::vector<uint32_t>& truthMs,
+                        LapScore& s) const {
+    // Every detection/truth pair within tolerance, closest pairs matched
+    // first; both lists are in time order, so each detection only looks at
+    // the truth passes inside its window
+    struct Pair {
+        uint32_t absError;
+        size_t d;
+        size_t t;
+    };
+    std::vector<Pair> pairs;
+    size_t first = 0;
+    for (size_t d = 0; d < detectedMs.size(); d++) {
+        while (first < truthMs.size() && truthMs[first] + config.toleranceMs < detectedMs[d]) {
+            first++;
+        }
+        for (size_t t = first; t < truthMs.size() && truthMs[t] <= detectedMs[d] + config.toleranceMs; t++) {
+            int64_t error = (int64_t)detectedMs[d] - (int64_t)truthMs[t];
+            pairs.push_back({(uint32_t)(error < 0 ? -error : error), d, t});
+        }
+    }
+    std::stable_sort(pairs.begin(), pairs.end(),
+                     [](const Pair& a, const Pair& b) { return a.absError < b.absError; });
+
+    std::vector<bool> detectedUsed(detectedMs.size(), false);
+    std::vector<bool> truthUsed(truthMs.size(), false);
+    uint32_t matched = 0;
+    for (const Pair& p : pairs) {
+        if (detectedUsed[p.d] || truthUsed[p.t]) continue;
+        detectedUsed[p.d] = true;
+        truthUsed[p.t] = true;
+        matched++;
+        int64_t error = (int64_t)detectedMs[p.d] - (int64_t)truthMs[p.t];
+        s.errorSum += error;
+        s.errorSqSum += (double)error * error;
+        if (p.absError > s.maxAbsError) s.maxAbsError = p.absError;
+        s.errorHist[p.absError < LAPSCORE_ERROR_BUCKETS ? p.absError : LAPSCORE_ERROR_BUCKETS - 1]++;
+    }
+    uint32_t missed = truthMs.size() - matched;
+    uint32_t extra = detectedMs.size() - matched;
+
+    s.races++;
+    s.passes += truthMs.size();
+    s.detected += detectedMs.size();
+    s.matched += matched;
+    s.missed += missed;
+    s.extra += extra;
+    if (missed == 0 && extra == 0) s.cleanRaces++;
+}
@@ -0,0 +1,66 @@
+#ifndef LAPSCORE_H
+#define LAPSCORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "lapdetector.h"
+
+/*
+ * Replays an RSSI trace through the firmware's LapDetector and scores the
+ * passes it finds against ground truth.
+ *
+ * A detected pass matches the nearest unmatched true pass within
+ * toleranceMs; detections left over are extra laps, true passes left over
+ * are missed ones. Timing error is detected minus true pass time.
+ */
+
+#define LAPSCORE_ERROR_BUCKETS 1000  // |error| histogram, 1 ms each, last one catches the rest
+
+struct LapScoreConfig {
+    LapDetectorSettings levels;
+    LapFilterSettings filter;
+    uint32_t toleranceMs;
+};
+
+struct LapScore {
+    uint32_t races;
+    uint32_t cleanRaces;     // No missed or extra laps
+    uint32_t passes;         // Ground truth
+    uint32_t detected;
+    uint32_t matched;
+    uint32_t missed;
+    uint32_t extra;
+    double errorSum;         // Matched passes, ms
+    double errorSqSum;
+    uint32_t maxAbsError;
+    uint32_t errorHist[LAPSCORE_ERROR_BUCKETS];
+
+    void reset();
+    void merge(const LapScore& other);
+    double meanError() const;
+    double errorStdDev() const;
+    uint32_t absErrorPercentile(double p) const;
+    int toJson(char* buf, size_t len) const;
+};
+
+class LapScorer {
+   public:
+    explicit LapScorer(const LapScoreConfig& config) : config(config) {}
+
+    // Pass times found in rssi (readRssi() values, sample i at i * sampleUs)
+    void detect(const uint8_t* rssi, size_t count, uint32_t sampleUs, std::vector<uint32_t>& passMs) const;
+
+    // detect(), then adds the race to score
+    void score(const uint8_t* rssi, size_t count, uint32_t sampleUs, const std::vector<uint32_t>& truthMs,
+               LapScore& score) const;
+
+    // Adds one race's detected passes to score
+    void compare(const std::vector<uint32_t>& detectedMs, const std::vector<uint32_t>& truthMs,
+                 LapScore& score) const;
+
+   private:
+    LapScoreConfig config;
+};
+
+#endif
@@ -0,0 +1,204 @@
+// Synthetic gate pass generator and lap detection scorer. Races of RSSI
+// samples come from a model of the quad, the RX5808 and the ESP32 ADC
+// (passgen.h), run through the firmware's own LapDetector, and the laps it
+// finds are scored against the true pass times, on every core.
+//
+//   g++ -O2 -std=c++17 -pthread -I../../lib/LAPTIMER -I../../lib/KALMAN lapsim_host.cpp passgen.cpp
+//     lapscore.cpp ../../lib/LAPTIMER/lapdetector.cpp ../../lib/KALMAN/kalman.cpp -o lapsim
+//   ./lapsim [--races 2000] [--enter 72 --exit 68 --min-lap-ms 2000] [--neighbours 2] ...
+//   ./lapsim --races 1 --trace race.csv      one race as time_ms,rssi,pass for plotting or lapopt
+//
+// Prints a summary and the score as JSON. The same seed gives the same
+// races whatever the thread count.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "lapscore.h"
+#include "passgen.h"
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --races N          races to simulate (1000)\n"
+            "  --threads N        worker threads (all cores)\n"
+            "  --seed N           first race's seed (1)\n"
+            "  --trace FILE       write the first race as CSV: time_ms,rssi,pass\n"
+            " flight:\n"
+            "  --laps N --lap-ms N --lap-jitter-ms N --speed M/S --speed-jitter F\n"
+            "  --offset-min M --offset-max M --course-radius M --sample-us N\n"
+            " signal:\n"
+            "  --power MW[,MW...] --power-jitter-db DB --path-exponent N\n"
+            "  --fading-db DB --fading-corr-m M --rician-k-db DB --detector-tau-ms MS\n"
+            "  --near-m M --far-step-ms N   full-rate model near the gate, N ms steps beyond (15, 4)\n"
+            "  --neighbours N --neighbour-mhz MHZ --reject-db-per-mhz DB\n"
+            "  --adc-noise COUNTS --mv-per-db MV --floor-dbm DBM\n"
+            " detection (firmware defaults):\n"
+            "  --enter N --exit N --min-lap-ms N --filter-q N --filter-r N --window N\n"
+            "  --tolerance-ms N   match window for a detected pass (500)\n",
+            name);
+}
+
+static bool parsePowers(const char* arg, PassGenConfig& config) {
+    config.powerCount = 0;
+    const char* p = arg;
+    while (*p && config.powerCount < PASSGEN_MAX_POWERS) {
+        char* end;
+        float mw = strtof(p, &end);
+        if (end == p || mw <= 0.0f) return false;
+        config.powersMw[config.powerCount++] = mw;
+        p = *end == ',' ? end + 1 : end;
+    }
+    return config.powerCount > 0;
+}
+
+static bool writeTrace(const char* path, const PassGenRace& race) {
+    FILE* f = fopen(path, "w");
+    if (!f) return false;
+    fprintf(f, "time_ms,rssi,pass\n");
+    size_t next = 0;
+    for (size_t i = 0; i < race.rssi.size(); i++) {
+        uint32_t timeMs = (uint32_t)((uint64_t)i * race.sampleUs / 1000);
+        uint32_t nextTimeMs = (uint32_t)((uint64_t)(i + 1) * race.sampleUs / 1000);
+        // Marked on the sample the true pass falls in
+        int pass = 0;
+        while (next < race.passMs.size() && race.passMs[next] < nextTimeMs) {
+            pass = 1;
+            next++;
+        }
+        fprintf(f, "%u,%u,%d\n", timeMs, race.rssi[i], pass);
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    PassGenConfig gen = PassGen::defaults();
+    LapScoreConfig scoring;
+    scoring.levels = {72, 68, 2000};  // Config::setDefaults()
+    scoring.filter = LapDetector::defaultFilter();
+    scoring.toleranceMs = 500;
+    uint32_t races = 1000;
+    uint32_t threads = std::thread::hardware_concurrency();
+    uint64_t seed = 1;
+    const char* tracePath = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        const char* opt = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char* val = argv[++i];
+        if (!strcmp(opt, "--races")) races = strtoul(val, nullptr, 10);
+        else if (!strcmp(opt, "--threads")) threads = strtoul(val, nullptr, 10);
+        else if (!strcmp(opt, "--seed")) seed = strtoull(val, nullptr, 10);
+        else if (!strcmp(opt, "--trace")) tracePath = val;
+        else if (!strcmp(opt, "--laps")) gen.laps = atoi(val);
+        else if (!strcmp(opt, "--lap-ms")) gen.lapMs = strtoul(val, nullptr, 10);
+        else if (!strcmp(opt, "--lap-jitter-ms")) gen.lapJitterMs = strtoul(val, nullptr, 10);
+        else if (!strcmp(opt, "--speed")) gen.speedMps = atof(val);
+        else if (!strcmp(opt, "--speed-jitter")) gen.speedJitter = atof(val);
+        else if (!strcmp(opt, "--offset-min")) gen.offsetMinM = atof(val);
+        else if (!strcmp(opt, "--offset-max")) gen.offsetMaxM = atof(val);
+        else if (!strcmp(opt, "--course-radius")) gen.courseRadiusM = atof(val);
+        else if (!strcmp(opt, "--sample-us")) gen.sampleUs = strtoul(val, nullptr, 10);
+        else if (!strcmp(opt, "--power")) {
+            if (!parsePowers(val, gen)) {
+                fprintf(stderr, "bad --power list: %s\n", val);
+                return 1;
+            }
+        }
+        else if (!strcmp(opt, "--power-jitter-db")) gen.powerJitterDb = atof(val);
+        else if (!strcmp(opt, "--path-exponent")) gen.pathExponent = atof(val);
+        else if (!strcmp(opt, "--fading-db")) gen.fadingDb = atof(val);
+        else if (!strcmp(opt, "--fading-corr-m")) gen.fadingCorrM = atof(val);
+        else if (!strcmp(opt, "--rician-k-db")) gen.ricianKDb = atof(val);
+        else if (!strcmp(opt, "--detector-tau-ms")) gen.detectorTauMs = atof(val);
+        else if (!strcmp(opt, "--near-m")) gen.nearM = atof(val);
+        else if (!strcmp(opt, "--far-step-ms")) gen.farStepMs = strtoul(val, nullptr, 10);
+        else if (!strcmp(opt, "--neighbours")) gen.neighbours = atoi(val);
+        else if (!strcmp(opt, "--neighbour-mhz")) gen.neighbourMhz = atof(val);
+        else if (!strcmp(opt, "--reject-db-per-mhz")) gen.rejectDbPerMhz = atof(val);
+        else if (!strcmp(opt, "--adc-noise")) gen.adcNoiseCounts = atof(val);
+        else if (!strcmp(opt, "--mv-per-db")) gen.mvPerDb = atof(val);
+        else if (!strcmp(opt, "--floor-dbm")) gen.floorDbm = atof(val);
+        else if (!strcmp(opt, "--enter")) scoring.levels.enterRssi = atoi(val);
+        else if (!strcmp(opt, "--exit")) scoring.levels.exitRssi = atoi(val);
+        else if (!strcmp(opt, "--min-lap-ms")) scoring.levels.minLapMs = strtoul(val, nullptr, 10);
+        else if (!strcmp(opt, "--filter-q")) scoring.filter.q = atoi(val);
+        else if (!strcmp(opt, "--filter-r")) scoring.filter.r = atoi(val);
+        else if (!strcmp(opt, "--window")) scoring.filter.window = atoi(val);
+        else if (!strcmp(opt, "--tolerance-ms")) scoring.toleranceMs = strtoul(val, nullptr, 10);
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (races == 0 || gen.sampleUs == 0 || gen.lapMs == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (threads == 0) threads = 1;
+    if (threads > races) threads = races;
+
+    if (tracePath) {
+        PassGen passGen(gen, seed);
+        PassGenRace race;
+        passGen.generate(race);
+        if (!writeTrace(tracePath, race)) {
+            fprintf(stderr, "can't write %s\n", tracePath);
+            return 1;
+        }
+        fprintf(stderr, "wrote %zu samples, %zu passes (%.0f mW) to %s\n", race.rssi.size(), race.passMs.size(),
+                race.powerMw, tracePath);
+    }
+
+    // Races are handed out one at a time; race n always uses seed + n
+    std::atomic<uint32_t> nextRace(0);
+    std::atomic<uint64_t> samples(0);
+    std::vector<LapScore> scores(threads);
+    std::vector<std::thread> workers;
+    LapScorer scorer(scoring);
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t w = 0; w < threads; w++) {
+        workers.emplace_back([&, w]() {
+            LapScore& score = scores[w];
+            score.reset();
+            PassGenRace race;
+            for (uint32_t n = nextRace++; n < races; n = nextRace++) {
+                PassGen passGen(gen, seed + n);
+                passGen.generate(race);
+                scorer.score(race.rssi.data(), race.rssi.size(), race.sampleUs, race.passMs, score);
+                samples += race.rssi.size();
+            }
+        });
+    }
+    for (std::thread& t : workers) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    LapScore total;
+    total.reset();
+    for (const LapScore& s : scores) {
+        total.merge(s);
+    }
+
+    fprintf(stderr, "%u races, %u passes on %u threads in %.2f s: %.0f laps/s, %.1f M samples/s\n", total.races,
+            total.passes, threads, seconds, total.passes / seconds, samples / seconds / 1e6);
+    fprintf(stderr, "enter %u exit %u min lap %u ms: %u missed, %u extra, %u/%u races clean\n",
+            scoring.levels.enterRssi, scoring.levels.exitRssi, scoring.levels.minLapMs, total.missed, total.extra,
+            total.cleanRaces, total.races);
+    fprintf(stderr, "pass time error %.1f +- %.1f ms, |error| p95 %u ms, max %u ms\n", total.meanError(),
+            total.errorStdDev(), total.absErrorPercentile(0.95), total.maxAbsError);
+
+    char json[512];
+    total.toJson(json, sizeof(json));
+    printf("%s\n", json);
+    return 0;
+}
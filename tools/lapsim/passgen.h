@@ -0,0 +1,161 @@
+#ifndef PASSGEN_H
+#define PASSGEN_H
+
+#include <stdint.h>
+#include <random>
+#include <vector>
+
+/*
+ * Synthetic RSSI traces of FPV gate passes, with ground truth
+ *
+ * Host only. Each race is one pilot flying `laps` laps on the timer's
+ * channel, optionally with neighbours on other channels, sampled the way
+ * LapTimer samples: one RX5808::readRssi() value per sampleUs.
+ *
+ *   flight     - Gate 1 from a standing start, then laps of lapMs +- jitter;
+ *                through the gate at speedMps +- jitter, a random lateral
+ *                offset from the antenna, out to courseRadiusM in between
+ *   signal     - VTX power (one of powersMw, +- powerJitterDb per race),
+ *                log-distance path loss at 5.8 GHz
+ *   fading     - slow shadowing (dB, correlated over fadingCorrM of flight)
+ *                and Rician multipath (K factor, decorrelates every half
+ *                wavelength), smoothed by the RSSI detector's time constant
+ *   neighbours - pilots neighbourMhz apart on both sides, attenuated by the
+ *                receiver's selectivity (rejectDbPerMhz, up to maxRejectDb)
+ *   ADC        - RX5808 RSSI volts (linear in dBm above floorDbm), ADC noise
+ *                in counts, then readRssi()'s clamp to 2047 and >> 3
+ *
+ * Fading and path loss run every sample within nearM of the gate. Farther
+ * out they run once per farStepMs of flight and are held in between, with
+ * the fading advanced by the whole step; the detector and ADC noise still
+ * run every sample. farStepMs = 1 ms runs the full model everywhere.
+ *
+ * A pass's ground truth is the moment of closest approach to the gate.
+ */
+
+#define PASSGEN_MAX_POWERS 4
+
+// xoshiro256** (Blackman and Vigna), seeded through splitmix64. Several
+// draws per sample made mt19937_64 the generator's biggest cost.
+class PassGenRng {
+   public:
+    typedef uint64_t result_type;
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    explicit PassGenRng(uint64_t seed) {
+        for (uint64_t& word : s) {
+            seed += 0x9E3779B97F4A7C15ull;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    result_type operator()() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+   private:
+    uint64_t s[4];
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+};
+
+struct PassGenConfig {
+    uint32_t sampleUs;
+    uint16_t laps;            // After Gate 1
+    uint32_t lapMs;
+    uint32_t lapJitterMs;     // Standard deviation
+    uint32_t launchMs;        // Race start to leaving the pad
+    uint32_t tailMs;          // Trace kept after the last pass
+    float startDistanceM;     // Pad to gate
+    float speedMps;
+    float speedJitter;        // Fraction of speedMps, standard deviation
+    float offsetMinM;         // Closest approach, uniform in [min, max]
+    float offsetMaxM;
+    float courseRadiusM;      // Farthest the course gets from the gate
+
+    float powersMw[PASSGEN_MAX_POWERS];
+    uint8_t powerCount;       // Each race picks one
+    float powerJitterDb;      // Antenna/VTX spread, standard deviation
+    float pathExponent;
+    float fadingDb;           // Shadowing, standard deviation
+    float fadingCorrM;
+    float ricianKDb;          // Direct over scattered power
+    float detectorTauMs;      // RSSI output low-pass
+    float nearM;              // Full-rate model within this distance of the gate
+    uint32_t farStepMs;       // Model step farther out
+
+    uint8_t neighbours;       // Alternating above and below the timer's channel
+    float neighbourMhz;       // Spacing (37 = Raceband)
+    float rejectDbPerMhz;
+    float maxRejectDb;
+
+    float floorDbm;           // RSSI output starts rising here
+    float floorVolts;
+    float mvPerDb;
+    float maxVolts;           // RX5808 RSSI saturates
+    float adcNoiseCounts;     // Standard deviation, 12-bit counts
+};
+
+struct PassGenRace {
+    uint32_t sampleUs;
+    std::vector<uint8_t> rssi;      // readRssi() values, sample i at i * sampleUs
+    std::vector<uint32_t> passMs;   // Ground truth, Gate 1 first
+    float powerMw;                  // What this race's pilot flew
+};
+
+class PassGen {
+   public:
+    static PassGenConfig defaults();
+
+    PassGen(const PassGenConfig& config, uint64_t seed);
+    void generate(PassGenRace& race);
+
+   private:
+    struct Flight {
+        std::vector<uint32_t> passMs;
+        std::vector<float> speed;   // Through each pass
+        std::vector<float> offset;
+        float launchSpeed;
+        uint32_t launchMs;
+        float baseMw;               // Received at 1 m before fading: power, 1 m loss, rejection
+        float shadowDb;
+        float scatterRe;
+        float scatterIm;
+        size_t next;                // First pass after the current sample
+
+        // Fading steps for the current distance per step (speed only
+        // changes at a pass, the step length at nearM)
+        float fadeMoved;
+        float shadowRho;
+        float shadowSigma;
+        float scatterRho;
+        float scatterSigma;
+    };
+
+    PassGenConfig config;
+    PassGenRng rng;
+    std::uniform_real_distribution<float> uniform;
+    float direct;    // Rician amplitudes from ricianKDb
+    float scatter;
+
+    float normal();  // Standard normal (ziggurat): several are drawn per sample
+    void plan(Flight& flight, uint32_t untilMs, float powerMw, float rejectDb);
+    float distanceSqAt(Flight& flight, uint32_t timeMs, float& speed);
+    bool nearGate(Flight& flight, uint32_t timeMs);
+    void setFadeStep(Flight& flight, float moved);
+    float receivedMw(Flight& flight, uint32_t timeMs, float dtS);
+    uint8_t readRssi(float volts);
+};
+
+#endif
@@ -0,0 +1,87 @@
+// Host build of the FPVGate storage benchmark, using a directory on this
+// machine as a stand-in for the SD card / LittleFS.
+//
+//   g++ -O2 -std=c++17 -I../../lib/STORAGE storagebench_host.cpp ../../lib/STORAGE/storagebench.cpp -o storagebench
+//   ./storagebench /mnt/sdcard [fileSizeKB] [dirFiles]
+//
+// Pointing it at a mounted card in a USB reader gives a baseline to compare
+// with the numbers the device reports on the self-test page.
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include "storagebench.h"
+
+class PosixBenchTarget : public BenchTarget {
+   public:
+    explicit PosixBenchTarget(const std::string& root) : root(root), file(nullptr) {}
+    ~PosixBenchTarget() override { close(); }
+
+    bool openRead(const char* path) override { return open(path, "rb"); }
+    bool openWrite(const char* path) override { return open(path, "wb"); }
+    bool openUpdate(const char* path) override { return open(path, "r+b"); }
+    size_t read(uint8_t* buf, size_t len) override { return file ? fread(buf, 1, len, file) : 0; }
+    size_t write(const uint8_t* data, size_t len) override { return file ? fwrite(data, 1, len, file) : 0; }
+    bool seek(uint32_t pos) override { return file && fseek(file, pos, SEEK_SET) == 0; }
+    void close() override {
+        if (file) {
+            fflush(file);
+            fsync(fileno(file));  // Same as closing a File on the device: data is on the medium
+            fclose(file);
+            file = nullptr;
+        }
+    }
+    bool remove(const char* path) override { return ::remove(full(path).c_str()) == 0; }
+    bool mkdir(const char* path) override { return ::mkdir(full(path).c_str(), 0755) == 0; }
+    bool rmdir(const char* path) override { return ::rmdir(full(path).c_str()) == 0; }
+    int listDir(const char* path) override {
+        DIR* dir = opendir(full(path).c_str());
+        if (!dir) return -1;
+        int count = 0;
+        while (struct dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] != '.') count++;
+        }
+        closedir(dir);
+        return count;
+    }
+    uint32_t micros() override {
+        using namespace std::chrono;
+        return (uint32_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+   private:
+    std::string root;
+    FILE* file;
+
+    std::string full(const char* path) const { return root + path; }
+    bool open(const char* path, const char* mode) {
+        close();
+        file = fopen(full(path).c_str(), mode);
+        return file != nullptr;
+    }
+};
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <directory> [fileSizeKB] [dirFiles]\n", argv[0]);
+        return 2;
+    }
+
+    StorageBenchConfig config = StorageBench::defaults();
+    if (argc > 2) config.fileSize = atoi(argv[2]) * 1024;
+    if (argc > 3) config.dirFiles = atoi(argv[3]);
+
+    PosixBenchTarget target(argv[1]);
+    StorageBenchResult result;
+    bool ok = StorageBench::run(target, config, result);
+
+    char json[STORAGEBENCH_JSON_SIZE];
+    StorageBench::toJson(result, json, sizeof(json));
+    printf("%s\n", json);
+    return ok ? 0 : 1;
+}